@@ -8,17 +8,20 @@
 template<typename Data> class BlockingQueue
 {
 public:
-	BlockingQueue() : _active(true) {}
+	/* a non-zero max_size makes push() wait while the queue is full */
+	explicit BlockingQueue(size_t max_size = 0) : _max_size(max_size), _active(true) {}
 	void deactivate() {
 		std::lock_guard<std::mutex> lk(_mutex);
 		_active = false;
 		_condition.notify_all();
+		_space_condition.notify_all();
 	}
 
 	void clear() {
 		std::lock_guard<std::mutex> lk(_mutex);
 		while (_queue.size() != 0)
 			_queue.pop();
+		_space_condition.notify_all();
 	}
 
 	void push_no_lock(std::vector<Data>* data) {
@@ -26,15 +29,18 @@ public:
 			_queue.push(*d);
 	}
 
-	void push(Data const& data)
+	/* returns false, without taking the data, once the queue has been deactivated */
+	bool push(Data const& data)
 	{
 		{
-			std::lock_guard<std::mutex> lk(_mutex);
+			std::unique_lock<std::mutex> lk(_mutex);
+			_space_condition.wait(lk, [this]{ return !_active || !_max_size || _queue.size() < _max_size; });
 			if (!_active)
-				return;
+				return false;
 			_queue.push(data);
 		}
 		_condition.notify_one();
+		return true;
 	}
 
 	bool empty() const
@@ -69,12 +75,15 @@ private:
 			return false;
 		value = _queue.front();
 		_queue.pop();
+		_space_condition.notify_one();
 		return true;
 	}
 
 	std::queue<Data> _queue;
 	mutable std::mutex _mutex;
 	std::condition_variable _condition;
+	std::condition_variable _space_condition;
+	size_t _max_size;
 	bool _active;
 };
 
@@ -0,0 +1,220 @@
+/*
+*    Copyright (C) 2016 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+ */
+
+#include "Scheduler.h"
+#include <iterator>
+
+/* index of the current thread's deque, or no_worker for non-worker threads */
+static const size_t no_worker = (size_t)-1;
+static thread_local size_t current_worker = no_worker;
+
+struct Scheduler::TaskGroup {
+	TaskGroup(size_t count) : pending(count) {}
+	std::atomic<size_t> pending;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::exception_ptr error;
+};
+
+std::mutex Scheduler::instance_mutex;
+Scheduler* Scheduler::singleton = nullptr;
+
+Scheduler* Scheduler::instance()
+{
+	std::lock_guard<std::mutex> lk(instance_mutex);
+	if (!singleton) {
+		size_t numWorkers = std::thread::hardware_concurrency();
+		singleton = new Scheduler(numWorkers ? numWorkers : 1);
+	}
+	return singleton;
+}
+
+void Scheduler::release()
+{
+	std::lock_guard<std::mutex> lk(instance_mutex);
+	delete singleton;
+	singleton = nullptr;
+}
+
+Scheduler::Scheduler(size_t numWorkers) : queued(0),
+										next_queue(0),
+										stop(false)
+{
+	for (size_t i = 0; i < numWorkers; ++i)
+		queues.push_back(new WorkerQueue());
+	for (size_t i = 0; i < numWorkers; ++i)
+		workers.emplace_back([this, i] { worker_loop(i); });
+}
+
+Scheduler::~Scheduler()
+{
+	{
+		std::lock_guard<std::mutex> lk(sleep_mutex);
+		stop = true;
+	}
+	sleep_condition.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+	for (auto q : queues)
+		delete q;
+}
+
+void Scheduler::worker_loop(size_t workerId)
+{
+	current_worker = workerId;
+	while (true) {
+		Task task;
+		if (try_pop(workerId, task)) {
+			execute(task);
+			continue;
+		}
+		std::unique_lock<std::mutex> lk(sleep_mutex);
+		sleep_condition.wait(lk, [this] { return stop || queued > 0; });
+		if (stop)
+			return;
+	}
+}
+
+/* pop from the back of our own deque, otherwise steal from the front of another */
+bool Scheduler::try_pop(size_t home, Task& task)
+{
+	auto numQueues = queues.size();
+	if (home != no_worker) {
+		auto q = queues[home];
+		std::lock_guard<std::mutex> lk(q->mutex);
+		if (!q->tasks.empty()) {
+			task = q->tasks.back();
+			q->tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+	auto start = (home == no_worker) ? 0 : home + 1;
+	for (size_t i = 0; i < numQueues; ++i) {
+		auto q = queues[(start + i) % numQueues];
+		std::lock_guard<std::mutex> lk(q->mutex);
+		if (!q->tasks.empty()) {
+			task = q->tasks.front();
+			q->tasks.pop_front();
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* take a queued task of group, wherever it sits: the newest one from our own
+   deque, otherwise the oldest one from another deque */
+bool Scheduler::try_pop_group(size_t home, const TaskGroup* group, Task& task)
+{
+	auto numQueues = queues.size();
+	if (home != no_worker) {
+		auto q = queues[home];
+		std::lock_guard<std::mutex> lk(q->mutex);
+		for (auto it = q->tasks.rbegin(); it != q->tasks.rend(); ++it) {
+			if (it->group == group) {
+				task = *it;
+				q->tasks.erase(std::next(it).base());
+				queued--;
+				return true;
+			}
+		}
+	}
+	auto start = (home == no_worker) ? 0 : home + 1;
+	for (size_t i = 0; i < numQueues; ++i) {
+		auto q = queues[(start + i) % numQueues];
+		std::lock_guard<std::mutex> lk(q->mutex);
+		for (auto it = q->tasks.begin(); it != q->tasks.end(); ++it) {
+			if (it->group == group) {
+				task = *it;
+				q->tasks.erase(it);
+				queued--;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void Scheduler::execute(Task& task)
+{
+	auto group = task.group;
+	try {
+		(*task.fn)(task.id);
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lk(group->mutex);
+		if (!group->error)
+			group->error = std::current_exception();
+	}
+	/* decrement under the lock: the waiter owns the group and may
+	   destroy it as soon as it observes zero */
+	std::lock_guard<std::mutex> lk(group->mutex);
+	if (--group->pending == 0)
+		group->condition.notify_all();
+}
+
+void Scheduler::run(size_t numTasks, const std::function<void(size_t)>& fn)
+{
+	if (numTasks == 0)
+		return;
+	if (numTasks == 1) {
+		fn(0);
+		return;
+	}
+
+	TaskGroup group(numTasks);
+	auto home = current_worker;
+
+	/* the calling thread runs task 0 itself; the rest are queued */
+	for (size_t i = 1; i < numTasks; ++i) {
+		Task task;
+		task.fn = &fn;
+		task.id = i;
+		task.group = &group;
+		auto qid = (home != no_worker) ? home : (next_queue++ % queues.size());
+		auto q = queues[qid];
+		std::lock_guard<std::mutex> lk(q->mutex);
+		q->tasks.push_back(task);
+		queued++;
+	}
+	{
+		std::lock_guard<std::mutex> lk(sleep_mutex);
+	}
+	sleep_condition.notify_all();
+
+	Task first;
+	first.fn = &fn;
+	first.id = 0;
+	first.group = &group;
+	execute(first);
+
+	/* help out until every task in this group has been taken. Tasks of other
+	   groups are left to the workers: running one here would hold this call
+	   until that unrelated task finishes */
+	while (group.pending > 0) {
+		Task task;
+		if (!try_pop_group(home, &group, task))
+			break;
+		execute(task);
+	}
+
+	std::unique_lock<std::mutex> lk(group.mutex);
+	group.condition.wait(lk, [&group] { return group.pending == 0; });
+	if (group.error)
+		std::rethrow_exception(group.error);
+}
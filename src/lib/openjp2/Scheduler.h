@@ -0,0 +1,88 @@
+/*
+*    Copyright (C) 2016 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+
+/*
+Process-wide work-stealing scheduler.
+
+Workers are started once and live until opj_cleanup. Each worker owns a deque:
+it pushes and pops at the back, and idle workers steal from the front of
+other workers' deques. A thread that calls run() executes the queued tasks
+of that call while it waits, so nested run() calls (e.g. T1 inside a tile job)
+cannot deadlock; it never runs the tasks of another run() call, such as those
+of another codec.
+*/
+class Scheduler
+{
+public:
+	/* get the scheduler, starting it on first use */
+	static Scheduler* instance();
+
+	/* stop and join all workers (called from opj_cleanup) */
+	static void release();
+
+	/*
+	Run fn(taskId) for taskId in [0, numTasks) and wait for completion.
+	Any exception thrown by a task is re-thrown in the calling thread.
+	*/
+	void run(size_t numTasks, const std::function<void(size_t)>& fn);
+
+	size_t num_workers() const { return workers.size(); }
+
+private:
+	struct TaskGroup;
+	struct Task {
+		Task() : fn(nullptr), id(0), group(nullptr) {}
+		const std::function<void(size_t)>* fn;
+		size_t id;
+		TaskGroup* group;
+	};
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	explicit Scheduler(size_t numWorkers);
+	~Scheduler();
+
+	void worker_loop(size_t workerId);
+	bool try_pop(size_t home, Task& task);
+	bool try_pop_group(size_t home, const TaskGroup* group, Task& task);
+	void execute(Task& task);
+
+	std::vector<std::thread> workers;
+	std::vector<WorkerQueue*> queues;
+
+	std::atomic<size_t> queued;
+	std::atomic<size_t> next_queue;
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_condition;
+	bool stop;
+
+	static std::mutex instance_mutex;
+	static Scheduler* singleton;
+};
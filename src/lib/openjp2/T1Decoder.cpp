@@ -15,96 +15,267 @@
 *
  */
 
+#include "cpu_features.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef OPJ_HAVE_TARGET_KERNELS
+#include <immintrin.h>
+#endif
+
 #include "opj_includes.h"
 #include "T1Decoder.h"
-#include "Barrier.h"
-#include "ThreadPool.h"
+#include "Scheduler.h"
 
 
 T1Decoder::T1Decoder(uint16_t blockw, 
 					uint16_t blockh) :codeblock_width(blockw), 
-					  				  codeblock_height(blockh)
+					  				  codeblock_height(blockh),
+									  decodeBlocks(NULL),
+									  nextBlock(0)
 {
 
 }
 
 
-void T1Decoder::decode(std::vector<decodeBlockInfo*>* blocks, int32_t numThreads) {
-	decodeQueue.push_no_lock(blocks);
-	Barrier decode_t1_barrier(numThreads);
-	Barrier decode_t1_calling_barrier(numThreads + 1);
-
-	auto pool = new ThreadPool(numThreads);
-	for (auto threadId = 0; threadId < numThreads; threadId++) {
-		pool->enqueue([this,
-											&decode_t1_barrier,
-											&decode_t1_calling_barrier,
-											threadId]()
-		{
-			auto t1 = opj_t1_create(false, (uint16_t)codeblock_width, (uint16_t)codeblock_height);
-			if (!t1)
-				return;
-			decodeBlockInfo* block = NULL;
-			while (decodeQueue.tryPop(block)) {
+/*
+ROI shift of one coefficient: magnitudes at or above the threshold belong to the
+region of interest, and are scaled back down by the ROI shift
+*/
+static inline int32_t opj_t1_roi_shift(int32_t value, uint32_t roishift, int32_t threshold) {
+	auto magnitude = abs(value);
+	if (magnitude >= threshold) {
+		magnitude >>= roishift;
+		value = value < 0 ? -magnitude : magnitude;
+	}
+	return value;
+}
+
+/*
+Apply ROI shift and dequantization to one row of decoded code-block coefficients,
+writing the reconstructed row straight into the tile buffer
+*/
+static void opj_t1_post_decode_row_int_base(const int32_t* restrict src,
+										int32_t* restrict dest,
+										uint32_t w,
+										uint32_t roishift,
+										int32_t threshold) {
+	uint32_t i = 0;
+#ifdef __SSE2__
+	const __m128i vthreshold = _mm_set1_epi32(threshold - 1);
+	const __m128i vshift = _mm_cvtsi32_si128((int)roishift);
+	for (; i + 4 <= w; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		if (roishift) {
+			__m128i sign = _mm_srai_epi32(v, 31);
+			__m128i mag = _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+			__m128i roi = _mm_cmpgt_epi32(mag, vthreshold);
+			mag = _mm_or_si128(_mm_and_si128(roi, _mm_sra_epi32(mag, vshift)),
+								_mm_andnot_si128(roi, mag));
+			v = _mm_sub_epi32(_mm_xor_si128(mag, sign), sign);
+		}
+		/* division by two, rounding towards zero */
+		v = _mm_srai_epi32(_mm_add_epi32(v, _mm_srli_epi32(v, 31)), 1);
+		_mm_storeu_si128((__m128i*)(dest + i), v);
+	}
+#endif
+	for (; i < w; ++i) {
+		auto value = src[i];
+		if (roishift)
+			value = opj_t1_roi_shift(value, roishift, threshold);
+		dest[i] = value / 2;
+	}
+}
+
+static void opj_t1_post_decode_row_float_base(const int32_t* restrict src,
+										float* restrict dest,
+										uint32_t w,
+										uint32_t roishift,
+										int32_t threshold,
+										float stepsize) {
+	uint32_t i = 0;
+#ifdef __SSE2__
+	const __m128i vthreshold = _mm_set1_epi32(threshold - 1);
+	const __m128i vshift = _mm_cvtsi32_si128((int)roishift);
+	const __m128 vstepsize = _mm_set1_ps(stepsize);
+	for (; i + 4 <= w; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		if (roishift) {
+			__m128i sign = _mm_srai_epi32(v, 31);
+			__m128i mag = _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+			__m128i roi = _mm_cmpgt_epi32(mag, vthreshold);
+			mag = _mm_or_si128(_mm_and_si128(roi, _mm_sra_epi32(mag, vshift)),
+								_mm_andnot_si128(roi, mag));
+			v = _mm_sub_epi32(_mm_xor_si128(mag, sign), sign);
+		}
+		_mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(v), vstepsize));
+	}
+#endif
+	for (; i < w; ++i) {
+		auto value = src[i];
+		if (roishift)
+			value = opj_t1_roi_shift(value, roishift, threshold);
+		dest[i] = (float)value * stepsize;
+	}
+}
+
+#ifdef OPJ_HAVE_TARGET_KERNELS
+OPJ_TARGET_AVX2 static inline __m256i opj_t1_roi_shift_avx2(__m256i v, __m256i vthreshold, __m128i vshift) {
+	__m256i sign = _mm256_srai_epi32(v, 31);
+	__m256i mag = _mm256_abs_epi32(v);
+	__m256i roi = _mm256_cmpgt_epi32(mag, vthreshold);
+	mag = _mm256_blendv_epi8(mag, _mm256_sra_epi32(mag, vshift), roi);
+	return _mm256_sub_epi32(_mm256_xor_si256(mag, sign), sign);
+}
+
+OPJ_TARGET_AVX2 static void opj_t1_post_decode_row_int_avx2(const int32_t* restrict src,
+										int32_t* restrict dest,
+										uint32_t w,
+										uint32_t roishift,
+										int32_t threshold) {
+	uint32_t i = 0;
+	const __m256i vthreshold = _mm256_set1_epi32(threshold - 1);
+	const __m128i vshift = _mm_cvtsi32_si128((int)roishift);
+	for (; i + 8 <= w; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+		if (roishift)
+			v = opj_t1_roi_shift_avx2(v, vthreshold, vshift);
+		v = _mm256_srai_epi32(_mm256_add_epi32(v, _mm256_srli_epi32(v, 31)), 1);
+		_mm256_storeu_si256((__m256i*)(dest + i), v);
+	}
+	opj_t1_post_decode_row_int_base(src + i, dest + i, w - i, roishift, threshold);
+}
+
+OPJ_TARGET_AVX2 static void opj_t1_post_decode_row_float_avx2(const int32_t* restrict src,
+										float* restrict dest,
+										uint32_t w,
+										uint32_t roishift,
+										int32_t threshold,
+										float stepsize) {
+	uint32_t i = 0;
+	const __m256i vthreshold = _mm256_set1_epi32(threshold - 1);
+	const __m128i vshift = _mm_cvtsi32_si128((int)roishift);
+	const __m256 vstepsize = _mm256_set1_ps(stepsize);
+	for (; i + 8 <= w; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+		if (roishift)
+			v = opj_t1_roi_shift_avx2(v, vthreshold, vshift);
+		_mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), vstepsize));
+	}
+	opj_t1_post_decode_row_float_base(src + i, dest + i, w - i, roishift, threshold, stepsize);
+}
+#endif
+
+struct opj_t1_post_decode_kernels_t {
+	void (*row_int)(const int32_t* restrict, int32_t* restrict, uint32_t, uint32_t, int32_t);
+	void (*row_float)(const int32_t* restrict, float* restrict, uint32_t, uint32_t, int32_t, float);
+};
+
+static const opj_t1_post_decode_kernels_t opj_t1_post_decode_kernels_base = {
+	opj_t1_post_decode_row_int_base,
+	opj_t1_post_decode_row_float_base
+};
+
+#ifdef OPJ_HAVE_TARGET_KERNELS
+static const opj_t1_post_decode_kernels_t opj_t1_post_decode_kernels_avx2 = {
+	opj_t1_post_decode_row_int_avx2,
+	opj_t1_post_decode_row_float_avx2
+};
+#endif
+
+static const opj_t1_post_decode_kernels_t* opj_t1_select_kernels(void) {
+#ifdef OPJ_HAVE_TARGET_KERNELS
+	if (opj_cpu_detect_features() & OPJ_CPU_AVX2)
+		return &opj_t1_post_decode_kernels_avx2;
+#endif
+	return &opj_t1_post_decode_kernels_base;
+}
+
+/* bound once, on first use */
+static const opj_t1_post_decode_kernels_t* opj_t1_get_kernels(void) {
+	static const opj_t1_post_decode_kernels_t* const l_kernels = opj_t1_select_kernels();
+	return l_kernels;
+}
+
+void opj_t1_init_kernels(void) {
+	opj_t1_get_kernels();
+}
+
+/*
+Reconstruct decoded code-block coefficients into the tile buffer, in a single pass
+over the code-block
+*/
+static void opj_t1_post_decode(decodeBlockInfo* block, int32_t* t1_data, uint32_t w, uint32_t h) {
+	auto roishift = (uint32_t)block->roishift;
+	/* the vector ROI test needs the threshold to fit in a signed 32 bit integer */
+	if (roishift >= 31) {
+		for (auto j = 0U; j < w * h; ++j)
+			t1_data[j] = opj_t1_roi_shift(t1_data[j], roishift, 1 << roishift);
+		roishift = 0;
+	}
+	int32_t threshold = 1 << roishift;
+	uint32_t tile_width = block->tilec->buf->data_width;
+	const opj_t1_post_decode_kernels_t* kernels = opj_t1_get_kernels();
+	if (block->qmfbid == 1) {
+		int32_t* restrict tile_data = block->tiledp;
+		for (auto j = 0U; j < h; ++j) {
+			kernels->row_int(t1_data, tile_data, w, roishift, threshold);
+			t1_data += w;
+			tile_data += tile_width;
+		}
+	}
+	else {
+		float* restrict tile_data = (float*)block->tiledp;
+		for (auto j = 0U; j < h; ++j) {
+			kernels->row_float(t1_data, tile_data, w, roishift, threshold, block->stepsize);
+			t1_data += w;
+			tile_data += tile_width;
+		}
+	}
+}
+
+
+void T1Decoder::decode(std::vector<decodeBlockInfo>* blocks, int32_t numThreads) {
+	decodeBlocks = blocks;
+	nextBlock = 0;
+	if (numThreads < 1)
+		numThreads = 1;
+	Scheduler::instance()->run((size_t)numThreads, [this](size_t)
+	{
+		auto t1 = opj_t1_create(false, (uint16_t)codeblock_width, (uint16_t)codeblock_height);
+		auto t1_opt = opj_t1_opt_create(false);
+		if (!t1 || !t1_opt ||
+			!opj_t1_opt_allocate_buffers(t1_opt, codeblock_width, codeblock_height)) {
+			opj_t1_destroy(t1);
+			opj_t1_opt_destroy(t1_opt);
+			return;
+		}
+		size_t index;
+		while ((index = nextBlock++) < decodeBlocks->size()) {
+			auto block = &(*decodeBlocks)[index];
+			// bypass mode is only supported by the original decoder
+			if (block->cblksty & J2K_CCP_CBLKSTY_LAZY) {
 				if (!opj_t1_decode_cblk(t1,
 										block->cblk,
 										block->bandno,
 										(uint32_t)block->roishift,
 										block->cblksty)) {
-						delete block;
-						break;
-				}
-
-
-				auto t1_data = t1->data;
-				if (block->roishift) {
-					int32_t threshold = 1 << block->roishift;
-					for (auto j = 0U; j < t1->h; ++j) {
-						for (auto i = 0U; i < t1->w; ++i) {
-							auto value = *t1_data;
-							auto magnitude = abs(value);
-							if (magnitude >= threshold) {
-								magnitude >>= block->roishift;
-								*t1_data = value < 0 ? -magnitude : magnitude;
-							}
-							t1_data++;
-						}
-					}
-					//reset t1_data to start of buffer
-					t1_data = t1->data;
+					break;
 				}
-
-				uint32_t tile_width = block->tilec->x1 - block->tilec->x0;
-				if (block->qmfbid == 1) {
-					int32_t* restrict tile_data = block->tiledp;
-					for (auto j = 0U; j < t1->h; ++j) {
-						int32_t* restrict tile_row_data = tile_data;
-						for (auto i = 0U; i < t1->w; ++i) {
-							tile_row_data[i] = *t1_data / 2;
-							t1_data++;
-						}
-						tile_data += tile_width;
-					}
-				}
-				else {		
-					float* restrict tile_data = (float*)block->tiledp;
-					for (auto j = 0U; j < t1->h; ++j) {
-						float* restrict tile_row_data = tile_data;
-						for (auto i = 0U; i < t1->w; ++i) {
-							tile_row_data[i] = (float)*t1_data * block->stepsize;
-							t1_data++;
-						}
-						tile_data += tile_width;
-					}
+				opj_t1_post_decode(block, t1->data, t1->w, t1->h);
+			}
+			else {
+				if (!opj_t1_opt_decode_cblk(t1_opt,
+											block->cblk,
+											block->bandno,
+											(uint32_t)block->roishift,
+											block->cblksty)) {
+					break;
 				}
-				delete block;
+				opj_t1_post_decode(block, (int32_t*)t1_opt->data, t1_opt->w, t1_opt->h);
 			}
-			opj_t1_destroy(t1);
-			decode_t1_barrier.arrive_and_wait();
-			decode_t1_calling_barrier.arrive_and_wait();
-		});
-	}
-
-	decode_t1_calling_barrier.arrive_and_wait();
-	delete pool;
+		}
+		opj_t1_destroy(t1);
+		opj_t1_opt_destroy(t1_opt);
+	});
 }
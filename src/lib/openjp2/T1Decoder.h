@@ -20,17 +20,19 @@
 #include <string>
 #include <vector>
 #include <thread>
-#include "BlockingQueue.h"
+#include <atomic>
 
 
 class T1Decoder
 {
 public:
 	T1Decoder(uint16_t blockw, uint16_t blockh);
-	void decode(std::vector<decodeBlockInfo*>* blocks, int32_t numThreads);
+	void decode(std::vector<decodeBlockInfo>* blocks, int32_t numThreads);
 
 private:
 
 	uint16_t codeblock_width, codeblock_height;  //nominal dimensions of block
-	BlockingQueue<decodeBlockInfo*> decodeQueue;
+	/* blocks are claimed in order through an atomic index into the block array */
+	std::vector<decodeBlockInfo>* decodeBlocks;
+	std::atomic<size_t> nextBlock;
 };
@@ -17,31 +17,33 @@
 
 #include "opj_includes.h"
 #include "T1Encoder.h"
-#include "Barrier.h"
-#include "ThreadPool.h"
+#include "Scheduler.h"
 
 
 T1Encoder::T1Encoder() : tile(NULL), 
 						maxCblkW(0),
-						maxCblkH(0)
+						maxCblkH(0),
+						encodeBlocks(NULL),
+						nextBlock(0)
 {
 
 }
 
-void T1Encoder::encode(void) {
+void T1Encoder::encode(size_t threadId) {
 	auto state = opj_plugin_get_debug_state();
 	auto t1 = opj_t1_create(true, 0,0);
 	if (!t1) {
 		return_code = false;
+		return;
 	}
-	encodeBlockInfo* block = NULL;
-	while (return_code && encodeQueue.tryPop(block)) {
+	size_t index;
+	while (return_code && (index = nextBlock++) < encodeBlocks->size()) {
+		auto block = &(*encodeBlocks)[index];
 		uint32_t tileIndex = 0, tileLineAdvance;
 		if (!opj_t1_allocate_buffers(
 			t1,
 			block->cblk->x1 - block->cblk->x0,
 			block->cblk->y1 - block->cblk->y0)) {
-			delete block;
 			return_code = false;
 			break;
 		}
@@ -92,19 +94,16 @@ void T1Encoder::encode(void) {
 										tile->numcomps,
 										block->mct_norms,
 										block->mct_numcomps);
-
-		delete block;
-
-		std::unique_lock<std::mutex> lk(distortion_mutex);
-		tile->distotile += dist;
+		distortion[index] = dist;
 	}
 	opj_t1_destroy(t1);
 }
 void T1Encoder::encodeOpt(size_t threadId) {
 	auto state = opj_plugin_get_debug_state();
 	auto t1 = t1OptVec[threadId];
-	encodeBlockInfo* block = NULL;
-	while (return_code && encodeQueue.tryPop(block)) {
+	size_t index;
+	while (return_code && (index = nextBlock++) < encodeBlocks->size()) {
+		auto block = &(*encodeBlocks)[index];
 
 		auto tilec = tile->comps + block->compno;
 		opj_t1_opt_init_buffers(t1,
@@ -179,16 +178,13 @@ void T1Encoder::encodeOpt(size_t threadId) {
 											block->mct_norms,
 											block->mct_numcomps,
 											max);
-
-		delete block;
-		std::unique_lock<std::mutex> lk(distortion_mutex);
-		tile->distotile += dist;
+		distortion[index] = dist;
 	}
 }
 
 bool T1Encoder::encode(bool do_opt, 
 						opj_tcd_tile_t *encodeTile,
-						std::vector<encodeBlockInfo*>* blocks, 
+						std::vector<encodeBlockInfo>* blocks, 
 						uint32_t encodeMaxCblkW,
 						uint32_t encodeMaxCblkH,
 						uint32_t numThreads) {
@@ -218,36 +214,22 @@ bool T1Encoder::encode(bool do_opt,
 			t1OptVec.push_back(t1);
 		}
 	}
-	encodeQueue.push_no_lock(blocks);
+	encodeBlocks = blocks;
+	nextBlock = 0;
+	distortion.assign(blocks->size(), 0);
 	return_code = true;
 
-	Barrier encode_t1_barrier(numThreads);
-	Barrier encode_t1_calling_barrier(numThreads + 1);
+	Scheduler::instance()->run(numThreads, [this, do_opt](size_t threadId) {
+		if (do_opt)
+			encodeOpt(threadId);
+		else
+			encode(threadId);
+	});
 
-	auto pool = new ThreadPool(numThreads);
-	for (auto threadId = 0U; threadId < numThreads; threadId++) {
-		pool->enqueue([this,
-						do_opt,
-						&encode_t1_barrier,
-						&encode_t1_calling_barrier,
-						threadId] {
-
-			if (do_opt)
-				encodeOpt(threadId);
-			else
-				encode();
-			encode_t1_barrier.arrive_and_wait();
-			encode_t1_calling_barrier.arrive_and_wait();
-		});
-	}
-
-	encode_t1_calling_barrier.arrive_and_wait();
-	delete pool;
-	
-	// clean up blocks
-	encodeBlockInfo* block = NULL;
-	while (encodeQueue.tryPop(block)) {
-		delete block;
+	/* sum in block order, so that the total does not depend on which thread
+	   encoded which block */
+	for (auto dist : distortion) {
+		tile->distotile += dist;
 	}
 
 	// clean up t1 structs
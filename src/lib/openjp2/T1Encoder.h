@@ -17,9 +17,9 @@
 
 #pragma once
 
-#include "BlockingQueue.h"
 #include <atomic>
 #include <thread>
+#include <vector>
 
 
 class T1Encoder
@@ -27,12 +27,12 @@ class T1Encoder
 public:
 	T1Encoder();
 	bool encode(bool do_opt, opj_tcd_tile_t *tile,
-				std::vector<encodeBlockInfo*>* blocks,
+				std::vector<encodeBlockInfo>* blocks,
 				uint32_t maxCblkW, 
 				uint32_t maxCblkH,
 				uint32_t numThreads);
 
-	void encode();
+	void encode(size_t threadId);
 	void encodeOpt(size_t threadId);
 
 	std::atomic_bool return_code;
@@ -45,7 +45,11 @@ private:
 	std::vector<opj_t1_opt*> t1OptVec;
 	std::vector<opj_t1*> t1Vec;
 
-	BlockingQueue<encodeBlockInfo*> encodeQueue;
-	mutable std::mutex distortion_mutex;
+	/* blocks are claimed in order through an atomic index into the block array */
+	std::vector<encodeBlockInfo>* encodeBlocks;
+	std::atomic<size_t> nextBlock;
+
+	/* distortion of each block, summed into the tile in block order at the end */
+	std::vector<double> distortion;
 
 };
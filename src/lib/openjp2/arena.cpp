@@ -0,0 +1,79 @@
+/*
+*    Copyright (C) 2016 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+
+#include "opj_includes.h"
+
+/* size of a regular arena block; larger requests get a block of their own */
+#define OPJ_ARENA_BLOCK_SIZE	(1 << 20)
+#define OPJ_ARENA_ALIGNMENT		16
+
+opj_arena_t::opj_arena_t() : cur_block(0) {
+}
+
+opj_arena_t::~opj_arena_t()  {
+	for (auto& block : blocks) {
+		if (block) {
+			opj_buf_free(block);
+		}
+	}
+}
+
+void* opj_arena_alloc(opj_arena_t* arena, size_t len)
+{
+    opj_buf_t* block = NULL;
+    uint8_t* ptr = NULL;
+    if (!arena)
+        return NULL;
+    len = (len + OPJ_ARENA_ALIGNMENT - 1) & ~(size_t)(OPJ_ARENA_ALIGNMENT - 1);
+
+    /* blocks kept from before a rewind are used in turn, skipping those too small */
+    for (; arena->cur_block < arena->blocks.size(); ++arena->cur_block) {
+        block = arena->blocks[arena->cur_block];
+        if (block->len - (size_t)block->offset >= len)
+            break;
+    }
+    if (arena->cur_block == arena->blocks.size()) {
+        size_t block_len = len > OPJ_ARENA_BLOCK_SIZE ? len : OPJ_ARENA_BLOCK_SIZE;
+        block = (opj_buf_t*)opj_malloc(sizeof(opj_buf_t));
+        if (!block)
+            return NULL;
+        memset(block, 0, sizeof(opj_buf_t));
+        block->buf = (uint8_t*)opj_malloc(block_len);
+        if (!block->buf) {
+            opj_free(block);
+            return NULL;
+        }
+        block->len = block_len;
+        block->owns_data = true;
+        arena->blocks.push_back(block);
+    }
+
+    ptr = block->buf + block->offset;
+    block->offset += (int64_t)len;
+    memset(ptr, 0, len);
+    return ptr;
+}
+
+void opj_arena_rewind(opj_arena_t* arena)
+{
+    if (!arena)
+        return;
+    for (auto& block : arena->blocks)
+        block->offset = 0;
+    arena->cur_block = 0;
+}
@@ -0,0 +1,44 @@
+/*
+*    Copyright (C) 2016 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <vector>
+
+/*  Arena Interface
+
+An arena hands out zero-filled memory carved from a few large blocks. Allocations
+are never freed one by one: rewinding the arena makes all of its memory available
+again, while keeping the blocks for the next round of allocations.
+
+*/
+struct opj_arena_t {
+    opj_arena_t();
+    ~opj_arena_t();
+    std::vector<opj_buf_t*> blocks;
+    size_t cur_block;	/* current index into blocks vector */
+};
+
+/*
+Allocate zero-filled memory from the arena, aligned for any type
+*/
+void* opj_arena_alloc(opj_arena_t* arena, size_t len);
+
+/*
+Make all memory of the arena available again
+*/
+void opj_arena_rewind(opj_arena_t* arena);
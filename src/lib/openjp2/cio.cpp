@@ -219,6 +219,10 @@ void OPJ_CALLCONV opj_stream_destroy(opj_stream_t* p_stream)
             opj_free(l_stream->m_stored_data);
             l_stream->m_stored_data = 00;
         }
+        if (l_stream->m_header_cache_key) {
+            opj_free(l_stream->m_header_cache_key);
+            l_stream->m_header_cache_key = 00;
+        }
         opj_free(l_stream);
     }
 }
@@ -184,6 +184,12 @@ typedef struct opj_stream_private {
      */
     uint32_t m_status;
 
+    /**
+     * Key of the file in the header cache (path, size and modification time),
+     * or NULL if the stream does not take part in header caching.
+     */
+    char* m_header_cache_key;
+
 }
 opj_stream_private_t;
 
@@ -0,0 +1,68 @@
+/*
+*    Copyright (C) 2016 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#include "cpu_features.h"
+
+static uint32_t opj_cpu_query_features(void)
+{
+    uint32_t l_features = 0;
+#if defined(OPJ_HAVE_TARGET_KERNELS)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        l_features |= OPJ_CPU_SSE2;
+    if (__builtin_cpu_supports("sse4.1"))
+        l_features |= OPJ_CPU_SSE41;
+    if (__builtin_cpu_supports("avx"))
+        l_features |= OPJ_CPU_AVX;
+    if (__builtin_cpu_supports("avx2"))
+        l_features |= OPJ_CPU_AVX2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        l_features |= OPJ_CPU_AVX512;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int l_info[4];
+    __cpuid(l_info, 1);
+    if (l_info[3] & (1 << 26))
+        l_features |= OPJ_CPU_SSE2;
+    if (l_info[2] & (1 << 19))
+        l_features |= OPJ_CPU_SSE41;
+    /* AVX also needs the OS to save the YMM (and for AVX-512, ZMM) registers */
+    bool l_osxsave = (l_info[2] & (1 << 27)) != 0;
+    uint64_t l_xcr0 = l_osxsave ? _xgetbv(0) : 0;
+    if ((l_info[2] & (1 << 28)) && (l_xcr0 & 0x6) == 0x6) {
+        l_features |= OPJ_CPU_AVX;
+        __cpuidex(l_info, 7, 0);
+        if (l_info[1] & (1 << 5))
+            l_features |= OPJ_CPU_AVX2;
+        if ((l_info[1] & (1 << 16)) && (l_info[1] & (1 << 30)) && (l_xcr0 & 0xE6) == 0xE6)
+            l_features |= OPJ_CPU_AVX512;
+    }
+#endif
+
+    return l_features;
+}
+
+uint32_t opj_cpu_detect_features(void)
+{
+    /* initialised once, thread-safely, by the first caller */
+    static const uint32_t l_features = opj_cpu_query_features();
+    return l_features;
+}
@@ -0,0 +1,55 @@
+/*
+*    Copyright (C) 2016 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+Instruction set extensions available to the SIMD kernels.
+
+With GCC and Clang on x86, each kernel is compiled once per extension through a
+target attribute, whatever the -m flags of the build, so that one library runs
+at full speed on every host. The extensions of the running CPU are detected on
+first use, and each module binds the widest kernels it has the first time it needs
+them, so callers that skip opj_initialize get the same kernels; opj_initialize only
+binds them up front through the opj_*_init_kernels functions.
+Other compilers only get the kernels their build flags allow.
+*/
+
+#define OPJ_CPU_SSE2	0x01
+#define OPJ_CPU_SSE41	0x02
+#define OPJ_CPU_AVX		0x04
+#define OPJ_CPU_AVX2	0x08
+/* AVX-512 F and BW */
+#define OPJ_CPU_AVX512	0x10
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define OPJ_HAVE_TARGET_KERNELS
+#define OPJ_TARGET_SSE41	__attribute__((target("sse4.1")))
+#define OPJ_TARGET_AVX		__attribute__((target("avx")))
+#define OPJ_TARGET_AVX2		__attribute__((target("avx2")))
+#define OPJ_TARGET_AVX512	__attribute__((target("avx512f,avx512bw")))
+#endif
+
+/**
+Detect the instruction set extensions of the running CPU.
+The first call detects them, thread-safely; later calls return the cached result,
+so kernel binders call this whenever they need the flags.
+@return OPJ_CPU_* flags
+*/
+uint32_t opj_cpu_detect_features(void);
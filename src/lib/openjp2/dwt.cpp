@@ -58,13 +58,16 @@
 #ifdef __SSE__
 #include <xmmintrin.h>
 #endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "cpu_features.h"
+#ifdef OPJ_HAVE_TARGET_KERNELS
+#include <immintrin.h>
+#endif
 
 #include "opj_includes.h"
-#include "Barrier.h"
-#include "T1Decoder.h"
-#include <atomic>
-
-std::vector<std::thread> dwtWorkers;
+#include "Scheduler.h"
 
 
 /** @defgroup DWT DWT - Implementation of a discrete wavelet transform */
@@ -91,6 +94,27 @@ typedef struct v4dwt_local {
     int32_t		cas ;
 } opj_v4dwt_t ;
 
+/* number of columns filtered together by the forward vertical pass */
+#define OPJ_DWT_VCOLS 8
+
+/**
+Lifting step over rows of OPJ_DWT_VCOLS interleaved columns
+*/
+typedef void (*opj_dwt_lift_fn)(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c);
+
+typedef struct opj_dwt_lift_ops {
+    opj_dwt_lift_fn predict_53;
+    opj_dwt_lift_fn update_53;
+    opj_dwt_lift_fn sub_97;
+    opj_dwt_lift_fn add_97;
+    void (*scale_97)(int32_t* x, int32_t n, int32_t c);
+} opj_dwt_lift_ops_t;
+
+/**
+Forward wavelet transform in 1-D on OPJ_DWT_VCOLS columns
+*/
+typedef void (*DWT1DVFN)(const opj_dwt_lift_ops_t* ops, int32_t *a, int32_t dn, int32_t sn, int32_t cas);
+
 static const float opj_dwt_alpha =  1.586134342f; /*  12994 */
 static const float opj_dwt_beta  =  0.052980118f; /*    434 */
 static const float opj_dwt_gamma = -0.882911075f; /*  -7233 */
@@ -114,10 +138,6 @@ Forward lazy transform (horizontal)
 */
 static void opj_dwt_deinterleave_h(int32_t *a, int32_t *b, int32_t dn, int32_t sn, int32_t cas);
 /**
-Forward lazy transform (vertical)
-*/
-static void opj_dwt_deinterleave_v(int32_t *a, int32_t *b, int32_t dn, int32_t sn, int32_t x, int32_t cas);
-/**
 Inverse lazy transform (horizontal)
 */
 static void opj_dwt_interleave_h(opj_dwt_t* h, int32_t *a);
@@ -139,6 +159,14 @@ Forward 9-7 wavelet transform in 1-D
 */
 static void opj_dwt_encode_1_real(int32_t *a, int32_t dn, int32_t sn, int32_t cas);
 /**
+Forward 5-3 wavelet transform in 1-D, on OPJ_DWT_VCOLS columns at a time
+*/
+static void opj_dwt_encode_v(const opj_dwt_lift_ops_t* ops, int32_t *a, int32_t dn, int32_t sn, int32_t cas);
+/**
+Forward 9-7 wavelet transform in 1-D, on OPJ_DWT_VCOLS columns at a time
+*/
+static void opj_dwt_encode_v_real(const opj_dwt_lift_ops_t* ops, int32_t *a, int32_t dn, int32_t sn, int32_t cas);
+/**
 Explicit calculation of the Quantization Stepsizes
 */
 static void opj_dwt_encode_stepsize(int32_t stepsize, int32_t numbps, opj_stepsize_t *bandno_stepsize);
@@ -151,7 +179,9 @@ static bool opj_dwt_decode_tile(opj_tcd_tilecomp_t* tilec,
 								uint32_t numThreads);
 
 static bool opj_dwt_encode_procedure(	opj_tcd_tilecomp_t * tilec,
-                                        void (*p_function)(int32_t *, int32_t,int32_t,int32_t) );
+                                        void (*p_function)(int32_t *, int32_t,int32_t,int32_t),
+                                        DWT1DVFN p_function_v,
+                                        uint32_t numThreads);
 
 
 /* <summary>                             */
@@ -236,32 +266,6 @@ static void opj_dwt_deinterleave_h(int32_t *a, int32_t *b, int32_t dn, int32_t s
     }
 }
 
-/* <summary>                             */
-/* Forward lazy transform (vertical).    */
-/* </summary>                            */
-static void opj_dwt_deinterleave_v(int32_t *a, int32_t *b, int32_t dn, int32_t sn, int32_t x, int32_t cas)
-{
-    int32_t i = sn;
-    int32_t * l_dest = b;
-    int32_t * l_src = a+cas;
-
-    while (i--) {
-        *l_dest = *l_src;
-        l_dest += x;
-        l_src += 2;
-    } /* b[i*x]=a[2*i+cas]; */
-
-    l_dest = b + sn * x;
-    l_src = a + 1 - cas;
-
-    i = dn;
-    while (i--) {
-        *l_dest = *l_src;
-        l_dest += x;
-        l_src += 2;
-    } /*b[(sn+i)*x]=a[(2*i+1-cas)];*/
-}
-
 /* <summary>                             */
 /* Inverse lazy transform (horizontal).  */
 /* </summary>                            */
@@ -398,6 +402,378 @@ static void opj_dwt_encode_1_real(int32_t *a, int32_t dn, int32_t sn, int32_t ca
     }
 }
 
+/*
+==========================================================
+   multi-column forward lifting
+==========================================================
+*/
+
+/* lifting step over n rows of OPJ_DWT_VCOLS columns: x(i) op= f(y1(i) + y2(i)) */
+static void opj_dwt_predict_53(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    (void)c;
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; ++k)
+            x[k] -= (y1[k] + y2[k]) >> 1;
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+static void opj_dwt_update_53(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    (void)c;
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; ++k)
+            x[k] += (y1[k] + y2[k] + 2) >> 2;
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+static void opj_dwt_sub_97(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; ++k)
+            x[k] -= opj_int_fix_mul(y1[k] + y2[k], c);
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+static void opj_dwt_add_97(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; ++k)
+            x[k] += opj_int_fix_mul(y1[k] + y2[k], c);
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+static void opj_dwt_scale_97(int32_t* x, int32_t n, int32_t c)
+{
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; ++k)
+            x[k] = opj_int_fix_mul(x[k], c);
+        x += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+static const opj_dwt_lift_ops_t opj_dwt_lift_ops = {
+    opj_dwt_predict_53,
+    opj_dwt_update_53,
+    opj_dwt_sub_97,
+    opj_dwt_add_97,
+    opj_dwt_scale_97
+};
+
+#ifdef __SSE2__
+/* opj_int_fix_mul on four lanes: SSE2 only has an unsigned 32x32->64 multiply,
+   so the product of a negative lane is corrected by subtracting c << 32 */
+static inline __m128i opj_dwt_fix_mul_sse2(__m128i a, __m128i c, __m128i chi, __m128i round, __m128i lo)
+{
+    __m128i sign = _mm_srai_epi32(a, 31);
+    __m128i even = _mm_mul_epu32(a, c);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), c);
+    even = _mm_sub_epi64(even, _mm_and_si128(_mm_shuffle_epi32(sign, _MM_SHUFFLE(2, 2, 0, 0)), chi));
+    odd = _mm_sub_epi64(odd, _mm_and_si128(_mm_shuffle_epi32(sign, _MM_SHUFFLE(3, 3, 1, 1)), chi));
+    /* only bits 13..44 of the product survive, so a logical shift will do */
+    even = _mm_srli_epi64(_mm_add_epi64(even, round), 13);
+    odd = _mm_srli_epi64(_mm_add_epi64(odd, round), 13);
+    return _mm_or_si128(_mm_and_si128(even, lo), _mm_slli_epi64(odd, 32));
+}
+
+static void opj_dwt_predict_53_sse2(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    (void)c;
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; k += 4) {
+            __m128i s = _mm_add_epi32(_mm_load_si128((const __m128i*)(y1 + k)), _mm_load_si128((const __m128i*)(y2 + k)));
+            __m128i* xk = (__m128i*)(x + k);
+            _mm_store_si128(xk, _mm_sub_epi32(_mm_load_si128(xk), _mm_srai_epi32(s, 1)));
+        }
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+static void opj_dwt_update_53_sse2(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    (void)c;
+    const __m128i two = _mm_set1_epi32(2);
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; k += 4) {
+            __m128i s = _mm_add_epi32(_mm_load_si128((const __m128i*)(y1 + k)), _mm_load_si128((const __m128i*)(y2 + k)));
+            __m128i* xk = (__m128i*)(x + k);
+            _mm_store_si128(xk, _mm_add_epi32(_mm_load_si128(xk), _mm_srai_epi32(_mm_add_epi32(s, two), 2)));
+        }
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+static void opj_dwt_sub_97_sse2(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    const __m128i cv = _mm_set1_epi32(c);
+    const __m128i chi = _mm_set_epi32(c, 0, c, 0);
+    const __m128i round = _mm_set_epi32(0, 4096, 0, 4096);
+    const __m128i lo = _mm_set_epi32(0, -1, 0, -1);
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; k += 4) {
+            __m128i s = _mm_add_epi32(_mm_load_si128((const __m128i*)(y1 + k)), _mm_load_si128((const __m128i*)(y2 + k)));
+            __m128i* xk = (__m128i*)(x + k);
+            _mm_store_si128(xk, _mm_sub_epi32(_mm_load_si128(xk), opj_dwt_fix_mul_sse2(s, cv, chi, round, lo)));
+        }
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+static void opj_dwt_add_97_sse2(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    const __m128i cv = _mm_set1_epi32(c);
+    const __m128i chi = _mm_set_epi32(c, 0, c, 0);
+    const __m128i round = _mm_set_epi32(0, 4096, 0, 4096);
+    const __m128i lo = _mm_set_epi32(0, -1, 0, -1);
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; k += 4) {
+            __m128i s = _mm_add_epi32(_mm_load_si128((const __m128i*)(y1 + k)), _mm_load_si128((const __m128i*)(y2 + k)));
+            __m128i* xk = (__m128i*)(x + k);
+            _mm_store_si128(xk, _mm_add_epi32(_mm_load_si128(xk), opj_dwt_fix_mul_sse2(s, cv, chi, round, lo)));
+        }
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+static void opj_dwt_scale_97_sse2(int32_t* x, int32_t n, int32_t c)
+{
+    const __m128i cv = _mm_set1_epi32(c);
+    const __m128i chi = _mm_set_epi32(c, 0, c, 0);
+    const __m128i round = _mm_set_epi32(0, 4096, 0, 4096);
+    const __m128i lo = _mm_set_epi32(0, -1, 0, -1);
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; k += 4) {
+            __m128i* xk = (__m128i*)(x + k);
+            _mm_store_si128(xk, opj_dwt_fix_mul_sse2(_mm_load_si128(xk), cv, chi, round, lo));
+        }
+        x += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+static const opj_dwt_lift_ops_t opj_dwt_lift_ops_sse2 = {
+    opj_dwt_predict_53_sse2,
+    opj_dwt_update_53_sse2,
+    opj_dwt_sub_97_sse2,
+    opj_dwt_add_97_sse2,
+    opj_dwt_scale_97_sse2
+};
+#endif
+
+#ifdef OPJ_HAVE_TARGET_KERNELS
+/* opj_int_fix_mul on eight lanes */
+OPJ_TARGET_AVX2 static inline __m256i opj_dwt_fix_mul_avx2(__m256i a, __m256i c, __m256i round)
+{
+    __m256i even = _mm256_mul_epi32(a, c);
+    __m256i odd = _mm256_mul_epi32(_mm256_srli_epi64(a, 32), c);
+    even = _mm256_srli_epi64(_mm256_add_epi64(even, round), 13);
+    odd = _mm256_slli_epi64(_mm256_srli_epi64(_mm256_add_epi64(odd, round), 13), 32);
+    return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+OPJ_TARGET_AVX2 static void opj_dwt_predict_53_avx2(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    (void)c;
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; k += 8) {
+            __m256i s = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(y1 + k)), _mm256_loadu_si256((const __m256i*)(y2 + k)));
+            __m256i* xk = (__m256i*)(x + k);
+            _mm256_storeu_si256(xk, _mm256_sub_epi32(_mm256_loadu_si256(xk), _mm256_srai_epi32(s, 1)));
+        }
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+OPJ_TARGET_AVX2 static void opj_dwt_update_53_avx2(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    (void)c;
+    const __m256i two = _mm256_set1_epi32(2);
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; k += 8) {
+            __m256i s = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(y1 + k)), _mm256_loadu_si256((const __m256i*)(y2 + k)));
+            __m256i* xk = (__m256i*)(x + k);
+            _mm256_storeu_si256(xk, _mm256_add_epi32(_mm256_loadu_si256(xk), _mm256_srai_epi32(_mm256_add_epi32(s, two), 2)));
+        }
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+OPJ_TARGET_AVX2 static void opj_dwt_sub_97_avx2(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    const __m256i cv = _mm256_set1_epi32(c);
+    const __m256i round = _mm256_set1_epi64x(4096);
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; k += 8) {
+            __m256i s = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(y1 + k)), _mm256_loadu_si256((const __m256i*)(y2 + k)));
+            __m256i* xk = (__m256i*)(x + k);
+            _mm256_storeu_si256(xk, _mm256_sub_epi32(_mm256_loadu_si256(xk), opj_dwt_fix_mul_avx2(s, cv, round)));
+        }
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+OPJ_TARGET_AVX2 static void opj_dwt_add_97_avx2(int32_t* x, const int32_t* y1, const int32_t* y2, int32_t n, int32_t c)
+{
+    const __m256i cv = _mm256_set1_epi32(c);
+    const __m256i round = _mm256_set1_epi64x(4096);
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; k += 8) {
+            __m256i s = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(y1 + k)), _mm256_loadu_si256((const __m256i*)(y2 + k)));
+            __m256i* xk = (__m256i*)(x + k);
+            _mm256_storeu_si256(xk, _mm256_add_epi32(_mm256_loadu_si256(xk), opj_dwt_fix_mul_avx2(s, cv, round)));
+        }
+        x += 2 * OPJ_DWT_VCOLS;
+        y1 += 2 * OPJ_DWT_VCOLS;
+        y2 += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+OPJ_TARGET_AVX2 static void opj_dwt_scale_97_avx2(int32_t* x, int32_t n, int32_t c)
+{
+    const __m256i cv = _mm256_set1_epi32(c);
+    const __m256i round = _mm256_set1_epi64x(4096);
+    for (int32_t i = 0; i < n; ++i) {
+        for (int32_t k = 0; k < OPJ_DWT_VCOLS; k += 8) {
+            __m256i* xk = (__m256i*)(x + k);
+            _mm256_storeu_si256(xk, opj_dwt_fix_mul_avx2(_mm256_loadu_si256(xk), cv, round));
+        }
+        x += 2 * OPJ_DWT_VCOLS;
+    }
+}
+
+static const opj_dwt_lift_ops_t opj_dwt_lift_ops_avx2 = {
+    opj_dwt_predict_53_avx2,
+    opj_dwt_update_53_avx2,
+    opj_dwt_sub_97_avx2,
+    opj_dwt_add_97_avx2,
+    opj_dwt_scale_97_avx2
+};
+#endif
+
+static const opj_dwt_lift_ops_t* opj_dwt_select_kernels(void)
+{
+#ifdef OPJ_HAVE_TARGET_KERNELS
+    /* eight interleaved columns fill one AVX2 register, so AVX-512 has nothing to add */
+    if (opj_cpu_detect_features() & OPJ_CPU_AVX2)
+        return &opj_dwt_lift_ops_avx2;
+#endif
+#ifdef __SSE2__
+    return &opj_dwt_lift_ops_sse2;
+#else
+    return &opj_dwt_lift_ops;
+#endif
+}
+
+/* bound once, on first use */
+static const opj_dwt_lift_ops_t* opj_dwt_get_kernels(void)
+{
+    static const opj_dwt_lift_ops_t* const l_kernels = opj_dwt_select_kernels();
+    return l_kernels;
+}
+
+void opj_dwt_init_kernels(void)
+{
+    opj_dwt_get_kernels();
+}
+
+/* apply one lifting step to rows X(0..n-1), reading neighbours Y(i+o1) and Y(i+o2)
+   clamped to [0, m-1]; only the boundary rows are filtered one at a time */
+static void opj_dwt_lift(opj_dwt_lift_fn fn, int32_t* X, const int32_t* Y,
+                         int32_t n, int32_t m, int32_t o1, int32_t o2, int32_t c)
+{
+    const int32_t stride = 2 * OPJ_DWT_VCOLS;
+    int32_t lo = opj_int_min(opj_int_max(-opj_int_min(o1, o2), 0), n);
+    int32_t hi = opj_int_clamp(m - opj_int_max(o1, o2), lo, n);
+    int32_t i;
+
+    for (i = 0; i < lo; ++i)
+        fn(X + i * stride, Y + opj_int_clamp(i + o1, 0, m - 1) * stride,
+           Y + opj_int_clamp(i + o2, 0, m - 1) * stride, 1, c);
+    if (hi > lo)
+        fn(X + lo * stride, Y + (lo + o1) * stride, Y + (lo + o2) * stride, hi - lo, c);
+    for (i = hi; i < n; ++i)
+        fn(X + i * stride, Y + opj_int_clamp(i + o1, 0, m - 1) * stride,
+           Y + opj_int_clamp(i + o2, 0, m - 1) * stride, 1, c);
+}
+
+/* <summary>                                                          */
+/* Forward 5-3 wavelet transform in 1-D, on OPJ_DWT_VCOLS columns.    */
+/* </summary>                                                         */
+static void opj_dwt_encode_v(const opj_dwt_lift_ops_t* ops, int32_t *a, int32_t dn, int32_t sn, int32_t cas)
+{
+    int32_t* S = a;
+    int32_t* D = a + OPJ_DWT_VCOLS;
+
+    if (!cas) {
+        if ((dn > 0) || (sn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+            opj_dwt_lift(ops->predict_53, D, S, dn, sn, 0, 1, 0);
+            opj_dwt_lift(ops->update_53, S, D, sn, dn, -1, 0, 0);
+        }
+    } else {
+        if (!sn && dn == 1) {		    /* NEW :  CASE ONE ELEMENT */
+            for (int32_t k = 0; k < OPJ_DWT_VCOLS; ++k)
+                S[k] *= 2;
+        } else {
+            opj_dwt_lift(ops->predict_53, S, D, dn, sn, 0, -1, 0);
+            opj_dwt_lift(ops->update_53, D, S, sn, dn, 0, 1, 0);
+        }
+    }
+}
+
+/* <summary>                                                          */
+/* Forward 9-7 wavelet transform in 1-D, on OPJ_DWT_VCOLS columns.    */
+/* </summary>                                                         */
+static void opj_dwt_encode_v_real(const opj_dwt_lift_ops_t* ops, int32_t *a, int32_t dn, int32_t sn, int32_t cas)
+{
+    int32_t* S = a;
+    int32_t* D = a + OPJ_DWT_VCOLS;
+
+    if (!cas) {
+        if ((dn > 0) || (sn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+            opj_dwt_lift(ops->sub_97, D, S, dn, sn, 0, 1, 12993);
+            opj_dwt_lift(ops->sub_97, S, D, sn, dn, -1, 0, 434);
+            opj_dwt_lift(ops->add_97, D, S, dn, sn, 0, 1, 7233);
+            opj_dwt_lift(ops->add_97, S, D, sn, dn, -1, 0, 3633);
+            ops->scale_97(D, dn, 5038);
+            ops->scale_97(S, sn, 6659);
+        }
+    } else {
+        if ((sn > 0) || (dn > 1)) {	/* NEW :  CASE ONE ELEMENT */
+            opj_dwt_lift(ops->sub_97, S, D, dn, sn, 0, -1, 12993);
+            opj_dwt_lift(ops->sub_97, D, S, sn, dn, 0, 1, 434);
+            opj_dwt_lift(ops->add_97, S, D, dn, sn, 0, -1, 7233);
+            opj_dwt_lift(ops->add_97, D, S, sn, dn, 0, 1, 3633);
+            ops->scale_97(S, dn, 5038);
+            ops->scale_97(D, sn, 6659);
+        }
+    }
+}
+
 static void opj_dwt_encode_stepsize(int32_t stepsize, int32_t numbps, opj_stepsize_t *bandno_stepsize)
 {
     int32_t p, n;
@@ -417,13 +793,14 @@ static void opj_dwt_encode_stepsize(int32_t stepsize, int32_t numbps, opj_stepsi
 /* <summary>                            */
 /* Forward 5-3 wavelet transform in 2-D. */
 /* </summary>                           */
-static inline bool opj_dwt_encode_procedure(opj_tcd_tilecomp_t * tilec,void (*p_function)(int32_t *, int32_t,int32_t,int32_t) )
+static inline bool opj_dwt_encode_procedure(opj_tcd_tilecomp_t * tilec,
+												void (*p_function)(int32_t *, int32_t,int32_t,int32_t),
+												DWT1DVFN p_function_v,
+												uint32_t numThreads)
 {
-    int32_t i,k;
+    int32_t l;
     int32_t *a = 00;
-    int32_t *aj = 00;
-    int32_t *bj = 00;
-    int32_t w, l;
+    int32_t w;
 
     int32_t rw;			/* width of the resolution level computed   */
     int32_t rh;			/* height of the resolution level computed  */
@@ -439,21 +816,32 @@ static inline bool opj_dwt_encode_procedure(opj_tcd_tilecomp_t * tilec,void (*p_
     l_cur_res = tilec->resolutions + l;
     l_last_res = l_cur_res - 1;
 
+    /* l_data_size is equal to 0 when numresolutions == 1, and there is nothing to transform */
     l_data_size = opj_dwt_max_resolution( tilec->resolutions,tilec->numresolutions) * (uint32_t)sizeof(int32_t);
-    bj = (int32_t*)opj_malloc((size_t)l_data_size);
-    /* l_data_size is equal to 0 when numresolutions == 1 but bj is not used */
-    /* in that case, so do not error out */
-    if (l_data_size != 0 && ! bj) {
-        return false;
+    if (l_data_size == 0)
+        return true;
+    if (numThreads < 1)
+        numThreads = 1;
+
+    const opj_dwt_lift_ops_t* ops = opj_dwt_get_kernels();
+
+    /* one scratch strip of OPJ_DWT_VCOLS columns per task, reused across resolution levels */
+    std::vector<int32_t*> mem(numThreads, nullptr);
+    bool rc = true;
+    for (auto& m : mem) {
+        m = (int32_t*)opj_aligned_malloc((size_t)l_data_size * OPJ_DWT_VCOLS);
+        if (!m) {
+            rc = false;
+            break;
+        }
     }
-    i = l;
 
-	while (i--) {
+    int32_t i = l;
+    while (rc && i--) {
         int32_t rw1;		/* width of the resolution level once lower than computed one                                       */
         int32_t rh1;		/* height of the resolution level once lower than computed one                                      */
         int32_t cas_col;	/* 0 = non inversion on horizontal filtering 1 = inversion between low-pass and high-pass filtering */
         int32_t cas_row;	/* 0 = non inversion on vertical filtering 1 = inversion between low-pass and high-pass filtering   */
-        int32_t dn, sn;
 
         rw  = l_cur_res->x1 - l_cur_res->x0;
         rh  = l_cur_res->y1 - l_cur_res->y0;
@@ -463,48 +851,57 @@ static inline bool opj_dwt_encode_procedure(opj_tcd_tilecomp_t * tilec,void (*p_
         cas_row = l_cur_res->x0 & 1;
         cas_col = l_cur_res->y0 & 1;
 
-        sn = rh1;
-        dn = rh - rh1;
-		
-		// j = threadId, j+= numThreads
-        for (int32_t j = 0; j < rw; ++j) {
-            aj = a + j;
-            for (k = 0; k < rh; ++k) {
-                bj[k] = aj[k*w];
+        /* vertical pass, in strips of OPJ_DWT_VCOLS columns so that
+           every row of a strip is read and written contiguously */
+        Scheduler::instance()->run(numThreads, [&mem, a, w, rw, rh, rh1, cas_col, numThreads, p_function_v, ops](size_t threadId) {
+            int32_t sn = rh1;
+            int32_t dn = rh - rh1;
+            int32_t* bj = mem[threadId];
+            for (int32_t j = (int32_t)threadId * OPJ_DWT_VCOLS; j < rw; j += (int32_t)numThreads * OPJ_DWT_VCOLS) {
+                int32_t* aj = a + j;
+                size_t nc = (size_t)opj_int_min(rw - j, OPJ_DWT_VCOLS);
+                for (int32_t k = 0; k < rh; ++k) {
+                    memcpy(bj + k * OPJ_DWT_VCOLS, aj + k * w, nc * sizeof(int32_t));
+                    if (nc < OPJ_DWT_VCOLS)
+                        memset(bj + k * OPJ_DWT_VCOLS + nc, 0, (OPJ_DWT_VCOLS - nc) * sizeof(int32_t));
+                }
+
+                (*p_function_v) (ops, bj, dn, sn, cas_col);
+
+                for (int32_t k = 0; k < sn; ++k)
+                    memcpy(aj + k * w, bj + (2 * k + cas_col) * OPJ_DWT_VCOLS, nc * sizeof(int32_t));
+                for (int32_t k = 0; k < dn; ++k)
+                    memcpy(aj + (sn + k) * w, bj + (2 * k + 1 - cas_col) * OPJ_DWT_VCOLS, nc * sizeof(int32_t));
             }
-
-            (*p_function) (bj, dn, sn, cas_col);
-
-            opj_dwt_deinterleave_v(bj, aj, dn, sn, w, cas_col);
-        }
-
-		// barrier
-
-        sn = rw1;
-        dn = rw - rw1;
-
-        for (int32_t j = 0; j < rh; j++) {
-            aj = a + j * w;
-            for (k = 0; k < rw; k++)  bj[k] = aj[k];
-            (*p_function) (bj, dn, sn, cas_row);
-            opj_dwt_deinterleave_h(bj, aj, dn, sn, cas_row);
-        }
-
-		// barrier
+        });
+
+        Scheduler::instance()->run(numThreads, [&mem, a, w, rw, rh, rw1, cas_row, numThreads, p_function, ops](size_t threadId) {
+            int32_t sn = rw1;
+            int32_t dn = rw - rw1;
+            int32_t* bj = mem[threadId];
+            for (int32_t j = (int32_t)threadId; j < rh; j += (int32_t)numThreads) {
+                int32_t* aj = a + j * w;
+                for (int32_t k = 0; k < rw; k++)  bj[k] = aj[k];
+                (*p_function) (bj, dn, sn, cas_row);
+                opj_dwt_deinterleave_h(bj, aj, dn, sn, cas_row);
+            }
+        });
 
         l_cur_res = l_last_res;
         --l_last_res;
     }
 
-    opj_free(bj);
-    return true;
+    for (auto m : mem)
+        opj_aligned_free(m);
+    return rc;
 }
 
 /* Forward 5-3 wavelet transform in 2-D. */
 /* </summary>                           */
-bool opj_dwt_encode(opj_tcd_tilecomp_t * tilec)
+bool opj_dwt_encode(opj_tcd_tilecomp_t * tilec,
+					uint32_t numThreads)
 {
-    return opj_dwt_encode_procedure(tilec,opj_dwt_encode_1);
+    return opj_dwt_encode_procedure(tilec,opj_dwt_encode_1,opj_dwt_encode_v,numThreads);
 }
 
 /* <summary>                            */
@@ -514,8 +911,8 @@ bool opj_dwt_decode(opj_tcd_tilecomp_t* tilec,
 					uint32_t numres,
 					uint32_t numThreads)
 {
-  //  if (opj_tile_buf_is_decode_region(tilec->buf))
- //       return opj_dwt_region_decode53(tilec, numres);
+    if (opj_tile_buf_is_decode_region(tilec->buf))
+        return opj_dwt_region_decode53(tilec, numres, numThreads);
     return opj_dwt_decode_tile(tilec, numres, &opj_dwt_decode_1,numThreads);
 }
 
@@ -543,9 +940,10 @@ double opj_dwt_getnorm(uint32_t level, uint32_t orient)
 /* <summary>                             */
 /* Forward 9-7 wavelet transform in 2-D. */
 /* </summary>                            */
-bool opj_dwt_encode_real(opj_tcd_tilecomp_t * tilec)
+bool opj_dwt_encode_real(opj_tcd_tilecomp_t * tilec,
+						uint32_t numThreads)
 {
-    return opj_dwt_encode_procedure(tilec,opj_dwt_encode_1_real);
+    return opj_dwt_encode_procedure(tilec,opj_dwt_encode_1_real,opj_dwt_encode_v_real,numThreads);
 }
 
 /* <summary>                          */
@@ -615,88 +1013,68 @@ static bool opj_dwt_decode_tile(opj_tcd_tilecomp_t* tilec,
 	if (numres == 1U) {
 		return true;
 	}
-	int rc = 0;
 	auto tileBuf = (int32_t*)opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
-	Barrier decode_dwt_barrier(numThreads);
-	Barrier decode_dwt_calling_barrier(numThreads + 1);
-
-	for (auto threadId = 0U; threadId < numThreads; threadId++) {
-		dwtWorkers.push_back(std::thread([tilec,
-											numres,
-											&rc, 
-											dwt_1D,
-											tileBuf,
-											&decode_dwt_barrier,
-											&decode_dwt_calling_barrier,
-											threadId,
-											numThreads]()
-		{
-			auto numResolutions = numres;
-			opj_dwt_t h;
-			opj_dwt_t v;
-
-			opj_tcd_resolution_t* tr = tilec->resolutions;
-
-			uint32_t rw = (tr->x1 - tr->x0);	/* width of the resolution level computed */
-			uint32_t rh = (tr->y1 - tr->y0);	/* height of the resolution level computed */
-
-			uint32_t w = (tilec->x1 - tilec->x0);
-			h.mem = (int32_t*)opj_aligned_malloc(opj_dwt_max_resolution(tr, numResolutions) * sizeof(int32_t));
-			if (!h.mem) {
-				rc++;
-				goto cleanup;
-			}
-
-			v.mem = h.mem;
-
-			while (--numResolutions) {
-				int32_t * restrict tiledp = tileBuf;
-
-				++tr;
-				h.sn = (int32_t)rw;
-				v.sn = (int32_t)rh;
-
-				rw = (tr->x1 - tr->x0);
-				rh = (tr->y1 - tr->y0);
-
-				h.dn = (int32_t)(rw - (uint32_t)h.sn);
-				h.cas = tr->x0 % 2;
-
-				for (uint32_t j = threadId; j < rh; j+= numThreads) {
-					opj_dwt_interleave_h(&h, &tiledp[j*w]);
-					(dwt_1D)(&h);
-					memcpy(&tiledp[j*w], h.mem, rw * sizeof(int32_t));
-				}
-
-				v.dn = (int32_t)(rh - (uint32_t)v.sn);
-				v.cas = tr->y0 % 2;
-
-				decode_dwt_barrier.arrive_and_wait();
+	opj_tcd_resolution_t* tr = tilec->resolutions;
+	uint32_t w = tilec->buf->data_width;
+	size_t bufSize = opj_dwt_max_resolution(tr, numres) * sizeof(int32_t);
+
+	/* one scratch line per task, reused across resolution levels */
+	std::vector<int32_t*> mem(numThreads, nullptr);
+	bool rc = true;
+	for (auto& m : mem) {
+		m = (int32_t*)opj_aligned_malloc(bufSize);
+		if (!m) {
+			rc = false;
+			break;
+		}
+	}
 
-				for (uint32_t j = threadId; j < rw; j+= numThreads) {
-							opj_dwt_interleave_v(&v, &tiledp[j], (int32_t)w);
-					(dwt_1D)(&v);
-					for (uint32_t k = 0; k < rh; ++k) {
-						tiledp[k * w + j] = v.mem[k];
-					}
+	uint32_t rw = (tr->x1 - tr->x0);	/* width of the resolution level computed */
+	uint32_t rh = (tr->y1 - tr->y0);	/* height of the resolution level computed */
+	while (rc && --numres) {
+		opj_dwt_t h;
+		opj_dwt_t v;
+
+		++tr;
+		h.sn = (int32_t)rw;
+		v.sn = (int32_t)rh;
+
+		rw = (tr->x1 - tr->x0);
+		rh = (tr->y1 - tr->y0);
+
+		h.dn = (int32_t)(rw - (uint32_t)h.sn);
+		h.cas = tr->x0 % 2;
+		v.dn = (int32_t)(rh - (uint32_t)v.sn);
+		v.cas = tr->y0 % 2;
+
+		Scheduler::instance()->run(numThreads, [&mem, h, tileBuf, w, rw, rh, numThreads, dwt_1D](size_t threadId) {
+			auto hl = h;
+			hl.mem = mem[threadId];
+			for (uint32_t j = (uint32_t)threadId; j < rh; j += numThreads) {
+				opj_dwt_interleave_h(&hl, &tileBuf[j*w]);
+				(dwt_1D)(&hl);
+				memcpy(&tileBuf[j*w], hl.mem, rw * sizeof(int32_t));
+			}
+		});
+
+		Scheduler::instance()->run(numThreads, [&mem, v, tileBuf, w, rw, rh, numThreads, dwt_1D](size_t threadId) {
+			auto vl = v;
+			vl.mem = mem[threadId];
+			for (uint32_t j = (uint32_t)threadId; j < rw; j += numThreads) {
+				opj_dwt_interleave_v(&vl, &tileBuf[j], (int32_t)w);
+				(dwt_1D)(&vl);
+				for (uint32_t k = 0; k < rh; ++k) {
+					tileBuf[k * w + j] = vl.mem[k];
 				}
-				decode_dwt_barrier.arrive_and_wait();
 			}
-cleanup:
-			if (h.mem)
-				opj_aligned_free(h.mem);
-			decode_dwt_calling_barrier.arrive_and_wait();
-
-		}));
+		});
 	}
-	decode_dwt_calling_barrier.arrive_and_wait();
 
-	for (auto& t : dwtWorkers) {
-		t.join();
+	for (auto m : mem) {
+		if (m)
+			opj_aligned_free(m);
 	}
-	dwtWorkers.clear();
-
-    return rc == 0 ? true : false;
+	return rc;
 }
 
 
@@ -920,141 +1298,123 @@ static void opj_v4dwt_decode(opj_v4dwt_t* restrict dwt)
 /* <summary>                             */
 /* Inverse 9-7 wavelet transform in 2-D. */
 /* </summary>                            */
-bool opj_dwt_decode_real(opj_tcd_tilecomp_t* restrict tilec, 
+bool opj_dwt_decode_real(opj_tcd_tilecomp_t* restrict tilec,
 						uint32_t numres,
 						uint32_t numThreads)
 {
-	int rc = 0;
+	if (numres == 1U) {
+		return true;
+	}
 	auto tileBuf = (float*)opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
-	Barrier decode_dwt_barrier(numThreads);
-	Barrier decode_dwt_calling_barrier(numThreads + 1);
-
-	for (auto threadId = 0U; threadId < numThreads; threadId++) {
-		dwtWorkers.push_back(std::thread([ tilec,
-											numres,
-											&rc,
-											tileBuf,
-											&decode_dwt_barrier,
-											&decode_dwt_calling_barrier,
-											threadId,
-											numThreads]()
-		{
-			auto numResolutions = numres;
-			opj_v4dwt_t h;
-			opj_v4dwt_t v;
-
-			opj_tcd_resolution_t* res = tilec->resolutions;
-
-			uint32_t rw = (res->x1 - res->x0);	/* width of the resolution level computed */
-			uint32_t rh = (res->y1 - res->y0);	/* height of the resolution level computed */
-
-			uint32_t w = (tilec->x1 - tilec->x0);
-
-			//  if (opj_tile_buf_is_decode_region(tilec->buf))
-			//      return opj_dwt_region_decode97(tilec, numres);
-
-			h.wavelet = (opj_v4_t*)opj_aligned_malloc((opj_dwt_max_resolution(res, numResolutions) + 5) * sizeof(opj_v4_t));
-			if (!h.wavelet) {
-				/* FIXME event manager error callback */
-				rc++;
-				goto cleanup;
-			}
-			v.wavelet = h.wavelet;
-
-			
-			while (--numResolutions) {
-				float * restrict aj = tileBuf + ((w << 2) * threadId);
-				uint64_t bufsize = (uint64_t)(tilec->x1 - tilec->x0) * (tilec->y1 - tilec->y0) - (threadId * (w << 2));
-
-				h.sn = (int32_t)rw;
-				v.sn = (int32_t)rh;
-
-				++res;
-
-				rw = (res->x1 - res->x0);	// width of the resolution level computed 
-				rh = (res->y1 - res->y0);	// height of the resolution level computed 
-
-				h.dn = (int32_t)(rw - (uint32_t)h.sn);
-				h.cas = res->x0 & 1;
-				int32_t j;
-				for (j = (int32_t)rh - (threadId<<2); j > 3; j -= (numThreads <<2)) {
-					opj_v4dwt_interleave_h(&h, aj, (int32_t)w, (int32_t)bufsize);
-					opj_v4dwt_decode(&h);
-					
-					for (int32_t k = (int32_t)rw; k-- > 0;) {
-						aj[(uint32_t)k] = h.wavelet[k].f[0];
-						aj[(uint32_t)k + w] = h.wavelet[k].f[1];
-						aj[(uint32_t)k + (w << 1)] = h.wavelet[k].f[2];
-						aj[(uint32_t)k + w * 3] = h.wavelet[k].f[3];
-					}
-					
-					aj += (w << 2) * numThreads;
-					bufsize -= (w << 2) * numThreads;
-				}
-				decode_dwt_barrier.arrive_and_wait();
-				
-				if (j > 0 && (rh & 0x03)) {
-					int32_t jCleanup = rh & 0x03;
-					opj_v4dwt_interleave_h(&h, aj, (int32_t)w, (int32_t)bufsize);
-					opj_v4dwt_decode(&h);
-					for (int32_t k = (int32_t)rw; k-- > 0;) {
-						switch (jCleanup) {
-						case 3:
-							aj[k + (int32_t)(w << 1)] = h.wavelet[k].f[2];
-						case 2:
-							aj[k + (int32_t)w] = h.wavelet[k].f[1];
-						case 1:
-							aj[k] = h.wavelet[k].f[0];
-						}
-					}
-				}
-				
-				decode_dwt_barrier.arrive_and_wait();
-				
-				v.dn = (int32_t)(rh - (uint32_t)v.sn);
-				v.cas = res->y0 & 1;
-				
-				decode_dwt_barrier.arrive_and_wait();
-				
-				aj = tileBuf + (threadId << 2);
-				for (j = (int32_t)rw - (threadId<<2); j > 3; j -= (numThreads <<2)) {
-					opj_v4dwt_interleave_v(&v, aj, (int32_t)w, 4);
-					opj_v4dwt_decode(&v);
-
-					for (uint32_t k = 0; k < rh; ++k) {
-						memcpy(&aj[k*w], &v.wavelet[k], 4 * sizeof(float));
-					}
-					aj += (numThreads <<2);
+	opj_tcd_resolution_t* res = tilec->resolutions;
+	uint32_t w = tilec->buf->data_width;
+	uint64_t tileSize = (uint64_t)w * tilec->buf->data_height;
+	size_t bufSize = (opj_dwt_max_resolution(res, numres) + 5) * sizeof(opj_v4_t);
+
+	if (opj_tile_buf_is_decode_region(tilec->buf))
+		return opj_dwt_region_decode97(tilec, numres, numThreads);
+
+	/* one scratch buffer per task, reused across resolution levels */
+	std::vector<opj_v4_t*> wavelets(numThreads, nullptr);
+	bool rc = true;
+	for (auto& wavelet : wavelets) {
+		wavelet = (opj_v4_t*)opj_aligned_malloc(bufSize);
+		if (!wavelet) {
+			rc = false;
+			break;
+		}
+	}
+
+	uint32_t rw = (res->x1 - res->x0);	/* width of the resolution level computed */
+	uint32_t rh = (res->y1 - res->y0);	/* height of the resolution level computed */
+	while (rc && --numres) {
+		opj_v4dwt_t h;
+		opj_v4dwt_t v;
+
+		h.sn = (int32_t)rw;
+		v.sn = (int32_t)rh;
+
+		++res;
+
+		rw = (res->x1 - res->x0);	// width of the resolution level computed
+		rh = (res->y1 - res->y0);	// height of the resolution level computed
+
+		h.dn = (int32_t)(rw - (uint32_t)h.sn);
+		h.cas = res->x0 & 1;
+		v.dn = (int32_t)(rh - (uint32_t)v.sn);
+		v.cas = res->y0 & 1;
+
+		/* horizontal pass, in strips of four rows */
+		Scheduler::instance()->run(numThreads, [&wavelets, h, tileBuf, tileSize, w, rw, rh, numThreads](size_t threadId) {
+			auto hl = h;
+			hl.wavelet = wavelets[threadId];
+			float * restrict aj = tileBuf + ((w << 2) * threadId);
+			uint64_t bufsize = tileSize - (threadId * (w << 2));
+			int32_t j;
+			for (j = (int32_t)rh - (int32_t)(threadId<<2); j > 3; j -= (int32_t)(numThreads <<2)) {
+				opj_v4dwt_interleave_h(&hl, aj, (int32_t)w, (int32_t)bufsize);
+				opj_v4dwt_decode(&hl);
+
+				for (int32_t k = (int32_t)rw; k-- > 0;) {
+					aj[(uint32_t)k] = hl.wavelet[k].f[0];
+					aj[(uint32_t)k + w] = hl.wavelet[k].f[1];
+					aj[(uint32_t)k + (w << 1)] = hl.wavelet[k].f[2];
+					aj[(uint32_t)k + w * 3] = hl.wavelet[k].f[3];
 				}
-				
-				if (j > 0 && (rw & 0x03)) {
-					int32_t jCleanup = rw & 0x03;
 
-					opj_v4dwt_interleave_v(&v, aj, (int32_t)w, jCleanup);
-					opj_v4dwt_decode(&v);
+				aj += (w << 2) * numThreads;
+				bufsize -= (w << 2) * numThreads;
+			}
 
-					for (uint32_t k = 0; k < rh; ++k) {
-						memcpy(&aj[k*w], &v.wavelet[k], (size_t)jCleanup * sizeof(float));
+			if (j > 0 && (rh & 0x03)) {
+				int32_t jCleanup = rh & 0x03;
+				opj_v4dwt_interleave_h(&hl, aj, (int32_t)w, (int32_t)bufsize);
+				opj_v4dwt_decode(&hl);
+				for (int32_t k = (int32_t)rw; k-- > 0;) {
+					switch (jCleanup) {
+					case 3:
+						aj[k + (int32_t)(w << 1)] = hl.wavelet[k].f[2];
+					case 2:
+						aj[k + (int32_t)w] = hl.wavelet[k].f[1];
+					case 1:
+						aj[k] = hl.wavelet[k].f[0];
 					}
 				}
-				
-				decode_dwt_barrier.arrive_and_wait();
+			}
+		});
+
+		/* vertical pass, in strips of four columns */
+		Scheduler::instance()->run(numThreads, [&wavelets, v, tileBuf, w, rw, rh, numThreads](size_t threadId) {
+			auto vl = v;
+			vl.wavelet = wavelets[threadId];
+			float * restrict aj = tileBuf + (threadId << 2);
+			int32_t j;
+			for (j = (int32_t)rw - (int32_t)(threadId<<2); j > 3; j -= (int32_t)(numThreads <<2)) {
+				opj_v4dwt_interleave_v(&vl, aj, (int32_t)w, 4);
+				opj_v4dwt_decode(&vl);
+
+				for (uint32_t k = 0; k < rh; ++k) {
+					memcpy(&aj[k*w], &vl.wavelet[k], 4 * sizeof(float));
+				}
+				aj += (numThreads <<2);
 			}
 
-		cleanup:
-			if (h.wavelet)
-				opj_aligned_free(h.wavelet);
-			decode_dwt_calling_barrier.arrive_and_wait();
-
-		}));
-	}
+			if (j > 0 && (rw & 0x03)) {
+				int32_t jCleanup = rw & 0x03;
 
-	decode_dwt_calling_barrier.arrive_and_wait();
+				opj_v4dwt_interleave_v(&vl, aj, (int32_t)w, jCleanup);
+				opj_v4dwt_decode(&vl);
 
-	for (auto& t : dwtWorkers) {
-		t.join();
+				for (uint32_t k = 0; k < rh; ++k) {
+					memcpy(&aj[k*w], &vl.wavelet[k], (size_t)jCleanup * sizeof(float));
+				}
+			}
+		});
 	}
-	dwtWorkers.clear();
 
-    return rc == 0 ? true : false;
+	for (auto wavelet : wavelets) {
+		if (wavelet)
+			opj_aligned_free(wavelet);
+	}
+	return rc;
 }
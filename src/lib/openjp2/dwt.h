@@ -76,8 +76,10 @@ DWT.C are used by some function in TCD.C.
 Forward 5-3 wavelet transform in 2-D.
 Apply a reversible DWT transform to a component of an image.
 @param tilec Tile component information (current tile)
+@param numThreads Number of tasks that rows and columns are split across
 */
-bool opj_dwt_encode(opj_tcd_tilecomp_t * tilec);
+bool opj_dwt_encode(opj_tcd_tilecomp_t * tilec,
+					uint32_t numThreads);
 
 /**
 Inverse 5-3 wavelet transform in 2-D.
@@ -106,8 +108,10 @@ double opj_dwt_getnorm(uint32_t level, uint32_t orient);
 Forward 9-7 wavelet transform in 2-D.
 Apply an irreversible DWT transform to a component of an image.
 @param tilec Tile component information (current tile)
+@param numThreads Number of tasks that rows and columns are split across
 */
-bool opj_dwt_encode_real(opj_tcd_tilecomp_t * tilec);
+bool opj_dwt_encode_real(opj_tcd_tilecomp_t * tilec,
+						uint32_t numThreads);
 /**
 Inverse 9-7 wavelet transform in 2-D.
 Apply an irreversible inverse DWT transform to a component of an image.
@@ -138,6 +142,11 @@ Explicit calculation of the Quantization Stepsizes
 */
 void opj_dwt_calc_explicit_stepsizes(opj_tccp_t * tccp, uint32_t prec);
 
+/**
+Bind the widest DWT kernels the CPU supports (see cpu_features.h)
+*/
+void opj_dwt_init_kernels(void);
+
 /* <summary>                             */
 /* Determine maximum computed resolution level for inverse wavelet transform */
 /* </summary>
@@ -56,6 +56,7 @@
 
 
 #include "opj_includes.h"
+#include "Scheduler.h"
 
 /*
 
@@ -172,7 +173,7 @@ static void opj_region_decode97(opj_dwt97_t* restrict dwt);
 static void opj_region_interleave97_h(opj_dwt97_t* restrict w,
                                       float* restrict tile_data,
                                       int32_t stride,
-                                      int32_t size);
+                                      int32_t rows);
 
 static void opj_region_interleave97_v(opj_dwt97_t* restrict buffer_v ,
                                       float* restrict tile_data ,
@@ -190,6 +191,14 @@ static void opj_region_decode97_lift(opj_coeff97_t* l,
                                      int32_t max,
                                      float scale);
 
+/**
+Offset of the first buffer location, leaving room for the lifting steps
+to read one sample either side of the sub-band ranges
+*/
+static int32_t opj_dwt_region_interleaved_offset(opj_pt_t range_even,
+        opj_pt_t range_odd,
+        int32_t odd_top_left_bit);
+
 
 
 /*@}*/
@@ -204,6 +213,15 @@ static void opj_region_decode97_lift(opj_coeff97_t* l,
 ==========================================================
 */
 
+static int32_t opj_dwt_region_interleaved_offset(opj_pt_t range_even,
+        opj_pt_t range_odd,
+        int32_t odd_top_left_bit)
+{
+    int32_t start = opj_int_min((range_even.x << 1) + odd_top_left_bit,
+                                (range_odd.x << 1) + (odd_top_left_bit ^ 1));
+    return opj_int_max(0, start - 2);
+}
+
 /***************************************************************************************
 
 5/3 Synthesis Wavelet Transform
@@ -310,96 +328,113 @@ static void opj_dwt_region_decode53_1d(opj_dwt53_t *buffer)
 /* <summary>                            */
 /* Inverse 5-3 data transform in 2-D. */
 /* </summary>                           */
-bool opj_dwt_region_decode53(opj_tcd_tilecomp_t* tilec, uint32_t numres)
+bool opj_dwt_region_decode53(opj_tcd_tilecomp_t* tilec,
+                             uint32_t numres,
+                             uint32_t numThreads)
 {
-    opj_dwt53_t buffer_h;
-    opj_dwt53_t buffer_v;
-
     opj_tcd_resolution_t* tr = tilec->resolutions;
 
     uint32_t res_width = (tr->x1 - tr->x0);	/* width of the resolution level computed */
     uint32_t res_height = (tr->y1 - tr->y0);	/* height of the resolution level computed */
 
-    uint32_t w = (tilec->x1 - tilec->x0);
+    uint32_t w = tilec->buf->data_width;
+    int32_t * restrict tiledp = opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
+    size_t bufSize = ((size_t)opj_tile_buf_get_max_interleaved_range(tilec->buf) + 4) * sizeof(int32_t);
 
     int32_t resno = 1;
 
     if (numres == 1U) {
         return true;
     }
-    buffer_h.data =
-        (int32_t*)opj_aligned_malloc((opj_tile_buf_get_max_interleaved_range(tilec->buf)+2) * sizeof(int32_t));
-    if (!buffer_h.data) {
-        /* FIXME event manager error callback */
-        return false;
+    if (numThreads < 1)
+        numThreads = 1;
+
+    /* one buffer per task, shared between horizontal and vertical lifting steps.
+       Lifting reads past the ends of the sub-band ranges, so keep those locations initialized */
+    std::vector<int32_t*> buffers(numThreads, nullptr);
+    bool rc = true;
+    for (auto& buffer : buffers) {
+        buffer = (int32_t*)opj_aligned_malloc(bufSize);
+        if (!buffer) {
+            rc = false;
+            break;
+        }
+        memset(buffer, 0, bufSize);
     }
 
-    buffer_v.data = buffer_h.data;
-
-    while (--numres) {
-        int32_t * restrict tiledp = opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
-        int32_t j;
+    while (rc && --numres) {
+        opj_dwt53_t buffer_h;
+        opj_dwt53_t buffer_v;
         opj_pt_t interleaved_h, interleaved_v;
+        uint32_t num_rows_even, num_rows;
 
         /* start with the first resolution, and work upwards*/
-        buffer_h.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, true, true);
-        buffer_h.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, false, true);
-        buffer_v.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, true, false);
-        buffer_v.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, resno, false, false);
-
-        interleaved_h = opj_tile_buf_get_interleaved_range(tilec->buf, resno, true);
-        interleaved_v = opj_tile_buf_get_interleaved_range(tilec->buf, resno, false);
+        buffer_h.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, (uint32_t)resno, true, true);
+        buffer_h.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, (uint32_t)resno, false, true);
+        buffer_v.range_even = opj_tile_buf_get_uninterleaved_range(tilec->buf, (uint32_t)resno, true, false);
+        buffer_v.range_odd = opj_tile_buf_get_uninterleaved_range(tilec->buf, (uint32_t)resno, false, false);
 
+        interleaved_h = opj_tile_buf_get_interleaved_range(tilec->buf, (uint32_t)resno, true);
+        interleaved_v = opj_tile_buf_get_interleaved_range(tilec->buf, (uint32_t)resno, false);
 
         buffer_h.s_n = (int32_t)res_width;
         buffer_v.s_n = (int32_t)res_height;
-        buffer_v.interleaved_offset = opj_int_max(0,interleaved_v.x-2);
 
         ++tr;
         res_width = (tr->x1 - tr->x0);
         res_height = (tr->y1 - tr->y0);
 
-        buffer_h.d_n = (int32_t)(res_width - buffer_h.s_n);
+        buffer_h.d_n = (int32_t)(res_width - (uint32_t)buffer_h.s_n);
         buffer_h.odd_top_left_bit = tr->x0 &1;
-        buffer_h.interleaved_offset = opj_int_max(0, interleaved_h.x - 2);
-
-        /* first do horizontal interleave */
-        tiledp += buffer_v.range_even.x * w;
-        for (j = buffer_v.range_even.x; j < buffer_v.range_even.y; ++j) {
-            opj_dwt_region_interleave53_h(&buffer_h, tiledp);
-            opj_dwt_region_decode53_1d(&buffer_h);
-            memcpy(tiledp + interleaved_h.x, buffer_h.data + interleaved_h.x - buffer_h.interleaved_offset, (interleaved_h.y - interleaved_h.x) * sizeof(int32_t));
-            tiledp += w;
-        }
-
-        tiledp += (buffer_v.s_n - buffer_v.range_even.y + buffer_v.range_odd.x)*w;
-        for (j = buffer_v.range_odd.x; j <  buffer_v.range_odd.y; ++j) {
-            opj_dwt_region_interleave53_h(&buffer_h, tiledp);
-            opj_dwt_region_decode53_1d(&buffer_h);
-            memcpy(tiledp + interleaved_h.x, buffer_h.data + interleaved_h.x - buffer_h.interleaved_offset, (interleaved_h.y - interleaved_h.x) * sizeof(int32_t));
-            tiledp += w;
-        }
-
-        buffer_v.d_n = (int32_t)(res_height - buffer_v.s_n);
+        buffer_h.interleaved_offset = opj_dwt_region_interleaved_offset(buffer_h.range_even,
+                                      buffer_h.range_odd,
+                                      buffer_h.odd_top_left_bit);
+        buffer_v.d_n = (int32_t)(res_height - (uint32_t)buffer_v.s_n);
         buffer_v.odd_top_left_bit = tr->y0 &1;
+        buffer_v.interleaved_offset = opj_dwt_region_interleaved_offset(buffer_v.range_even,
+                                      buffer_v.range_odd,
+                                      buffer_v.odd_top_left_bit);
+
+        /* first do horizontal interleave, on the rows holding vertically low pass
+           and then vertically high pass samples */
+        num_rows_even = (uint32_t)(buffer_v.range_even.y - buffer_v.range_even.x);
+        num_rows = num_rows_even + (uint32_t)(buffer_v.range_odd.y - buffer_v.range_odd.x);
+        Scheduler::instance()->run(numThreads, [&buffers, buffer_h, buffer_v, tiledp, w, interleaved_h, num_rows_even, num_rows, numThreads](size_t threadId) {
+            auto bh = buffer_h;
+            bh.data = buffers[threadId];
+            for (uint32_t j = (uint32_t)threadId; j < num_rows; j += numThreads) {
+                int32_t row = (j < num_rows_even) ? buffer_v.range_even.x + (int32_t)j :
+                              buffer_v.s_n + buffer_v.range_odd.x + (int32_t)(j - num_rows_even);
+                int32_t * restrict row_ptr = tiledp + (uint64_t)row * w;
+                opj_dwt_region_interleave53_h(&bh, row_ptr);
+                opj_dwt_region_decode53_1d(&bh);
+                memcpy(row_ptr + interleaved_h.x,
+                       bh.data + interleaved_h.x - bh.interleaved_offset,
+                       (size_t)(interleaved_h.y - interleaved_h.x) * sizeof(int32_t));
+            }
+        });
 
         /* next do vertical interleave */
-        tiledp = opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0) + interleaved_h.x;
-        for (j = interleaved_h.x; j < interleaved_h.y; ++j) {
-            int32_t k;
-            int32_t * restrict tiledp_v = tiledp + (interleaved_v.x)*w;
-            opj_dwt_region_interleave53_v(&buffer_v, tiledp, (int32_t)w);
-            opj_dwt_region_decode53_1d(&buffer_v);
-            for (k = interleaved_v.x; k < interleaved_v.y; ++k) {
-                *tiledp_v = buffer_v.data[k - buffer_v.interleaved_offset];
-                tiledp_v += w;
+        Scheduler::instance()->run(numThreads, [&buffers, buffer_v, tiledp, w, interleaved_h, interleaved_v, numThreads](size_t threadId) {
+            auto bv = buffer_v;
+            bv.data = buffers[threadId];
+            for (int32_t j = interleaved_h.x + (int32_t)threadId; j < interleaved_h.y; j += (int32_t)numThreads) {
+                int32_t * restrict col_ptr = tiledp + j;
+                opj_dwt_region_interleave53_v(&bv, col_ptr, (int32_t)w);
+                opj_dwt_region_decode53_1d(&bv);
+                for (int32_t k = interleaved_v.x; k < interleaved_v.y; ++k) {
+                    col_ptr[(uint64_t)k * w] = bv.data[k - bv.interleaved_offset];
+                }
             }
-            tiledp++;
-        }
+        });
         resno++;
     }
-    opj_aligned_free(buffer_h.data);
-    return true;
+
+    for (auto buffer : buffers) {
+        if (buffer)
+            opj_aligned_free(buffer);
+    }
+    return rc;
 }
 
 /***************************************************************************************
@@ -410,7 +445,7 @@ bool opj_dwt_region_decode53(opj_tcd_tilecomp_t* tilec, uint32_t numres)
 static void opj_region_interleave97_h(opj_dwt97_t* restrict buffer,
                                       float* restrict tile_data,
                                       int32_t stride,
-                                      int32_t size)
+                                      int32_t rows)
 {
 
     float* restrict buffer_data_ptr = (float*) (buffer->data - buffer->interleaved_offset + buffer->odd_top_left_bit);
@@ -419,7 +454,7 @@ static void opj_region_interleave97_h(opj_dwt97_t* restrict buffer,
     int32_t i, k;
 
     for (k = 0; k < 2; ++k) {
-        if (count_low + 3 * stride < size) {
+        if (rows == 4) {
             /* Fast code path */
             for (i = count_low; i < count_high; ++i) {
                 int32_t j = i;
@@ -435,32 +470,19 @@ static void opj_region_interleave97_h(opj_dwt97_t* restrict buffer,
                 buffer_data_ptr[(i << 3) + 3] = tile_data[j];
             }
         } else {
-            /* Slow code path */
+            /* Slow code path: fewer than four rows remain */
             for (i = count_low; i < count_high; ++i) {
                 int32_t j = i;
-
-                buffer_data_ptr[i << 3] = tile_data[j];
-                j += stride;
-                if (j >= size)
-                    continue;
-
-                buffer_data_ptr[(i << 3) + 1] = tile_data[j];
-                j += stride;
-                if (j >= size)
-                    continue;
-
-                buffer_data_ptr[(i << 3) + 2] = tile_data[j];
-                j += stride;
-                if (j >= size)
-                    continue;
-
-                buffer_data_ptr[(i << 3) + 3] = tile_data[j];
+                int32_t r;
+                for (r = 0; r < rows; ++r) {
+                    buffer_data_ptr[(i << 3) + r] = tile_data[j];
+                    j += stride;
+                }
             }
         }
 
         buffer_data_ptr = (float*)(buffer->data - buffer->interleaved_offset + (buffer->odd_top_left_bit^1) );
         tile_data += buffer->s_n;
-        size -= buffer->s_n;
         count_low = buffer->range_odd.x;
         count_high = buffer->range_odd.y;
     }
@@ -530,6 +552,7 @@ static void opj_region_decode97_lift(opj_coeff97_t* l,
 
     assert(count_low <= count_high);
     assert(maximum <= count);
+    (void)count;
 
     if (count_low > 0) {
         fw += count_low << 3;
@@ -545,10 +568,13 @@ static void opj_region_decode97_lift(opj_coeff97_t* l,
         fw += 8;
     }
 
-    /* symmetric boundary extension */
-    if(maximum < count_high) {
+    /* symmetric boundary extension: samples past the maximum
+       only see the last sample of the other band */
+    if(i < count_high) {
+        if (count_low > maximum)
+            fl = (maximum > 0) ? (float*)w + ((maximum - 1) << 3) : (float*)l;
         scale += scale;
-        for(; maximum < count_high; ++maximum) {
+        for(; i < count_high; ++i) {
             fw[-4] += fl[0] * scale;
             fw[-3] += fl[1] * scale;
             fw[-2] += fl[2] * scale;
@@ -620,11 +646,10 @@ static void opj_region_decode97(opj_dwt97_t* restrict dwt)
 /* <summary>                             */
 /* Inverse 9-7 data transform in 2-D. */
 /* </summary>                            */
-bool opj_dwt_region_decode97(opj_tcd_tilecomp_t* restrict tilec, uint32_t numres)
+bool opj_dwt_region_decode97(opj_tcd_tilecomp_t* restrict tilec,
+                             uint32_t numres,
+                             uint32_t numThreads)
 {
-    opj_dwt97_t buffer_h;
-    opj_dwt97_t buffer_v;
-
     opj_tcd_resolution_t* res = tilec->resolutions;
 
     uint32_t resno = 1;
@@ -633,23 +658,34 @@ bool opj_dwt_region_decode97(opj_tcd_tilecomp_t* restrict tilec, uint32_t numres
     uint32_t res_width = (res->x1 - res->x0);	/* width of the resolution level computed */
     uint32_t res_height = (res->y1 - res->y0);	/* height of the resolution level computed */
 
-    uint32_t tile_width = (tilec->x1 - tilec->x0);
+    uint32_t tile_width = tilec->buf->data_width;
+    float * restrict tile_buf = (float*)opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
+    size_t bufSize = ((size_t)opj_tile_buf_get_max_interleaved_range(tilec->buf) + 4) * sizeof(opj_coeff97_t);
 
-    buffer_h.data =
-        (opj_coeff97_t*)opj_aligned_malloc((opj_tile_buf_get_max_interleaved_range(tilec->buf) + 4) * sizeof(opj_coeff97_t));
-
-    if (!buffer_h.data) {
-        /* FIXME event manager error callback */
-        return false;
+    if (numres == 1U) {
+        return true;
+    }
+    if (numThreads < 1)
+        numThreads = 1;
+
+    /* one buffer per task, shared between horizontal and vertical lifting steps.
+       Lifting reads past the ends of the sub-band ranges, so keep those locations initialized */
+    std::vector<opj_coeff97_t*> buffers(numThreads, nullptr);
+    bool rc = true;
+    for (auto& buffer : buffers) {
+        buffer = (opj_coeff97_t*)opj_aligned_malloc(bufSize);
+        if (!buffer) {
+            rc = false;
+            break;
+        }
+        memset(buffer, 0, bufSize);
     }
-    /* share data buffer between vertical and horizontal lifting steps*/
-    buffer_v.data = buffer_h.data;
 
-    while( --numres) {
-        float * restrict tile_data = (float*)opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0);
-        uint32_t bufsize = (tile_width * (tilec->y1 - tilec->y0));
-        int32_t j;
+    while(rc && --numres) {
+        opj_dwt97_t buffer_h;
+        opj_dwt97_t buffer_v;
         opj_pt_t interleaved_h, interleaved_v;
+        uint32_t num_groups_even, num_groups;
 
         /* start with the first resolution, and work upwards*/
 
@@ -670,151 +706,91 @@ bool opj_dwt_region_decode97(opj_tcd_tilecomp_t* restrict tilec, uint32_t numres
         res_width = (res->x1 - res->x0);	/* width of the resolution level computed */
         res_height = (res->y1 - res->y0);	/* height of the resolution level computed */
 
-        buffer_h.d_n = (int32_t)(res_width - buffer_h.s_n);
+        buffer_h.d_n = (int32_t)(res_width - (uint32_t)buffer_h.s_n);
         buffer_h.odd_top_left_bit = res->x0 &1;
-        buffer_h.interleaved_offset = opj_int_max(0, interleaved_h.x - 4);
-
-        /*  Step 1.  interleave and lift in horizontal direction */
-        tile_data += tile_width * buffer_v.range_even.x;
-        bufsize -= tile_width * buffer_v.range_even.x;
-
-        for(j = buffer_v.range_even.y - buffer_v.range_even.x; j > 3; j -= 4) {
-            int32_t k;
-            opj_region_interleave97_h(&buffer_h,
-                                      tile_data,
-                                      (int32_t)tile_width,
-                                      (int32_t)bufsize);
-
-            opj_region_decode97(&buffer_h);
-
-            for (k = interleaved_h.x; k < interleaved_h.y; ++k) {
-                int32_t buffer_index = k - buffer_h.interleaved_offset;
-                tile_data[k               ]					= buffer_h.data[buffer_index].f[0];
-                tile_data[k+(int32_t)tile_width]			= buffer_h.data[buffer_index].f[1];
-                tile_data[k+((int32_t)tile_width <<1)]	= buffer_h.data[buffer_index].f[2];
-                tile_data[k+(int32_t)tile_width *3]		= buffer_h.data[buffer_index].f[3];
-            }
-
-            tile_data	+= tile_width <<2;
-            bufsize		-= tile_width <<2;
-        }
-
-        if (j > 0) {
-            int32_t k;
-            opj_region_interleave97_h(&buffer_h,
-                                      tile_data,
-                                      (int32_t)tile_width,
-                                      (int32_t)bufsize);
-
-            opj_region_decode97(&buffer_h);
-            for (k = interleaved_h.x; k < interleaved_h.y; ++k) {
-                int32_t buffer_index = k - buffer_h.interleaved_offset;
-                switch(j) {
-                case 3:
-                    tile_data[k+((int32_t)tile_width <<1)] = buffer_h.data[buffer_index].f[2];
-                case 2:
-                    tile_data[k+(int32_t)tile_width]		= buffer_h.data[buffer_index].f[1];
-                case 1:
-                    tile_data[k]							= buffer_h.data[buffer_index].f[0];
+        buffer_h.interleaved_offset = opj_dwt_region_interleaved_offset(buffer_h.range_even,
+                                      buffer_h.range_odd,
+                                      buffer_h.odd_top_left_bit);
+        buffer_v.d_n = (int32_t)(res_height - (uint32_t)buffer_v.s_n);
+        buffer_v.odd_top_left_bit = res->y0 &1;
+        buffer_v.interleaved_offset = opj_dwt_region_interleaved_offset(buffer_v.range_even,
+                                      buffer_v.range_odd,
+                                      buffer_v.odd_top_left_bit);
+
+        /*  Step 1.  interleave and lift in horizontal direction, four rows at a time,
+            first on the rows holding vertically low pass and then vertically high pass samples */
+        num_groups_even = (uint32_t)(buffer_v.range_even.y - buffer_v.range_even.x + 3) >> 2;
+        num_groups = num_groups_even + ((uint32_t)(buffer_v.range_odd.y - buffer_v.range_odd.x + 3) >> 2);
+        Scheduler::instance()->run(numThreads, [&buffers, buffer_h, buffer_v, tile_buf, tile_width, interleaved_h, num_groups_even, num_groups, numThreads](size_t threadId) {
+            auto bh = buffer_h;
+            bh.data = buffers[threadId];
+            for (uint32_t g = (uint32_t)threadId; g < num_groups; g += numThreads) {
+                int32_t row, rows;
+                if (g < num_groups_even) {
+                    row = buffer_v.range_even.x + (int32_t)(g << 2);
+                    rows = opj_int_min(4, buffer_v.range_even.y - row);
+                } else {
+                    int32_t odd_row = buffer_v.range_odd.x + (int32_t)((g - num_groups_even) << 2);
+                    rows = opj_int_min(4, buffer_v.range_odd.y - odd_row);
+                    row = buffer_v.s_n + odd_row;
                 }
-            }
-
-            tile_data	+= tile_width * j;
-            bufsize		-= 	tile_width *j;
-        }
-
-        tile_data += tile_width *(buffer_v.s_n - buffer_v.range_even.y + buffer_v.range_odd.x);
-        bufsize -= tile_width *(buffer_v.s_n - buffer_v.range_even.y + buffer_v.range_odd.x);
-
-        for (j = buffer_v.range_odd.y - buffer_v.range_odd.x; j > 3; j -= 4) {
-            int32_t k;
-            opj_region_interleave97_h(&buffer_h,
-                                      tile_data,
-                                      (int32_t)tile_width,
-                                      (int32_t)bufsize);
-
-            opj_region_decode97(&buffer_h);
-
-            for (k = interleaved_h.x; k < interleaved_h.y; ++k) {
-                int32_t buffer_index = k - buffer_h.interleaved_offset;
-                tile_data[k] = buffer_h.data[buffer_index].f[0];
-                tile_data[k + (int32_t)tile_width] = buffer_h.data[buffer_index].f[1];
-                tile_data[k + ((int32_t)tile_width << 1)] = buffer_h.data[buffer_index].f[2];
-                tile_data[k + (int32_t)tile_width * 3] = buffer_h.data[buffer_index].f[3];
-            }
-
-            tile_data += tile_width << 2;
-            bufsize -= tile_width << 2;
-        }
-
-        if (j > 0) {
-            int32_t k;
-            opj_region_interleave97_h(&buffer_h,
-                                      tile_data,
-                                      (int32_t)tile_width,
-                                      (int32_t)bufsize);
-
-            opj_region_decode97(&buffer_h);
-            for (k = interleaved_h.x; k < interleaved_h.y; ++k) {
-                int32_t buffer_index = k - buffer_h.interleaved_offset;
-                switch (j) {
-                case 3:
-                    tile_data[k + ((int32_t)tile_width << 1)] = buffer_h.data[buffer_index].f[2];
-                case 2:
-                    tile_data[k + (int32_t)tile_width] = buffer_h.data[buffer_index].f[1];
-                case 1:
-                    tile_data[k] = buffer_h.data[buffer_index].f[0];
+                float * restrict tile_data = tile_buf + (uint64_t)row * tile_width;
+
+                opj_region_interleave97_h(&bh,
+                                          tile_data,
+                                          (int32_t)tile_width,
+                                          rows);
+
+                opj_region_decode97(&bh);
+
+                for (int32_t k = interleaved_h.x; k < interleaved_h.y; ++k) {
+                    int32_t buffer_index = k - bh.interleaved_offset;
+                    switch (rows) {
+                    case 4:
+                        tile_data[k + (int32_t)tile_width * 3] = bh.data[buffer_index].f[3];
+                    case 3:
+                        tile_data[k + ((int32_t)tile_width << 1)] = bh.data[buffer_index].f[2];
+                    case 2:
+                        tile_data[k + (int32_t)tile_width] = bh.data[buffer_index].f[1];
+                    case 1:
+                        tile_data[k] = bh.data[buffer_index].f[0];
+                    }
                 }
             }
-        }
-        /*****************************************************************************/
-
-        /* interleave and lift in vertical direction */
-
-        buffer_v.d_n = (int32_t)(res_height - buffer_v.s_n);
-        buffer_v.odd_top_left_bit = res->y0 &1;
-        buffer_v.interleaved_offset = opj_int_max(0, interleaved_v.x - 4);
-
-        tile_data = ((float*)opj_tile_buf_get_ptr(tilec->buf, 0, 0, 0, 0)) + interleaved_h.x;
-        for(j = interleaved_h.y - interleaved_h.x; j > 3; j -= 4) {
-            int32_t k;
-
-            opj_region_interleave97_v(&buffer_v,
-                                      tile_data,
-                                      (int32_t)tile_width,
-                                      4);
-
-            opj_region_decode97(&buffer_v);
+        });
 
-            for (k = interleaved_v.x; k < interleaved_v.y; ++k) {
-                memcpy(tile_data +k*tile_width,
-                       buffer_v.data+k - buffer_v.interleaved_offset,
-                       4 * sizeof(float));
-            }
-            tile_data += 4;
-        }
-
-
-        if (j > 0) {
-            int32_t k;
-            opj_region_interleave97_v(&buffer_v,
-                                      tile_data,
-                                      (int32_t)tile_width,
-                                      j);
-
-            opj_region_decode97(&buffer_v);
+        /*****************************************************************************/
 
-            for (k = interleaved_v.x; k < interleaved_v.y; ++k) {
-                memcpy(tile_data + k*tile_width,
-                       buffer_v.data+k - buffer_v.interleaved_offset,
-                       (size_t)j * sizeof(float));
+        /* interleave and lift in vertical direction, four columns at a time */
+        Scheduler::instance()->run(numThreads, [&buffers, buffer_v, tile_buf, tile_width, interleaved_h, interleaved_v, numThreads](size_t threadId) {
+            auto bv = buffer_v;
+            bv.data = buffers[threadId];
+            for (int32_t j = interleaved_h.x + (int32_t)(threadId << 2); j < interleaved_h.y; j += (int32_t)(numThreads << 2)) {
+                int32_t cols = opj_int_min(4, interleaved_h.y - j);
+                float * restrict tile_data = tile_buf + j;
+
+                opj_region_interleave97_v(&bv,
+                                          tile_data,
+                                          (int32_t)tile_width,
+                                          cols);
+
+                opj_region_decode97(&bv);
+
+                for (int32_t k = interleaved_v.x; k < interleaved_v.y; ++k) {
+                    memcpy(tile_data + (uint64_t)k * tile_width,
+                           bv.data + k - bv.interleaved_offset,
+                           (size_t)cols * sizeof(float));
+                }
             }
-        }
+        });
         /*****************************************************************************/
 
         resno++;
     }
 
-    opj_aligned_free(buffer_h.data);
-    return true;
+    for (auto buffer : buffers) {
+        if (buffer)
+            opj_aligned_free(buffer);
+    }
+    return rc;
 }
@@ -78,8 +78,11 @@ Inverse 5-3 wavelet transform in 2-D.
 Apply a reversible inverse DWT transform to a component of an image.
 @param tilec Tile component information (current tile)
 @param numres Number of resolution levels to decode
+@param numThreads Number of tasks to split rows and columns across
 */
-bool opj_dwt_region_decode53(opj_tcd_tilecomp_t* tilec, uint32_t numres);
+bool opj_dwt_region_decode53(opj_tcd_tilecomp_t* tilec,
+                             uint32_t numres,
+                             uint32_t numThreads);
 
 
 
@@ -88,8 +91,11 @@ Inverse 9-7 wavelet transform in 2-D.
 Apply an irreversible inverse DWT transform to a component of an image.
 @param tilec Tile component information (current tile)
 @param numres Number of resolution levels to decode
+@param numThreads Number of tasks to split rows and columns across
 */
-bool opj_dwt_region_decode97(opj_tcd_tilecomp_t* restrict tilec, uint32_t numres);
+bool opj_dwt_region_decode97(opj_tcd_tilecomp_t* restrict tilec,
+                             uint32_t numres,
+                             uint32_t numThreads);
 
 
 
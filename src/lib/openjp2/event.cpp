@@ -50,6 +50,7 @@
  */
 
 #include "opj_includes.h"
+#include <mutex>
 
 /* ==========================================================
      Utility functions
@@ -114,7 +115,10 @@ bool opj_event_msg(opj_event_mgr_t* p_event_mgr, int32_t event_type, const char
         /* deinitialize the optional parameter list */
         va_end(arg);
 
-        /* output the message to the user program */
+        /* output the message to the user program; tiles and code-blocks report from
+           several threads, and user callbacks are not expected to be reentrant */
+        static std::mutex l_mutex;
+        std::lock_guard<std::mutex> lk(l_mutex);
         msg_handler(message, l_data);
     }
 
@@ -0,0 +1,146 @@
+/*
+*    Copyright (C) 2016 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#include "opj_includes.h"
+#include "header_cache.h"
+#include <sys/stat.h>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+
+typedef std::shared_ptr<const opj_header_cache_entry_t> opj_header_cache_ptr_t;
+
+static std::mutex cache_mutex;
+static uint32_t cache_max_entries = 0;
+static std::unordered_map<std::string, opj_header_cache_ptr_t> cache_entries;
+/* keys in insertion order; the oldest entry is evicted first */
+static std::list<std::string> cache_order;
+
+static void opj_header_cache_insert(const std::string& key, opj_header_cache_ptr_t entry)
+{
+    auto it = cache_entries.find(key);
+    if (it != cache_entries.end()) {
+        it->second = entry;
+        return;
+    }
+    while (!cache_order.empty() && cache_entries.size() >= cache_max_entries) {
+        cache_entries.erase(cache_order.front());
+        cache_order.pop_front();
+    }
+    cache_entries[key] = entry;
+    cache_order.push_back(key);
+}
+
+void opj_header_cache_set_size(uint32_t max_entries)
+{
+    std::lock_guard<std::mutex> lk(cache_mutex);
+    cache_max_entries = max_entries;
+    while (!cache_order.empty() && cache_entries.size() > cache_max_entries) {
+        cache_entries.erase(cache_order.front());
+        cache_order.pop_front();
+    }
+}
+
+char* opj_header_cache_make_key(const char* fname)
+{
+    {
+        std::lock_guard<std::mutex> lk(cache_mutex);
+        if (!cache_max_entries)
+            return NULL;
+    }
+    struct stat st;
+    if (!fname || stat(fname, &st) != 0)
+        return NULL;
+
+    /* a file rewritten within the same second, or replaced by another file
+       of the same size, must not match the key of the previous one */
+#if defined(_WIN32)
+    long long l_mtime_nsec = 0;
+#elif defined(__APPLE__)
+    long long l_mtime_nsec = (long long)st.st_mtimespec.tv_nsec;
+#else
+    long long l_mtime_nsec = (long long)st.st_mtim.tv_nsec;
+#endif
+    std::string key = std::string(fname) + "\n" +
+                      std::to_string((unsigned long long)st.st_size) + "\n" +
+                      std::to_string((long long)st.st_mtime) + "." +
+                      std::to_string(l_mtime_nsec) + "\n" +
+                      std::to_string((unsigned long long)st.st_ino) + "\n" +
+                      std::to_string((unsigned long long)st.st_dev);
+    char* l_key = (char*)opj_malloc(key.size() + 1);
+    if (!l_key)
+        return NULL;
+    memcpy(l_key, key.c_str(), key.size() + 1);
+    return l_key;
+}
+
+std::shared_ptr<const opj_header_cache_entry_t> opj_header_cache_get(const char* key)
+{
+    std::lock_guard<std::mutex> lk(cache_mutex);
+    auto it = cache_entries.find(key);
+    if (it == cache_entries.end())
+        return opj_header_cache_ptr_t();
+    return it->second;
+}
+
+void opj_header_cache_put_header(const char* key, std::vector<uint8_t>&& header)
+{
+    auto entry = std::make_shared<opj_header_cache_entry_t>();
+    entry->header = std::move(header);
+
+    std::lock_guard<std::mutex> lk(cache_mutex);
+    if (!cache_max_entries)
+        return;
+    opj_header_cache_insert(key, entry);
+}
+
+void opj_header_cache_put_index(const char* key, const opj_codestream_index_t* index)
+{
+    if (!index || !index->tile_index)
+        return;
+
+    std::lock_guard<std::mutex> lk(cache_mutex);
+    auto it = cache_entries.find(key);
+    if (it == cache_entries.end())
+        return;
+
+    /* entries are shared with readers, so merge into a copy */
+    std::shared_ptr<opj_header_cache_entry_t> entry;
+    for (uint32_t i = 0; i < index->nb_of_tiles; ++i) {
+        const opj_tile_index_t* l_tile = index->tile_index + i;
+        if (!l_tile->nb_tps || !l_tile->tp_index)
+            continue;
+        if (it->second->tiles.size() == index->nb_of_tiles && !it->second->tiles[i].empty())
+            continue;
+        bool complete = true;
+        for (uint32_t j = 0; j < l_tile->nb_tps; ++j) {
+            if (l_tile->tp_index[j].end_pos <= l_tile->tp_index[j].start_pos) {
+                complete = false;
+                break;
+            }
+        }
+        if (!complete)
+            continue;
+        if (!entry) {
+            entry = std::make_shared<opj_header_cache_entry_t>(*it->second);
+            entry->tiles.resize(index->nb_of_tiles);
+        }
+        entry->tiles[i].assign(l_tile->tp_index, l_tile->tp_index + l_tile->nb_tps);
+    }
+    if (entry)
+        it->second = entry;
+}
@@ -0,0 +1,73 @@
+/*
+*    Copyright (C) 2016 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#include <vector>
+#include <memory>
+
+/*
+Process-wide cache of codestream headers, for decoders that open the same files
+over and over.
+
+A file is identified by its path, size and modification time. For each file the
+cache keeps the bytes from the start of the file to the end of the main header
+(JP2 boxes included), so that the header can be parsed again from memory, and
+the tile-part index discovered by earlier decodes, so that tiles can be reached
+with a single seek.
+
+The cache is disabled until opj_set_header_cache_size is called.
+*/
+
+/* tile-part positions of one tile; empty if not (fully) known */
+typedef std::vector<opj_tp_index_t> opj_header_cache_tile_t;
+
+typedef struct opj_header_cache_entry {
+    /* file contents up to and including the first SOT marker */
+    std::vector<uint8_t> header;
+    /* tile-part index, one element per tile, or empty */
+    std::vector<opj_header_cache_tile_t> tiles;
+} opj_header_cache_entry_t;
+
+/**
+Set the maximum number of files kept in the cache. Zero disables the cache
+and releases all entries.
+*/
+void opj_header_cache_set_size(uint32_t max_entries);
+
+/**
+Build the cache key of a file from its path, size, modification time, inode and device.
+@return key allocated with opj_malloc, or NULL if the cache is disabled or the file cannot be stat'ed
+*/
+char* opj_header_cache_make_key(const char* fname);
+
+/**
+Look up a file.
+@return the cached entry, or an empty pointer on a miss
+*/
+std::shared_ptr<const opj_header_cache_entry_t> opj_header_cache_get(const char* key);
+
+/**
+Store the header bytes of a file, replacing any previous entry.
+*/
+void opj_header_cache_put_header(const char* key, std::vector<uint8_t>&& header);
+
+/**
+Merge the tile-part index of a decoded file into its entry. Only tiles whose
+tile-parts are all known are kept; tiles already cached are left alone.
+*/
+void opj_header_cache_put_index(const char* key, const opj_codestream_index_t* index);
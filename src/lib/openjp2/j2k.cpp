@@ -59,6 +59,9 @@
  */
 
 #include "opj_includes.h"
+#include "Scheduler.h"
+#include "BlockingQueue.h"
+#include <system_error>
 
 /** @defgroup J2K J2K - JPEG-2000 codestream reader/writer */
 /*@{*/
@@ -78,6 +81,9 @@ opj_tcp_t::opj_tcp_t() : csty(0),
 						tccps(NULL),
 						m_nb_tile_parts(0),
 						m_data(NULL),
+						m_packet_lengths(NULL),
+						m_nb_packet_lengths(0),
+						m_max_packet_lengths(0),
 						mct_norms(NULL),
 						m_mct_decoding_matrix(NULL),
 						m_mct_coding_matrix(NULL),
@@ -435,6 +441,38 @@ static bool opj_j2k_decode_tiles (  opj_j2k_t *p_j2k,
                                     opj_stream_private_t *p_stream,
                                     opj_event_mgr_t * p_manager);
 
+/**
+ * Reads the tiles, decoding several tiles concurrently on decoder threads
+ * while the calling thread keeps parsing tile-part headers.
+ */
+static bool opj_j2k_decode_tiles_concurrent (  opj_j2k_t *p_j2k,
+        opj_stream_private_t *p_stream,
+        opj_event_mgr_t * p_manager);
+
+/**
+ * Reads tile-part headers and data until a complete tile is available.
+ *
+ * @param       p_j2k           the jpeg2000 codec.
+ * @param       p_go_on         set to false if there are no more tiles to read.
+ * @param       p_stream        the stream to read data from.
+ * @param       p_manager       the user event manager.
+*/
+static bool opj_j2k_read_tile_parts (   opj_j2k_t * p_j2k,
+                                        bool * p_go_on,
+                                        opj_stream_private_t *p_stream,
+                                        opj_event_mgr_t * p_manager );
+
+/**
+ * Resets the tile decoding state and reads the marker following the tile data.
+ *
+ * @param       p_j2k           the jpeg2000 codec.
+ * @param       p_stream        the stream to read data from.
+ * @param       p_manager       the user event manager.
+*/
+static bool opj_j2k_end_tile_data ( opj_j2k_t * p_j2k,
+                                    opj_stream_private_t *p_stream,
+                                    opj_event_mgr_t * p_manager );
+
 static bool opj_j2k_pre_write_tile ( opj_j2k_t * p_j2k,
                                      uint32_t p_tile_index,
                                      opj_stream_private_t *p_stream,
@@ -442,24 +480,37 @@ static bool opj_j2k_pre_write_tile ( opj_j2k_t * p_j2k,
 
 static bool opj_j2k_update_image_data (opj_tcd_t * p_tcd, uint8_t * p_data, opj_image_t* p_output_image);
 
-static void opj_get_tile_dimensions(opj_image_t * l_image,
-                                    opj_tcd_tilecomp_t * l_tilec,
-                                    opj_image_comp_t * l_img_comp,
-                                    uint32_t* l_size_comp,
-                                    uint32_t* l_width,
-                                    uint32_t* l_height,
-                                    uint32_t* l_offset_x,
-                                    uint32_t* l_offset_y,
-                                    uint32_t* l_image_width,
-                                    uint32_t* l_stride,
-                                    uint32_t* l_tile_offset);
+/**
+ * Copies the number of decoded resolutions of each component to the output image,
+ * for tiles that were written to a decode buffer rather than to the output image.
+ */
+static void opj_j2k_update_resno_decoded (opj_tcd_t * p_tcd, opj_image_t* p_output_image);
 
-static void opj_j2k_get_tile_data (opj_tcd_t * p_tcd, uint8_t * p_data);
+/**
+ * Fills the tile components of the tile initialised in p_tcd with image data.
+ *
+ * @param       p_tcd           the tile coder.
+ * @param       p_tile_index    index of the tile.
+ * @param       p_reuse_data    use the image component buffers directly (single tile only).
+ * @param       p_manager       the user event manager.
+*/
+static bool opj_j2k_load_tile_data (opj_tcd_t * p_tcd,
+                                    uint32_t p_tile_index,
+                                    bool p_reuse_data,
+                                    opj_event_mgr_t * p_manager);
 
 static bool opj_j2k_post_write_tile (opj_j2k_t * p_j2k,
                                      opj_stream_private_t *p_stream,
                                      opj_event_mgr_t * p_manager );
 
+/**
+ * Encodes the tiles, with several tiles precoded concurrently by their own
+ * tile coders while the calling thread writes finished tiles in tile order.
+ */
+static bool opj_j2k_encode_tiles_concurrent(opj_j2k_t * p_j2k,
+        opj_stream_private_t *p_stream,
+        opj_event_mgr_t * p_manager );
+
 /**
  * Sets up the procedures to do on writing header.
  * Developers wanting to extend the library can add their own writing procedures.
@@ -746,6 +797,11 @@ static void opj_j2k_write_poc_in_memory(opj_j2k_t *p_j2k,
                                         uint8_t * p_data,
                                         uint32_t * p_data_written,
                                         opj_event_mgr_t * p_manager );
+/**
+ * Gets the size of the POC marker written in the first tile part of a tile.
+ */
+static uint32_t opj_j2k_get_poc_size(opj_j2k_t *p_j2k, uint32_t p_tile_index);
+
 /**
  * Gets the maximum size taken by the writing of a POC.
  */
@@ -960,6 +1016,21 @@ static bool opj_j2k_write_sod(      opj_j2k_t *p_j2k,
                                     const opj_stream_private_t *p_stream,
                                     opj_event_mgr_t * p_manager );
 
+/**
+ * Gets the room left to the tile coder by opj_j2k_write_sod.
+ *
+ * @param       p_total_data_size   the size available from the SOD marker on.
+ */
+static uint32_t opj_j2k_get_sod_data_size(uint32_t p_total_data_size);
+
+/**
+ * Gets the size of the markers written before SOD in the first tile part of a tile.
+ *
+ * @param       p_j2k               J2K codec.
+ * @param       p_tile_index        the tile.
+ */
+static uint32_t opj_j2k_get_first_tile_part_header_size(opj_j2k_t *p_j2k, uint32_t p_tile_index);
+
 /**
  * Reads a SOD marker (Start Of Data)
  *
@@ -1074,6 +1145,42 @@ Add tile header marker information
  */
 static bool opj_j2k_add_tlmarker(uint32_t tileno, opj_codestream_index_t *cstr_index, uint32_t type, int64_t pos, uint32_t len);
 
+/**
+Add the packet lengths read from the PLT markers of the current tile-part
+to the packet index of its tile
+@param tileno       tile index number
+@param cstr_index   Codestream information structure
+@param tcp          tile coding parameters holding the packet lengths
+@param pos          byte offset of the tile-part data (just after SOD)
+ */
+static bool opj_j2k_add_packets_index(uint32_t tileno, opj_codestream_index_t *cstr_index, opj_tcp_t *tcp, int64_t pos);
+
+/**
+Build the tile-part index of every tile from the TLM markers of the main header,
+so that a tile can be reached without walking through the tile-parts before it.
+Inconsistent TLM markers are ignored, leaving the index to be built while reading.
+@param p_j2k        the jpeg2000 codec.
+@param p_stream     the stream, to check the tile-parts against its length.
+@param p_manager    the user event manager.
+ */
+static bool opj_j2k_build_tlm_index(opj_j2k_t *p_j2k, opj_stream_private_t *p_stream, opj_event_mgr_t * p_manager);
+
+/**
+Check that an SOT marker of the given tile starts at a tile-part position taken from the index.
+@param p_stream     the stream, left positioned anywhere.
+@param p_tile_no    the tile the tile-part should belong to.
+@param p_pos        the position of the tile-part.
+@param p_manager    the user event manager.
+ */
+static bool opj_j2k_check_sot_at(opj_stream_private_t *p_stream, uint32_t p_tile_no,
+                                 int64_t p_pos, opj_event_mgr_t * p_manager);
+
+/**
+Drop the tile-part index of every tile, so that it is built again while reading.
+@param p_j2k        the jpeg2000 codec.
+ */
+static void opj_j2k_reset_tp_index(opj_j2k_t *p_j2k);
+
 /**
  * Reads an unknown marker
  *
@@ -3026,7 +3133,7 @@ static void opj_j2k_write_poc_in_memory(   opj_j2k_t *p_j2k,
         l_poc_room = 2;
     }
 
-    l_poc_size = 4 + (5 + 2 * l_poc_room) * l_nb_poc;
+    l_poc_size = opj_j2k_get_poc_size(p_j2k, p_j2k->m_current_tile_number);
 
     l_current_data = p_data;
 
@@ -3067,6 +3174,12 @@ static void opj_j2k_write_poc_in_memory(   opj_j2k_t *p_j2k,
     *p_data_written = l_poc_size;
 }
 
+static uint32_t opj_j2k_get_poc_size(opj_j2k_t *p_j2k, uint32_t p_tile_index)
+{
+    uint32_t l_poc_room = (p_j2k->m_private_image->numcomps <= 256) ? 1 : 2;
+    return 4 + (5 + 2 * l_poc_room) * (1 + p_j2k->m_cp.tcps[p_tile_index].numpocs);
+}
+
 static uint32_t opj_j2k_get_max_poc_size(opj_j2k_t *p_j2k)
 {
     opj_tcp_t * l_tcp = 00;
@@ -3270,12 +3383,15 @@ static bool opj_j2k_read_tlm (  opj_j2k_t *p_j2k,
                                 opj_event_mgr_t * p_manager
                              )
 {
-    uint32_t l_Ztlm, l_Stlm, l_ST, l_SP, l_tot_num_tp_remaining, l_quotient, l_Ptlm_size;
+    uint32_t l_Ztlm, l_Stlm, l_ST, l_SP, l_tot_num_tp, l_tot_num_tp_remaining, l_quotient, l_Ptlm_size, i;
+    opj_j2k_dec_t *l_l_dec = 00;
     /* preconditions */
     assert(p_header_data != 00);
     assert(p_j2k != 00);
     assert(p_manager != 00);
 
+    l_l_dec = &p_j2k->m_specific_param.m_decoder;
+
     if (p_header_size < 2) {
         opj_event_msg(p_manager, EVT_ERROR, "Error reading TLM marker\n");
         return false;
@@ -3299,16 +3415,36 @@ static bool opj_j2k_read_tlm (  opj_j2k_t *p_j2k,
         opj_event_msg(p_manager, EVT_ERROR, "Error reading TLM marker\n");
         return false;
     }
-    /* FIXME Do not care of this at the moment since only local variables are set here */
-    /*
-    for
-            (i = 0; i < l_tot_num_tp; ++i)
-    {
-            opj_read_bytes(p_header_data,&l_Ttlm_i,l_ST);                           // Ttlm_i
+    (void)l_Ztlm;
+
+    l_tot_num_tp = p_header_size / l_quotient;
+    if (l_l_dec->m_nb_tlm_entries + l_tot_num_tp > l_l_dec->m_max_tlm_entries) {
+        uint32_t l_max_entries = l_l_dec->m_nb_tlm_entries + l_tot_num_tp;
+        opj_tlm_info_t *new_entries = (opj_tlm_info_t *) opj_realloc(l_l_dec->m_tlm_entries,
+                                      l_max_entries * sizeof(opj_tlm_info_t));
+        if (! new_entries) {
+            opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to read TLM marker\n");
+            return false;
+        }
+        l_l_dec->m_tlm_entries = new_entries;
+        l_l_dec->m_max_tlm_entries = l_max_entries;
+    }
+
+    for (i = 0; i < l_tot_num_tp; ++i) {
+        opj_tlm_info_t *l_entry = l_l_dec->m_tlm_entries + l_l_dec->m_nb_tlm_entries;
+        uint32_t l_Ttlm_i = l_l_dec->m_nb_tlm_entries;	/* without Ttlm, tiles have a single tile-part, in order */
+        uint32_t l_Ptlm_i;
+        if (l_ST) {
+            opj_read_bytes(p_header_data,&l_Ttlm_i,l_ST);                       /* Ttlm_i */
             p_header_data += l_ST;
-            opj_read_bytes(p_header_data,&l_Ptlm_i,l_Ptlm_size);            // Ptlm_i
-            p_header_data += l_Ptlm_size;
-    }*/
+        }
+        opj_read_bytes(p_header_data,&l_Ptlm_i,l_Ptlm_size);               /* Ptlm_i */
+        p_header_data += l_Ptlm_size;
+
+        l_entry->m_tile_no = l_Ttlm_i;
+        l_entry->m_length = l_Ptlm_i;
+        ++l_l_dec->m_nb_tlm_entries;
+    }
     return true;
 }
 
@@ -3397,6 +3533,7 @@ static bool opj_j2k_read_plt (  opj_j2k_t *p_j2k,
                              )
 {
     uint32_t l_Zplt, l_tmp, l_packet_len = 0, i;
+    opj_tcp_t *l_tcp = 00;
 
     /* preconditions */
     assert(p_header_data != 00);
@@ -3407,6 +3544,7 @@ static bool opj_j2k_read_plt (  opj_j2k_t *p_j2k,
         opj_event_msg(p_manager, EVT_ERROR, "Error reading PLT marker\n");
         return false;
     }
+    l_tcp = &p_j2k->m_cp.tcps[p_j2k->m_current_tile_number];
 
     opj_read_bytes(p_header_data,&l_Zplt,1);                /* Zplt */
     ++p_header_data;
@@ -3421,6 +3559,18 @@ static bool opj_j2k_read_plt (  opj_j2k_t *p_j2k,
             l_packet_len <<= 7;
         } else {
             /* store packet length and proceed to next packet */
+            if (l_tcp->m_nb_packet_lengths == l_tcp->m_max_packet_lengths) {
+                uint32_t l_max_lengths = l_tcp->m_max_packet_lengths ? l_tcp->m_max_packet_lengths * 2 : 256;
+                uint32_t *new_lengths = (uint32_t *) opj_realloc(l_tcp->m_packet_lengths,
+                                        l_max_lengths * sizeof(uint32_t));
+                if (! new_lengths) {
+                    opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to read PLT marker\n");
+                    return false;
+                }
+                l_tcp->m_packet_lengths = new_lengths;
+                l_tcp->m_max_packet_lengths = l_max_lengths;
+            }
+            l_tcp->m_packet_lengths[l_tcp->m_nb_packet_lengths++] = l_packet_len;
             l_packet_len = 0;
         }
     }
@@ -3429,6 +3579,7 @@ static bool opj_j2k_read_plt (  opj_j2k_t *p_j2k,
         opj_event_msg(p_manager, EVT_ERROR, "Error reading PLT marker\n");
         return false;
     }
+    (void)l_Zplt;
 
     return true;
 }
@@ -4006,6 +4157,13 @@ static bool opj_j2k_read_sot ( opj_j2k_t *p_j2k,
             (p_j2k->m_current_tile_number != (uint32_t)p_j2k->m_specific_param.m_decoder.m_tile_ind_to_dec);
     }
 
+    /* a tile that is read again from its first tile-part gets its packet lengths again */
+    if (!p_j2k->m_specific_param.m_decoder.m_skip_data && l_current_part == 0) {
+        l_tcp->m_nb_packet_lengths = 0;
+        if (p_j2k->cstr_index && p_j2k->cstr_index->tile_index)
+            p_j2k->cstr_index->tile_index[p_j2k->m_current_tile_number].nb_packet = 0;
+    }
+
     /* Index */
     if (p_j2k->cstr_index) {
         assert(p_j2k->cstr_index->tile_index != 00);
@@ -4092,8 +4250,7 @@ static bool opj_j2k_write_sod(     opj_j2k_t *p_j2k,
     opj_write_bytes(p_data,J2K_MS_SOD,2);                                   /* SOD */
     p_data += 2;
 
-    /* make room for the EOF marker */
-    l_remaining_data =  p_total_data_size - 4;
+    l_remaining_data = opj_j2k_get_sod_data_size(p_total_data_size);
 
     /* update tile coder */
     p_tile_coder->tp_num = p_j2k->m_specific_param.m_encoder.m_current_poc_tile_part_number ;
@@ -4118,6 +4275,21 @@ static bool opj_j2k_write_sod(     opj_j2k_t *p_j2k,
     return true;
 }
 
+static uint32_t opj_j2k_get_sod_data_size(uint32_t p_total_data_size)
+{
+    /* make room for the EOF marker */
+    return p_total_data_size - 4;
+}
+
+static uint32_t opj_j2k_get_first_tile_part_header_size(opj_j2k_t *p_j2k, uint32_t p_tile_index)
+{
+    uint32_t l_size = 12;       /* SOT */
+    if (!OPJ_IS_CINEMA(p_j2k->m_cp.rsiz) && p_j2k->m_cp.tcps[p_tile_index].numpocs) {
+        l_size += opj_j2k_get_poc_size(p_j2k, p_tile_index);
+    }
+    return l_size;
+}
+
 static bool opj_j2k_read_sod (opj_j2k_t *p_j2k,
                               opj_stream_private_t *p_stream,
                               opj_event_mgr_t * p_manager
@@ -4183,6 +4355,14 @@ static bool opj_j2k_read_sod (opj_j2k_t *p_j2k,
             return false;
         }
 
+        if (false == opj_j2k_add_packets_index(p_j2k->m_current_tile_number,
+                                               l_cstr_index,
+                                               l_tcp,
+                                               l_current_pos + 2)) {
+            opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to add packet index\n");
+            return false;
+        }
+
         /*l_cstr_index->packno = 0;*/
     }
 
@@ -6331,6 +6511,131 @@ static bool opj_j2k_add_tlmarker(uint32_t tileno, opj_codestream_index_t *cstr_i
     return true;
 }
 
+static bool opj_j2k_add_packets_index(uint32_t tileno, opj_codestream_index_t *cstr_index, opj_tcp_t *tcp, int64_t pos)
+{
+    opj_tile_index_t *l_tile_index = 00;
+    opj_packet_info_t *new_packet_index = 00;
+    uint32_t l_packno;
+
+    assert(cstr_index != 00);
+    assert(cstr_index->tile_index != 00);
+    assert(tcp != 00);
+
+    /* packets of the current tile-part are the ones not indexed yet */
+    l_tile_index = cstr_index->tile_index + tileno;
+    if (tcp->m_nb_packet_lengths <= l_tile_index->nb_packet)
+        return true;
+
+    new_packet_index = (opj_packet_info_t *) opj_realloc(l_tile_index->packet_index,
+                       tcp->m_nb_packet_lengths * sizeof(opj_packet_info_t));
+    if (! new_packet_index) {
+        opj_free(l_tile_index->packet_index);
+        l_tile_index->packet_index = NULL;
+        l_tile_index->nb_packet = 0;
+        return false;
+    }
+    l_tile_index->packet_index = new_packet_index;
+
+    for (l_packno = l_tile_index->nb_packet; l_packno < tcp->m_nb_packet_lengths; ++l_packno) {
+        opj_packet_info_t *l_packet = l_tile_index->packet_index + l_packno;
+        uint32_t l_len = tcp->m_packet_lengths[l_packno];
+        l_packet->start_pos = pos;
+        l_packet->end_ph_pos = 0;	/* not known until the packet header is read */
+        l_packet->end_pos = pos + l_len - 1;
+        l_packet->disto = 0;
+        pos += l_len;
+    }
+    l_tile_index->nb_packet = tcp->m_nb_packet_lengths;
+
+    return true;
+}
+
+static bool opj_j2k_build_tlm_index(opj_j2k_t *p_j2k, opj_stream_private_t *p_stream, opj_event_mgr_t * p_manager)
+{
+    opj_j2k_dec_t *l_dec = &p_j2k->m_specific_param.m_decoder;
+    opj_codestream_index_t *l_cstr_index = p_j2k->cstr_index;
+    uint32_t l_nb_tiles = p_j2k->m_cp.tw * p_j2k->m_cp.th;
+    int64_t l_pos;
+    uint32_t i;
+
+    if (!l_dec->m_nb_tlm_entries || !l_cstr_index || !l_cstr_index->tile_index)
+        return true;
+
+    /* PSot is at least 14: SOT marker segment and SOD marker. The tile-parts follow each
+       other from the end of the main header and, when the stream length is known, must
+       end within the stream; each tile-part is checked for its SOT marker when reached */
+    l_pos = (int64_t)l_cstr_index->main_head_end;
+    for (i = 0; i < l_dec->m_nb_tlm_entries; ++i) {
+        l_pos += l_dec->m_tlm_entries[i].m_length;
+        if (l_dec->m_tlm_entries[i].m_tile_no >= l_nb_tiles || l_dec->m_tlm_entries[i].m_length < 14 ||
+                (p_stream->m_user_data_length && (uint64_t)l_pos > p_stream->m_user_data_length)) {
+            opj_event_msg(p_manager, EVT_WARNING, "TLM marker is inconsistent with the image, ignoring it\n");
+            return true;
+        }
+    }
+
+    for (i = 0; i < l_dec->m_nb_tlm_entries; ++i)
+        l_cstr_index->tile_index[l_dec->m_tlm_entries[i].m_tile_no].nb_tps++;
+
+    for (i = 0; i < l_nb_tiles; ++i) {
+        opj_tile_index_t *l_tile_index = l_cstr_index->tile_index + i;
+        if (!l_tile_index->nb_tps)
+            continue;
+        l_tile_index->tileno = i;
+        l_tile_index->current_nb_tps = l_tile_index->nb_tps;
+        l_tile_index->tp_index = (opj_tp_index_t*)opj_calloc(l_tile_index->nb_tps, sizeof(opj_tp_index_t));
+        if (!l_tile_index->tp_index) {
+            opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to build tile-part index\n");
+            return false;
+        }
+        /* count again while filling */
+        l_tile_index->nb_tps = 0;
+    }
+
+    /* the first tile-part starts where the main header ends */
+    l_pos = (int64_t)l_cstr_index->main_head_end;
+    for (i = 0; i < l_dec->m_nb_tlm_entries; ++i) {
+        opj_tile_index_t *l_tile_index = l_cstr_index->tile_index + l_dec->m_tlm_entries[i].m_tile_no;
+        opj_tp_index_t *l_tp = l_tile_index->tp_index + l_tile_index->nb_tps++;
+        l_tp->start_pos = l_pos;
+        l_tp->end_header = 0;
+        l_tp->end_pos = l_pos + l_dec->m_tlm_entries[i].m_length;
+        l_pos = l_tp->end_pos;
+    }
+
+    return true;
+}
+
+static bool opj_j2k_check_sot_at(opj_stream_private_t *p_stream, uint32_t p_tile_no,
+                                 int64_t p_pos, opj_event_mgr_t * p_manager)
+{
+    uint8_t l_data[6];
+    uint32_t l_marker, l_length, l_tile_no;
+
+    if (p_stream->m_user_data_length && (uint64_t)p_pos + sizeof(l_data) > p_stream->m_user_data_length)
+        return false;
+    if (!opj_stream_read_seek(p_stream, p_pos, p_manager) ||
+            opj_stream_read_data(p_stream, l_data, sizeof(l_data), p_manager) != sizeof(l_data))
+        return false;
+    opj_read_bytes(l_data, &l_marker, 2);
+    opj_read_bytes(l_data + 2, &l_length, 2);
+    opj_read_bytes(l_data + 4, &l_tile_no, 2);
+    return l_marker == J2K_MS_SOT && l_length == 10 && l_tile_no == p_tile_no;
+}
+
+static void opj_j2k_reset_tp_index(opj_j2k_t *p_j2k)
+{
+    opj_codestream_index_t *l_cstr_index = p_j2k->cstr_index;
+    for (uint32_t i = 0; i < l_cstr_index->nb_of_tiles; ++i) {
+        opj_tile_index_t *l_tile_index = l_cstr_index->tile_index + i;
+        opj_free(l_tile_index->tp_index);
+        l_tile_index->tp_index = NULL;
+        l_tile_index->nb_tps = 0;
+        l_tile_index->current_nb_tps = 0;
+        l_tile_index->current_tpsno = 0;
+    }
+}
+
 /*
  * -----------------------------------------------------------------------
  * -----------------------------------------------------------------------
@@ -6435,6 +6740,10 @@ bool opj_j2k_read_header(   opj_stream_private_t *p_stream,
         return false;
     }
 
+    if (!opj_j2k_build_tlm_index(p_j2k, p_stream, p_manager)) {
+        return false;
+    }
+
     return true;
 }
 
@@ -7115,6 +7424,13 @@ void opj_j2k_destroy (opj_j2k_t *p_j2k)
             p_j2k->m_specific_param.m_decoder.m_header_data = 00;
             p_j2k->m_specific_param.m_decoder.m_header_data_size = 0;
         }
+
+        if (p_j2k->m_specific_param.m_decoder.m_tlm_entries != 00) {
+            opj_free(p_j2k->m_specific_param.m_decoder.m_tlm_entries);
+            p_j2k->m_specific_param.m_decoder.m_tlm_entries = 00;
+            p_j2k->m_specific_param.m_decoder.m_nb_tlm_entries = 0;
+            p_j2k->m_specific_param.m_decoder.m_max_tlm_entries = 0;
+        }
     } else {
 
         if (p_j2k->m_specific_param.m_encoder.m_encoded_tile_data) {
@@ -7264,6 +7580,13 @@ static void opj_j2k_tcp_destroy (opj_tcp_t *p_tcp)
         p_tcp->mct_norms = 00;
     }
 
+    if (p_tcp->m_packet_lengths != 00) {
+        opj_free(p_tcp->m_packet_lengths);
+        p_tcp->m_packet_lengths = 00;
+        p_tcp->m_nb_packet_lengths = 0;
+        p_tcp->m_max_packet_lengths = 0;
+    }
+
     opj_j2k_tcp_data_destroy(p_tcp);
 
 }
@@ -7421,15 +7744,10 @@ static bool opj_j2k_need_nb_tile_parts_correction(opj_stream_private_t *p_stream
     return true;
 }
 
-bool opj_j2k_read_tile_header(      opj_j2k_t * p_j2k,
-                                    uint32_t * p_tile_index,
-                                    uint32_t * p_data_size,
-                                    uint32_t * p_tile_x0, uint32_t * p_tile_y0,
-                                    uint32_t * p_tile_x1, uint32_t * p_tile_y1,
-                                    uint32_t * p_nb_comps,
-                                    bool * p_go_on,
-                                    opj_stream_private_t *p_stream,
-                                    opj_event_mgr_t * p_manager )
+static bool opj_j2k_read_tile_parts (   opj_j2k_t * p_j2k,
+                                        bool * p_go_on,
+                                        opj_stream_private_t *p_stream,
+                                        opj_event_mgr_t * p_manager )
 {
     uint32_t l_current_marker = J2K_MS_SOT;
     uint32_t l_marker_size;
@@ -7660,9 +7978,27 @@ bool opj_j2k_read_tile_header(      opj_j2k_t * p_j2k,
         opj_event_msg(p_manager, EVT_ERROR, "Failed to merge PPT data\n");
         return false;
     }
-    /*FIXME ???*/
 
-    l_tcp = p_j2k->m_specific_param.m_decoder.m_default_tcp;
+    *p_go_on = true;
+    return true;
+}
+
+bool opj_j2k_read_tile_header(      opj_j2k_t * p_j2k,
+                                    uint32_t * p_tile_index,
+                                    uint32_t * p_data_size,
+                                    uint32_t * p_tile_x0, uint32_t * p_tile_y0,
+                                    uint32_t * p_tile_x1, uint32_t * p_tile_y1,
+                                    uint32_t * p_nb_comps,
+                                    bool * p_go_on,
+                                    opj_stream_private_t *p_stream,
+                                    opj_event_mgr_t * p_manager )
+{
+    if (! opj_j2k_read_tile_parts(p_j2k, p_go_on, p_stream, p_manager)) {
+        return false;
+    }
+    if (! *p_go_on) {
+        return true;
+    }
 
     if (! opj_tcd_init_decode_tile(p_j2k->m_tcd,
                                    p_j2k->m_output_image,
@@ -7696,8 +8032,6 @@ bool opj_j2k_decode_tile (  opj_j2k_t * p_j2k,
                             opj_stream_private_t *p_stream,
                             opj_event_mgr_t * p_manager )
 {
-    uint32_t l_current_marker;
-    uint8_t l_data [2];
     opj_tcp_t * l_tcp;
 
     /* preconditions */
@@ -7726,10 +8060,14 @@ bool opj_j2k_decode_tile (  opj_j2k_t * p_j2k,
         return false;
     }
 
-    /* if p_data is not null, then copy decoded resolutions from tile data into p_data.
+    /* if the caller supplied a decode buffer, write the tile straight into it.
+    Else, if p_data is not null, then copy decoded resolutions from tile data into p_data.
     Otherwise, simply copy tile data pointer to output image
     */
-    if (p_data) {
+    if (p_j2k->m_tcd->decode_buffer) {
+        opj_tcd_write_decode_buffer(p_j2k->m_tcd, p_j2k->m_output_image);
+        opj_j2k_update_resno_decoded(p_j2k->m_tcd, p_j2k->m_output_image);
+    } else if (p_data) {
         if (!opj_tcd_update_tile_data(p_j2k->m_tcd, p_data, p_data_size)) {
             return false;
         }
@@ -7769,6 +8107,16 @@ bool opj_j2k_decode_tile (  opj_j2k_t * p_j2k,
      /* we only destroy the data, which will be re-read in read_tile_header*/
     opj_j2k_tcp_data_destroy(l_tcp);
 
+    return opj_j2k_end_tile_data(p_j2k, p_stream, p_manager);
+}
+
+static bool opj_j2k_end_tile_data ( opj_j2k_t * p_j2k,
+                                    opj_stream_private_t *p_stream,
+                                    opj_event_mgr_t * p_manager )
+{
+    uint32_t l_current_marker;
+    uint8_t l_data [2];
+
     p_j2k->m_specific_param.m_decoder.m_can_decode = 0;
     p_j2k->m_specific_param.m_decoder.m_state &= (~ (J2K_DEC_STATE_DATA));
 
@@ -7802,6 +8150,12 @@ bool opj_j2k_decode_tile (  opj_j2k_t * p_j2k,
     return true;
 }
 
+static void opj_j2k_update_resno_decoded (opj_tcd_t * p_tcd, opj_image_t* p_output_image)
+{
+    for (uint32_t compno = 0; compno < p_tcd->image->numcomps; ++compno)
+        p_output_image->comps[compno].resno_decoded = p_tcd->image->comps[compno].resno_decoded;
+}
+
 /*
 p_data stores the number of resolutions decoded, in the actual precision of the decoded image.
 
@@ -8188,6 +8542,47 @@ bool opj_j2k_set_decode_area(       opj_j2k_t *p_j2k,
     return true;
 }
 
+bool opj_j2k_set_decode_buffer(     opj_j2k_t *p_j2k,
+                                    opj_image_t* p_image,
+                                    opj_decode_buffer_t* p_buffer,
+                                    opj_event_mgr_t * p_manager )
+{
+    uint32_t compno;
+
+    if (!p_buffer) {
+        memset(&p_j2k->m_specific_param.m_decoder.m_decode_buffer, 0, sizeof(opj_decode_buffer_t));
+        return true;
+    }
+    if (!p_image || !p_buffer->data || !p_buffer->stride) {
+        opj_event_msg(p_manager, EVT_ERROR, "Invalid decode buffer\n");
+        return false;
+    }
+    if (p_buffer->prec != 8 && p_buffer->prec != 16) {
+        opj_event_msg(p_manager, EVT_ERROR, "Decode buffer precision must be 8 or 16 bits, not %d\n", p_buffer->prec);
+        return false;
+    }
+    if (p_buffer->numcomps != p_image->numcomps) {
+        opj_event_msg(p_manager, EVT_ERROR, "Decode buffer has %d samples per pixel, but the image has %d components\n",
+                      p_buffer->numcomps, p_image->numcomps);
+        return false;
+    }
+    for (compno = 0; compno < p_image->numcomps; ++compno) {
+        opj_image_comp_t* l_img_comp = p_image->comps + compno;
+        if (l_img_comp->dx != 1 || l_img_comp->dy != 1) {
+            opj_event_msg(p_manager, EVT_ERROR, "Component %d is sub-sampled, and cannot be decoded into a buffer\n", compno);
+            return false;
+        }
+        if (l_img_comp->prec > p_buffer->prec) {
+            opj_event_msg(p_manager, EVT_ERROR, "Component %d precision (%d) is larger than the decode buffer precision (%d)\n",
+                          compno, l_img_comp->prec, p_buffer->prec);
+            return false;
+        }
+    }
+    p_j2k->m_specific_param.m_decoder.m_decode_buffer = *p_buffer;
+
+    return true;
+}
+
 opj_j2k_t* opj_j2k_create_decompress(void)
 {
     opj_j2k_t *l_j2k = (opj_j2k_t*) opj_calloc(1,sizeof(opj_j2k_t));
@@ -9116,6 +9511,33 @@ opj_codestream_info_v2_t* j2k_get_cstr_info(opj_j2k_t* p_j2k)
     return cstr_info;
 }
 
+bool j2k_set_tile_part_index(opj_j2k_t* p_j2k, uint32_t tileno, const opj_tp_index_t* tp_index, uint32_t nb_tps)
+{
+    opj_tile_index_t *l_tile_index = 00;
+
+    if (!p_j2k->cstr_index || !p_j2k->cstr_index->tile_index ||
+            tileno >= p_j2k->cstr_index->nb_of_tiles || !nb_tps)
+        return false;
+
+    l_tile_index = p_j2k->cstr_index->tile_index + tileno;
+    if (l_tile_index->nb_tps)
+        return true;
+
+    if (l_tile_index->tp_index)
+        opj_free(l_tile_index->tp_index);
+    l_tile_index->tp_index = (opj_tp_index_t*)opj_malloc(nb_tps * sizeof(opj_tp_index_t));
+    if (!l_tile_index->tp_index) {
+        l_tile_index->current_nb_tps = 0;
+        return false;
+    }
+    memcpy(l_tile_index->tp_index, tp_index, nb_tps * sizeof(opj_tp_index_t));
+    l_tile_index->tileno = tileno;
+    l_tile_index->nb_tps = nb_tps;
+    l_tile_index->current_nb_tps = nb_tps;
+
+    return true;
+}
+
 opj_codestream_index_t* j2k_get_cstr_index(opj_j2k_t* p_j2k)
 {
     opj_codestream_index_t* l_cstr_index = (opj_codestream_index_t*)
@@ -9157,65 +9579,48 @@ opj_codestream_index_t* j2k_get_cstr_index(opj_j2k_t* p_j2k)
         for (it_tile = 0; it_tile < l_cstr_index->nb_of_tiles; it_tile++ ) {
 
             /* Tile Marker*/
-            l_cstr_index->tile_index[it_tile].marknum = p_j2k->cstr_index->tile_index[it_tile].marknum;
-
-            l_cstr_index->tile_index[it_tile].marker =
-                (opj_marker_info_t*)opj_malloc(l_cstr_index->tile_index[it_tile].marknum*sizeof(opj_marker_info_t));
-
-            if (!l_cstr_index->tile_index[it_tile].marker) {
-                uint32_t it_tile_free;
-
-                for (it_tile_free=0; it_tile_free < it_tile; it_tile_free++) {
-                    opj_free(l_cstr_index->tile_index[it_tile_free].marker);
+            l_cstr_index->tile_index[it_tile].marknum = 0;
+            if (p_j2k->cstr_index->tile_index[it_tile].marknum && p_j2k->cstr_index->tile_index[it_tile].marker) {
+                l_cstr_index->tile_index[it_tile].marker =
+                    (opj_marker_info_t*)opj_malloc(p_j2k->cstr_index->tile_index[it_tile].marknum*sizeof(opj_marker_info_t));
+                if (!l_cstr_index->tile_index[it_tile].marker) {
+                    j2k_destroy_cstr_index(l_cstr_index);
+                    return NULL;
                 }
-
-                opj_free( l_cstr_index->tile_index);
-                opj_free( l_cstr_index->marker);
-                opj_free( l_cstr_index);
-                return NULL;
-            }
-
-            if (p_j2k->cstr_index->tile_index[it_tile].marker)
+                l_cstr_index->tile_index[it_tile].marknum = p_j2k->cstr_index->tile_index[it_tile].marknum;
                 memcpy( l_cstr_index->tile_index[it_tile].marker,
                         p_j2k->cstr_index->tile_index[it_tile].marker,
                         l_cstr_index->tile_index[it_tile].marknum * sizeof(opj_marker_info_t) );
-            else {
-                opj_free(l_cstr_index->tile_index[it_tile].marker);
-                l_cstr_index->tile_index[it_tile].marker = NULL;
             }
 
-            /* Tile part index*/
-            l_cstr_index->tile_index[it_tile].nb_tps = p_j2k->cstr_index->tile_index[it_tile].nb_tps;
-
-            l_cstr_index->tile_index[it_tile].tp_index =
-                (opj_tp_index_t*)opj_malloc(l_cstr_index->tile_index[it_tile].nb_tps*sizeof(opj_tp_index_t));
-
-            if(!l_cstr_index->tile_index[it_tile].tp_index) {
-                uint32_t it_tile_free;
-
-                for (it_tile_free=0; it_tile_free < it_tile; it_tile_free++) {
-                    opj_free(l_cstr_index->tile_index[it_tile_free].marker);
-                    opj_free(l_cstr_index->tile_index[it_tile_free].tp_index);
+            /* Tile part index (tiles that have not been read yet have none) */
+            l_cstr_index->tile_index[it_tile].nb_tps = 0;
+            if (p_j2k->cstr_index->tile_index[it_tile].nb_tps && p_j2k->cstr_index->tile_index[it_tile].tp_index) {
+                l_cstr_index->tile_index[it_tile].tp_index =
+                    (opj_tp_index_t*)opj_malloc(p_j2k->cstr_index->tile_index[it_tile].nb_tps*sizeof(opj_tp_index_t));
+                if(!l_cstr_index->tile_index[it_tile].tp_index) {
+                    j2k_destroy_cstr_index(l_cstr_index);
+                    return NULL;
                 }
-
-                opj_free( l_cstr_index->tile_index);
-                opj_free( l_cstr_index->marker);
-                opj_free( l_cstr_index);
-                return NULL;
-            }
-
-            if (p_j2k->cstr_index->tile_index[it_tile].tp_index) {
+                l_cstr_index->tile_index[it_tile].nb_tps = p_j2k->cstr_index->tile_index[it_tile].nb_tps;
                 memcpy( l_cstr_index->tile_index[it_tile].tp_index,
                         p_j2k->cstr_index->tile_index[it_tile].tp_index,
                         l_cstr_index->tile_index[it_tile].nb_tps * sizeof(opj_tp_index_t) );
-            } else {
-                opj_free(l_cstr_index->tile_index[it_tile].tp_index);
-                l_cstr_index->tile_index[it_tile].tp_index = NULL;
             }
 
-            /* Packet index (NOT USED)*/
+            /* Packet index, from PLT markers */
             l_cstr_index->tile_index[it_tile].nb_packet = 0;
             l_cstr_index->tile_index[it_tile].packet_index = NULL;
+            if (p_j2k->cstr_index->tile_index[it_tile].nb_packet) {
+                l_cstr_index->tile_index[it_tile].packet_index =
+                    (opj_packet_info_t*)opj_malloc(p_j2k->cstr_index->tile_index[it_tile].nb_packet * sizeof(opj_packet_info_t));
+                if (l_cstr_index->tile_index[it_tile].packet_index) {
+                    l_cstr_index->tile_index[it_tile].nb_packet = p_j2k->cstr_index->tile_index[it_tile].nb_packet;
+                    memcpy( l_cstr_index->tile_index[it_tile].packet_index,
+                            p_j2k->cstr_index->tile_index[it_tile].packet_index,
+                            l_cstr_index->tile_index[it_tile].nb_packet * sizeof(opj_packet_info_t) );
+                }
+            }
 
         }
     }
@@ -9307,7 +9712,16 @@ static bool opj_j2k_decode_tiles ( opj_j2k_t *p_j2k,
     uint8_t * l_current_data=NULL;
     uint32_t nr_tiles = 0;
 
-    if (opj_j2k_needs_copy_tile_data(p_j2k, p_j2k->m_cp.th * p_j2k->m_cp.tw)) {
+    /* PPM packet headers must be read in codestream order, and plugins decode one tile at a time */
+    if (p_j2k->m_cp.th * p_j2k->m_cp.tw > 1 &&
+            p_j2k->m_tcd->numThreads > 1 &&
+            !p_j2k->m_cp.ppm &&
+            !p_j2k->m_tcd->current_plugin_tile) {
+        return opj_j2k_decode_tiles_concurrent(p_j2k, p_stream, p_manager);
+    }
+
+    if (!p_j2k->m_tcd->decode_buffer &&
+            opj_j2k_needs_copy_tile_data(p_j2k, p_j2k->m_cp.th * p_j2k->m_cp.tw)) {
         l_current_data = (uint8_t*)opj_malloc(1);
         if (!l_current_data) {
             opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to decode tiles\n");
@@ -9381,6 +9795,206 @@ static bool opj_j2k_decode_tiles ( opj_j2k_t *p_j2k,
 	return true;
 }
 
+/* a complete tile, handed from the header parser to a tile decoder */
+struct opj_j2k_tile_job_t {
+    uint32_t tile_no;
+    opj_seg_buf_t* data;
+};
+
+static bool opj_j2k_decode_tiles_concurrent ( opj_j2k_t *p_j2k,
+        opj_stream_private_t *p_stream,
+        opj_event_mgr_t * p_manager)
+{
+    uint32_t l_nb_tiles = p_j2k->m_cp.th * p_j2k->m_cp.tw;
+    uint32_t l_nb_decoders = opj_uint_min(p_j2k->m_tcd->numThreads,
+                                          (uint32_t)Scheduler::instance()->num_workers());
+    l_nb_decoders = opj_uint_max(opj_uint_min(l_nb_decoders, l_nb_tiles), 1);
+
+    /* the parser blocks once every decoder has a tile waiting, so at most
+       about twice as many tiles as decoders are held in memory */
+    BlockingQueue<opj_j2k_tile_job_t> l_jobs(l_nb_decoders);
+    std::atomic<bool> l_parse_success(true);
+    std::atomic<bool> l_decode_success(true);
+    std::atomic<uint32_t> num_tiles_decoded(0);
+    std::mutex l_update_mutex;
+    std::exception_ptr l_error;
+
+    /* allocate the output components up front, so that decoders only write into them */
+    for (uint32_t compno = 0; compno < p_j2k->m_output_image->numcomps && !p_j2k->m_tcd->decode_buffer; ++compno) {
+        opj_image_comp_t* l_comp = p_j2k->m_output_image->comps + compno;
+        if (!l_comp->data && !opj_image_single_component_data_alloc(l_comp)) {
+            opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to decode tiles\n");
+            return false;
+        }
+    }
+
+    /* each decoder owns a tcd and decodes whole tiles. Decoders block on the queue,
+       so they run on threads of their own rather than as scheduler tasks, which a
+       worker waiting in a nested run() could otherwise pick up; their T1 and DWT
+       work still goes through the scheduler */
+    auto l_decoder = [&]() {
+        opj_image_t* l_image = NULL;
+        opj_tcd_t* l_tcd = NULL;
+        uint8_t* l_current_data = NULL;
+        uint32_t l_max_data_size = 0;
+        opj_j2k_tile_job_t l_job;
+
+        try {
+            bool l_ready = false;
+            l_image = opj_image_create0();
+            l_tcd = opj_tcd_create(true);
+            /* each decoder has its own image header, since tcd records the decoded resolutions there */
+            if (l_image && l_tcd) {
+                opj_copy_image_header(p_j2k->m_private_image, l_image);
+                l_ready = l_image->comps &&
+                          opj_tcd_init(l_tcd, l_image, &p_j2k->m_cp, p_j2k->m_tcd->numThreads);
+                l_tcd->decode_buffer = p_j2k->m_tcd->decode_buffer;
+            }
+            if (!l_ready) {
+                opj_event_msg(p_manager, EVT_ERROR, "Cannot decode tile, memory error\n");
+                l_decode_success = false;
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lk(l_update_mutex);
+            if (!l_error)
+                l_error = std::current_exception();
+            l_decode_success = false;
+        }
+
+        /* a failed decoder keeps draining the queue, so that the parser never waits on it */
+        while (l_jobs.waitAndPop(l_job)) {
+            if (l_decode_success) {
+                bool l_rc = false;
+                try {
+                    uint32_t l_data_size = 0;
+                    if (! opj_tcd_init_decode_tile(l_tcd, p_j2k->m_output_image, l_job.tile_no, p_manager)) {
+                        opj_event_msg(p_manager, EVT_ERROR, "Cannot decode tile, memory error\n");
+                    } else if (l_tcd->decode_buffer) {
+                        opj_seg_buf_rewind(l_job.data);
+                        l_rc = opj_tcd_decode_tile(l_tcd, l_job.data, l_job.tile_no, p_manager);
+                        if (l_rc)
+                            opj_tcd_write_decode_buffer(l_tcd, p_j2k->m_output_image);
+                        else
+                            opj_event_msg(p_manager, EVT_ERROR, "Failed to decode tile %d/%d\n", l_job.tile_no + 1, l_nb_tiles);
+                    } else {
+                        l_data_size = opj_tcd_get_decoded_tile_size(l_tcd);
+                        if (l_data_size > l_max_data_size) {
+                            uint8_t *l_new_current_data = (uint8_t *) opj_realloc(l_current_data, l_data_size);
+                            if (l_new_current_data) {
+                                l_current_data = l_new_current_data;
+                                l_max_data_size = l_data_size;
+                            }
+                        }
+                        if (l_data_size > l_max_data_size) {
+                            opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to decode tile %d/%d\n", l_job.tile_no + 1, l_nb_tiles);
+                        } else {
+                            opj_seg_buf_rewind(l_job.data);
+                            l_rc = opj_tcd_decode_tile(l_tcd, l_job.data, l_job.tile_no, p_manager) &&
+                                   opj_tcd_update_tile_data(l_tcd, l_current_data, l_data_size);
+                            if (!l_rc)
+                                opj_event_msg(p_manager, EVT_ERROR, "Failed to decode tile %d/%d\n", l_job.tile_no + 1, l_nb_tiles);
+                        }
+                    }
+                    if (l_rc) {
+                        opj_event_msg(p_manager, EVT_INFO, "Tile %d/%d has been decoded.\n", l_job.tile_no + 1, l_nb_tiles);
+                    }
+                    if (l_rc) {
+                        /* tiles cover disjoint regions, but share the output component headers */
+                        std::lock_guard<std::mutex> lk(l_update_mutex);
+                        if (l_tcd->decode_buffer)
+                            opj_j2k_update_resno_decoded(l_tcd, p_j2k->m_output_image);
+                        else
+                            l_rc = opj_j2k_update_image_data(l_tcd, l_current_data, p_j2k->m_output_image);
+                    }
+                } catch (...) {
+                    std::lock_guard<std::mutex> lk(l_update_mutex);
+                    if (!l_error)
+                        l_error = std::current_exception();
+                    l_rc = false;
+                }
+                if (l_rc)
+                    num_tiles_decoded++;
+                else
+                    l_decode_success = false;
+            }
+            delete l_job.data;
+        }
+
+        if (l_current_data)
+            opj_free(l_current_data);
+        if (l_tcd)
+            opj_tcd_destroy(l_tcd);
+        if (l_image)
+            opj_image_destroy(l_image);
+    };
+
+    std::vector<std::thread> l_decoders;
+    try {
+        for (uint32_t i = 0; i < l_nb_decoders; ++i)
+            l_decoders.emplace_back(l_decoder);
+    } catch (const std::system_error&) {
+        if (l_decoders.empty()) {
+            opj_event_msg(p_manager, EVT_ERROR, "Cannot start tile decoders\n");
+            return false;
+        }
+    }
+
+    /* the calling thread parses the codestream */
+    bool l_go_on = true;
+    for (uint32_t nr_tiles = 0; nr_tiles < l_nb_tiles && l_decode_success; nr_tiles++) {
+        if (! opj_j2k_read_tile_parts(p_j2k, &l_go_on, p_stream, p_manager)) {
+            l_parse_success = false;
+            break;
+        }
+        if (! l_go_on) {
+            break;
+        }
+
+        opj_tcp_t* l_tcp = p_j2k->m_cp.tcps + p_j2k->m_current_tile_number;
+        if (!l_tcp->m_data) {
+            opj_event_msg(p_manager, EVT_ERROR, "Failed to decode tile %d/%d\n", p_j2k->m_current_tile_number + 1, l_nb_tiles);
+            l_parse_success = false;
+            break;
+        }
+        opj_event_msg(p_manager, EVT_INFO, "Header of tile %d / %d has been read.\n",
+                      p_j2k->m_current_tile_number + 1, l_nb_tiles);
+
+        /* the decoder now owns the tile data */
+        opj_j2k_tile_job_t l_job;
+        l_job.tile_no = p_j2k->m_current_tile_number;
+        l_job.data = l_tcp->m_data;
+        l_tcp->m_data = NULL;
+        if (!l_jobs.push(l_job))
+            delete l_job.data;
+
+        if (! opj_j2k_end_tile_data(p_j2k, p_stream, p_manager)) {
+            l_parse_success = false;
+            break;
+        }
+        if(opj_stream_get_number_byte_left(p_stream) == 0
+                && p_j2k->m_specific_param.m_decoder.m_state == J2K_DEC_STATE_NEOC)
+            break;
+    }
+    l_jobs.deactivate();
+    for (auto& l_thread : l_decoders)
+        l_thread.join();
+    if (l_error)
+        std::rethrow_exception(l_error);
+
+    if (!l_decode_success) {
+        p_j2k->m_specific_param.m_decoder.m_state |= J2K_DEC_STATE_ERR;
+        return false;
+    }
+    if (!l_parse_success) {
+        return false;
+    }
+    if (num_tiles_decoded == 0) {
+        opj_event_msg(p_manager, EVT_ERROR, "No tiles were decoded. Exiting\n");
+        return false;
+    }
+    return true;
+}
+
 /**
  * Sets up the procedures to do on decoding data. Developpers wanting to extend the library can add their own reading procedures.
  */
@@ -9433,7 +10047,7 @@ static bool opj_j2k_decode_one_tile ( opj_j2k_t *p_j2k,
     /* Move into the codestream to the first SOT used to decode the desired tile */
     l_tile_no_to_dec = p_j2k->m_specific_param.m_decoder.m_tile_ind_to_dec;
     if (p_j2k->cstr_index->tile_index)
-        if(p_j2k->cstr_index->tile_index->tp_index) {
+        if(p_j2k->cstr_index->tile_index->tp_index || p_j2k->cstr_index->tile_index[l_tile_no_to_dec].nb_tps) {
             if ( ! p_j2k->cstr_index->tile_index[l_tile_no_to_dec].nb_tps) {
                 /* the index for this tile has not been built,
                  *  so move to the last SOT read */
@@ -9444,7 +10058,15 @@ static bool opj_j2k_decode_one_tile ( opj_j2k_t *p_j2k,
                     return false;
                 }
             } else {
-                if ( !(opj_stream_read_seek(p_stream, p_j2k->cstr_index->tile_index[l_tile_no_to_dec].tp_index[0].start_pos+2, p_manager)) ) {
+                int64_t l_start_pos = p_j2k->cstr_index->tile_index[l_tile_no_to_dec].tp_index[0].start_pos;
+                /* the index may come from TLM markers: when its tile-part is not where it says,
+                   read the tile-parts in order from the first one instead */
+                if (!opj_j2k_check_sot_at(p_stream, l_tile_no_to_dec, l_start_pos, p_manager)) {
+                    opj_event_msg(p_manager, EVT_WARNING, "Tile-part index is inconsistent with the codestream, reading tile-parts in order\n");
+                    opj_j2k_reset_tp_index(p_j2k);
+                    l_start_pos = (int64_t)p_j2k->cstr_index->main_head_end;
+                }
+                if ( !(opj_stream_read_seek(p_stream, l_start_pos+2, p_manager)) ) {
                     opj_event_msg(p_manager, EVT_ERROR, "Problem with seek function\n");
                     if (l_current_data)
                         opj_free(l_current_data);
@@ -9559,9 +10181,13 @@ bool opj_j2k_decode(opj_j2k_t * p_j2k,
     /* customization of the decoding */
     opj_j2k_setup_decoding(p_j2k, p_manager);
 	p_j2k->m_tcd->current_plugin_tile = tile;
+    if (p_j2k->m_specific_param.m_decoder.m_decode_buffer.data)
+        p_j2k->m_tcd->decode_buffer = &p_j2k->m_specific_param.m_decoder.m_decode_buffer;
 
     /* Decode the codestream */
-    if (! opj_j2k_exec (p_j2k,p_j2k->m_procedure_list,p_stream,p_manager)) {
+    bool l_rc = opj_j2k_exec (p_j2k,p_j2k->m_procedure_list,p_stream,p_manager);
+    p_j2k->m_tcd->decode_buffer = NULL;
+    if (! l_rc) {
         opj_image_destroy(p_j2k->m_private_image);
         p_j2k->m_private_image = NULL;
         return false;
@@ -9721,8 +10347,6 @@ bool opj_j2k_encode(opj_j2k_t * p_j2k,
 {
     uint32_t i, j;
     uint32_t l_nb_tiles;
-    uint32_t l_max_tile_size = 0, l_current_tile_size;
-    uint8_t * l_current_data = 00;
     bool l_reuse_data = false;
     opj_tcd_t* p_tcd = 00;
 
@@ -9735,6 +10359,12 @@ bool opj_j2k_encode(opj_j2k_t * p_j2k,
 	p_tcd->current_plugin_tile = tile;
 
     l_nb_tiles = p_j2k->m_cp.th * p_j2k->m_cp.tw;
+    if (l_nb_tiles > 1 &&
+            p_tcd->numThreads > 1 &&
+            !tile &&
+            !opj_plugin_get_debug_state()) {
+        return opj_j2k_encode_tiles_concurrent(p_j2k, p_stream, p_manager);
+    }
     if (l_nb_tiles == 1) {
         l_reuse_data = true;
 #ifdef __SSE__
@@ -9748,68 +10378,169 @@ bool opj_j2k_encode(opj_j2k_t * p_j2k,
     }
     for (i=0; i<l_nb_tiles; ++i) {
         if (! opj_j2k_pre_write_tile(p_j2k,i,p_stream,p_manager)) {
-            if (l_current_data)
-                opj_free(l_current_data);
             return false;
         }
 
-        /* if we only have one tile, then simply set tile component data equal to image component data */
-        /* otherwise, allocate the data */
-        for (j=0; j<p_j2k->m_tcd->image->numcomps; ++j) {
-            opj_tcd_tilecomp_t* l_tilec = p_tcd->tile->comps + j;
-            if (l_reuse_data) {
-                opj_image_comp_t * l_img_comp = p_tcd->image->comps + j;
-                opj_tile_buf_set_ptr(l_tilec->buf, l_img_comp->data);
-            } else {
-                if(! opj_tile_buf_alloc_component_data_encode(l_tilec->buf)) {
-                    opj_event_msg(p_manager, EVT_ERROR, "Error allocating tile component data." );
-                    if (l_current_data) {
-                        opj_free(l_current_data);
-                    }
-                    return false;
-                }
-            }
+        if (! opj_j2k_load_tile_data(p_tcd, i, l_reuse_data, p_manager)) {
+            return false;
         }
-        l_current_tile_size = opj_tcd_get_encoded_tile_size(p_j2k->m_tcd);
-        if (!l_reuse_data) {
-            if (l_current_tile_size > l_max_tile_size) {
-                uint8_t *l_new_current_data = (uint8_t *) opj_realloc(l_current_data, l_current_tile_size);
-                if (! l_new_current_data) {
-                    if (l_current_data) {
-                        opj_free(l_current_data);
-                    }
-                    opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to encode all tiles\n");
-                    return false;
-                }
-                l_current_data = l_new_current_data;
-                l_max_tile_size = l_current_tile_size;
-            }
 
-            /* copy image data (32 bit) to l_current_data as contiguous, all-component, zero offset buffer */
-            /* 32 bit components @ 8 bit precision get converted to 8 bit */
-            /* 32 bit components @ 16 bit precision get converted to 16 bit */
-            opj_j2k_get_tile_data(p_j2k->m_tcd,l_current_data);
+        if (! opj_j2k_post_write_tile (p_j2k,p_stream,p_manager)) {
+            return false;
+        }
+    }
 
-            /* now copy this data into the tile component */
-            if (! opj_tcd_copy_tile_data(p_j2k->m_tcd,l_current_data,l_current_tile_size)) {
-                opj_event_msg(p_manager, EVT_ERROR, "Size mismatch between tile data and sent data." );
-                opj_free(l_current_data);
+    return true;
+}
+
+static bool opj_j2k_load_tile_data (opj_tcd_t * p_tcd,
+                                    uint32_t p_tile_index,
+                                    bool p_reuse_data,
+                                    opj_event_mgr_t * p_manager)
+{
+    uint32_t j;
+
+    /* if we only have one tile, then simply set tile component data equal to image component data */
+    /* otherwise, allocate the data */
+    for (j=0; j<p_tcd->image->numcomps; ++j) {
+        opj_tcd_tilecomp_t* l_tilec = p_tcd->tile->comps + j;
+        if (p_reuse_data) {
+            opj_image_comp_t * l_img_comp = p_tcd->image->comps + j;
+            opj_tile_buf_set_ptr(l_tilec->buf, l_img_comp->data);
+        } else {
+            if(! opj_tile_buf_alloc_component_data_encode(l_tilec->buf)) {
+                opj_event_msg(p_manager, EVT_ERROR, "Error allocating tile component data." );
                 return false;
             }
         }
+    }
+    if (p_reuse_data)
+        return true;
 
-        if (! opj_j2k_post_write_tile (p_j2k,p_stream,p_manager)) {
-            if (l_current_data) {
-                opj_free(l_current_data);
+    /* read the tile region of the image straight into the tile components,
+       DC shifted and colour transformed when possible */
+    opj_tcd_copy_image_data(p_tcd, p_tile_index);
+    return true;
+}
+
+/* a tile coder, with its own image header, that precodes one tile at a time */
+struct opj_j2k_tile_coder_t {
+    opj_tcd_t* tcd;
+    opj_image_t* image;
+};
+
+static uint32_t opj_j2k_get_first_tile_part_max_length(opj_j2k_t *p_j2k, uint32_t p_tile_index)
+{
+    /* what opj_j2k_write_sod is left with, once SOT and POC have been written */
+    return opj_j2k_get_sod_data_size(p_j2k->m_specific_param.m_encoder.m_encoded_tile_size -
+                                     opj_j2k_get_first_tile_part_header_size(p_j2k, p_tile_index));
+}
+
+static bool opj_j2k_precode_tile(opj_j2k_t *p_j2k,
+                                 opj_j2k_tile_coder_t* p_coder,
+                                 uint32_t p_tile_index,
+                                 opj_event_mgr_t * p_manager)
+{
+    opj_tcd_t* l_tcd = p_coder->tcd;
+
+    l_tcd->cur_totnum_tp = p_j2k->m_cp.tcps[p_tile_index].m_nb_tile_parts;
+    if (! opj_tcd_init_encode_tile(l_tcd, p_tile_index, p_manager)) {
+        return false;
+    }
+    if (! opj_j2k_load_tile_data(l_tcd, p_tile_index, false, p_manager)) {
+        return false;
+    }
+    if (! opj_tcd_precode_tile(l_tcd,
+                               p_tile_index,
+                               opj_j2k_get_first_tile_part_max_length(p_j2k, p_tile_index),
+                               NULL)) {
+        opj_event_msg(p_manager, EVT_ERROR, "Cannot encode tile\n");
+        return false;
+    }
+    return true;
+}
+
+static bool opj_j2k_encode_tiles_concurrent(opj_j2k_t * p_j2k,
+        opj_stream_private_t *p_stream,
+        opj_event_mgr_t * p_manager )
+{
+    uint32_t l_nb_tiles = p_j2k->m_cp.th * p_j2k->m_cp.tw;
+    uint32_t l_batch_size = opj_uint_min(p_j2k->m_tcd->numThreads,
+                                         (uint32_t)Scheduler::instance()->num_workers());
+    l_batch_size = opj_uint_max(opj_uint_min(l_batch_size, l_nb_tiles), 1);
+
+    /* two sets of tile coders: while one batch of tiles is precoded,
+       the previous batch is written to the stream in tile order */
+    std::vector<opj_j2k_tile_coder_t> l_coders(2 * l_batch_size);
+    opj_tcd_t* l_main_tcd = p_j2k->m_tcd;
+    bool l_success = true;
+
+    for (auto& l_coder : l_coders) {
+        l_coder.tcd = opj_tcd_create(false);
+        l_coder.image = opj_image_create0();
+        if (!l_coder.tcd || !l_coder.image) {
+            l_success = false;
+            continue;
+        }
+        /* tcd writes per-tile state into its image header; the samples are shared */
+        opj_copy_image_header(p_j2k->m_private_image, l_coder.image);
+        if (!l_coder.image->comps) {
+            l_success = false;
+            continue;
+        }
+        for (uint32_t compno = 0; compno < l_coder.image->numcomps; ++compno)
+            l_coder.image->comps[compno].data = p_j2k->m_private_image->comps[compno].data;
+        if (! opj_tcd_init(l_coder.tcd, l_coder.image, &p_j2k->m_cp, l_main_tcd->numThreads)) {
+            l_success = false;
+        }
+    }
+    if (!l_success) {
+        opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to encode all tiles\n");
+    }
+
+    for (uint32_t l_first = 0; l_success && l_first < l_nb_tiles + l_batch_size; l_first += l_batch_size) {
+        uint32_t l_set = (l_first / l_batch_size) & 1;
+        uint32_t l_nb_precode = (l_first < l_nb_tiles) ? opj_uint_min(l_batch_size, l_nb_tiles - l_first) : 0;
+        std::atomic<bool> l_precode_success(true);
+        bool l_write_success = true;
+
+        Scheduler::instance()->run(l_nb_precode + 1, [&](size_t taskId) {
+            if (taskId == 0) {
+                if (l_first == 0)
+                    return;
+                uint32_t l_prev_first = l_first - l_batch_size;
+                uint32_t l_prev_set = l_set ^ 1;
+                for (uint32_t i = 0; i < l_batch_size && l_prev_first + i < l_nb_tiles; ++i) {
+                    p_j2k->m_tcd = l_coders[l_prev_set * l_batch_size + i].tcd;
+                    if (! opj_j2k_pre_write_tile(p_j2k, l_prev_first + i, p_stream, p_manager) ||
+                            ! opj_j2k_post_write_tile(p_j2k, p_stream, p_manager)) {
+                        l_write_success = false;
+                        break;
+                    }
+                }
+                p_j2k->m_tcd = l_main_tcd;
+                return;
             }
-            return false;
-        }
+            uint32_t l_index = (uint32_t)taskId - 1;
+            if (! opj_j2k_precode_tile(p_j2k,
+                                       &l_coders[l_set * l_batch_size + l_index],
+                                       l_first + l_index,
+                                       p_manager)) {
+                l_precode_success = false;
+            }
+        });
+        l_success = l_precode_success && l_write_success;
     }
 
-    if (l_current_data) {
-        opj_free(l_current_data);
+    for (auto& l_coder : l_coders) {
+        if (l_coder.image) {
+            for (uint32_t compno = 0; compno < l_coder.image->numcomps; ++compno)
+                l_coder.image->comps[compno].data = NULL;
+            opj_image_destroy(l_coder.image);
+        }
+        opj_tcd_destroy(l_coder.tcd);
     }
-    return true;
+    return l_success;
 }
 
 bool opj_j2k_end_compress(  opj_j2k_t *p_j2k,
@@ -9897,134 +10628,15 @@ static bool opj_j2k_pre_write_tile (       opj_j2k_t * p_j2k,
     p_j2k->m_tcd->cur_totnum_tp = p_j2k->m_cp.tcps[p_tile_index].m_nb_tile_parts;
     p_j2k->m_specific_param.m_encoder.m_current_poc_tile_part_number = 0;
 
-    /* initialisation before tile encoding  */
-    if (! opj_tcd_init_encode_tile(p_j2k->m_tcd, p_j2k->m_current_tile_number, p_manager)) {
+    /* initialisation before tile encoding (a precoded tile is already initialised) */
+    if (! p_j2k->m_tcd->m_tile_precoded &&
+            ! opj_tcd_init_encode_tile(p_j2k->m_tcd, p_j2k->m_current_tile_number, p_manager)) {
         return false;
     }
 
     return true;
 }
 
-static void opj_get_tile_dimensions(opj_image_t * l_image,
-                                    opj_tcd_tilecomp_t * l_tilec,
-                                    opj_image_comp_t * l_img_comp,
-                                    uint32_t* l_size_comp,
-                                    uint32_t* l_width,
-                                    uint32_t* l_height,
-                                    uint32_t* l_offset_x,
-                                    uint32_t* l_offset_y,
-                                    uint32_t* l_image_width,
-                                    uint32_t* l_stride,
-                                    uint32_t* l_tile_offset)
-{
-    uint32_t l_remaining;
-    *l_size_comp = l_img_comp->prec >> 3; /* (/8) */
-    l_remaining = l_img_comp->prec & 7;  /* (%8) */
-    if (l_remaining) {
-        *l_size_comp += 1;
-    }
-
-    if (*l_size_comp == 3) {
-        *l_size_comp = 4;
-    }
-
-    *l_width  = (l_tilec->x1 - l_tilec->x0);
-    *l_height = (l_tilec->y1 - l_tilec->y0);
-    *l_offset_x = opj_uint_ceildiv(l_image->x0, l_img_comp->dx);
-    *l_offset_y = opj_uint_ceildiv(l_image->y0, l_img_comp->dy);
-    *l_image_width = opj_uint_ceildiv(l_image->x1 - l_image->x0, l_img_comp->dx);
-    *l_stride = *l_image_width - *l_width;
-    *l_tile_offset = (l_tilec->x0 - *l_offset_x) + (l_tilec->y0 - *l_offset_y) * *l_image_width;
-}
-
-static void opj_j2k_get_tile_data (opj_tcd_t * p_tcd, uint8_t * p_data)
-{
-    uint32_t i,j,k = 0;
-
-    for (i=0; i<p_tcd->image->numcomps; ++i) {
-        opj_image_t * l_image =  p_tcd->image;
-        int32_t * l_src_ptr;
-        opj_tcd_tilecomp_t * l_tilec = p_tcd->tile->comps + i;
-        opj_image_comp_t * l_img_comp = l_image->comps + i;
-        uint32_t l_size_comp,l_width,l_height,l_offset_x,l_offset_y, l_image_width,l_stride,l_tile_offset;
-
-        opj_get_tile_dimensions(l_image,
-                                l_tilec,
-                                l_img_comp,
-                                &l_size_comp,
-                                &l_width,
-                                &l_height,
-                                &l_offset_x,
-                                &l_offset_y,
-                                &l_image_width,
-                                &l_stride,
-                                &l_tile_offset);
-
-        l_src_ptr = l_img_comp->data + l_tile_offset;
-
-        switch (l_size_comp) {
-        case 1: {
-            char * l_dest_ptr = (char*) p_data;
-            if (l_img_comp->sgnd) {
-                for     (j=0; j<l_height; ++j) {
-                    for (k=0; k<l_width; ++k) {
-                        *(l_dest_ptr) = (char) (*l_src_ptr);
-                        ++l_dest_ptr;
-                        ++l_src_ptr;
-                    }
-                    l_src_ptr += l_stride;
-                }
-            } else {
-                for (j=0; j<l_height; ++j) {
-                    for (k=0; k<l_width; ++k) {
-                        *(l_dest_ptr) = (char)((*l_src_ptr)&0xff);
-                        ++l_dest_ptr;
-                        ++l_src_ptr;
-                    }
-                    l_src_ptr += l_stride;
-                }
-            }
-
-            p_data = (uint8_t*) l_dest_ptr;
-        }
-        break;
-        case 2: {
-            int16_t * l_dest_ptr = (int16_t *) p_data;
-            if (l_img_comp->sgnd) {
-                for (j=0; j<l_height; ++j) {
-                    for (k=0; k<l_width; ++k) {
-                        *(l_dest_ptr++) = (int16_t) (*(l_src_ptr++));
-                    }
-                    l_src_ptr += l_stride;
-                }
-            } else {
-                for (j=0; j<l_height; ++j) {
-                    for (k=0; k<l_width; ++k) {
-                        *(l_dest_ptr++) = (int16_t)((*(l_src_ptr++)) & 0xffff);
-                    }
-                    l_src_ptr += l_stride;
-                }
-            }
-
-            p_data = (uint8_t*) l_dest_ptr;
-        }
-        break;
-        case 4: {
-            int32_t * l_dest_ptr = (int32_t *) p_data;
-            for (j=0; j<l_height; ++j) {
-                for (k=0; k<l_width; ++k) {
-                    *(l_dest_ptr++) = *(l_src_ptr++);
-                }
-                l_src_ptr += l_stride;
-            }
-
-            p_data = (uint8_t*) l_dest_ptr;
-        }
-        break;
-        }
-    }
-}
-
 static bool opj_j2k_post_write_tile (      opj_j2k_t * p_j2k,
         opj_stream_private_t *p_stream,
         opj_event_mgr_t * p_manager )
@@ -10251,6 +10863,9 @@ static bool opj_j2k_write_first_tile_part (opj_j2k_t *p_j2k,
         }
     }
 
+    /* precoded tiles were rate allocated for this header size */
+    assert(l_nb_bytes_written == opj_j2k_get_first_tile_part_header_size(p_j2k, p_j2k->m_current_tile_number));
+
     l_current_nb_bytes_written = 0;
     if (! opj_j2k_write_sod(p_j2k,l_tcd,p_data,&l_current_nb_bytes_written,p_total_data_size,p_stream,p_manager)) {
         return false;
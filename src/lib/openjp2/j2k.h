@@ -284,6 +284,13 @@ struct opj_tcp_t {
 
     opj_seg_buf_t* m_data;
 
+    /** packet lengths read from PLT markers, in codestream order */
+    uint32_t *m_packet_lengths;
+    /** number of packet lengths read */
+    uint32_t m_nb_packet_lengths;
+    /** size of the m_packet_lengths array */
+    uint32_t m_max_packet_lengths;
+
     /** encoding norms */
     double *	mct_norms;
     /** the mct decoding matrix */
@@ -411,6 +418,16 @@ typedef struct opj_cp {
 } opj_cp_t;
 
 
+/**
+Tile-part length read from a TLM marker
+*/
+typedef struct opj_tlm_info {
+    /** index of the tile the tile-part belongs to */
+    uint32_t m_tile_no;
+    /** length of the tile-part, from the start of its SOT marker */
+    uint32_t m_length;
+} opj_tlm_info_t;
+
 typedef struct opj_j2k_dec {
     /** Decoder state: used to indicate in which part of the codestream the decoder is (main header, tile header, end) */
     uint32_t m_state;
@@ -433,11 +450,21 @@ typedef struct opj_j2k_dec {
     uint32_t m_DA_x1;
     uint32_t m_DA_y1;
 
+    /** caller-owned destination of opj_decode, unset when data is NULL */
+    opj_decode_buffer_t m_decode_buffer;
+
     /** Index of the tile to decode (used in get_tile); initialized to -1 */
     int32_t m_tile_ind_to_dec;
     /** Position of the last SOT marker read */
     int64_t m_last_sot_read_pos;
 
+    /** tile-part lengths from TLM markers, in codestream order */
+    opj_tlm_info_t *m_tlm_entries;
+    /** number of tile-part lengths read */
+    uint32_t m_nb_tlm_entries;
+    /** size of the m_tlm_entries array */
+    uint32_t m_max_tlm_entries;
+
     /**
      * Indicate that the current tile-part is assumed to be the last tile part of the codestream.
      * This is useful in the case when PSot is equal to zero. The sot length will be computed in the
@@ -679,6 +706,21 @@ bool opj_j2k_set_decode_area(	opj_j2k_t *p_j2k,
                                 uint32_t p_end_x, uint32_t p_end_y,
                                 opj_event_mgr_t * p_manager );
 
+/**
+ * Sets the caller-owned buffer the image is decoded into.
+ *
+ * @param	p_j2k			the jpeg2000 codec.
+ * @param	p_image			the image previously set by opj_read_header.
+ * @param	p_buffer		the destination buffer, or NULL to decode into the image components.
+ * @param	p_manager		the user event manager
+ *
+ * @return	true			if the buffer could be set.
+ */
+bool opj_j2k_set_decode_buffer(	opj_j2k_t *p_j2k,
+                                opj_image_t* p_image,
+                                opj_decode_buffer_t* p_buffer,
+                                opj_event_mgr_t * p_manager );
+
 /**
  * Creates a J2K decompression structure.
  *
@@ -735,6 +777,19 @@ opj_codestream_info_v2_t* j2k_get_cstr_info(opj_j2k_t* p_j2k);
  */
 opj_codestream_index_t* j2k_get_cstr_index(opj_j2k_t* p_j2k);
 
+/**
+ * Set the tile-part positions of a tile, e.g. from a previous decode of the same file.
+ * Tiles whose tile-parts are already known are left untouched.
+ *
+ *@param	p_j2k		the jpeg2000 codec, after the main header has been read.
+ *@param	tileno		the tile index.
+ *@param	tp_index	positions of the tile-parts of the tile.
+ *@param	nb_tps		number of tile-parts.
+ *
+ *@return	true if successful
+ */
+bool j2k_set_tile_part_index(opj_j2k_t* p_j2k, uint32_t tileno, const opj_tp_index_t* tp_index, uint32_t nb_tps);
+
 /**
  * Decode an image from a JPEG-2000 codestream
  * @param j2k J2K decompressor handle
@@ -1517,6 +1517,15 @@ bool opj_jp2_decode(opj_jp2_t *jp2,
     if (!p_image)
         return false;
 
+    /* palettes and channel definitions rearrange the component data, which is not kept
+       when decoding into a caller buffer */
+    if (jp2->j2k->m_specific_param.m_decoder.m_decode_buffer.data &&
+            !jp2->ignore_pclr_cmap_cdef &&
+            (jp2->color.jp2_pclr || jp2->color.jp2_cdef)) {
+        opj_event_msg(p_manager, EVT_ERROR, "JP2 palette and channel definition boxes are not supported when decoding into a buffer\n");
+        return false;
+    }
+
     /* J2K decoding */
     if( ! opj_j2k_decode(jp2->j2k, tile, p_stream, p_image, p_manager) ) {
         opj_event_msg(p_manager, EVT_ERROR, "Failed to decode the codestream in the JP2 file\n");
@@ -2834,6 +2843,15 @@ bool opj_jp2_set_decode_area(	opj_jp2_t *p_jp2,
     return opj_j2k_set_decode_area(p_jp2->j2k, p_image, p_start_x, p_start_y, p_end_x, p_end_y, p_manager);
 }
 
+bool opj_jp2_set_decode_buffer(	opj_jp2_t *p_jp2,
+                                opj_image_t* p_image,
+                                opj_decode_buffer_t* p_buffer,
+                                opj_event_mgr_t * p_manager
+                              )
+{
+    return opj_j2k_set_decode_buffer(p_jp2->j2k, p_image, p_buffer, p_manager);
+}
+
 bool opj_jp2_get_tile(	opj_jp2_t *p_jp2,
                         opj_stream_private_t *p_stream,
                         opj_image_t* p_image,
@@ -2952,6 +2970,11 @@ opj_codestream_index_t* jp2_get_cstr_index(opj_jp2_t* p_jp2)
     return j2k_get_cstr_index(p_jp2->j2k);
 }
 
+bool jp2_set_tile_part_index(opj_jp2_t* p_jp2, uint32_t tileno, const opj_tp_index_t* tp_index, uint32_t nb_tps)
+{
+    return j2k_set_tile_part_index(p_jp2->j2k, tileno, tp_index, nb_tps);
+}
+
 opj_codestream_info_v2_t* jp2_get_cstr_info(opj_jp2_t* p_jp2)
 {
     return j2k_get_cstr_info(p_jp2->j2k);
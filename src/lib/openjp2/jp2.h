@@ -437,6 +437,21 @@ bool opj_jp2_set_decode_area(  opj_jp2_t *p_jp2,
                                uint32_t p_end_x, uint32_t p_end_y,
                                opj_event_mgr_t * p_manager );
 
+/**
+ * Sets the caller-owned buffer the image is decoded into.
+ *
+ * @param  p_jp2       the jpeg2000 codec.
+ * @param  p_image     the image previously set by opj_read_header.
+ * @param  p_buffer    the destination buffer, or NULL to decode into the image components.
+ * @param  p_manager   the user event manager
+ *
+ * @return  true      if the buffer could be set.
+ */
+bool opj_jp2_set_decode_buffer(  opj_jp2_t *p_jp2,
+                                 opj_image_t* p_image,
+                                 opj_decode_buffer_t* p_buffer,
+                                 opj_event_mgr_t * p_manager );
+
 /**
 *
 */
@@ -484,6 +499,11 @@ opj_codestream_info_v2_t* jp2_get_cstr_info(opj_jp2_t* p_jp2);
  */
 opj_codestream_index_t* jp2_get_cstr_index(opj_jp2_t* p_jp2);
 
+/**
+ * Set the tile-part positions of a tile (see j2k_set_tile_part_index)
+ */
+bool jp2_set_tile_part_index(opj_jp2_t* p_jp2, uint32_t tileno, const opj_tp_index_t* tp_index, uint32_t nb_tps);
+
 
 /*@}*/
 
@@ -55,6 +55,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "cpu_features.h"
 #ifdef __SSE__
 #include <xmmintrin.h>
 #endif
@@ -64,9 +65,22 @@
 #ifdef __SSE4_1__
 #include <smmintrin.h>
 #endif
+#if defined(__AVX__) || defined(OPJ_HAVE_TARGET_KERNELS)
+#include <immintrin.h>
+#endif
 
 #include "opj_includes.h"
 
+/* SSE 4.1 kernels are built when the build flags allow them, or for run time selection */
+#if defined(__SSE4_1__) || defined(OPJ_HAVE_TARGET_KERNELS)
+#define OPJ_MCT_HAVE_SSE41
+#ifdef OPJ_HAVE_TARGET_KERNELS
+#define OPJ_MCT_SSE41 OPJ_TARGET_SSE41
+#else
+#define OPJ_MCT_SSE41
+#endif
+#endif
+
 /* <summary> */
 /* This table contains the norms of the basis function of the reversible MCT. */
 /* </summary> */
@@ -91,7 +105,7 @@ const double * opj_mct_get_mct_norms_real ()
 /* Forward reversible MCT. */
 /* </summary> */
 #ifdef __SSE2__
-void opj_mct_encode(
+static void opj_mct_encode_base(
     int32_t* restrict c0,
     int32_t* restrict c1,
     int32_t* restrict c2,
@@ -99,25 +113,22 @@ void opj_mct_encode(
 {
     size_t i;
     const size_t len = n;
-    /* buffer are aligned on 16 bytes */
-    assert( ((size_t)c0 & 0xf) == 0 );
-    assert( ((size_t)c1 & 0xf) == 0 );
-    assert( ((size_t)c2 & 0xf) == 0 );
 
+    /* rows of a tile need not be aligned on 16 bytes */
     for(i = 0; i < (len & ~3U); i += 4) {
         __m128i y, u, v;
-        __m128i r = _mm_load_si128((const __m128i *)&(c0[i]));
-        __m128i g = _mm_load_si128((const __m128i *)&(c1[i]));
-        __m128i b = _mm_load_si128((const __m128i *)&(c2[i]));
+        __m128i r = _mm_loadu_si128((const __m128i *)&(c0[i]));
+        __m128i g = _mm_loadu_si128((const __m128i *)&(c1[i]));
+        __m128i b = _mm_loadu_si128((const __m128i *)&(c2[i]));
         y = _mm_add_epi32(g, g);
         y = _mm_add_epi32(y, b);
         y = _mm_add_epi32(y, r);
         y = _mm_srai_epi32(y, 2);
         u = _mm_sub_epi32(b, g);
         v = _mm_sub_epi32(r, g);
-        _mm_store_si128((__m128i *)&(c0[i]), y);
-        _mm_store_si128((__m128i *)&(c1[i]), u);
-        _mm_store_si128((__m128i *)&(c2[i]), v);
+        _mm_storeu_si128((__m128i *)&(c0[i]), y);
+        _mm_storeu_si128((__m128i *)&(c1[i]), u);
+        _mm_storeu_si128((__m128i *)&(c2[i]), v);
     }
 
     for(; i < len; ++i) {
@@ -133,7 +144,7 @@ void opj_mct_encode(
     }
 }
 #else
-void opj_mct_encode(
+static void opj_mct_encode_base(
     int32_t* restrict c0,
     int32_t* restrict c1,
     int32_t* restrict c2,
@@ -160,7 +171,7 @@ void opj_mct_encode(
 /* Inverse reversible MCT. */
 /* </summary> */
 #ifdef __SSE2__
-void opj_mct_decode(
+static void opj_mct_decode_base(
     int32_t* restrict c0,
     int32_t* restrict c1,
     int32_t* restrict c2,
@@ -195,7 +206,7 @@ void opj_mct_decode(
     }
 }
 #else
-void opj_mct_decode(
+static void opj_mct_decode_base(
     int32_t* restrict c0,
     int32_t* restrict c1,
     int32_t* restrict c2,
@@ -237,8 +248,8 @@ double opj_mct_getnorm(uint32_t compno)
 /* <summary> */
 /* Forward irreversible MCT. */
 /* </summary> */
-#ifdef __SSE4_1__
-void opj_mct_encode_real(
+#ifdef OPJ_MCT_HAVE_SSE41
+OPJ_MCT_SSE41 static void opj_mct_encode_real_sse41(
     int32_t* restrict c0,
     int32_t* restrict c1,
     int32_t* restrict c2,
@@ -261,9 +272,9 @@ void opj_mct_encode_real(
     for(i = 0; i < (len & ~3U); i += 4) {
         __m128i lo, hi;
         __m128i y, u, v;
-        __m128i r = _mm_load_si128((const __m128i *)&(c0[i]));
-        __m128i g = _mm_load_si128((const __m128i *)&(c1[i]));
-        __m128i b = _mm_load_si128((const __m128i *)&(c2[i]));
+        __m128i r = _mm_loadu_si128((const __m128i *)&(c0[i]));
+        __m128i g = _mm_loadu_si128((const __m128i *)&(c1[i]));
+        __m128i b = _mm_loadu_si128((const __m128i *)&(c2[i]));
 
         lo = r;
         hi = _mm_shuffle_epi32(r, _MM_SHUFFLE(3, 3, 1, 1));
@@ -294,7 +305,7 @@ void opj_mct_encode_real(
         lo = _mm_srli_epi64(lo, 13);
         hi = _mm_slli_epi64(hi, 32-13);
         y = _mm_add_epi32(y, _mm_blend_epi16(lo, hi, 0xCC));
-        _mm_store_si128((__m128i *)&(c0[i]), y);
+        _mm_storeu_si128((__m128i *)&(c0[i]), y);
 
         /*lo = b;
         hi = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 3, 1, 1));
@@ -329,7 +340,7 @@ void opj_mct_encode_real(
         lo = _mm_srli_epi64(lo, 13);
         hi = _mm_slli_epi64(hi, 32-13);
         u = _mm_sub_epi32(u, _mm_blend_epi16(lo, hi, 0xCC));
-        _mm_store_si128((__m128i *)&(c1[i]), u);
+        _mm_storeu_si128((__m128i *)&(c1[i]), u);
 
         /*lo = r;
         hi = _mm_shuffle_epi32(r, _MM_SHUFFLE(3, 3, 1, 1));
@@ -364,7 +375,7 @@ void opj_mct_encode_real(
         lo = _mm_srli_epi64(lo, 13);
         hi = _mm_slli_epi64(hi, 32-13);
         v = _mm_sub_epi32(v, _mm_blend_epi16(lo, hi, 0xCC));
-        _mm_store_si128((__m128i *)&(c2[i]), v);
+        _mm_storeu_si128((__m128i *)&(c2[i]), v);
     }
     for(; i < len; ++i) {
         int32_t r = c0[i];
@@ -378,8 +389,9 @@ void opj_mct_encode_real(
         c2[i] = v;
     }
 }
-#else
-void opj_mct_encode_real(
+#endif
+#ifndef __SSE4_1__
+static void opj_mct_encode_real_c(
     int32_t* restrict c0,
     int32_t* restrict c1,
     int32_t* restrict c2,
@@ -403,7 +415,7 @@ void opj_mct_encode_real(
 /* <summary> */
 /* Inverse irreversible MCT. */
 /* </summary> */
-void opj_mct_decode_real(
+static void opj_mct_decode_real_base(
     float* restrict c0,
     float* restrict c1,
     float* restrict c2,
@@ -470,6 +482,114 @@ void opj_mct_decode_real(
 #endif
 }
 
+#ifdef __SSE2__
+static inline __m128i opj_mct_clamp_epi32(__m128i v, __m128i min, __m128i max)
+{
+#ifdef __SSE4_1__
+    return _mm_min_epi32(_mm_max_epi32(v, min), max);
+#else
+    __m128i lt = _mm_cmplt_epi32(v, min);
+    v = _mm_or_si128(_mm_and_si128(lt, min), _mm_andnot_si128(lt, v));
+    __m128i gt = _mm_cmpgt_epi32(v, max);
+    return _mm_or_si128(_mm_and_si128(gt, max), _mm_andnot_si128(gt, v));
+#endif
+}
+#endif
+
+/* <summary> */
+/* Inverse reversible MCT, fused with DC level shift and clamp. */
+/* </summary> */
+static void opj_mct_decode_shift_base(
+    int32_t* restrict c0,
+    int32_t* restrict c1,
+    int32_t* restrict c2,
+    uint32_t n,
+    const int32_t* shift,
+    const int32_t* min,
+    const int32_t* max)
+{
+    size_t i = 0;
+    const size_t len = n;
+#ifdef __SSE2__
+    const __m128i vshift0 = _mm_set1_epi32(shift[0]), vshift1 = _mm_set1_epi32(shift[1]), vshift2 = _mm_set1_epi32(shift[2]);
+    const __m128i vmin0 = _mm_set1_epi32(min[0]), vmin1 = _mm_set1_epi32(min[1]), vmin2 = _mm_set1_epi32(min[2]);
+    const __m128i vmax0 = _mm_set1_epi32(max[0]), vmax1 = _mm_set1_epi32(max[1]), vmax2 = _mm_set1_epi32(max[2]);
+
+    for(; i < (len & ~(size_t)3); i += 4) {
+        __m128i r, g, b;
+        __m128i y = _mm_loadu_si128((const __m128i *)&(c0[i]));
+        __m128i u = _mm_loadu_si128((const __m128i *)&(c1[i]));
+        __m128i v = _mm_loadu_si128((const __m128i *)&(c2[i]));
+        g = _mm_sub_epi32(y, _mm_srai_epi32(_mm_add_epi32(u, v), 2));
+        r = _mm_add_epi32(v, g);
+        b = _mm_add_epi32(u, g);
+        _mm_storeu_si128((__m128i *)&(c0[i]), opj_mct_clamp_epi32(_mm_add_epi32(r, vshift0), vmin0, vmax0));
+        _mm_storeu_si128((__m128i *)&(c1[i]), opj_mct_clamp_epi32(_mm_add_epi32(g, vshift1), vmin1, vmax1));
+        _mm_storeu_si128((__m128i *)&(c2[i]), opj_mct_clamp_epi32(_mm_add_epi32(b, vshift2), vmin2, vmax2));
+    }
+#endif
+    for (; i < len; ++i) {
+        int32_t y = c0[i];
+        int32_t u = c1[i];
+        int32_t v = c2[i];
+        int32_t g = y - ((u + v) >> 2);
+        int32_t r = v + g;
+        int32_t b = u + g;
+        c0[i] = opj_int_clamp(r + shift[0], min[0], max[0]);
+        c1[i] = opj_int_clamp(g + shift[1], min[1], max[1]);
+        c2[i] = opj_int_clamp(b + shift[2], min[2], max[2]);
+    }
+}
+
+/* <summary> */
+/* Inverse irreversible MCT, fused with rounding, DC level shift and clamp. */
+/* </summary> */
+static void opj_mct_decode_real_shift_base(
+    float* restrict c0,
+    float* restrict c1,
+    float* restrict c2,
+    uint32_t n,
+    const int32_t* shift,
+    const int32_t* min,
+    const int32_t* max)
+{
+    size_t i = 0;
+    const size_t len = n;
+#ifdef __SSE2__
+    const __m128 vrv = _mm_set1_ps(1.402f);
+    const __m128 vgu = _mm_set1_ps(0.34413f);
+    const __m128 vgv = _mm_set1_ps(0.71414f);
+    const __m128 vbu = _mm_set1_ps(1.772f);
+    const __m128i vshift0 = _mm_set1_epi32(shift[0]), vshift1 = _mm_set1_epi32(shift[1]), vshift2 = _mm_set1_epi32(shift[2]);
+    const __m128i vmin0 = _mm_set1_epi32(min[0]), vmin1 = _mm_set1_epi32(min[1]), vmin2 = _mm_set1_epi32(min[2]);
+    const __m128i vmax0 = _mm_set1_epi32(max[0]), vmax1 = _mm_set1_epi32(max[1]), vmax2 = _mm_set1_epi32(max[2]);
+
+    for(; i < (len & ~(size_t)3); i += 4) {
+        __m128 vy = _mm_loadu_ps(c0 + i);
+        __m128 vu = _mm_loadu_ps(c1 + i);
+        __m128 vv = _mm_loadu_ps(c2 + i);
+        __m128 vr = _mm_add_ps(vy, _mm_mul_ps(vv, vrv));
+        __m128 vg = _mm_sub_ps(_mm_sub_ps(vy, _mm_mul_ps(vu, vgu)), _mm_mul_ps(vv, vgv));
+        __m128 vb = _mm_add_ps(vy, _mm_mul_ps(vu, vbu));
+        /* _mm_cvtps_epi32 rounds to nearest even, as lrintf does */
+        _mm_storeu_si128((__m128i *)(c0 + i), opj_mct_clamp_epi32(_mm_add_epi32(_mm_cvtps_epi32(vr), vshift0), vmin0, vmax0));
+        _mm_storeu_si128((__m128i *)(c1 + i), opj_mct_clamp_epi32(_mm_add_epi32(_mm_cvtps_epi32(vg), vshift1), vmin1, vmax1));
+        _mm_storeu_si128((__m128i *)(c2 + i), opj_mct_clamp_epi32(_mm_add_epi32(_mm_cvtps_epi32(vb), vshift2), vmin2, vmax2));
+    }
+#endif
+    for (; i < len; ++i) {
+        float y = c0[i];
+        float u = c1[i];
+        float v = c2[i];
+        float r = y + (v * 1.402f);
+        float g = y - (u * 0.34413f) - (v * (0.71414f));
+        float b = y + (u * 1.772f);
+        ((int32_t*)c0)[i] = opj_int_clamp((int32_t)opj_lrintf(r) + shift[0], min[0], max[0]);
+        ((int32_t*)c1)[i] = opj_int_clamp((int32_t)opj_lrintf(g) + shift[1], min[1], max[1]);
+        ((int32_t*)c2)[i] = opj_int_clamp((int32_t)opj_lrintf(b) + shift[2], min[2], max[2]);
+    }
+}
+
 /* <summary> */
 /* Get norm of basis function of irreversible MCT. */
 /* </summary> */
@@ -479,6 +599,516 @@ double opj_mct_getnorm_real(uint32_t compno)
 }
 
 
+#ifdef OPJ_HAVE_TARGET_KERNELS
+/* opj_int_fix_mul on eight lanes */
+OPJ_TARGET_AVX2 static inline __m256i opj_mct_fix_mul_avx2(__m256i a, __m256i coeff)
+{
+    const __m256i round = _mm256_set1_epi64x(4096);
+    __m256i lo = _mm256_mul_epi32(a, coeff);
+    __m256i hi = _mm256_mul_epi32(_mm256_srli_epi64(a, 32), coeff);
+    lo = _mm256_srli_epi64(_mm256_add_epi64(lo, round), 13);
+    hi = _mm256_slli_epi64(_mm256_add_epi64(hi, round), 32 - 13);
+    return _mm256_blend_epi32(lo, hi, 0xAA);
+}
+
+/* opj_int_fix_mul on sixteen lanes; the zero-masking forms, with every lane
+   selected, initialise the pass-through operand that the plain intrinsics leave
+   undefined (and that GCC then reports as maybe-uninitialized) */
+OPJ_TARGET_AVX512 static inline __m512i opj_mct_fix_mul_avx512(__m512i a, __m512i coeff)
+{
+    const __mmask8 all = 0xFF;
+    const __m512i round = _mm512_set1_epi64(4096);
+    __m512i lo = _mm512_maskz_mul_epi32(all, a, coeff);
+    __m512i hi = _mm512_maskz_mul_epi32(all, _mm512_maskz_srli_epi64(all, a, 32), coeff);
+    lo = _mm512_maskz_srli_epi64(all, _mm512_add_epi64(lo, round), 13);
+    hi = _mm512_maskz_slli_epi64(all, _mm512_add_epi64(hi, round), 32 - 13);
+    return _mm512_mask_blend_epi32(0xAAAA, lo, hi);
+}
+
+OPJ_TARGET_AVX2 static void opj_mct_encode_avx2(
+    int32_t* restrict c0,
+    int32_t* restrict c1,
+    int32_t* restrict c2,
+    uint32_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i r = _mm256_loadu_si256((const __m256i *)(c0 + i));
+        __m256i g = _mm256_loadu_si256((const __m256i *)(c1 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(c2 + i));
+        __m256i y = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(g, g), b), r), 2);
+        _mm256_storeu_si256((__m256i *)(c0 + i), y);
+        _mm256_storeu_si256((__m256i *)(c1 + i), _mm256_sub_epi32(b, g));
+        _mm256_storeu_si256((__m256i *)(c2 + i), _mm256_sub_epi32(r, g));
+    }
+    opj_mct_encode_base(c0 + i, c1 + i, c2 + i, n - (uint32_t)i);
+}
+
+OPJ_TARGET_AVX2 static void opj_mct_decode_avx2(
+    int32_t* restrict c0,
+    int32_t* restrict c1,
+    int32_t* restrict c2,
+    uint32_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i y = _mm256_loadu_si256((const __m256i *)(c0 + i));
+        __m256i u = _mm256_loadu_si256((const __m256i *)(c1 + i));
+        __m256i v = _mm256_loadu_si256((const __m256i *)(c2 + i));
+        __m256i g = _mm256_sub_epi32(y, _mm256_srai_epi32(_mm256_add_epi32(u, v), 2));
+        _mm256_storeu_si256((__m256i *)(c0 + i), _mm256_add_epi32(v, g));
+        _mm256_storeu_si256((__m256i *)(c1 + i), g);
+        _mm256_storeu_si256((__m256i *)(c2 + i), _mm256_add_epi32(u, g));
+    }
+    opj_mct_decode_base(c0 + i, c1 + i, c2 + i, n - (uint32_t)i);
+}
+
+OPJ_TARGET_AVX2 static void opj_mct_encode_real_avx2(
+    int32_t* restrict c0,
+    int32_t* restrict c1,
+    int32_t* restrict c2,
+    uint32_t n)
+{
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i r = _mm256_loadu_si256((const __m256i *)(c0 + i));
+        __m256i g = _mm256_loadu_si256((const __m256i *)(c1 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(c2 + i));
+        __m256i y = _mm256_add_epi32(_mm256_add_epi32(opj_mct_fix_mul_avx2(r, _mm256_set1_epi32(2449)),
+                                     opj_mct_fix_mul_avx2(g, _mm256_set1_epi32(4809))),
+                                     opj_mct_fix_mul_avx2(b, _mm256_set1_epi32(934)));
+        __m256i u = _mm256_sub_epi32(_mm256_sub_epi32(opj_mct_fix_mul_avx2(b, _mm256_set1_epi32(4096)),
+                                     opj_mct_fix_mul_avx2(r, _mm256_set1_epi32(1382))),
+                                     opj_mct_fix_mul_avx2(g, _mm256_set1_epi32(2714)));
+        __m256i v = _mm256_sub_epi32(_mm256_sub_epi32(opj_mct_fix_mul_avx2(r, _mm256_set1_epi32(4096)),
+                                     opj_mct_fix_mul_avx2(g, _mm256_set1_epi32(3430))),
+                                     opj_mct_fix_mul_avx2(b, _mm256_set1_epi32(666)));
+        _mm256_storeu_si256((__m256i *)(c0 + i), y);
+        _mm256_storeu_si256((__m256i *)(c1 + i), u);
+        _mm256_storeu_si256((__m256i *)(c2 + i), v);
+    }
+    for(; i < n; ++i) {
+        int32_t r = c0[i];
+        int32_t g = c1[i];
+        int32_t b = c2[i];
+        c0[i] =  opj_int_fix_mul(r, 2449) + opj_int_fix_mul(g, 4809) + opj_int_fix_mul(b, 934);
+        c1[i] = -opj_int_fix_mul(r, 1382) - opj_int_fix_mul(g, 2714) + opj_int_fix_mul(b, 4096);
+        c2[i] =  opj_int_fix_mul(r, 4096) - opj_int_fix_mul(g, 3430) - opj_int_fix_mul(b, 666);
+    }
+}
+
+OPJ_TARGET_AVX static void opj_mct_decode_real_avx(
+    float* restrict c0,
+    float* restrict c1,
+    float* restrict c2,
+    uint32_t n)
+{
+    const __m256 vrv = _mm256_set1_ps(1.402f);
+    const __m256 vgu = _mm256_set1_ps(0.34413f);
+    const __m256 vgv = _mm256_set1_ps(0.71414f);
+    const __m256 vbu = _mm256_set1_ps(1.772f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 vy = _mm256_loadu_ps(c0 + i);
+        __m256 vu = _mm256_loadu_ps(c1 + i);
+        __m256 vv = _mm256_loadu_ps(c2 + i);
+        _mm256_storeu_ps(c0 + i, _mm256_add_ps(vy, _mm256_mul_ps(vv, vrv)));
+        _mm256_storeu_ps(c1 + i, _mm256_sub_ps(_mm256_sub_ps(vy, _mm256_mul_ps(vu, vgu)), _mm256_mul_ps(vv, vgv)));
+        _mm256_storeu_ps(c2 + i, _mm256_add_ps(vy, _mm256_mul_ps(vu, vbu)));
+    }
+    for (; i < n; ++i) {
+        float y = c0[i];
+        float u = c1[i];
+        float v = c2[i];
+        c0[i] = y + (v * 1.402f);
+        c1[i] = y - (u * 0.34413f) - (v * (0.71414f));
+        c2[i] = y + (u * 1.772f);
+    }
+}
+
+OPJ_TARGET_AVX2 static inline __m256i opj_mct_clamp_avx2(__m256i v, __m256i min, __m256i max)
+{
+    return _mm256_min_epi32(_mm256_max_epi32(v, min), max);
+}
+
+OPJ_TARGET_AVX2 static void opj_mct_decode_shift_avx2(
+    int32_t* restrict c0,
+    int32_t* restrict c1,
+    int32_t* restrict c2,
+    uint32_t n,
+    const int32_t* shift,
+    const int32_t* min,
+    const int32_t* max)
+{
+    const __m256i vshift0 = _mm256_set1_epi32(shift[0]), vshift1 = _mm256_set1_epi32(shift[1]), vshift2 = _mm256_set1_epi32(shift[2]);
+    const __m256i vmin0 = _mm256_set1_epi32(min[0]), vmin1 = _mm256_set1_epi32(min[1]), vmin2 = _mm256_set1_epi32(min[2]);
+    const __m256i vmax0 = _mm256_set1_epi32(max[0]), vmax1 = _mm256_set1_epi32(max[1]), vmax2 = _mm256_set1_epi32(max[2]);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256i y = _mm256_loadu_si256((const __m256i *)(c0 + i));
+        __m256i u = _mm256_loadu_si256((const __m256i *)(c1 + i));
+        __m256i v = _mm256_loadu_si256((const __m256i *)(c2 + i));
+        __m256i g = _mm256_sub_epi32(y, _mm256_srai_epi32(_mm256_add_epi32(u, v), 2));
+        __m256i r = _mm256_add_epi32(v, g);
+        __m256i b = _mm256_add_epi32(u, g);
+        _mm256_storeu_si256((__m256i *)(c0 + i), opj_mct_clamp_avx2(_mm256_add_epi32(r, vshift0), vmin0, vmax0));
+        _mm256_storeu_si256((__m256i *)(c1 + i), opj_mct_clamp_avx2(_mm256_add_epi32(g, vshift1), vmin1, vmax1));
+        _mm256_storeu_si256((__m256i *)(c2 + i), opj_mct_clamp_avx2(_mm256_add_epi32(b, vshift2), vmin2, vmax2));
+    }
+    opj_mct_decode_shift_base(c0 + i, c1 + i, c2 + i, n - (uint32_t)i, shift, min, max);
+}
+
+OPJ_TARGET_AVX2 static void opj_mct_decode_real_shift_avx2(
+    float* restrict c0,
+    float* restrict c1,
+    float* restrict c2,
+    uint32_t n,
+    const int32_t* shift,
+    const int32_t* min,
+    const int32_t* max)
+{
+    const __m256 vrv = _mm256_set1_ps(1.402f);
+    const __m256 vgu = _mm256_set1_ps(0.34413f);
+    const __m256 vgv = _mm256_set1_ps(0.71414f);
+    const __m256 vbu = _mm256_set1_ps(1.772f);
+    const __m256i vshift0 = _mm256_set1_epi32(shift[0]), vshift1 = _mm256_set1_epi32(shift[1]), vshift2 = _mm256_set1_epi32(shift[2]);
+    const __m256i vmin0 = _mm256_set1_epi32(min[0]), vmin1 = _mm256_set1_epi32(min[1]), vmin2 = _mm256_set1_epi32(min[2]);
+    const __m256i vmax0 = _mm256_set1_epi32(max[0]), vmax1 = _mm256_set1_epi32(max[1]), vmax2 = _mm256_set1_epi32(max[2]);
+    size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        __m256 vy = _mm256_loadu_ps(c0 + i);
+        __m256 vu = _mm256_loadu_ps(c1 + i);
+        __m256 vv = _mm256_loadu_ps(c2 + i);
+        __m256 vr = _mm256_add_ps(vy, _mm256_mul_ps(vv, vrv));
+        __m256 vg = _mm256_sub_ps(_mm256_sub_ps(vy, _mm256_mul_ps(vu, vgu)), _mm256_mul_ps(vv, vgv));
+        __m256 vb = _mm256_add_ps(vy, _mm256_mul_ps(vu, vbu));
+        _mm256_storeu_si256((__m256i *)(c0 + i), opj_mct_clamp_avx2(_mm256_add_epi32(_mm256_cvtps_epi32(vr), vshift0), vmin0, vmax0));
+        _mm256_storeu_si256((__m256i *)(c1 + i), opj_mct_clamp_avx2(_mm256_add_epi32(_mm256_cvtps_epi32(vg), vshift1), vmin1, vmax1));
+        _mm256_storeu_si256((__m256i *)(c2 + i), opj_mct_clamp_avx2(_mm256_add_epi32(_mm256_cvtps_epi32(vb), vshift2), vmin2, vmax2));
+    }
+    opj_mct_decode_real_shift_base(c0 + i, c1 + i, c2 + i, n - (uint32_t)i, shift, min, max);
+}
+#endif
+
+/* custom transforms with up to this many components get a kernel unrolled for their size */
+#define OPJ_MCT_MAX_UNROLLED_COMPS 16
+
+/*
+Forward custom MCT for N components, from sample i on: each sample is read from all
+components before every output component is accumulated from them and written back
+in place. The SIMD kernels below do the same on blocks of samples held in registers.
+*/
+template <uint32_t N> static void opj_mct_encode_custom_c(const int32_t* restrict matrix,
+        size_t i,
+        size_t n,
+        int32_t* const* data)
+{
+    for (; i < n; ++i) {
+        int32_t in[N];
+        for (uint32_t k = 0; k < N; ++k)
+            in[k] = data[k][i];
+        for (uint32_t j = 0; j < N; ++j) {
+            int32_t acc = 0;
+            for (uint32_t k = 0; k < N; ++k)
+                acc += opj_int_fix_mul(matrix[j * N + k], in[k]);
+            data[j][i] = acc;
+        }
+    }
+}
+
+/* inverse custom MCT for N components, from sample i on */
+template <uint32_t N> static void opj_mct_decode_custom_c(const float* restrict matrix,
+        size_t i,
+        size_t n,
+        float* const* data)
+{
+    for (; i < n; ++i) {
+        float in[N];
+        for (uint32_t k = 0; k < N; ++k)
+            in[k] = data[k][i];
+        for (uint32_t j = 0; j < N; ++j) {
+            float acc = 0;
+            for (uint32_t k = 0; k < N; ++k)
+                acc += matrix[j * N + k] * in[k];
+            data[j][i] = acc;
+        }
+    }
+}
+
+template <uint32_t N> static void opj_mct_encode_custom_base(const int32_t* restrict matrix,
+        size_t n,
+        int32_t* const* data)
+{
+    opj_mct_encode_custom_c<N>(matrix, 0, n, data);
+}
+
+#ifdef __SSE__
+template <uint32_t N> static void opj_mct_decode_custom_sse(const float* restrict matrix,
+        size_t n,
+        float* const* data)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 in[N];
+        for (uint32_t k = 0; k < N; ++k)
+            in[k] = _mm_loadu_ps(data[k] + i);
+        for (uint32_t j = 0; j < N; ++j) {
+            __m128 acc = _mm_setzero_ps();
+            for (uint32_t k = 0; k < N; ++k)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(matrix[j * N + k]), in[k]));
+            _mm_storeu_ps(data[j] + i, acc);
+        }
+    }
+    opj_mct_decode_custom_c<N>(matrix, i, n, data);
+}
+#else
+template <uint32_t N> static void opj_mct_decode_custom_base(const float* restrict matrix,
+        size_t n,
+        float* const* data)
+{
+    opj_mct_decode_custom_c<N>(matrix, 0, n, data);
+}
+#endif
+
+#ifdef OPJ_MCT_HAVE_SSE41
+/* opj_int_fix_mul on four lanes */
+OPJ_MCT_SSE41 static inline __m128i opj_mct_fix_mul_sse41(__m128i a, __m128i coeff)
+{
+    const __m128i round = _mm_set1_epi64x(4096);
+    __m128i lo = _mm_mul_epi32(a, coeff);
+    __m128i hi = _mm_mul_epi32(_mm_srli_epi64(a, 32), coeff);
+    lo = _mm_srli_epi64(_mm_add_epi64(lo, round), 13);
+    hi = _mm_slli_epi64(_mm_add_epi64(hi, round), 32 - 13);
+    return _mm_blend_epi16(lo, hi, 0xCC);
+}
+
+template <uint32_t N> OPJ_MCT_SSE41 static void opj_mct_encode_custom_sse41(const int32_t* restrict matrix,
+        size_t n,
+        int32_t* const* data)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i in[N];
+        for (uint32_t k = 0; k < N; ++k)
+            in[k] = _mm_loadu_si128((const __m128i*)(data[k] + i));
+        for (uint32_t j = 0; j < N; ++j) {
+            __m128i acc = _mm_setzero_si128();
+            for (uint32_t k = 0; k < N; ++k)
+                acc = _mm_add_epi32(acc, opj_mct_fix_mul_sse41(in[k], _mm_set1_epi32(matrix[j * N + k])));
+            _mm_storeu_si128((__m128i*)(data[j] + i), acc);
+        }
+    }
+    opj_mct_encode_custom_c<N>(matrix, i, n, data);
+}
+#endif
+
+#ifdef OPJ_HAVE_TARGET_KERNELS
+template <uint32_t N> OPJ_TARGET_AVX2 static void opj_mct_encode_custom_avx2(const int32_t* restrict matrix,
+        size_t n,
+        int32_t* const* data)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i in[N];
+        for (uint32_t k = 0; k < N; ++k)
+            in[k] = _mm256_loadu_si256((const __m256i*)(data[k] + i));
+        for (uint32_t j = 0; j < N; ++j) {
+            __m256i acc = _mm256_setzero_si256();
+            for (uint32_t k = 0; k < N; ++k)
+                acc = _mm256_add_epi32(acc, opj_mct_fix_mul_avx2(in[k], _mm256_set1_epi32(matrix[j * N + k])));
+            _mm256_storeu_si256((__m256i*)(data[j] + i), acc);
+        }
+    }
+    opj_mct_encode_custom_c<N>(matrix, i, n, data);
+}
+
+template <uint32_t N> OPJ_TARGET_AVX static void opj_mct_decode_custom_avx(const float* restrict matrix,
+        size_t n,
+        float* const* data)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 in[N];
+        for (uint32_t k = 0; k < N; ++k)
+            in[k] = _mm256_loadu_ps(data[k] + i);
+        for (uint32_t j = 0; j < N; ++j) {
+            __m256 acc = _mm256_setzero_ps();
+            for (uint32_t k = 0; k < N; ++k)
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(matrix[j * N + k]), in[k]));
+            _mm256_storeu_ps(data[j] + i, acc);
+        }
+    }
+    opj_mct_decode_custom_c<N>(matrix, i, n, data);
+}
+
+template <uint32_t N> OPJ_TARGET_AVX512 static void opj_mct_encode_custom_avx512(const int32_t* restrict matrix,
+        size_t n,
+        int32_t* const* data)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i in[N];
+        for (uint32_t k = 0; k < N; ++k)
+            in[k] = _mm512_loadu_si512((const void*)(data[k] + i));
+        for (uint32_t j = 0; j < N; ++j) {
+            __m512i acc = _mm512_setzero_si512();
+            for (uint32_t k = 0; k < N; ++k)
+                acc = _mm512_add_epi32(acc, opj_mct_fix_mul_avx512(in[k], _mm512_set1_epi32(matrix[j * N + k])));
+            _mm512_storeu_si512((void*)(data[j] + i), acc);
+        }
+    }
+    opj_mct_encode_custom_c<N>(matrix, i, n, data);
+}
+#endif
+
+typedef void (*opj_mct_encode_custom_fn)(const int32_t*, size_t, int32_t* const*);
+typedef void (*opj_mct_decode_custom_fn)(const float*, size_t, float* const*);
+
+#define OPJ_MCT_CUSTOM_KERNELS(fn) { NULL, \
+    fn<1>, fn<2>, fn<3>, fn<4>, fn<5>, fn<6>, fn<7>, fn<8>, \
+    fn<9>, fn<10>, fn<11>, fn<12>, fn<13>, fn<14>, fn<15>, fn<16> }
+
+#ifdef __SSE4_1__
+static const opj_mct_encode_custom_fn opj_mct_encode_custom_kernels_base[] = OPJ_MCT_CUSTOM_KERNELS(opj_mct_encode_custom_sse41);
+#else
+static const opj_mct_encode_custom_fn opj_mct_encode_custom_kernels_base[] = OPJ_MCT_CUSTOM_KERNELS(opj_mct_encode_custom_base);
+#endif
+#ifdef __SSE__
+static const opj_mct_decode_custom_fn opj_mct_decode_custom_kernels_base[] = OPJ_MCT_CUSTOM_KERNELS(opj_mct_decode_custom_sse);
+#else
+static const opj_mct_decode_custom_fn opj_mct_decode_custom_kernels_base[] = OPJ_MCT_CUSTOM_KERNELS(opj_mct_decode_custom_base);
+#endif
+
+/* one set of kernels per instruction set extension */
+typedef struct opj_mct_kernels {
+    void (*encode)(int32_t* restrict, int32_t* restrict, int32_t* restrict, uint32_t);
+    void (*decode)(int32_t* restrict, int32_t* restrict, int32_t* restrict, uint32_t);
+    void (*encode_real)(int32_t* restrict, int32_t* restrict, int32_t* restrict, uint32_t);
+    void (*decode_real)(float* restrict, float* restrict, float* restrict, uint32_t);
+    void (*decode_shift)(int32_t* restrict, int32_t* restrict, int32_t* restrict, uint32_t,
+                         const int32_t*, const int32_t*, const int32_t*);
+    void (*decode_real_shift)(float* restrict, float* restrict, float* restrict, uint32_t,
+                              const int32_t*, const int32_t*, const int32_t*);
+    const opj_mct_encode_custom_fn* encode_custom;
+    const opj_mct_decode_custom_fn* decode_custom;
+} opj_mct_kernels_t;
+
+static const opj_mct_kernels_t opj_mct_kernels_base = {
+    opj_mct_encode_base,
+    opj_mct_decode_base,
+#ifdef __SSE4_1__
+    opj_mct_encode_real_sse41,
+#else
+    opj_mct_encode_real_c,
+#endif
+    opj_mct_decode_real_base,
+    opj_mct_decode_shift_base,
+    opj_mct_decode_real_shift_base,
+    opj_mct_encode_custom_kernels_base,
+    opj_mct_decode_custom_kernels_base
+};
+
+#ifdef OPJ_HAVE_TARGET_KERNELS
+static const opj_mct_encode_custom_fn opj_mct_encode_custom_kernels_sse41[] = OPJ_MCT_CUSTOM_KERNELS(opj_mct_encode_custom_sse41);
+static const opj_mct_encode_custom_fn opj_mct_encode_custom_kernels_avx2[] = OPJ_MCT_CUSTOM_KERNELS(opj_mct_encode_custom_avx2);
+static const opj_mct_decode_custom_fn opj_mct_decode_custom_kernels_avx[] = OPJ_MCT_CUSTOM_KERNELS(opj_mct_decode_custom_avx);
+static const opj_mct_encode_custom_fn opj_mct_encode_custom_kernels_avx512[] = OPJ_MCT_CUSTOM_KERNELS(opj_mct_encode_custom_avx512);
+
+static const opj_mct_kernels_t opj_mct_kernels_sse41 = {
+    opj_mct_encode_base,
+    opj_mct_decode_base,
+    opj_mct_encode_real_sse41,
+    opj_mct_decode_real_base,
+    opj_mct_decode_shift_base,
+    opj_mct_decode_real_shift_base,
+    opj_mct_encode_custom_kernels_sse41,
+    opj_mct_decode_custom_kernels_base
+};
+
+static const opj_mct_kernels_t opj_mct_kernels_avx2 = {
+    opj_mct_encode_avx2,
+    opj_mct_decode_avx2,
+    opj_mct_encode_real_avx2,
+    opj_mct_decode_real_avx,
+    opj_mct_decode_shift_avx2,
+    opj_mct_decode_real_shift_avx2,
+    opj_mct_encode_custom_kernels_avx2,
+    opj_mct_decode_custom_kernels_avx
+};
+
+/* the three component transforms stay on AVX2, as they are bound by memory bandwidth.
+   The float transforms stay on AVX too: with AVX-512 the compiler may fuse their multiplies
+   and adds, and the decoded samples would then depend on the host */
+static const opj_mct_kernels_t opj_mct_kernels_avx512 = {
+    opj_mct_encode_avx2,
+    opj_mct_decode_avx2,
+    opj_mct_encode_real_avx2,
+    opj_mct_decode_real_avx,
+    opj_mct_decode_shift_avx2,
+    opj_mct_decode_real_shift_avx2,
+    opj_mct_encode_custom_kernels_avx512,
+    opj_mct_decode_custom_kernels_avx
+};
+#endif
+
+static const opj_mct_kernels_t* opj_mct_select_kernels(void)
+{
+#ifdef OPJ_HAVE_TARGET_KERNELS
+    uint32_t l_features = opj_cpu_detect_features();
+    if (l_features & OPJ_CPU_AVX512)
+        return &opj_mct_kernels_avx512;
+    if (l_features & OPJ_CPU_AVX2)
+        return &opj_mct_kernels_avx2;
+    if (l_features & OPJ_CPU_SSE41)
+        return &opj_mct_kernels_sse41;
+#endif
+    return &opj_mct_kernels_base;
+}
+
+/* bound once, on first use */
+static const opj_mct_kernels_t* opj_mct_get_kernels(void)
+{
+    static const opj_mct_kernels_t* const l_kernels = opj_mct_select_kernels();
+    return l_kernels;
+}
+
+void opj_mct_init_kernels(void)
+{
+    opj_mct_get_kernels();
+}
+
+void opj_mct_encode(int32_t* restrict c0, int32_t* restrict c1, int32_t* restrict c2, uint32_t n)
+{
+    opj_mct_get_kernels()->encode(c0, c1, c2, n);
+}
+
+void opj_mct_decode(int32_t* restrict c0, int32_t* restrict c1, int32_t* restrict c2, uint32_t n)
+{
+    opj_mct_get_kernels()->decode(c0, c1, c2, n);
+}
+
+void opj_mct_encode_real(int32_t* restrict c0, int32_t* restrict c1, int32_t* restrict c2, uint32_t n)
+{
+    opj_mct_get_kernels()->encode_real(c0, c1, c2, n);
+}
+
+void opj_mct_decode_real(float* restrict c0, float* restrict c1, float* restrict c2, uint32_t n)
+{
+    opj_mct_get_kernels()->decode_real(c0, c1, c2, n);
+}
+
+void opj_mct_decode_shift(int32_t* restrict c0, int32_t* restrict c1, int32_t* restrict c2, uint32_t n,
+                          const int32_t* shift, const int32_t* min, const int32_t* max)
+{
+    opj_mct_get_kernels()->decode_shift(c0, c1, c2, n, shift, min, max);
+}
+
+void opj_mct_decode_real_shift(float* restrict c0, float* restrict c1, float* restrict c2, uint32_t n,
+                               const int32_t* shift, const int32_t* min, const int32_t* max)
+{
+    opj_mct_get_kernels()->decode_real_shift(c0, c1, c2, n, shift, min, max);
+}
+
 bool opj_mct_encode_custom(
     uint8_t * pCodingdata,
     uint32_t n,
@@ -510,6 +1140,12 @@ bool opj_mct_encode_custom(
         lCurrentMatrix[i] = (int32_t) (*(lMct++) * (float)lMultiplicator);
     }
 
+    if (pNbComp && pNbComp <= OPJ_MCT_MAX_UNROLLED_COMPS) {
+        opj_mct_get_kernels()->encode_custom[pNbComp](lCurrentMatrix, n, lData);
+        opj_free(lCurrentData);
+        return true;
+    }
+
     for (i = 0; i < n; ++i)  {
         lMctPtr = lCurrentMatrix;
         for (j=0; j<pNbComp; ++j) {
@@ -550,6 +1186,11 @@ bool opj_mct_decode_custom(
 
     OPJ_ARG_NOT_USED(isSigned);
 
+    if (pNbComp && pNbComp <= OPJ_MCT_MAX_UNROLLED_COMPS) {
+        opj_mct_get_kernels()->decode_custom[pNbComp]((const float*)pDecodingData, n, lData);
+        return true;
+    }
+
     lCurrentData = (float *) opj_malloc (2 * pNbComp * sizeof(float));
     if (! lCurrentData) {
         return false;
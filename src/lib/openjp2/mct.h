@@ -112,6 +112,33 @@ Apply an irreversible multi-component inverse transform to an image
 */
 void opj_mct_decode_real(float* c0, float* c1, float* c2, uint32_t n);
 /**
+Apply a reversible multi-component inverse transform to an image, then DC level shift
+and clamp each output component
+@param c0 Samples for luminance component
+@param c1 Samples for red chrominance component
+@param c2 Samples for blue chrominance component
+@param n Number of samples for each component
+@param shift DC level shift of each output component
+@param min Smallest value of each output component
+@param max Largest value of each output component
+*/
+void opj_mct_decode_shift(int32_t* c0, int32_t* c1, int32_t* c2, uint32_t n,
+                          const int32_t* shift, const int32_t* min, const int32_t* max);
+/**
+Apply an irreversible multi-component inverse transform to an image, then round,
+DC level shift and clamp each output component. The integer results are written
+in place of the float samples.
+@param c0 Samples for luminance component
+@param c1 Samples for red chrominance component
+@param c2 Samples for blue chrominance component
+@param n Number of samples for each component
+@param shift DC level shift of each output component
+@param min Smallest value of each output component
+@param max Largest value of each output component
+*/
+void opj_mct_decode_real_shift(float* c0, float* c1, float* c2, uint32_t n,
+                               const int32_t* shift, const int32_t* min, const int32_t* max);
+/**
 Get norm of the basis function used for the irreversible multi-component transform
 @param compno Number of the component (0->Y, 1->U, 2->V)
 @return
@@ -159,6 +186,10 @@ void opj_calculate_norms(   double * pNorms,
                             uint32_t p_nb_comps,
                             float * pMatrix);
 /**
+Bind the widest MCT kernels the CPU supports (see cpu_features.h)
+*/
+void opj_mct_init_kernels(void);
+/**
 FIXME DOC
 */
 const double * opj_mct_get_mct_norms (void);
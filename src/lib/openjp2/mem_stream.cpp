@@ -397,7 +397,7 @@ opj_stream_t* opj_create_mapped_file_read_stream(const char *fname)
 
     opj_stream_set_user_data(l_stream, buffer_info, (opj_stream_free_user_data_fn)opj_mem_map_free);
     opj_set_up_buffer_stream(l_stream, buffer_info->len, p_is_read_stream);
-
+    ((opj_stream_private_t*)l_stream)->m_header_cache_key = opj_header_cache_make_key(fname);
 
     return l_stream;
 }
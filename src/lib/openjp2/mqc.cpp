@@ -55,6 +55,7 @@
  */
 
 #include "opj_includes.h"
+#include "mqc_inl.h"
 
 /** @defgroup MQC MQC - Implementation of an MQ-Coder */
 /*@{*/
@@ -69,47 +70,10 @@ After a 0xff byte, the next byte must be smaller than 0x90.
 */
 static void opj_mqc_byteout(opj_mqc_t *mqc);
 /**
-Renormalize mqc->a and mqc->c while encoding, so that mqc->a stays between 0x8000 and 0x10000
-@param mqc MQC handle
-*/
-static void opj_mqc_renorme(opj_mqc_t *mqc);
-/**
-Encode the most probable symbol
-@param mqc MQC handle
-*/
-static void opj_mqc_codemps(opj_mqc_t *mqc);
-/**
-Encode the most least symbol
-@param mqc MQC handle
-*/
-static void opj_mqc_codelps(opj_mqc_t *mqc);
-/**
 Fill mqc->c with 1's for flushing
 @param mqc MQC handle
 */
 static void opj_mqc_setbits(opj_mqc_t *mqc);
-/**
-FIXME DOC
-@param mqc MQC handle
-@return
-*/
-static inline int32_t opj_mqc_mpsexchange(opj_mqc_t *const mqc);
-/**
-FIXME DOC
-@param mqc MQC handle
-@return
-*/
-static inline int32_t opj_mqc_lpsexchange(opj_mqc_t *const mqc);
-/**
-Input a byte
-@param mqc MQC handle
-*/
-static inline void opj_mqc_bytein(opj_mqc_t *const mqc);
-/**
-Renormalize mqc->a and mqc->c while decoding
-@param mqc MQC handle
-*/
-static inline void opj_mqc_renormd(opj_mqc_t *const mqc);
 /*@}*/
 
 /*@}*/
@@ -222,78 +186,11 @@ static opj_mqc_state_t mqc_states[47 * 2] = {
 
 static void opj_mqc_byteout(opj_mqc_t *mqc)
 {
-    if (mqc->bp < mqc->start) {
-        mqc->bp++;
-        *mqc->bp = (uint8_t)(mqc->c >> 19);
-        mqc->c &= 0x7ffff;
-        mqc->ct = 8;
-    } else if (*mqc->bp == 0xff) {
-        mqc->bp++;
-        *mqc->bp = (uint8_t)(mqc->c >> 20);
-        mqc->c &= 0xfffff;
-        mqc->ct = 7;
-    } else {
-        if ((mqc->c & 0x8000000) == 0) {
-            mqc->bp++;
-            *mqc->bp = (uint8_t)(mqc->c >> 19);
-            mqc->c &= 0x7ffff;
-            mqc->ct = 8;
-        } else {
-            (*mqc->bp)++;
-            if (*mqc->bp == 0xff) {
-                mqc->c &= 0x7ffffff;
-                mqc->bp++;
-                *mqc->bp = (uint8_t)(mqc->c >> 20);
-                mqc->c &= 0xfffff;
-                mqc->ct = 7;
-            } else {
-                mqc->bp++;
-                *mqc->bp = (uint8_t)(mqc->c >> 19);
-                mqc->c &= 0x7ffff;
-                mqc->ct = 8;
-            }
-        }
-    }
-}
-
-static void opj_mqc_renorme(opj_mqc_t *mqc)
-{
-    do {
-        mqc->a <<= 1;
-        mqc->c <<= 1;
-        mqc->ct--;
-        if (mqc->ct == 0) {
-            opj_mqc_byteout(mqc);
-        }
-    } while ((mqc->a & 0x8000) == 0);
-}
-
-static void opj_mqc_codemps(opj_mqc_t *mqc)
-{
-    mqc->a -= (*mqc->curctx)->qeval;
-    if ((mqc->a & 0x8000) == 0) {
-        if (mqc->a < (*mqc->curctx)->qeval) {
-            mqc->a = (*mqc->curctx)->qeval;
-        } else {
-            mqc->c += (*mqc->curctx)->qeval;
-        }
-        *mqc->curctx = (*mqc->curctx)->nmps;
-        opj_mqc_renorme(mqc);
-    } else {
-        mqc->c += (*mqc->curctx)->qeval;
-    }
-}
-
-static void opj_mqc_codelps(opj_mqc_t *mqc)
-{
-    mqc->a -= (*mqc->curctx)->qeval;
-    if (mqc->a < (*mqc->curctx)->qeval) {
-        mqc->c += (*mqc->curctx)->qeval;
-    } else {
-        mqc->a = (*mqc->curctx)->qeval;
-    }
-    *mqc->curctx = (*mqc->curctx)->nlps;
-    opj_mqc_renorme(mqc);
+    uint32_t c = mqc->c;
+    uint32_t ct = mqc->ct;
+    opj_mqc_byteout_macro(mqc, c, ct);
+    mqc->c = c;
+    mqc->ct = ct;
 }
 
 static void opj_mqc_setbits(opj_mqc_t *mqc)
@@ -305,37 +202,7 @@ static void opj_mqc_setbits(opj_mqc_t *mqc)
     }
 }
 
-static inline int32_t opj_mqc_mpsexchange(opj_mqc_t *const mqc)
-{
-    int32_t d;
-    if (mqc->a < (*mqc->curctx)->qeval) {
-        d = (int32_t)(1 - (*mqc->curctx)->mps);
-        *mqc->curctx = (*mqc->curctx)->nlps;
-    } else {
-        d = (int32_t)(*mqc->curctx)->mps;
-        *mqc->curctx = (*mqc->curctx)->nmps;
-    }
-
-    return d;
-}
-
-static inline int32_t opj_mqc_lpsexchange(opj_mqc_t *const mqc)
-{
-    int32_t d;
-    if (mqc->a < (*mqc->curctx)->qeval) {
-        mqc->a = (*mqc->curctx)->qeval;
-        d = (int32_t)(*mqc->curctx)->mps;
-        *mqc->curctx = (*mqc->curctx)->nmps;
-    } else {
-        mqc->a = (*mqc->curctx)->qeval;
-        d = (int32_t)(1 - (*mqc->curctx)->mps);
-        *mqc->curctx = (*mqc->curctx)->nlps;
-    }
-
-    return d;
-}
-
-static void opj_mqc_bytein(opj_mqc_t *const mqc)
+void opj_mqc_bytein(opj_mqc_t *const mqc)
 {
     if (mqc->bp != mqc->end) {
         uint32_t c;
@@ -365,18 +232,6 @@ static void opj_mqc_bytein(opj_mqc_t *const mqc)
 }
 
 
-static inline void opj_mqc_renormd(opj_mqc_t *const mqc)
-{
-    do {
-        if (mqc->ct == 0) {
-            opj_mqc_bytein(mqc);
-        }
-        mqc->a <<= 1;
-        mqc->c <<= 1;
-        mqc->ct--;
-    } while (mqc->a < 0x8000);
-}
-
 /*
 ==========================================================
    MQ-Coder interface
@@ -428,14 +283,16 @@ void opj_mqc_init_enc(opj_mqc_t *mqc, uint8_t *bp)
 
 void opj_mqc_encode(opj_mqc_t *mqc, uint32_t d)
 {
-	if ((mqc->debug_mqc.debug_state  & OPJ_PLUGIN_STATE_DEBUG_ENCODE) &&
-		!(mqc->debug_mqc.debug_state & OPJ_PLUGIN_STATE_PRE_TR1)) {
-		nextCXD(&mqc->debug_mqc, d);
-	}
-    if ((*mqc->curctx)->mps == d) {
-        opj_mqc_codemps(mqc);
-    } else {
-        opj_mqc_codelps(mqc);
+    DOWNLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct);
+    opj_mqc_encode_macro(mqc, curctx, a, c, ct, d);
+    UPLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct);
+}
+
+void opj_mqc_debug_encode(opj_mqc_t *mqc, opj_mqc_state_t **curctx, uint32_t d)
+{
+    mqc->debug_mqc.context_number = (uint8_t)(curctx - mqc->ctxs);
+    if (!(mqc->debug_mqc.debug_state & OPJ_PLUGIN_STATE_PRE_TR1)) {
+        nextCXD(&mqc->debug_mqc, d);
     }
 }
 
@@ -460,17 +317,11 @@ void opj_mqc_bypass_init_enc(opj_mqc_t *mqc)
 
 void opj_mqc_bypass_enc(opj_mqc_t *mqc, uint32_t d)
 {
-    mqc->ct--;
-    mqc->c = mqc->c + (d << mqc->ct);
-    if (mqc->ct == 0) {
-        mqc->bp++;
-        *mqc->bp = (uint8_t)mqc->c;
-        mqc->ct = 8;
-        if (*mqc->bp == 0xff) {
-            mqc->ct = 7;
-        }
-        mqc->c = 0;
-    }
+    uint32_t c = mqc->c;
+    uint32_t ct = mqc->ct;
+    opj_mqc_bypass_enc_macro(mqc, c, ct, d);
+    mqc->c = c;
+    mqc->ct = ct;
 }
 
 uint32_t opj_mqc_bypass_flush_enc(opj_mqc_t *mqc)
@@ -577,22 +428,11 @@ bool opj_mqc_init_dec(opj_mqc_t *mqc, uint8_t *bp, uint32_t len)
 
 int32_t opj_mqc_decode(opj_mqc_t *const mqc)
 {
-    int32_t d;
-    mqc->a -= (*mqc->curctx)->qeval;
-    if ((mqc->c >> 16) < (*mqc->curctx)->qeval) {
-        d = opj_mqc_lpsexchange(mqc);
-        opj_mqc_renormd(mqc);
-    } else {
-        mqc->c -= (*mqc->curctx)->qeval << 16;
-        if ((mqc->a & 0x8000) == 0) {
-            d = opj_mqc_mpsexchange(mqc);
-            opj_mqc_renormd(mqc);
-        } else {
-            d = (int32_t)(*mqc->curctx)->mps;
-        }
-    }
-
-    return d;
+    uint32_t d;
+    DOWNLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct);
+    opj_mqc_decode_macro(d, mqc, curctx, a, c, ct);
+    UPLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct);
+    return (int32_t)d;
 }
 
 void opj_mqc_resetstates(opj_mqc_t *mqc)
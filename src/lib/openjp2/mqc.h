@@ -154,6 +154,13 @@ Encode a symbol using the MQ-coder
 */
 void opj_mqc_encode(opj_mqc_t *mqc, uint32_t d);
 /**
+Report an encoded symbol, and its context, to the debug plugin
+@param mqc MQC handle
+@param curctx Context used to code the symbol
+@param d The symbol encoded (0 or 1)
+*/
+void opj_mqc_debug_encode(opj_mqc_t *mqc, opj_mqc_state_t **curctx, uint32_t d);
+/**
 Flush the encoder, so that all remaining data is written
 @param mqc MQC handle
 */
@@ -219,6 +226,11 @@ Decode a symbol
 @return Returns the decoded symbol (0 or 1)
 */
 int32_t opj_mqc_decode(opj_mqc_t * const mqc);
+/**
+Input a byte, handling 0xff bit-stuffing, markers and the end of the segment
+@param mqc MQC handle
+*/
+void opj_mqc_bytein(opj_mqc_t *const mqc);
 /* ----------------------------------------------------------------------- */
 /*@}*/
 
@@ -0,0 +1,227 @@
+/*
+*    Copyright (C) 2016 Grok Image Compression Inc.
+*
+*    This source code is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This source code is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*/
+
+#pragma once
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/**
+Inline MQ coder engine.
+
+A coding pass copies the coder registers A, C and CT (and the current context)
+into locals with DOWNLOAD_MQC_VARIABLES, codes every symbol of the pass with
+opj_mqc_decode_macro or opj_mqc_encode_macro, and writes them back with
+UPLOAD_MQC_VARIABLES. Only the byte pointer is touched through memory,
+when C is refilled (decoder) or a byte is emitted (encoder).
+*/
+
+#define DOWNLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct) \
+        opj_mqc_state_t **curctx = (mqc)->curctx; \
+        uint32_t a = (mqc)->a; \
+        uint32_t c = (mqc)->c; \
+        uint32_t ct = (mqc)->ct
+
+#define UPLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct) \
+        (mqc)->curctx = curctx; \
+        (mqc)->a = a; \
+        (mqc)->c = c; \
+        (mqc)->ct = ct
+
+#define opj_mqc_setcurctx_macro(mqc, curctx, ctxno) \
+        curctx = &(mqc)->ctxs[(uint32_t)(ctxno)]
+
+/**
+Number of left shifts needed to bring a non-zero A register back above 0x8000
+*/
+static inline uint32_t opj_mqc_renorm_shift(uint32_t a)
+{
+#if defined(__GNUC__)
+    return (uint32_t)__builtin_clz(a) - 16U;
+#elif defined(_MSC_VER)
+    unsigned long msb;
+    _BitScanReverse(&msb, a);
+    return 15U - (uint32_t)msb;
+#else
+    uint32_t n = 0;
+    while (a < 0x8000) {
+        a <<= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+/**
+Refill C. When neither of the next two bytes is 0xff, both are loaded at once;
+stuffed bytes, markers and the end of the segment go through opj_mqc_bytein.
+*/
+#define opj_mqc_bytein_macro(mqc, c, ct) \
+{ \
+        uint8_t* l_bp = (mqc)->bp; \
+        if (l_bp + 2 < (mqc)->end && l_bp[0] != 0xff && l_bp[1] != 0xff) { \
+            c += ((uint32_t)l_bp[1] << 8) | l_bp[2]; \
+            ct = 16; \
+            (mqc)->bp = l_bp + 2; \
+        } else { \
+            (mqc)->c = c; \
+            (mqc)->ct = ct; \
+            opj_mqc_bytein(mqc); \
+            c = (mqc)->c; \
+            ct = (mqc)->ct; \
+        } \
+}
+
+/**
+Renormalize A and C, shifting as many bits at a time as CT allows
+*/
+#define opj_mqc_renormd_macro(mqc, a, c, ct) \
+{ \
+        uint32_t l_n = opj_mqc_renorm_shift(a); \
+        while (l_n > ct) { \
+            a <<= ct; \
+            c <<= ct; \
+            l_n -= ct; \
+            opj_mqc_bytein_macro(mqc, c, ct); \
+        } \
+        a <<= l_n; \
+        c <<= l_n; \
+        ct -= l_n; \
+}
+
+/**
+Decode a symbol into d, using the context pointed to by curctx
+*/
+#define opj_mqc_decode_macro(d, mqc, curctx, a, c, ct) \
+{ \
+        const opj_mqc_state_t* l_state = *(curctx); \
+        uint32_t const l_qeval = l_state->qeval; \
+        a -= l_qeval; \
+        if ((c >> 16) < l_qeval) { \
+            /* LPS exchange: conditional exchange decodes the MPS when A < Qe */ \
+            uint32_t const l_xchg = a < l_qeval; \
+            a = l_qeval; \
+            d = l_state->mps ^ l_xchg ^ 1U; \
+            *(curctx) = l_xchg ? l_state->nmps : l_state->nlps; \
+            opj_mqc_renormd_macro(mqc, a, c, ct); \
+        } else { \
+            c -= l_qeval << 16; \
+            if ((a & 0x8000) == 0) { \
+                /* MPS exchange: conditional exchange decodes the LPS when A < Qe */ \
+                uint32_t const l_xchg = a < l_qeval; \
+                d = l_state->mps ^ l_xchg; \
+                *(curctx) = l_xchg ? l_state->nlps : l_state->nmps; \
+                opj_mqc_renormd_macro(mqc, a, c, ct); \
+            } else { \
+                d = l_state->mps; \
+            } \
+        } \
+}
+
+/**
+Output a byte, doing bit-stuffing if necessary.
+After a 0xff byte, the next byte must be smaller than 0x90.
+A carry out of C is held back until here, and is then propagated into the
+previously emitted byte (which cannot be 0xff, since that byte only got 7 bits).
+*/
+#define opj_mqc_byteout_macro(mqc, c, ct) \
+{ \
+        uint8_t* l_bp = (mqc)->bp; \
+        bool const l_first = l_bp < (mqc)->start; \
+        if (!l_first && *l_bp != 0xff && (c & 0x8000000)) { \
+            ++(*l_bp); \
+            c &= 0x7ffffff; \
+        } \
+        if (!l_first && *l_bp == 0xff) { \
+            *++l_bp = (uint8_t)(c >> 20); \
+            c &= 0xfffff; \
+            ct = 7; \
+        } else { \
+            *++l_bp = (uint8_t)(c >> 19); \
+            c &= 0x7ffff; \
+            ct = 8; \
+        } \
+        (mqc)->bp = l_bp; \
+}
+
+/**
+Renormalize A and C while encoding, emitting a byte each time CT runs out
+*/
+#define opj_mqc_renorme_macro(mqc, a, c, ct) \
+{ \
+        uint32_t l_n = opj_mqc_renorm_shift(a); \
+        while (l_n >= ct) { \
+            a <<= ct; \
+            c <<= ct; \
+            l_n -= ct; \
+            opj_mqc_byteout_macro(mqc, c, ct); \
+        } \
+        a <<= l_n; \
+        c <<= l_n; \
+        ct -= l_n; \
+}
+
+/**
+Encode symbol d, using the context pointed to by curctx
+*/
+#define opj_mqc_encode_macro(mqc, curctx, a, c, ct, d) \
+{ \
+        const opj_mqc_state_t* l_state = *(curctx); \
+        uint32_t const l_qeval = l_state->qeval; \
+        uint32_t const l_d = (d); \
+        if ((mqc)->debug_mqc.debug_state & OPJ_PLUGIN_STATE_DEBUG_ENCODE) { \
+            opj_mqc_debug_encode((mqc), (curctx), l_d); \
+        } \
+        a -= l_qeval; \
+        if (l_state->mps == l_d) { \
+            if ((a & 0x8000) == 0) { \
+                if (a < l_qeval) { \
+                    a = l_qeval; \
+                } else { \
+                    c += l_qeval; \
+                } \
+                *(curctx) = l_state->nmps; \
+                opj_mqc_renorme_macro(mqc, a, c, ct); \
+            } else { \
+                c += l_qeval; \
+            } \
+        } else { \
+            if (a < l_qeval) { \
+                c += l_qeval; \
+            } else { \
+                a = l_qeval; \
+            } \
+            *(curctx) = l_state->nlps; \
+            opj_mqc_renorme_macro(mqc, a, c, ct); \
+        } \
+}
+
+/**
+BYPASS mode switch, coding operation: symbol d is written as a raw bit
+*/
+#define opj_mqc_bypass_enc_macro(mqc, c, ct, d) \
+{ \
+        ct -= 1; \
+        c += (uint32_t)(d) << ct; \
+        if (ct == 0) { \
+            (mqc)->bp++; \
+            *(mqc)->bp = (uint8_t)c; \
+            ct = (*(mqc)->bp == 0xff) ? 7 : 8; \
+            c = 0; \
+        } \
+}
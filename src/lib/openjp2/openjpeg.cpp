@@ -67,6 +67,8 @@
 
 #include "opj_includes.h"
 #include "opj_config.h"
+#include "Scheduler.h"
+#include "cpu_features.h"
 
 
 #ifdef _OPENMP
@@ -77,6 +79,14 @@ static bool is_initialized = false;
 bool OPJ_CALLCONV opj_initialize(const char* plugin_path)
 {
     if (!is_initialized) {
+		/* start the worker threads up front, rather than on the first decode */
+		Scheduler::instance();
+		/* bind the SIMD kernels of the running CPU */
+		opj_cpu_detect_features();
+		opj_dwt_init_kernels();
+		opj_mct_init_kernels();
+		opj_t1_init_kernels();
+		opj_tcd_init_kernels();
 		opj_plugin_init_info_t info;
 		info.plugin_path = plugin_path;
         is_initialized = opj_plugin_init(info);
@@ -86,6 +96,8 @@ bool OPJ_CALLCONV opj_initialize(const char* plugin_path)
 
 OPJ_API void OPJ_CALLCONV opj_cleanup() {
 	opj_plugin_cleanup();
+	Scheduler::release();
+	opj_header_cache_set_size(0);
 }
 
 /* ---------------------------------------------------------------------- */
@@ -237,6 +249,8 @@ opj_codec_t* OPJ_CALLCONV opj_create_decompress(OPJ_CODEC_FORMAT p_format)
 
         l_codec->opj_get_codec_index = (opj_codestream_index_t* (*) (void*) ) j2k_get_cstr_index;
 
+        l_codec->opj_set_tile_part_index = (bool (*) (void*, uint32_t, const opj_tp_index_t*, uint32_t) ) j2k_set_tile_part_index;
+
         l_codec->m_codec_data.m_decompression.opj_decode =
             (bool (*) (	void *, 
 						opj_plugin_tile_t*,
@@ -286,6 +300,12 @@ opj_codec_t* OPJ_CALLCONV opj_create_decompress(OPJ_CODEC_FORMAT p_format)
                         uint32_t, uint32_t, uint32_t, uint32_t,
                         struct opj_event_mgr *)) opj_j2k_set_decode_area;
 
+        l_codec->m_codec_data.m_decompression.opj_set_decode_buffer =
+            (bool (*) ( void *,
+                        opj_image_t*,
+                        opj_decode_buffer_t*,
+                        struct opj_event_mgr *)) opj_j2k_set_decode_buffer;
+
         l_codec->m_codec_data.m_decompression.opj_get_decoded_tile =
             (bool (*) ( void *p_codec,
                         opj_stream_private_t *p_cio,
@@ -315,6 +335,8 @@ opj_codec_t* OPJ_CALLCONV opj_create_decompress(OPJ_CODEC_FORMAT p_format)
 
         l_codec->opj_get_codec_index = (opj_codestream_index_t* (*) (void*) ) jp2_get_cstr_index;
 
+        l_codec->opj_set_tile_part_index = (bool (*) (void*, uint32_t, const opj_tp_index_t*, uint32_t) ) jp2_set_tile_part_index;
+
         l_codec->m_codec_data.m_decompression.opj_decode =
             (bool (*) (	void *, 
 						opj_plugin_tile_t*,
@@ -364,6 +386,12 @@ opj_codec_t* OPJ_CALLCONV opj_create_decompress(OPJ_CODEC_FORMAT p_format)
                         uint32_t,uint32_t,uint32_t,uint32_t,
                         struct opj_event_mgr * )) opj_jp2_set_decode_area;
 
+        l_codec->m_codec_data.m_decompression.opj_set_decode_buffer =
+            (bool (*) ( void *,
+                        opj_image_t*,
+                        opj_decode_buffer_t*,
+                        struct opj_event_mgr * )) opj_jp2_set_decode_buffer;
+
         l_codec->m_codec_data.m_decompression.opj_get_decoded_tile =
             (bool (*) ( void *p_codec,
                         opj_stream_private_t *p_cio,
@@ -430,6 +458,72 @@ bool OPJ_CALLCONV opj_setup_decoder(opj_codec_t *p_codec,
     return false;
 }
 
+/*
+Read the header of a stream that takes part in header caching.
+
+On a hit, the header is parsed from the cached bytes, the stream is moved to
+the end of the main header, and the cached tile-part index is handed to the codec.
+On a miss, the header is read from the stream as usual and its bytes are stored.
+*/
+static bool opj_read_header_cached(opj_codec_private_t* p_codec,
+                                   opj_stream_private_t* p_stream,
+                                   opj_cparameters_t* encoding_parameters,
+                                   opj_image_t **p_image)
+{
+    opj_event_mgr_t* l_manager = &(p_codec->m_event_mgr);
+    auto l_entry = opj_header_cache_get(p_stream->m_header_cache_key);
+    bool rc = false;
+
+    if (l_entry) {
+        opj_stream_t* l_header_stream = opj_stream_create_buffer_stream((uint8_t*)l_entry->header.data(),
+                                        l_entry->header.size(), true);
+        if (!l_header_stream)
+            return false;
+        /* the cached header is a prefix of the file: checks against the stream length,
+           such as those of the TLM index, must see the length of the file */
+        opj_stream_set_user_data_length(l_header_stream, p_stream->m_user_data_length);
+        rc = p_codec->m_codec_data.m_decompression.opj_read_header((opj_stream_private_t*)l_header_stream,
+                p_codec->m_codec,
+                encoding_parameters,
+                p_image,
+                l_manager);
+        opj_stream_destroy(l_header_stream);
+        if (rc)
+            rc = opj_stream_seek(p_stream, (int64_t)l_entry->header.size(), l_manager);
+        if (rc) {
+            for (uint32_t i = 0; i < (uint32_t)l_entry->tiles.size(); ++i) {
+                if (!l_entry->tiles[i].empty())
+                    p_codec->opj_set_tile_part_index(p_codec->m_codec, i,
+                                                     l_entry->tiles[i].data(), (uint32_t)l_entry->tiles[i].size());
+            }
+        }
+    } else {
+        rc = p_codec->m_codec_data.m_decompression.opj_read_header(p_stream,
+                p_codec->m_codec,
+                encoding_parameters,
+                p_image,
+                l_manager);
+        if (rc) {
+            /* the stream now sits just after the first SOT marker */
+            int64_t l_header_size = opj_stream_tell(p_stream);
+            std::vector<uint8_t> l_header((size_t)l_header_size);
+            if (opj_stream_seek(p_stream, 0, l_manager) &&
+                    opj_stream_read_data(p_stream, l_header.data(), l_header.size(), l_manager) == l_header.size())
+                opj_header_cache_put_header(p_stream->m_header_cache_key, std::move(l_header));
+            rc = opj_stream_seek(p_stream, l_header_size, l_manager);
+        }
+    }
+
+    /* keep the key, to store the tile-part index once the codec is done */
+    if (rc && !p_codec->m_header_cache_key) {
+        size_t l_len = strlen(p_stream->m_header_cache_key) + 1;
+        p_codec->m_header_cache_key = (char*)opj_malloc(l_len);
+        if (p_codec->m_header_cache_key)
+            memcpy(p_codec->m_header_cache_key, p_stream->m_header_cache_key, l_len);
+    }
+    return rc;
+}
+
 bool OPJ_CALLCONV opj_read_header(opj_stream_t *p_stream,
 	opj_codec_t *p_codec,
 	opj_image_t **p_image) {
@@ -452,6 +546,9 @@ bool OPJ_CALLCONV opj_read_header_ex (	opj_stream_t *p_stream,
             return false;
         }
 
+        if (l_stream->m_header_cache_key)
+            return opj_read_header_cached(l_codec, l_stream, encoding_parameters, p_image);
+
         return l_codec->m_codec_data.m_decompression.opj_read_header(	l_stream,
                 l_codec->m_codec,
 				encoding_parameters,
@@ -462,6 +559,11 @@ bool OPJ_CALLCONV opj_read_header_ex (	opj_stream_t *p_stream,
     return false;
 }
 
+void OPJ_CALLCONV opj_set_header_cache_size(uint32_t max_entries)
+{
+    opj_header_cache_set_size(max_entries);
+}
+
 bool OPJ_CALLCONV opj_decode(opj_codec_t *p_codec,
 	opj_stream_t *p_stream,
 	opj_image_t* p_image) {
@@ -513,6 +615,25 @@ bool OPJ_CALLCONV opj_set_decode_area(	opj_codec_t *p_codec,
     return false;
 }
 
+bool OPJ_CALLCONV opj_set_decode_buffer(	opj_codec_t *p_codec,
+                                        opj_image_t* p_image,
+                                        opj_decode_buffer_t* p_buffer)
+{
+    if (p_codec) {
+        opj_codec_private_t * l_codec = (opj_codec_private_t *) p_codec;
+
+        if (! l_codec->is_decompressor) {
+            return false;
+        }
+
+        return  l_codec->m_codec_data.m_decompression.opj_set_decode_buffer(	l_codec->m_codec,
+                p_image,
+                p_buffer,
+                &(l_codec->m_event_mgr) );
+    }
+    return false;
+}
+
 bool OPJ_CALLCONV opj_read_tile_header(	opj_codec_t *p_codec,
                                         opj_stream_t * p_stream,
                                         uint32_t * p_tile_index,
@@ -891,6 +1012,13 @@ void OPJ_CALLCONV opj_destroy_codec(opj_codec_t *p_codec)
         opj_codec_private_t * l_codec = (opj_codec_private_t *) p_codec;
 
         if (l_codec->is_decompressor) {
+            if (l_codec->m_header_cache_key) {
+                opj_codestream_index_t* l_index = l_codec->opj_get_codec_index(l_codec->m_codec);
+                opj_header_cache_put_index(l_codec->m_header_cache_key, l_index);
+                opj_destroy_cstr_index(&l_index);
+                opj_free(l_codec->m_header_cache_key);
+                l_codec->m_header_cache_key = 00;
+            }
             l_codec->m_codec_data.m_decompression.opj_destroy(l_codec->m_codec);
         } else {
             l_codec->m_codec_data.m_compression.opj_destroy(l_codec->m_codec);
@@ -1003,6 +1131,8 @@ opj_stream_t* OPJ_CALLCONV opj_stream_create_file_stream (
 
     opj_stream_set_user_data(l_stream, p_file, (opj_stream_free_user_data_fn) fclose);
     opj_stream_set_user_data_length(l_stream, opj_get_data_length_from_file(p_file));
+    if (p_is_read_stream)
+        ((opj_stream_private_t*)l_stream)->m_header_cache_key = opj_header_cache_make_key(fname);
     opj_stream_set_read_function(l_stream, (opj_stream_read_fn) opj_read_from_file);
     opj_stream_set_write_function(l_stream, (opj_stream_write_fn) opj_write_from_file);
     opj_stream_set_skip_function(l_stream, (opj_stream_skip_fn) opj_skip_from_file);
@@ -1261,6 +1261,18 @@ OPJ_API bool OPJ_CALLCONV opj_read_header_ex (	opj_stream_t *p_stream,
 		opj_cparameters_t* encoding_parameters,
         opj_image_t **p_image);
 
+/**
+ * Enables the decoder header cache, for applications that open the same files many times.
+ *
+ * File streams created after this call are identified by path, size and modification time.
+ * The first opj_read_header on a file stores its headers, later ones parse them from memory,
+ * and the tile-part positions found while decoding let later opens seek straight to a tile.
+ *
+ * @param	max_entries		maximum number of files kept in the cache. 0 (the default) disables
+ *							the cache and releases its memory.
+ */
+OPJ_API void OPJ_CALLCONV opj_set_header_cache_size(uint32_t max_entries);
+
 /**
  * Sets the given area to be decoded. This function should be called right after opj_read_header and before any tile header reading.
  *
@@ -1278,6 +1290,41 @@ OPJ_API bool OPJ_CALLCONV opj_set_decode_area(	opj_codec_t *p_codec,
         uint32_t p_start_x, uint32_t p_start_y,
         uint32_t p_end_x, uint32_t p_end_y );
 
+/**
+ * Caller-owned destination for decoded samples, stored as interleaved pixels
+ * */
+typedef struct opj_decode_buffer {
+    /** first sample of the top left pixel of the decoded area */
+    uint8_t *data;
+    /** distance in bytes between the first samples of two consecutive rows */
+    size_t stride;
+    /** bits per sample: 8 or 16. Signed components are stored in two's complement */
+    uint32_t prec;
+    /** samples per pixel; this must equal the number of image components */
+    uint32_t numcomps;
+} opj_decode_buffer_t;
+
+/**
+ * Sets a buffer that opj_decode writes the decoded image into, in place of the component data of the image.
+ *
+ * Each tile is DC shifted, clamped to the component precision and packed into the buffer as soon
+ * as it is decoded, so the component data of the image is left unallocated. The buffer covers the
+ * image (or the decode area) at the decoded resolution, i.e. p_image->comps[0].w by p_image->comps[0].h
+ * pixels after opj_set_decode_area and opj_set_decoded_resolution_factor.
+ * Only images without sub-sampled components can be decoded this way, and JP2 palettes and
+ * channel definitions are not applied.
+ *
+ * @param	p_codec			the jpeg2000 codec.
+ * @param	p_image			the image previously set by opj_read_header.
+ * @param	p_buffer		the destination buffer, which must stay valid until opj_decode returns,
+ *							or NULL to decode into the component data again.
+ *
+ * @return	true			if the image can be decoded into the buffer.
+ */
+OPJ_API bool OPJ_CALLCONV opj_set_decode_buffer(	opj_codec_t *p_codec,
+        opj_image_t* p_image,
+        opj_decode_buffer_t* p_buffer);
+
 ////////////////////////////////////////////////////
 // Structs to pass data between plugin and grok
 ////////////////////////////////////////////////////
@@ -120,6 +120,12 @@ typedef struct opj_codec_private {
                                           uint32_t p_end_y,
                                           struct opj_event_mgr * p_manager);
 
+            /** Set decode buffer function handler */
+            bool (*opj_set_decode_buffer) ( void * p_codec,
+                                            opj_image_t * p_image,
+                                            opj_decode_buffer_t * p_buffer,
+                                            struct opj_event_mgr * p_manager);
+
             /** Get tile function */
             bool (*opj_get_decoded_tile) ( void *p_codec,
                                            opj_stream_private_t * p_cio,
@@ -175,6 +181,9 @@ typedef struct opj_codec_private {
     void (*opj_dump_codec) (void * p_codec, int32_t info_flag, FILE* output_stream);
     opj_codestream_info_v2_t* (*opj_get_codec_info)(void* p_codec);
     opj_codestream_index_t* (*opj_get_codec_index)(void* p_codec);
+    bool (*opj_set_tile_part_index)(void* p_codec, uint32_t tileno, const opj_tp_index_t* tp_index, uint32_t nb_tps);
+    /** header cache key of the stream the header was read from (NULL if not cached) */
+    char* m_header_cache_key;
 }
 opj_codec_private_t;
 
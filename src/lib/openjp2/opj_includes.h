@@ -209,6 +209,7 @@ static inline long opj_lrintf(float f)
 #include "vector.h"
 #include "util.h"
 #include "segmented_stream.h"
+#include "arena.h"
 #include "bio.h"
 #include "cio.h"
 
@@ -232,6 +233,7 @@ static inline long opj_lrintf(float f)
 #include "mct.h"
 #include "opj_intmath.h"
 #include "plugin_bridge.h"
+#include "header_cache.h"
 
 /* V2 */
 #include "opj_codec.h"
@@ -20,65 +20,6 @@
 /* #define DEBUG_SEG_BUF */
 
 
-bool opj_min_buf_vec_copy_to_contiguous_buffer(opj_vec_t* min_buf_vec, uint8_t* buffer)
-{
-    int32_t i = 0;
-    size_t offset = 0;
-
-    if (!buffer || !min_buf_vec)
-        return false;
-
-    for (i = 0; i < opj_vec_size(min_buf_vec); ++i) {
-        opj_min_buf_t* seg = (opj_min_buf_t*)opj_vec_get(min_buf_vec, i);
-        if (seg->len)
-            memcpy(buffer + offset, seg->buf, seg->len);
-        offset += seg->len;
-    }
-    return true;
-
-}
-
-bool opj_min_buf_vec_push_back(opj_vec_t* buf_vec, uint8_t* buf, uint16_t len)
-{
-    opj_min_buf_t* seg = NULL;
-    if (!buf_vec || !buf || !len)
-        return false;
-
-    if (!buf_vec->data) {
-        opj_vec_init(buf_vec,true);
-    }
-
-    seg = (opj_min_buf_t*)opj_malloc(sizeof(opj_buf_t));
-    if (!seg)
-        return false;
-
-    seg->buf = buf;
-    seg->len = len;
-    if (!opj_vec_push_back(buf_vec, seg)) {
-        opj_free(seg);
-        return false;
-    }
-
-    return true;
-}
-
-uint16_t opj_min_buf_vec_get_len(opj_vec_t* min_buf_vec)
-{
-    size_t i = 0;
-    uint16_t len = 0;
-    if (!min_buf_vec || !min_buf_vec->data)
-        return 0;
-    for (i = 0; i < opj_vec_size(min_buf_vec); ++i) {
-        opj_min_buf_t* seg = (opj_min_buf_t*)opj_vec_get(min_buf_vec, i);
-        if (seg)
-            len += seg->len;
-    }
-    return len;
-
-}
-
-
-
 /*--------------------------------------------------------------------------*/
 
 /*  Segmented Buffer Stream */
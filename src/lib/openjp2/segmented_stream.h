@@ -37,32 +37,6 @@
 
 #include <vector>
 
-/*
-Smart wrapper to low level C array
-*/
-
-typedef struct opj_min_buf {
-    uint8_t *buf;		/* internal array*/
-    uint16_t len;		/* length of array */
-} opj_min_buf_t;
-
-/*
-Copy all segments, in sequence, into contiguous array
-*/
-bool opj_min_buf_vec_copy_to_contiguous_buffer(opj_vec_t* min_buf_vec, uint8_t* buffer);
-
-/*
-Push buffer to back of min buf vector
-*/
-bool opj_min_buf_vec_push_back(opj_vec_t* buf_vec, uint8_t* buf, uint16_t len);
-
-/*
-Sum lengths of all buffers
-*/
-
-uint16_t opj_min_buf_vec_get_len(opj_vec_t* min_buf_vec);
-
-
 /*
 Increment buffer offset
 */
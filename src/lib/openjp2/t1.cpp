@@ -56,6 +56,7 @@
 
 #include "opj_includes.h"
 #include "t1_luts.h"
+#include "mqc_inl.h"
 #include "T1Encoder.h"
 
 #ifdef _OPENMP
@@ -86,7 +87,7 @@ static void opj_t1_updateflags(opj_flag_t *flagsp, uint32_t s, uint32_t stride);
 /**
 Encode significant pass
 */
-static void opj_t1_enc_sigpass_step(opj_t1_t *t1,
+static inline void opj_t1_enc_sigpass_step(opj_t1_t *t1,
                                     opj_flag_t *flagsp,
                                     int32_t *datap,
                                     uint32_t orient,
@@ -94,7 +95,10 @@ static void opj_t1_enc_sigpass_step(opj_t1_t *t1,
                                     int32_t one,
                                     int32_t *nmsedec,
                                     uint8_t type,
-                                    uint32_t vsc);
+                                    uint32_t vsc,
+                                    uint32_t *a,
+                                    uint32_t *c,
+                                    uint32_t *ct);
 
 /**
 Decode significant pass
@@ -153,14 +157,17 @@ static void opj_t1_dec_sigpass_mqc_vsc(
 /**
 Encode refinement pass
 */
-static void opj_t1_enc_refpass_step(opj_t1_t *t1,
+static inline void opj_t1_enc_refpass_step(opj_t1_t *t1,
                                     opj_flag_t *flagsp,
                                     int32_t *datap,
                                     int32_t bpno,
                                     int32_t one,
                                     int32_t *nmsedec,
                                     uint8_t type,
-                                    uint32_t vsc);
+                                    uint32_t vsc,
+                                    uint32_t *a,
+                                    uint32_t *c,
+                                    uint32_t *ct);
 
 
 /**
@@ -216,7 +223,7 @@ static inline void opj_t1_dec_refpass_step_mqc_vsc(
 /**
 Encode clean-up pass
 */
-static void opj_t1_enc_clnpass_step(
+static inline void opj_t1_enc_clnpass_step(
     opj_t1_t *t1,
     opj_flag_t *flagsp,
     int32_t *datap,
@@ -225,7 +232,10 @@ static void opj_t1_enc_clnpass_step(
     int32_t one,
     int32_t *nmsedec,
     uint32_t partial,
-    uint32_t vsc);
+    uint32_t vsc,
+    uint32_t *a,
+    uint32_t *c,
+    uint32_t *ct);
 /**
 Decode clean-up pass
 */
@@ -342,7 +352,7 @@ static void opj_t1_updateflags(opj_flag_t *flagsp, uint32_t s, uint32_t stride)
     sp[1]  |= T1_SIG_NW;
 }
 
-static void opj_t1_enc_sigpass_step(   opj_t1_t *t1,
+static inline void opj_t1_enc_sigpass_step(   opj_t1_t *t1,
                                        opj_flag_t *flagsp,
                                        int32_t *datap,
                                        uint32_t orient,
@@ -350,8 +360,10 @@ static void opj_t1_enc_sigpass_step(   opj_t1_t *t1,
                                        int32_t one,
                                        int32_t *nmsedec,
                                        uint8_t type,
-                                       uint32_t vsc
-                                   )
+                                       uint32_t vsc,
+                                       uint32_t *a,
+                                       uint32_t *c,
+                                       uint32_t *ct)
 {
     int32_t v;
     uint32_t flag;
@@ -361,20 +373,20 @@ static void opj_t1_enc_sigpass_step(   opj_t1_t *t1,
     flag = vsc ? (uint32_t)((*flagsp) & (~(T1_SIG_S | T1_SIG_SE | T1_SIG_SW | T1_SGN_S))) : (uint32_t)(*flagsp);
     if ((flag & T1_SIG_OTH) && !(flag & (T1_SIG | T1_VISIT))) {
         v = (opj_int_abs(*datap) & one) ? 1 : 0;
-        opj_mqc_setcurctx(mqc, opj_t1_getctxno_zc(flag, orient));	
+        opj_mqc_setcurctx_macro(mqc, mqc->curctx, opj_t1_getctxno_zc(flag, orient));	
         if (type == T1_TYPE_RAW) {	/* BYPASS/LAZY MODE */
-            opj_mqc_bypass_enc(mqc, (uint32_t)v);
+            opj_mqc_bypass_enc_macro(mqc, *c, *ct, (uint32_t)v);
         } else {
-            opj_mqc_encode(mqc, (uint32_t)v);
+            opj_mqc_encode_macro(mqc, mqc->curctx, *a, *c, *ct, (uint32_t)v);
         }
         if (v) {
             v = *datap < 0 ? 1 : 0;
             *nmsedec +=	opj_t1_getnmsedec_sig((uint32_t)opj_int_abs(*datap), (uint32_t)(bpno));
-            opj_mqc_setcurctx(mqc, opj_t1_getctxno_sc(flag));	
+            opj_mqc_setcurctx_macro(mqc, mqc->curctx, opj_t1_getctxno_sc(flag));	
             if (type == T1_TYPE_RAW) {	/* BYPASS/LAZY MODE */
-                opj_mqc_bypass_enc(mqc, (uint32_t)v);
+                opj_mqc_bypass_enc_macro(mqc, *c, *ct, (uint32_t)v);
             } else {
-                opj_mqc_encode(mqc, (uint32_t)(v ^ opj_t1_getspb((uint32_t)flag)));
+                opj_mqc_encode_macro(mqc, mqc->curctx, *a, *c, *ct, (uint32_t)(v ^ opj_t1_getspb((uint32_t)flag)));
             }
             opj_t1_updateflags(flagsp, (uint32_t)v, t1->flags_stride);
         }
@@ -468,6 +480,11 @@ static void opj_t1_enc_sigpass(opj_t1_t *t1,
     uint32_t i, j, k, vsc;
     int32_t one;
 
+    opj_mqc_t *mqc = t1->mqc;
+    uint32_t a = mqc->a;
+    uint32_t c = mqc->c;
+    uint32_t ct = mqc->ct;
+
     *nmsedec = 0;
     one = 1 << (bpno + T1_NMSEDEC_FRACBITS);
     for (k = 0; k < t1->h; k += 4) {
@@ -483,10 +500,14 @@ static void opj_t1_enc_sigpass(opj_t1_t *t1,
                     one,
                     nmsedec,
                     type,
-                    vsc);
+                    vsc,
+                    &a, &c, &ct);
             }
         }
     }
+    mqc->a = a;
+    mqc->c = c;
+    mqc->ct = ct;
 }
 
 static void opj_t1_dec_sigpass_raw(
@@ -587,14 +608,17 @@ static void opj_t1_dec_sigpass_mqc_vsc(
 
 
 
-static void opj_t1_enc_refpass_step(   opj_t1_t *t1,
+static inline void opj_t1_enc_refpass_step(   opj_t1_t *t1,
                                        opj_flag_t *flagsp,
                                        int32_t *datap,
                                        int32_t bpno,
                                        int32_t one,
                                        int32_t *nmsedec,
                                        uint8_t type,
-                                       uint32_t vsc)
+                                       uint32_t vsc,
+                                       uint32_t *a,
+                                       uint32_t *c,
+                                       uint32_t *ct)
 {
     int32_t v;
     uint32_t flag;
@@ -605,11 +629,11 @@ static void opj_t1_enc_refpass_step(   opj_t1_t *t1,
     if ((flag & (T1_SIG | T1_VISIT)) == T1_SIG) {
         *nmsedec += opj_t1_getnmsedec_ref((uint32_t)opj_int_abs(*datap), (uint32_t)(bpno));
         v = (opj_int_abs(*datap) & one) ? 1 : 0;
-        opj_mqc_setcurctx(mqc, opj_t1_getctxno_mag(flag));	
+        opj_mqc_setcurctx_macro(mqc, mqc->curctx, opj_t1_getctxno_mag(flag));	
         if (type == T1_TYPE_RAW) {	/* BYPASS/LAZY MODE */
-            opj_mqc_bypass_enc(mqc, (uint32_t)v);
+            opj_mqc_bypass_enc_macro(mqc, *c, *ct, (uint32_t)v);
         } else {
-            opj_mqc_encode(mqc, (uint32_t)v);
+            opj_mqc_encode_macro(mqc, mqc->curctx, *a, *c, *ct, (uint32_t)v);
         }
         *flagsp |= T1_REFINE;
     }
@@ -690,6 +714,11 @@ static void opj_t1_enc_refpass(
     uint32_t i, j, k, vsc;
     int32_t one;
 
+    opj_mqc_t *mqc = t1->mqc;
+    uint32_t a = mqc->a;
+    uint32_t c = mqc->c;
+    uint32_t ct = mqc->ct;
+
     *nmsedec = 0;
     one = 1 << (bpno + T1_NMSEDEC_FRACBITS);
     for (k = 0; k < t1->h; k += 4) {
@@ -704,10 +733,14 @@ static void opj_t1_enc_refpass(
                     one,
                     nmsedec,
                     type,
-                    vsc);
+                    vsc,
+                    &a, &c, &ct);
             }
         }
     }
+    mqc->a = a;
+    mqc->c = c;
+    mqc->ct = ct;
 }
 
 static void opj_t1_dec_refpass_raw(
@@ -806,7 +839,7 @@ static void opj_t1_dec_refpass_mqc_vsc(
 }                               
 
 
-static void opj_t1_enc_clnpass_step(
+static inline void opj_t1_enc_clnpass_step(
     opj_t1_t *t1,
     opj_flag_t *flagsp,
     int32_t *datap,
@@ -815,7 +848,10 @@ static void opj_t1_enc_clnpass_step(
     int32_t one,
     int32_t *nmsedec,
     uint32_t partial,
-    uint32_t vsc)
+    uint32_t vsc,
+    uint32_t *a,
+    uint32_t *c,
+    uint32_t *ct)
 {
     int32_t v;
     uint32_t flag;
@@ -827,15 +863,15 @@ static void opj_t1_enc_clnpass_step(
         goto LABEL_PARTIAL;
     }
     if (!(*flagsp & (T1_SIG | T1_VISIT))) {
-        opj_mqc_setcurctx(mqc, opj_t1_getctxno_zc(flag, orient));
+        opj_mqc_setcurctx_macro(mqc, mqc->curctx, opj_t1_getctxno_zc(flag, orient));
         v = (opj_int_abs(*datap) & one) ? 1 : 0;
-        opj_mqc_encode(mqc, (uint32_t)v);
+        opj_mqc_encode_macro(mqc, mqc->curctx, *a, *c, *ct, (uint32_t)v);
         if (v) {
 LABEL_PARTIAL:
             *nmsedec += opj_t1_getnmsedec_sig((uint32_t)opj_int_abs(*datap), (uint32_t)(bpno));
-            opj_mqc_setcurctx(mqc, opj_t1_getctxno_sc(flag));
+            opj_mqc_setcurctx_macro(mqc, mqc->curctx, opj_t1_getctxno_sc(flag));
             v = *datap < 0 ? 1 : 0;
-            opj_mqc_encode(mqc, (uint32_t)(v ^ opj_t1_getspb((uint32_t)flag)));
+            opj_mqc_encode_macro(mqc, mqc->curctx, *a, *c, *ct, (uint32_t)(v ^ opj_t1_getspb((uint32_t)flag)));
             opj_t1_updateflags(flagsp, (uint32_t)v, t1->flags_stride);
         }
     }
@@ -927,7 +963,10 @@ static void opj_t1_enc_clnpass(
     int32_t one;
     uint32_t agg, runlen, vsc;
 
-    opj_mqc_t *mqc = t1->mqc;	
+    opj_mqc_t *mqc = t1->mqc;
+    uint32_t a = mqc->a;
+    uint32_t c = mqc->c;
+    uint32_t ct = mqc->ct;
 
     *nmsedec = 0;
     one = 1 << (bpno + T1_NMSEDEC_FRACBITS);
@@ -954,14 +993,14 @@ static void opj_t1_enc_clnpass(
                     if (opj_int_abs(t1->data[((k + runlen)*t1->data_stride) + i]) & one)
                         break;
                 }
-                opj_mqc_setcurctx(mqc, T1_CTXNO_AGG);
-                opj_mqc_encode(mqc, runlen != 4);
+                opj_mqc_setcurctx_macro(mqc, mqc->curctx, T1_CTXNO_AGG);
+                opj_mqc_encode_macro(mqc, mqc->curctx, a, c, ct, runlen != 4);
                 if (runlen == 4) {
                     continue;
                 }
-                opj_mqc_setcurctx(mqc, T1_CTXNO_UNI);
-                opj_mqc_encode(mqc, runlen >> 1);
-                opj_mqc_encode(mqc, runlen & 1);
+                opj_mqc_setcurctx_macro(mqc, mqc->curctx, T1_CTXNO_UNI);
+                opj_mqc_encode_macro(mqc, mqc->curctx, a, c, ct, runlen >> 1);
+                opj_mqc_encode_macro(mqc, mqc->curctx, a, c, ct, runlen & 1);
             } else {
                 runlen = 0;
             }
@@ -976,10 +1015,14 @@ static void opj_t1_enc_clnpass(
                     one,
                     nmsedec,
                     agg && (j == k + runlen),
-                    vsc);
+                    vsc,
+                    &a, &c, &ct);
             }
         }
     }
+    mqc->a = a;
+    mqc->c = c;
+    mqc->ct = ct;
 }
 
 static void opj_t1_dec_clnpass(
@@ -1262,7 +1305,7 @@ void opj_t1_destroy(opj_t1_t *p_t1)
 
 bool opj_t1_decode_cblks(  opj_tcd_tilecomp_t* tilec,
                            opj_tccp_t* tccp,
-						   std::vector<decodeBlockInfo*>* blocks,
+						   std::vector<decodeBlockInfo>* blocks,
                            opj_event_mgr_t * p_manager)
 {
     uint32_t resno, bandno, precno;
@@ -1289,11 +1332,10 @@ bool opj_t1_decode_cblks(  opj_tcd_tilecomp_t* tilec,
                         x = cblk->x0;
                         y = cblk->y0;
 
-                        /* check if block overlaps with decode region */
-                        opj_rect_init(&cblk_rect, x, y, x + (1<< tccp->cblkw), y + (1<<tccp->cblkh));
-
-
-                        if (!opj_tile_buf_hit_test(tilec->buf, &cblk_rect))
+                        /* skip blocks that cannot reach the decode region through
+                           the synthesis filters of this band's resolution and those above it */
+                        opj_rect_init(&cblk_rect, x, y, (int32_t)cblk->x1, (int32_t)cblk->y1);
+                        if (!opj_tile_buf_hit_test_band(tilec->buf, resno, bandno, &cblk_rect))
                             continue;
 
 
@@ -1310,7 +1352,8 @@ bool opj_t1_decode_cblks(  opj_tcd_tilecomp_t* tilec,
                             y += pres->y1 - pres->y0;
                         }
 
-						auto block = new decodeBlockInfo();
+						blocks->emplace_back();
+						auto block = &blocks->back();
 						block->bandno = band->bandno;
 						block->cblk = cblk;
 						block->cblksty = tccp->cblksty;
@@ -1322,7 +1365,6 @@ bool opj_t1_decode_cblks(  opj_tcd_tilecomp_t* tilec,
 						block->x = x;
 						block->y = y;
 						block->tiledp = opj_tile_buf_get_ptr(tilec->buf, resno, bandno, (uint32_t)x, (uint32_t)y);
-						blocks->push_back(block);
 
                     } /* cblkno */
             } /* precno */
@@ -1355,11 +1397,13 @@ bool opj_t1_decode_cblk(opj_t1_t *t1,
         return false;
     }
 
-    total_seg_len = opj_min_buf_vec_get_len(&cblk->seg_buffers);
+    total_seg_len = 0;
+    for (uint32_t i = 0; i < cblk->numchunks; ++i)
+        total_seg_len += cblk->chunks[i].len;
     if (cblk->real_num_segs && total_seg_len) {
-        /* if there is only one segment, then it is already contiguous, so no need to make a copy*/
-        if (total_seg_len == 1 && opj_vec_get(&cblk->seg_buffers, 0)) {
-            block_buffer = ((opj_buf_t*)(opj_vec_get(&cblk->seg_buffers, 0)))->buf;
+        /* if there is only one chunk, then it is already contiguous, so no need to make a copy*/
+        if (cblk->numchunks == 1) {
+            block_buffer = cblk->chunks[0].data;
         } else {
             /* block should have been allocated on creation of t1*/
             if (!t1->compressed_block)
@@ -1371,7 +1415,11 @@ bool opj_t1_decode_cblk(opj_t1_t *t1,
                 t1->compressed_block = new_block;
                 t1->compressed_block_size = total_seg_len;
             }
-            opj_min_buf_vec_copy_to_contiguous_buffer(&cblk->seg_buffers, t1->compressed_block);
+            size_t offset = 0;
+            for (uint32_t i = 0; i < cblk->numchunks; ++i) {
+                memcpy(t1->compressed_block + offset, cblk->chunks[i].data, cblk->chunks[i].len);
+                offset += cblk->chunks[i].len;
+            }
             block_buffer = t1->compressed_block;
         }
     } else {
@@ -1465,7 +1513,22 @@ bool opj_t1_encode_cblks(   opj_tcd_tile_t *tile,
         }
     }
 
-	std::vector<encodeBlockInfo*> blocks;
+	/* block descriptors live in one array for the lifetime of the tile */
+	size_t numBlocks = 0;
+	for (compno = 0; compno < tile->numcomps; ++compno) {
+		opj_tcd_tilecomp_t* tilec = &tile->comps[compno];
+		for (resno = 0; resno < tilec->numresolutions; ++resno) {
+			opj_tcd_resolution_t *res = &tilec->resolutions[resno];
+			for (bandno = 0; bandno < res->numbands; ++bandno) {
+				opj_tcd_band_t* restrict band = &res->bands[bandno];
+				for (precno = 0; precno < res->pw * res->ph; ++precno) {
+					numBlocks += (size_t)band->precincts[precno].cw * band->precincts[precno].ch;
+				}
+			}
+		}
+	}
+	std::vector<encodeBlockInfo> blocks;
+	blocks.reserve(numBlocks);
 	auto maxCblkW = 0;
 	auto maxCblkH = 0;
 
@@ -1500,7 +1563,8 @@ bool opj_t1_encode_cblks(   opj_tcd_tile_t *tile,
 
 						maxCblkW = opj_int_max(maxCblkW, 1 << tccp->cblkw);
 						maxCblkH = opj_int_max(maxCblkH, 1 << tccp->cblkh);
-						auto block = new encodeBlockInfo();
+						blocks.emplace_back();
+						auto block = &blocks.back();
 						block->compno = compno;
 						block->bandno = band->bandno;
 						block->cblk = cblk;
@@ -1514,7 +1578,6 @@ bool opj_t1_encode_cblks(   opj_tcd_tile_t *tile,
 						block->mct_norms = mct_norms;
 						block->mct_numcomps = mct_numcomps;
 						block->tiledp = opj_tile_buf_get_ptr(tilec->buf, resno, bandno, (uint32_t)x, (uint32_t)y);
-						blocks.push_back(block);
 					
                     } /* cblkno */
                 } /* precno */
@@ -241,10 +241,15 @@ Decode the code-blocks of a tile
 */
 bool opj_t1_decode_cblks(   opj_tcd_tilecomp_t* tilec,
                             opj_tccp_t* tccp,
-							std::vector<decodeBlockInfo*>* blocks,
+							std::vector<decodeBlockInfo>* blocks,
                             opj_event_mgr_t * p_manager);
 
 
+/**
+Bind the widest code-block reconstruction kernels the CPU supports (see cpu_features.h)
+*/
+void opj_t1_init_kernels(void);
+
 /**
 Decode 1 code-block
 @param t1 T1 handle
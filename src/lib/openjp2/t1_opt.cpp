@@ -57,6 +57,7 @@
 
 #include "opj_includes.h"
 #include "t1_luts.h"
+#include "mqc_inl.h"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -87,13 +88,16 @@ static inline void			opj_t1_updateflags_opt(opj_flag_opt_t *flagsp, uint32_t ci,
 /**
 Encode significant pass
 */
-static void opj_t1_enc_sigpass_step(opj_t1_opt_t *t1,
+static inline void opj_t1_enc_sigpass_step(opj_t1_opt_t *t1,
                                     opj_flag_opt_t *flagsp,
                                     uint32_t *datap,
                                     uint32_t orient,
                                     int32_t bpno,
                                     int32_t one,
-                                    int32_t *nmsedec);
+                                    int32_t *nmsedec,
+                                    uint32_t *a,
+                                    uint32_t *c,
+                                    uint32_t *ct);
 
 /**
 Encode significant pass
@@ -107,12 +111,15 @@ static void opj_t1_enc_sigpass( opj_t1_opt_t *t1,
 /**
 Encode refinement pass
 */
-static void opj_t1_enc_refpass_step(opj_t1_opt_t *t1,
+static inline void opj_t1_enc_refpass_step(opj_t1_opt_t *t1,
                                     opj_flag_opt_t *flagsp,
                                     uint32_t *datap,
                                     int32_t bpno,
                                     int32_t one,
-                                    int32_t *nmsedec);
+                                    int32_t *nmsedec,
+                                    uint32_t *a,
+                                    uint32_t *c,
+                                    uint32_t *ct);
 
 
 /**
@@ -127,7 +134,7 @@ static void opj_t1_enc_refpass( opj_t1_opt_t *t1,
 /**
 Encode clean-up pass
 */
-static void opj_t1_enc_clnpass_step(
+static inline void opj_t1_enc_clnpass_step(
     opj_t1_opt_t *t1,
     opj_flag_opt_t *flagsp,
     uint32_t *datap,
@@ -137,7 +144,10 @@ static void opj_t1_enc_clnpass_step(
     int32_t *nmsedec,
     uint32_t agg,
     uint32_t runlen,
-    uint32_t y);
+    uint32_t y,
+    uint32_t *a,
+    uint32_t *c,
+    uint32_t *ct);
 
 /**
 Encode clean-up pass
@@ -149,6 +159,30 @@ static void opj_t1_enc_clnpass(
     int32_t *nmsedec);
 
 
+/**
+Decode significance propagation pass
+*/
+static void opj_t1_dec_sigpass_opt(opj_t1_opt_t *t1,
+                                   int32_t bpno,
+                                   uint32_t orient,
+                                   uint32_t vsc);
+
+/**
+Decode refinement pass
+*/
+static void opj_t1_dec_refpass_opt(opj_t1_opt_t *t1,
+                                   int32_t bpno,
+                                   uint32_t vsc);
+
+/**
+Decode clean-up pass
+*/
+static void opj_t1_dec_clnpass_opt(opj_t1_opt_t *t1,
+                                   int32_t bpno,
+                                   uint32_t orient,
+                                   uint32_t cblksty);
+
+
 
 
 
@@ -209,6 +243,9 @@ void opj_t1_opt_destroy(opj_t1_opt_t *p_t1)
         p_t1->flags = 00;
     }
 
+    if (p_t1->compressed_block)
+        opj_free(p_t1->compressed_block);
+
     opj_free(p_t1);
 }
 
@@ -332,13 +369,16 @@ static void opj_t1_updateflags_opt(opj_flag_opt_t *flagsp, uint32_t ci, uint32_t
     }
 }
 
-static void  opj_t1_enc_sigpass_step(   opj_t1_opt_t *t1,
+static inline void  opj_t1_enc_sigpass_step(   opj_t1_opt_t *t1,
                                         opj_flag_opt_t *flagsp,
                                         uint32_t *datap,
                                         uint32_t orient,
                                         int32_t bpno,
                                         int32_t one,
-                                        int32_t *nmsedec)
+                                        int32_t *nmsedec,
+                                        uint32_t *a,
+                                        uint32_t *c,
+                                        uint32_t *ct)
 {
     uint32_t v;
     uint32_t ci;
@@ -353,14 +393,14 @@ static void  opj_t1_enc_sigpass_step(   opj_t1_opt_t *t1,
         then code in this pass: */
         if ((shift_flags & (T1_SIGMA_THIS | T1_PI_THIS)) == 0U && (shift_flags & T1_SIGMA_NEIGHBOURS) != 0U) {
             v = (*datap >> one) & 1;
-            opj_mqc_setcurctx(mqc, opj_t1_getctxno_zc_opt(shift_flags, orient));
-            opj_mqc_encode(mqc, v);
+            opj_mqc_setcurctx_macro(mqc, mqc->curctx, opj_t1_getctxno_zc_opt(shift_flags, orient));
+            opj_mqc_encode_macro(mqc, mqc->curctx, *a, *c, *ct, v);
             if (v) {
                 /* sign bit */
                 v = *datap >> T1_DATA_SIGN_BIT_INDEX;
                 *nmsedec += opj_t1_getnmsedec_sig(*datap, (uint32_t)bpno);
-                opj_mqc_setcurctx(mqc, opj_t1_getctxno_sc_opt(*flagsp, flagsp[-1], flagsp[1], ci));
-                opj_mqc_encode(mqc, v ^ opj_t1_getspb_opt(*flagsp, flagsp[-1], flagsp[1], ci));
+                opj_mqc_setcurctx_macro(mqc, mqc->curctx, opj_t1_getctxno_sc_opt(*flagsp, flagsp[-1], flagsp[1], ci));
+                opj_mqc_encode_macro(mqc, mqc->curctx, *a, *c, *ct, v ^ opj_t1_getspb_opt(*flagsp, flagsp[-1], flagsp[1], ci));
                 opj_t1_updateflags_opt(flagsp, ci, v, t1->flags_stride);
             }
             /* set propagation pass bit for this location */
@@ -385,6 +425,11 @@ static void opj_t1_enc_sigpass(opj_t1_opt_t *t1,
     opj_flag_opt_t* f = ENC_FLAGS_ADDRESS(0, 0);
     uint32_t* d = t1->data;
 
+    opj_mqc_t *mqc = t1->mqc;
+    uint32_t a = mqc->a;
+    uint32_t c = mqc->c;
+    uint32_t ct = mqc->ct;
+
     *nmsedec = 0;
     for (k = 0; k < t1->h; k += 4) {
         for (i = 0; i < t1->w; ++i) {
@@ -395,7 +440,8 @@ static void opj_t1_enc_sigpass(opj_t1_opt_t *t1,
                 orient,
                 bpno,
                 one,
-                nmsedec);
+                nmsedec,
+                &a, &c, &ct);
 
             ++f;
             ++d;
@@ -403,14 +449,20 @@ static void opj_t1_enc_sigpass(opj_t1_opt_t *t1,
         d += data_row_extra;
         f += flag_row_extra;
     }
+    mqc->a = a;
+    mqc->c = c;
+    mqc->ct = ct;
 }
 
-static void opj_t1_enc_refpass_step(   opj_t1_opt_t *t1,
+static inline void opj_t1_enc_refpass_step(   opj_t1_opt_t *t1,
                                        opj_flag_opt_t *flagsp,
                                        uint32_t *datap,
                                        int32_t bpno,
                                        int32_t one,
-                                       int32_t *nmsedec)
+                                       int32_t *nmsedec,
+                                       uint32_t *a,
+                                       uint32_t *c,
+                                       uint32_t *ct)
 {
     uint32_t v;
     uint32_t ci;
@@ -432,8 +484,8 @@ static void opj_t1_enc_refpass_step(   opj_t1_opt_t *t1,
         if ((shift_flags & (T1_SIGMA_THIS | T1_PI_THIS)) == T1_SIGMA_THIS) {
             *nmsedec += opj_t1_getnmsedec_ref(*datap, (uint32_t)bpno);
             v = (*datap >> one) & 1;
-            opj_mqc_setcurctx(mqc, opj_t1_getctxno_mag_opt(shift_flags));
-            opj_mqc_encode(mqc, v);
+            opj_mqc_setcurctx_macro(mqc, mqc->curctx, opj_t1_getctxno_mag_opt(shift_flags));
+            opj_mqc_encode_macro(mqc, mqc->curctx, *a, *c, *ct, v);
             /* flip magnitude refinement bit*/
             *flagsp |= T1_MU_THIS << (ci * 3U);
         }
@@ -453,6 +505,11 @@ static void opj_t1_enc_refpass(
     uint32_t const data_row_extra = (t1->w << 2) - t1->w;
     uint32_t* d = t1->data;
 
+    opj_mqc_t *mqc = t1->mqc;
+    uint32_t a = mqc->a;
+    uint32_t c = mqc->c;
+    uint32_t ct = mqc->ct;
+
     *nmsedec = 0;
     for (k = 0U; k < t1->h; k += 4U) {
         for (i = 0U; i < t1->w; ++i) {
@@ -462,16 +519,20 @@ static void opj_t1_enc_refpass(
                 d,
                 bpno,
                 one,
-                nmsedec);
+                nmsedec,
+                &a, &c, &ct);
             ++f;
             ++d;
         }
         f += flag_row_extra;
         d += data_row_extra;
     }
+    mqc->a = a;
+    mqc->c = c;
+    mqc->ct = ct;
 }
 
-static void opj_t1_enc_clnpass_step(
+static inline void opj_t1_enc_clnpass_step(
     opj_t1_opt_t *t1,
     opj_flag_opt_t *flagsp,
     uint32_t *datap,
@@ -481,7 +542,10 @@ static void opj_t1_enc_clnpass_step(
     int32_t *nmsedec,
     uint32_t agg,
     uint32_t runlen,
-    uint32_t y)
+    uint32_t y,
+    uint32_t *a,
+    uint32_t *c,
+    uint32_t *ct)
 {
     uint32_t v;
     uint32_t ci;
@@ -513,16 +577,16 @@ static void opj_t1_enc_clnpass_step(
         shift_flags = *flagsp >> (ci * 3U);
 
         if (!(shift_flags & (T1_SIGMA_THIS | T1_PI_THIS))) {
-            opj_mqc_setcurctx(mqc, opj_t1_getctxno_zc_opt(shift_flags, orient));
+            opj_mqc_setcurctx_macro(mqc, mqc->curctx, opj_t1_getctxno_zc_opt(shift_flags, orient));
             v = (*datap >> one) & 1;
-            opj_mqc_encode(mqc, v);
+            opj_mqc_encode_macro(mqc, mqc->curctx, *a, *c, *ct, v);
             if (v) {
 LABEL_PARTIAL:
                 *nmsedec += opj_t1_getnmsedec_sig(*datap, (uint32_t)bpno);
-                opj_mqc_setcurctx(mqc, opj_t1_getctxno_sc_opt(*flagsp, flagsp[-1], flagsp[1], ci));
+                opj_mqc_setcurctx_macro(mqc, mqc->curctx, opj_t1_getctxno_sc_opt(*flagsp, flagsp[-1], flagsp[1], ci));
                 /* sign bit */
                 v = *datap >> T1_DATA_SIGN_BIT_INDEX;
-                opj_mqc_encode(mqc, v ^ opj_t1_getspb_opt(*flagsp, flagsp[-1], flagsp[1], ci));
+                opj_mqc_encode_macro(mqc, mqc->curctx, *a, *c, *ct, v ^ opj_t1_getspb_opt(*flagsp, flagsp[-1], flagsp[1], ci));
                 opj_t1_updateflags_opt(flagsp, ci, v, t1->flags_stride);
             }
         }
@@ -543,6 +607,9 @@ static void opj_t1_enc_clnpass(
     uint32_t agg, runlen;
 
     opj_mqc_t *mqc = t1->mqc;
+    uint32_t a = mqc->a;
+    uint32_t c = mqc->c;
+    uint32_t ct = mqc->ct;
 
     *nmsedec = 0;
 
@@ -554,14 +621,14 @@ static void opj_t1_enc_clnpass(
                     if ( (t1->data[((k + runlen)*t1->w) + i] >> one) & 1)
                         break;
                 }
-                opj_mqc_setcurctx(mqc, T1_CTXNO_AGG);
-                opj_mqc_encode(mqc, runlen != 4);
+                opj_mqc_setcurctx_macro(mqc, mqc->curctx, T1_CTXNO_AGG);
+                opj_mqc_encode_macro(mqc, mqc->curctx, a, c, ct, runlen != 4);
                 if (runlen == 4) {
                     continue;
                 }
-                opj_mqc_setcurctx(mqc, T1_CTXNO_UNI);
-                opj_mqc_encode(mqc, runlen >> 1);
-                opj_mqc_encode(mqc, runlen & 1);
+                opj_mqc_setcurctx_macro(mqc, mqc->curctx, T1_CTXNO_UNI);
+                opj_mqc_encode_macro(mqc, mqc->curctx, a, c, ct, runlen >> 1);
+                opj_mqc_encode_macro(mqc, mqc->curctx, a, c, ct, runlen & 1);
             } else {
                 runlen = 0;
             }
@@ -575,8 +642,199 @@ static void opj_t1_enc_clnpass(
                 nmsedec,
                 agg,
                 runlen,
-                k);
+                k,
+                &a, &c, &ct);
+        }
+    }
+    mqc->a = a;
+    mqc->c = c;
+    mqc->ct = ct;
+}
+
+
+/* With vertically causal context, the south neighbours of the last
+   row of a stripe are ignored when forming contexts */
+#define T1_VSC_MASK (~(T1_SIGMA_15 | T1_SIGMA_16 | T1_SIGMA_17 | T1_CHI_5))
+
+static void opj_t1_dec_sigpass_opt(opj_t1_opt_t *t1,
+                                   int32_t bpno,
+                                   uint32_t orient,
+                                   uint32_t vsc)
+{
+    uint32_t i, k, ci;
+    int32_t const one = 1 << bpno;
+    int32_t const oneplushalf = one | (one >> 1);
+    uint32_t const flag_row_extra = t1->flags_stride - t1->w;
+    uint32_t const data_row_extra = (t1->w << 2) - t1->w;
+    opj_mqc_t *mqc = t1->mqc;
+    DOWNLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct);
+
+    opj_flag_opt_t* f = ENC_FLAGS_ADDRESS(0, 0);
+    int32_t* d = (int32_t*)t1->data;
+
+    for (k = 0; k < t1->h; k += 4) {
+        for (i = 0; i < t1->w; ++i) {
+            /* a zero flags word has no significant neighbours: nothing to do */
+            if (*f) {
+                int32_t* datap = d;
+                for (ci = 0U; ci < 4U; ++ci) {
+                    uint32_t const flags = (vsc && ci == 3U) ? (*f & T1_VSC_MASK) : *f;
+                    uint32_t const shift_flags = flags >> (ci * 3U);
+                    /* rows beyond the end of the block carry T1_PI_X, so they are never coded */
+                    if ((shift_flags & (T1_SIGMA_THIS | T1_PI_THIS)) == 0U && (shift_flags & T1_SIGMA_NEIGHBOURS) != 0U) {
+                        uint32_t v;
+                        opj_mqc_setcurctx_macro(mqc, curctx, opj_t1_getctxno_zc_opt(shift_flags, orient));
+                        opj_mqc_decode_macro(v, mqc, curctx, a, c, ct);
+                        if (v) {
+                            opj_mqc_setcurctx_macro(mqc, curctx, opj_t1_getctxno_sc_opt(flags, f[-1], f[1], ci));
+                            opj_mqc_decode_macro(v, mqc, curctx, a, c, ct);
+                            v ^= opj_t1_getspb_opt(flags, f[-1], f[1], ci);
+                            *datap = v ? -oneplushalf : oneplushalf;
+                            opj_t1_updateflags_opt(f, ci, v, t1->flags_stride);
+                        }
+                        /* set propagation pass bit for this location */
+                        *f |= T1_PI_THIS << (ci * 3U);
+                    }
+                    datap += t1->w;
+                }
+            }
+            ++f;
+            ++d;
+        }
+        d += data_row_extra;
+        f += flag_row_extra;
+    }
+    UPLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct);
+}
+
+static void opj_t1_dec_refpass_opt(opj_t1_opt_t *t1,
+                                   int32_t bpno,
+                                   uint32_t vsc)
+{
+    uint32_t i, k, ci;
+    int32_t const one = 1 << bpno;
+    int32_t const poshalf = one >> 1;
+    int32_t const neghalf = bpno > 0 ? -poshalf : -1;
+    uint32_t const flag_row_extra = t1->flags_stride - t1->w;
+    uint32_t const data_row_extra = (t1->w << 2) - t1->w;
+    opj_mqc_t *mqc = t1->mqc;
+    DOWNLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct);
+
+    opj_flag_opt_t* f = ENC_FLAGS_ADDRESS(0, 0);
+    int32_t* d = (int32_t*)t1->data;
+
+    for (k = 0; k < t1->h; k += 4) {
+        for (i = 0; i < t1->w; ++i) {
+            /* skip columns with no significant location, or with all locations coded in sigpass */
+            if ((*f & (T1_SIGMA_4 | T1_SIGMA_7 | T1_SIGMA_10 | T1_SIGMA_13)) != 0 &&
+                    (*f & (T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3)) != (T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3)) {
+                int32_t* datap = d;
+                for (ci = 0U; ci < 4U; ++ci) {
+                    uint32_t const flags = (vsc && ci == 3U) ? (*f & T1_VSC_MASK) : *f;
+                    uint32_t const shift_flags = flags >> (ci * 3U);
+                    /* significant, but not coded in significance propagation pass */
+                    if ((shift_flags & (T1_SIGMA_THIS | T1_PI_THIS)) == T1_SIGMA_THIS) {
+                        uint32_t v;
+                        int32_t t;
+                        opj_mqc_setcurctx_macro(mqc, curctx, opj_t1_getctxno_mag_opt(shift_flags));
+                        opj_mqc_decode_macro(v, mqc, curctx, a, c, ct);
+                        t = v ? poshalf : neghalf;
+                        *datap += *datap < 0 ? -t : t;
+                        /* flip magnitude refinement bit*/
+                        *f |= T1_MU_THIS << (ci * 3U);
+                    }
+                    datap += t1->w;
+                }
+            }
+            ++f;
+            ++d;
+        }
+        d += data_row_extra;
+        f += flag_row_extra;
+    }
+    UPLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct);
+}
+
+static void opj_t1_dec_clnpass_opt(opj_t1_opt_t *t1,
+                                   int32_t bpno,
+                                   uint32_t orient,
+                                   uint32_t cblksty)
+{
+    uint32_t i, k, ci;
+    int32_t const one = 1 << bpno;
+    int32_t const oneplushalf = one | (one >> 1);
+    uint32_t const vsc = cblksty & J2K_CCP_CBLKSTY_VSC;
+    uint32_t const agg_mask = vsc ? T1_VSC_MASK : ~0U;
+    uint32_t const check = (T1_SIGMA_4 | T1_SIGMA_7 | T1_SIGMA_10 | T1_SIGMA_13 | T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3);
+    uint32_t const flag_row_extra = t1->flags_stride - t1->w;
+    uint32_t const data_row_extra = (t1->w << 2) - t1->w;
+    opj_mqc_t *mqc = t1->mqc;
+    DOWNLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct);
+
+    opj_flag_opt_t* f = ENC_FLAGS_ADDRESS(0, 0);
+    int32_t* d = (int32_t*)t1->data;
+
+    for (k = 0; k < t1->h; k += 4) {
+        uint32_t const lim = 4U < (t1->h - k) ? 4U : (t1->h - k);
+        for (i = 0; i < t1->w; ++i, ++f, ++d) {
+            uint32_t runlen = 0;
+            uint32_t v;
+            int32_t* datap;
+            /* a partial stripe carries T1_PI_X for its missing rows, so it never aggregates */
+            uint32_t const agg = !(*f & agg_mask);
+
+            if ((*f & check) == check) {
+                /* all four locations were coded in sigpass */
+                *f &= ~(T1_PI_0 | T1_PI_1 | T1_PI_2 | T1_PI_3);
+                continue;
+            }
+            if (agg) {
+                opj_mqc_setcurctx_macro(mqc, curctx, T1_CTXNO_AGG);
+                opj_mqc_decode_macro(v, mqc, curctx, a, c, ct);
+                if (!v) {
+                    continue;
+                }
+                opj_mqc_setcurctx_macro(mqc, curctx, T1_CTXNO_UNI);
+                opj_mqc_decode_macro(runlen, mqc, curctx, a, c, ct);
+                opj_mqc_decode_macro(v, mqc, curctx, a, c, ct);
+                runlen = (runlen << 1) | v;
+            }
+            datap = d + runlen * t1->w;
+            for (ci = runlen; ci < lim; ++ci) {
+                uint32_t const flags = (vsc && ci == 3U) ? (*f & T1_VSC_MASK) : *f;
+                uint32_t const shift_flags = flags >> (ci * 3U);
+                if ((agg != 0) && (ci == runlen)) {
+                    goto LABEL_PARTIAL;
+                }
+                if (!(shift_flags & (T1_SIGMA_THIS | T1_PI_THIS))) {
+                    opj_mqc_setcurctx_macro(mqc, curctx, opj_t1_getctxno_zc_opt(shift_flags, orient));
+                    opj_mqc_decode_macro(v, mqc, curctx, a, c, ct);
+                    if (v) {
+LABEL_PARTIAL:
+                        opj_mqc_setcurctx_macro(mqc, curctx, opj_t1_getctxno_sc_opt(flags, f[-1], f[1], ci));
+                        opj_mqc_decode_macro(v, mqc, curctx, a, c, ct);
+                        v ^= opj_t1_getspb_opt(flags, f[-1], f[1], ci);
+                        *datap = v ? -oneplushalf : oneplushalf;
+                        opj_t1_updateflags_opt(f, ci, v, t1->flags_stride);
+                    }
+                }
+                *f &= ~(T1_PI_0 << (3U * ci));
+                datap += t1->w;
+            }
         }
+        d += data_row_extra;
+        f += flag_row_extra;
+    }
+
+    UPLOAD_MQC_VARIABLES(mqc, curctx, a, c, ct);
+
+    /* the segmentation symbol is read and ignored */
+    if (cblksty & J2K_CCP_CBLKSTY_SEGSYM) {
+        opj_mqc_setcurctx(mqc, T1_CTXNO_UNI);
+        opj_mqc_decode(mqc);
+        opj_mqc_decode(mqc);
+        opj_mqc_decode(mqc);
+        opj_mqc_decode(mqc);
     }
 }
 
@@ -743,4 +1001,87 @@ double opj_t1_opt_encode_cblk(opj_t1_opt_t *t1,
         pass->len = pass->rate - (passno == 0 ? 0 : cblk->passes[passno - 1].rate);
     }
 	return cumwmsedec;
-}
\ No newline at end of file
+}
+
+
+
+bool opj_t1_opt_decode_cblk(opj_t1_opt_t *t1,
+                            opj_tcd_cblk_dec_t* cblk,
+                            uint32_t orient,
+                            uint32_t roishift,
+                            uint32_t cblksty)
+{
+    opj_mqc_t *mqc = t1->mqc;
+    int32_t bpno_plus_one;
+    uint32_t passtype;
+    uint32_t segno, passno;
+    uint8_t* block_buffer = NULL;
+    size_t total_seg_len;
+
+    opj_t1_opt_init_buffers(t1, cblk->x1 - cblk->x0, cblk->y1 - cblk->y0);
+
+    total_seg_len = 0;
+    for (uint32_t i = 0; i < cblk->numchunks; ++i)
+        total_seg_len += cblk->chunks[i].len;
+    if (!cblk->real_num_segs || !total_seg_len) {
+        return true;
+    }
+    /* if there is only one chunk, then it is already contiguous, so no need to make a copy*/
+    if (cblk->numchunks == 1) {
+        block_buffer = cblk->chunks[0].data;
+    } else {
+        if (t1->compressed_block_size < total_seg_len) {
+            uint8_t* new_block = (uint8_t*)opj_realloc(t1->compressed_block, total_seg_len);
+            if (!new_block)
+                return false;
+            t1->compressed_block = new_block;
+            t1->compressed_block_size = total_seg_len;
+        }
+        size_t offset = 0;
+        for (uint32_t i = 0; i < cblk->numchunks; ++i) {
+            memcpy(t1->compressed_block + offset, cblk->chunks[i].data, cblk->chunks[i].len);
+            offset += cblk->chunks[i].len;
+        }
+        block_buffer = t1->compressed_block;
+    }
+
+    bpno_plus_one = (int32_t)(roishift + cblk->numbps);
+    passtype = 2;
+
+    opj_mqc_resetstates(mqc);
+    opj_mqc_setstate(mqc, T1_CTXNO_UNI, 0, 46);
+    opj_mqc_setstate(mqc, T1_CTXNO_AGG, 0, 3);
+    opj_mqc_setstate(mqc, T1_CTXNO_ZC, 0, 4);
+
+    for (segno = 0; segno < cblk->real_num_segs; ++segno) {
+        opj_tcd_seg_t *seg = &cblk->segs[segno];
+        if (!opj_mqc_init_dec(mqc, block_buffer + seg->dataindex, seg->len)) {
+            return false;
+        }
+        for (passno = 0; (passno < seg->real_num_passes) && (bpno_plus_one >= 1); ++passno) {
+            switch (passtype) {
+            case 0:
+                opj_t1_dec_sigpass_opt(t1, bpno_plus_one, orient, cblksty & J2K_CCP_CBLKSTY_VSC);
+                break;
+            case 1:
+                opj_t1_dec_refpass_opt(t1, bpno_plus_one, cblksty & J2K_CCP_CBLKSTY_VSC);
+                break;
+            case 2:
+                opj_t1_dec_clnpass_opt(t1, bpno_plus_one, orient, cblksty);
+                break;
+            }
+
+            if (cblksty & J2K_CCP_CBLKSTY_RESET) {
+                opj_mqc_resetstates(mqc);
+                opj_mqc_setstate(mqc, T1_CTXNO_UNI, 0, 46);
+                opj_mqc_setstate(mqc, T1_CTXNO_AGG, 0, 3);
+                opj_mqc_setstate(mqc, T1_CTXNO_ZC, 0, 4);
+            }
+            if (++passtype == 3) {
+                passtype = 0;
+                bpno_plus_one--;
+            }
+        }
+    }
+    return true;
+}
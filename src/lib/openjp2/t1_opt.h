@@ -65,7 +65,7 @@
 *
 *  These #defines declare the layout of a 32-bit flags word.
 *
-*  This is currently done for encoding only.
+*  Both the encoder and the decoder (apart from bypass mode) use this layout.
 */
 
 /* T1_SIGMA_XXX is significance flag for stripe column and neighbouring locations: 18 locations in total */
@@ -182,6 +182,9 @@ typedef struct opj_t1_opt {
 	uint32_t h;
 	uint32_t flags_stride;
 	bool   encoder;
+	/* contiguous copy of a code-block's segments (decoder only) */
+	uint8_t* compressed_block;
+	size_t compressed_block_size;
 } opj_t1_opt_t;
 
 /** @name Exported functions */
@@ -225,6 +228,22 @@ double opj_t1_opt_encode_cblk(opj_t1_opt_t *t1,
 	uint32_t max);
 
 
+/**
+Decode one code-block, with the stripe-based flag layout.
+Bypass (LAZY) code-blocks are not supported: use opj_t1_decode_cblk for those.
+On return, t1->data holds the decoded coefficients as w x h signed 32-bit integers.
+@param t1 T1 handle, with buffers allocated for the nominal code-block size
+@param cblk Code-block coding parameters
+@param orient
+@param roishift Region of interest shifting value
+@param cblksty Code-block style
+*/
+bool opj_t1_opt_decode_cblk(opj_t1_opt_t *t1,
+	opj_tcd_cblk_dec_t* cblk,
+	uint32_t orient,
+	uint32_t roishift,
+	uint32_t cblksty);
+
 
 /* ----------------------------------------------------------------------- */
 /*@}*/
@@ -56,6 +56,9 @@
  */
 
 #include "opj_includes.h"
+#include "Scheduler.h"
+#include <atomic>
+#include <map>
 
 /** @defgroup T2 T2 - Implementation of a tier-2 coding */
 /*@{*/
@@ -107,12 +110,64 @@ Encode a packet of a tile to a destination buffer
 @param cstr_info Codestream information structure
 @return
 */
+/**
+Measure one packet of a tile, without writing it
+@param tile         Tile for which to measure the packet
+@param tcp          Tile coding parameters
+@param compno       Component of the packet
+@param resno        Resolution of the packet
+@param precno       Precinct of the packet
+@param layno        Layer of the packet
+@param bio          Scratch bit writer
+@param p_data_written   incremented by the size of the packet
+@param len          bytes left for the packet
+*/
 static bool opj_t2_encode_packet_thresh(opj_tcd_tile_t *tile,
                                         opj_tcp_t *tcp,
-                                        opj_pi_iterator_t *pi,
+                                        uint32_t compno,
+                                        uint32_t resno,
+                                        uint32_t precno,
+                                        uint32_t layno,
+                                        opj_bio_t *bio,
                                         uint32_t * p_data_written,
                                         uint32_t len);
 
+static bool opj_t2_encode_packets_thresh_precincts(opj_t2_t* p_t2,
+        uint32_t p_tile_no,
+        opj_tcd_tile_t *p_tile,
+        uint32_t p_maxlayers,
+        uint32_t * p_data_written,
+        uint32_t p_max_len,
+        uint32_t p_num_threads);
+
+/**
+Decode the packets of a tile in parallel over its precincts, using the packet
+lengths from the PLT markers to locate each packet in the source buffer
+@return false, leaving the tile and the source buffer as they were, when the
+        packet lengths do not match the packets of the tile
+*/
+static bool opj_t2_decode_packets_plt(opj_t2_t *p_t2,
+                                      uint32_t p_tile_no,
+                                      opj_tcd_tile_t *p_tile,
+                                      opj_seg_buf_t* src_buf,
+                                      uint32_t * p_data_read,
+                                      uint32_t p_num_threads,
+                                      opj_event_mgr_t *p_manager);
+
+/**
+Check whether none of the precincts of a resolution intersect the region to decode
+*/
+static bool opj_t2_skip_precinct(opj_tcd_tilecomp_t* tilec, uint32_t resno);
+
+/**
+Check that the packet lengths read from PLT markers lay the packets out over the
+tile data from the current position: every packet lies within one tile-part, every
+tile-part ends on a packet boundary, and with SOP markers every packet starts with one.
+@param tcp      Tile coding parameters holding the packet lengths
+@param src_buf  Tile data, one segment per tile-part
+*/
+static bool opj_t2_check_plt_lengths(opj_tcp_t *tcp, opj_seg_buf_t* src_buf);
+
 
 
 /**
@@ -183,6 +238,14 @@ static bool opj_t2_init_seg(    opj_tcd_cblk_dec_t* cblk,
                                 uint32_t cblksty,
                                 uint32_t first);
 
+/**
+Append a run of source data to a code-block, extending the last run when the
+new one follows it directly
+*/
+static bool opj_t2_add_chunk(opj_tcd_cblk_dec_t* cblk,
+                             uint8_t *data,
+                             uint32_t len);
+
 /*@}*/
 
 /*@}*/
@@ -322,7 +385,8 @@ bool opj_t2_encode_packets_thresh(opj_t2_t* p_t2,
                                   uint32_t p_maxlayers,
                                   uint32_t * p_data_written,
                                   uint32_t p_max_len,
-                                  uint32_t p_tp_pos)
+                                  uint32_t p_tp_pos,
+                                  uint32_t p_num_threads)
 {
     uint32_t l_nb_bytes = 0;
     uint32_t compno;
@@ -335,9 +399,21 @@ bool opj_t2_encode_packets_thresh(opj_t2_t* p_t2,
     uint32_t pocno = (l_cp->rsiz == OPJ_PROFILE_CINEMA_4K) ? 2 : 1;
     uint32_t l_max_comp = l_cp->m_specific_param.m_enc.m_max_comp_size > 0 ? l_image->numcomps : 1;
     uint32_t l_nb_pocs = l_tcp->numpocs + 1;
+    opj_bio_t *l_bio = 00;
 
+    /* outside of cinema profiles, every packet of the tile is measured once, whatever the
+       progression order: precincts are then independent, and are measured in parallel */
+    if (!OPJ_IS_CINEMA(l_cp->rsiz) && !l_cp->m_specific_param.m_enc.m_max_comp_size) {
+        return opj_t2_encode_packets_thresh_precincts(p_t2, p_tile_no, p_tile, p_maxlayers, p_data_written, p_max_len, p_num_threads);
+    }
+
+    l_bio = opj_bio_create();
+    if (!l_bio) {
+        return false;
+    }
     l_pi = opj_pi_initialise_encode(l_image, l_cp, p_tile_no, THRESH_CALC);
     if (!l_pi) {
+        opj_bio_destroy(l_bio);
         return false;
     }
     *p_data_written = 0;
@@ -356,14 +432,17 @@ bool opj_t2_encode_packets_thresh(opj_t2_t* p_t2,
             if (l_current_pi->poc.prg == OPJ_PROG_UNKNOWN) {
                 /* TODO ADE : add an error */
                 opj_pi_destroy(l_pi, l_nb_pocs);
+                opj_bio_destroy(l_bio);
                 return false;
             }
             while (opj_pi_next(l_current_pi)) {
                 if (l_current_pi->layno < p_maxlayers) {
                     l_nb_bytes = 0;
 
-                    if (!opj_t2_encode_packet_thresh(p_tile, l_tcp, l_current_pi, &l_nb_bytes, p_max_len)) {
+                    if (!opj_t2_encode_packet_thresh(p_tile, l_tcp, l_current_pi->compno, l_current_pi->resno,
+                                                     l_current_pi->precno, l_current_pi->layno, l_bio, &l_nb_bytes, p_max_len)) {
                         opj_pi_destroy(l_pi, l_nb_pocs);
+                        opj_bio_destroy(l_bio);
                         return false;
                     }
 
@@ -377,6 +456,7 @@ bool opj_t2_encode_packets_thresh(opj_t2_t* p_t2,
             if (l_cp->m_specific_param.m_enc.m_max_comp_size) {
                 if (l_comp_len > l_cp->m_specific_param.m_enc.m_max_comp_size) {
                     opj_pi_destroy(l_pi, l_nb_pocs);
+                    opj_bio_destroy(l_bio);
                     return false;
                 }
             }
@@ -385,6 +465,104 @@ bool opj_t2_encode_packets_thresh(opj_t2_t* p_t2,
         }
     }
     opj_pi_destroy(l_pi, l_nb_pocs);
+    opj_bio_destroy(l_bio);
+    return true;
+}
+
+/*
+Packet sizes of one precinct, for the last number of layers and set of passes in
+the top layer it was measured with
+*/
+struct opj_t2_thresh_precinct {
+    opj_t2_thresh_precinct(uint32_t compno, uint32_t resno, uint32_t precno) :
+        compno(compno), resno(resno), precno(precno), maxlayers(0), bytes(0) {}
+    uint32_t compno, resno, precno;
+    uint32_t maxlayers;			/* 0 until measured */
+    uint64_t bytes;
+    std::vector<uint32_t> numpasses;
+};
+
+struct opj_t2_thresh_cache {
+    std::vector<opj_t2_thresh_precinct> precincts;
+};
+
+/*
+Measure the packets of each precinct for all of its layers in turn: the header of a
+packet only depends on the packets of the same precinct in lower layers
+*/
+static bool opj_t2_encode_packets_thresh_precincts(opj_t2_t* p_t2,
+        uint32_t p_tile_no,
+        opj_tcd_tile_t *p_tile,
+        uint32_t p_maxlayers,
+        uint32_t * p_data_written,
+        uint32_t p_max_len,
+        uint32_t p_num_threads)
+{
+    opj_tcp_t *l_tcp = p_t2->cp->tcps + p_tile_no;
+
+    if (!p_t2->thresh_cache) {
+        p_t2->thresh_cache = new opj_t2_thresh_cache();
+        for (uint32_t compno = 0; compno < p_tile->numcomps; ++compno) {
+            opj_tcd_tilecomp_t *tilec = p_tile->comps + compno;
+            for (uint32_t resno = 0; resno < tilec->numresolutions; ++resno) {
+                opj_tcd_resolution_t *res = tilec->resolutions + resno;
+                for (uint32_t precno = 0; precno < res->pw * res->ph; ++precno)
+                    p_t2->thresh_cache->precincts.emplace_back(compno, resno, precno);
+            }
+        }
+    }
+    std::vector<opj_t2_thresh_precinct>& l_precincts = p_t2->thresh_cache->precincts;
+    size_t l_num_tasks = opj_uint_max(1, opj_uint_min(p_num_threads, (uint32_t)l_precincts.size()));
+    std::atomic<size_t> l_next(0);
+    std::atomic<uint64_t> l_bytes(0);
+    std::atomic<bool> l_success(true);
+
+    Scheduler::instance()->run(l_num_tasks, [&](size_t) {
+        opj_bio_t *l_bio = opj_bio_create();
+        if (!l_bio) {
+            l_success = false;
+            return;
+        }
+        std::vector<uint32_t> l_numpasses;
+        uint64_t l_task_bytes = 0;
+        size_t i;
+        while (l_success && (i = l_next++) < l_precincts.size()) {
+            opj_t2_thresh_precinct& l_prc = l_precincts[i];
+            opj_tcd_resolution_t *res = p_tile->comps[l_prc.compno].resolutions + l_prc.resno;
+
+            l_numpasses.clear();
+            for (uint32_t bandno = 0; bandno < res->numbands; ++bandno) {
+                opj_tcd_precinct_t *prc = res->bands[bandno].precincts + l_prc.precno;
+                for (uint32_t cblkno = 0; cblkno < prc->cw * prc->ch; ++cblkno)
+                    l_numpasses.push_back(prc->cblks.enc[cblkno].layers[p_maxlayers - 1].numpasses);
+            }
+            if (l_prc.maxlayers != p_maxlayers || l_prc.numpasses != l_numpasses) {
+                uint32_t l_nb_bytes = 0;
+                for (uint32_t layno = 0; layno < p_maxlayers; ++layno) {
+                    if (!opj_t2_encode_packet_thresh(p_tile, l_tcp, l_prc.compno, l_prc.resno, l_prc.precno,
+                                                     layno, l_bio, &l_nb_bytes, UINT_MAX - l_nb_bytes)) {
+                        l_success = false;
+                        break;
+                    }
+                }
+                l_prc.maxlayers = p_maxlayers;
+                l_prc.bytes = l_nb_bytes;
+                l_prc.numpasses.swap(l_numpasses);
+            }
+            l_task_bytes += l_prc.bytes;
+        }
+        l_bytes += l_task_bytes;
+        opj_bio_destroy(l_bio);
+    });
+
+    if (!l_success) {
+        for (auto& l_prc : l_precincts)
+            l_prc.maxlayers = 0;
+        return false;
+    }
+    if (l_bytes > p_max_len)
+        return false;
+    *p_data_written = (uint32_t)l_bytes;
     return true;
 }
 
@@ -401,11 +579,214 @@ static void opj_null_jas_fprintf(FILE* file, const char * format, ...)
 #define JAS_FPRINTF opj_null_jas_fprintf
 #endif
 
+static bool opj_t2_check_plt_lengths(opj_tcp_t *tcp, opj_seg_buf_t* src_buf)
+{
+    if (src_buf->segments.empty())
+        return false;
+    size_t l_seg_id = src_buf->cur_seg_id;
+    size_t l_seg_offset = (size_t)src_buf->segments[l_seg_id]->offset;
+    for (uint32_t i = 0; i < tcp->m_nb_packet_lengths; ++i) {
+        uint32_t l_len = tcp->m_packet_lengths[i];
+        opj_buf_t *l_seg = src_buf->segments[l_seg_id];
+        while (l_seg_offset == l_seg->len && l_seg_id + 1 < src_buf->segments.size()) {
+            l_seg = src_buf->segments[++l_seg_id];
+            l_seg_offset = 0;
+        }
+        if (!l_len || l_len > l_seg->len - l_seg_offset)
+            return false;
+        if ((tcp->csty & J2K_CP_CSTY_SOP) &&
+                (l_len < 6 || l_seg->buf[l_seg_offset] != 0xff || l_seg->buf[l_seg_offset + 1] != 0x91))
+            return false;
+        l_seg_offset += l_len;
+    }
+    /* nothing may be left over */
+    if (l_seg_offset != src_buf->segments[l_seg_id]->len)
+        return false;
+    while (++l_seg_id < src_buf->segments.size()) {
+        if (src_buf->segments[l_seg_id]->len)
+            return false;
+    }
+    return true;
+}
+
+static bool opj_t2_skip_precinct(opj_tcd_tilecomp_t* tilec, uint32_t resno)
+{
+    opj_tcd_resolution_t* res = tilec->resolutions + resno;
+    for (uint32_t bandno = 0; bandno < res->numbands; ++bandno) {
+        opj_tcd_band_t* band = res->bands + bandno;
+        uint32_t num_precincts =
+            band->precincts_data_size / sizeof(opj_tcd_precinct_t);
+        for (uint32_t precno = 0; precno < num_precincts; ++precno) {
+            opj_rect_t prec_rect;
+            opj_tcd_precinct_t* prec = band->precincts + precno;
+            opj_rect_init(&prec_rect,prec->x0, prec->y0, prec->x1, prec->y1);
+            if (opj_tile_buf_hit_test(tilec->buf,&prec_rect))
+                return false;
+        }
+    }
+    return true;
+}
+
+/* packet located in the source buffer from its PLT length */
+struct opj_t2_plt_packet {
+    uint32_t compno, resno, precno, layno;
+    uint8_t *data;
+    uint32_t len;
+};
+
+static bool opj_t2_decode_packets_plt(opj_t2_t *p_t2,
+                                      uint32_t p_tile_no,
+                                      opj_tcd_tile_t *p_tile,
+                                      opj_seg_buf_t* src_buf,
+                                      uint32_t * p_data_read,
+                                      uint32_t p_num_threads,
+                                      opj_event_mgr_t *p_manager)
+{
+    opj_image_t *l_image = p_t2->image;
+    opj_tcp_t *l_tcp = p_t2->cp->tcps + p_tile_no;
+    uint32_t l_nb_pocs = l_tcp->numpocs + 1;
+    std::vector<opj_t2_plt_packet> l_packets;
+    std::vector<uint32_t> l_resno_decoded(l_image->numcomps);
+    std::map<uint64_t, std::vector<size_t> > l_precincts;
+
+    /* walk the progression once to identify every packet, without reading the stream */
+    opj_pi_iterator_t *l_pi = opj_pi_create_decode(l_image, p_t2->cp, p_tile_no);
+    if (!l_pi)
+        return false;
+    for (uint32_t compno = 0; compno < l_image->numcomps; ++compno)
+        l_resno_decoded[compno] = l_image->comps[compno].resno_decoded;
+    for (uint32_t pino = 0; pino < l_nb_pocs; ++pino) {
+        opj_pi_iterator_t *l_current_pi = l_pi + pino;
+        std::vector<bool> first_pass_failed(l_image->numcomps, true);
+
+        if (l_current_pi->poc.prg == OPJ_PROG_UNKNOWN) {
+            opj_pi_destroy(l_pi, l_nb_pocs);
+            return false;
+        }
+        while (opj_pi_next(l_current_pi)) {
+            opj_tcd_tilecomp_t* tilec = p_tile->comps + l_current_pi->compno;
+            bool skip_layer_or_res = l_current_pi->layno >= l_tcp->num_layers_to_decode ||
+                                     l_current_pi->resno >= tilec->minimum_num_resolutions;
+            opj_t2_plt_packet l_packet;
+
+            if (l_packets.size() == l_tcp->m_nb_packet_lengths) {
+                opj_pi_destroy(l_pi, l_nb_pocs);
+                return false;
+            }
+            l_packet.compno = l_current_pi->compno;
+            l_packet.resno = l_current_pi->resno;
+            l_packet.precno = l_current_pi->precno;
+            l_packet.layno = l_current_pi->layno;
+            l_packet.data = NULL;
+            l_packet.len = l_tcp->m_packet_lengths[l_packets.size()];
+            if (!skip_layer_or_res && !opj_t2_skip_precinct(tilec, l_current_pi->resno)) {
+                uint64_t l_key = ((uint64_t)l_packet.compno << 48) | ((uint64_t)l_packet.resno << 32) | l_packet.precno;
+                l_precincts[l_key].push_back(l_packets.size());
+                first_pass_failed[l_packet.compno] = false;
+            }
+            l_packets.push_back(l_packet);
+
+            if (!skip_layer_or_res)
+                l_resno_decoded[l_packet.compno] = opj_uint_max(l_packet.resno, l_resno_decoded[l_packet.compno]);
+            if (first_pass_failed[l_packet.compno] && l_resno_decoded[l_packet.compno] == 0)
+                l_resno_decoded[l_packet.compno] = tilec->minimum_num_resolutions - 1;
+        }
+    }
+    opj_pi_destroy(l_pi, l_nb_pocs);
+    if (l_packets.size() != l_tcp->m_nb_packet_lengths)
+        return false;
+
+    /* a packet never straddles two tile-parts */
+    if (src_buf->segments.empty())
+        return false;
+    size_t l_seg_id = src_buf->cur_seg_id;
+    size_t l_seg_offset = (size_t)src_buf->segments[l_seg_id]->offset;
+    for (auto& l_packet : l_packets) {
+        opj_buf_t *l_seg = src_buf->segments[l_seg_id];
+        if (l_packet.len > l_seg->len - l_seg_offset)
+            return false;
+        l_packet.data = l_seg->buf + l_seg_offset;
+        l_seg_offset += l_packet.len;
+        if (l_seg_offset == l_seg->len && l_seg_id < src_buf->segments.size() - 1)
+            l_seg_offset = (size_t)src_buf->segments[++l_seg_id]->offset;
+    }
+
+    /* the packets of a precinct only depend on each other, so each worker decodes
+       whole precincts, one layer after the other */
+    std::vector<std::vector<size_t>*> l_tasks;
+    for (auto& l_prc : l_precincts)
+        l_tasks.push_back(&l_prc.second);
+    size_t l_num_tasks = opj_uint_max(1, opj_uint_min(p_num_threads, (uint32_t)l_tasks.size()));
+    std::atomic<size_t> l_next(0);
+    std::atomic<bool> l_success(true);
+
+    Scheduler::instance()->run(l_num_tasks, [&](size_t) {
+        opj_pi_iterator_t l_pi_packet;
+        memset(&l_pi_packet, 0, sizeof(l_pi_packet));
+        size_t i;
+        while (l_success && (i = l_next++) < l_tasks.size()) {
+            for (size_t l_packno : *l_tasks[i]) {
+                opj_t2_plt_packet& l_packet = l_packets[l_packno];
+                opj_seg_buf_t l_packet_buf;
+                uint32_t l_nb_bytes_read = 0;
+
+                l_pi_packet.compno = l_packet.compno;
+                l_pi_packet.resno = l_packet.resno;
+                l_pi_packet.precno = l_packet.precno;
+                l_pi_packet.layno = l_packet.layno;
+                if (!opj_seg_buf_push_back(&l_packet_buf, l_packet.data, l_packet.len) ||
+                        !opj_t2_decode_packet(p_t2, p_tile, l_tcp, &l_pi_packet, &l_packet_buf,
+                                              &l_nb_bytes_read, NULL, p_manager)) {
+                    l_success = false;
+                    break;
+                }
+                if (l_nb_bytes_read != l_packet.len) {
+                    l_success = false;
+                    break;
+                }
+            }
+        }
+    });
+
+    if (!l_success) {
+        /* start the tile over: the first packet of each precinct resets its tag trees,
+           and code-blocks without segments are read from scratch */
+        opj_event_msg(p_manager, EVT_WARNING, "Packet lengths from PLT markers do not match the packets of tile %d\n", p_tile_no);
+        for (auto& l_prc : l_precincts) {
+            opj_t2_plt_packet& l_packet = l_packets[l_prc.second.front()];
+            opj_tcd_resolution_t* l_res = &p_tile->comps[l_packet.compno].resolutions[l_packet.resno];
+            for (uint32_t bandno = 0; bandno < l_res->numbands; ++bandno) {
+                opj_tcd_band_t *l_band = l_res->bands + bandno;
+                if (l_packet.precno >= l_band->precincts_data_size / sizeof(opj_tcd_precinct_t))
+                    continue;
+                opj_tcd_precinct_t *l_prc_data = l_band->precincts + l_packet.precno;
+                for (uint32_t cblkno = 0; cblkno < l_prc_data->cw * l_prc_data->ch; ++cblkno) {
+                    opj_tcd_cblk_dec_t* l_cblk = l_prc_data->cblks.dec + cblkno;
+                    l_cblk->numchunks = 0;
+                    l_cblk->numsegs = 0;
+                    l_cblk->real_num_segs = 0;
+                    l_cblk->data_current_size = 0;
+                }
+            }
+        }
+        return false;
+    }
+
+    for (uint32_t compno = 0; compno < l_image->numcomps; ++compno)
+        l_image->comps[compno].resno_decoded = l_resno_decoded[compno];
+    for (auto& l_packet : l_packets) {
+        opj_seg_buf_incr_cur_seg_offset(src_buf, l_packet.len);
+        *p_data_read += l_packet.len;
+    }
+    return true;
+}
+
 bool opj_t2_decode_packets( opj_t2_t *p_t2,
                             uint32_t p_tile_no,
                             opj_tcd_tile_t *p_tile,
                             opj_seg_buf_t* src_buf,
                             uint32_t * p_data_read,
+                            uint32_t p_num_threads,
                             opj_event_mgr_t *p_manager)
 {
     opj_pi_iterator_t *l_pi = 00;
@@ -422,6 +803,8 @@ bool opj_t2_decode_packets( opj_t2_t *p_t2,
 #endif
     opj_packet_info_t *l_pack_info = 00;
     opj_image_comp_t* l_img_comp = 00;
+    uint32_t l_packno = 0;
+    bool l_use_plt = false;
 
     /* create a packet iterator */
     l_pi = opj_pi_create_decode(l_image, l_cp, p_tile_no);
@@ -429,6 +812,17 @@ bool opj_t2_decode_packets( opj_t2_t *p_t2,
         return false;
     }
 
+    /* packet lengths from PLT markers let skipped packets be stepped over
+       without parsing their headers, as long as they lay out the whole tile */
+    if (l_tcp->m_nb_packet_lengths && !l_cp->ppm && !l_tcp->ppt)
+        l_use_plt = opj_t2_check_plt_lengths(l_tcp, src_buf);
+
+    if (l_use_plt && p_num_threads > 1 &&
+            opj_t2_decode_packets_plt(p_t2, p_tile_no, p_tile, src_buf, p_data_read, p_num_threads, p_manager)) {
+        opj_pi_destroy(l_pi, l_nb_pocs);
+        return true;
+    }
+
 
     l_current_pi = l_pi;
 
@@ -472,26 +866,8 @@ bool opj_t2_decode_packets( opj_t2_t *p_t2,
 
 
 
-            if (!skip_layer_or_res) {
-                opj_tcd_resolution_t* res = tilec->resolutions + l_current_pi->resno;
-                uint32_t bandno;
-                skip_precinct = true;
-                for (bandno = 0; bandno < res->numbands && skip_precinct; ++bandno) {
-                    opj_tcd_band_t* band = res->bands + bandno;
-                    uint32_t num_precincts =
-                        band->precincts_data_size / sizeof(opj_tcd_precinct_t);
-                    uint32_t precno;
-                    for (precno = 0; precno < num_precincts && skip_precinct; ++precno) {
-                        opj_rect_t prec_rect;
-                        opj_tcd_precinct_t* prec = band->precincts + precno;
-                        opj_rect_init(&prec_rect,prec->x0, prec->y0, prec->x1, prec->y1);
-                        if (opj_tile_buf_hit_test(tilec->buf,&prec_rect)) {
-                            skip_precinct = false;
-                            break;
-                        }
-                    }
-                }
-            }
+            if (!skip_layer_or_res)
+                skip_precinct = opj_t2_skip_precinct(tilec, l_current_pi->resno);
 
             if (!skip_layer_or_res && !skip_precinct) {
                 l_nb_bytes_read = 0;
@@ -510,7 +886,19 @@ bool opj_t2_decode_packets( opj_t2_t *p_t2,
                     opj_free(first_pass_failed);
                     return false;
                 }
+                if (l_use_plt &&
+                        (l_packno >= l_tcp->m_nb_packet_lengths || l_nb_bytes_read != l_tcp->m_packet_lengths[l_packno]))
+                    l_use_plt = false;
+            } else if (l_use_plt &&
+                       l_packno < l_tcp->m_nb_packet_lengths &&
+                       l_tcp->m_packet_lengths[l_packno] <= opj_seg_buf_get_cur_seg_len(src_buf)) {
+                /* the tag trees of a skipped precinct are never needed again,
+                   so its packet can be skipped blindly */
+                l_nb_bytes_read = l_tcp->m_packet_lengths[l_packno];
+                opj_seg_buf_incr_cur_seg_offset(src_buf, l_nb_bytes_read);
             } else {
+                /* packet lengths no longer line up with the stream */
+                l_use_plt = false;
                 l_nb_bytes_read = 0;
                 if (! opj_t2_skip_packet(p_t2,
                                          p_tile,
@@ -534,6 +922,7 @@ bool opj_t2_decode_packets( opj_t2_t *p_t2,
             }
 
             *p_data_read += l_nb_bytes_read;
+            ++l_packno;
         }
         ++l_current_pi;
 
@@ -571,6 +960,7 @@ opj_t2_t* opj_t2_create(opj_image_t *p_image, opj_cp_t *p_cp)
 void opj_t2_destroy(opj_t2_t *t2)
 {
     if(t2) {
+        delete t2->thresh_cache;
         opj_free(t2);
     }
 }
@@ -855,16 +1245,16 @@ static bool opj_t2_encode_packet(  uint32_t tileno,
 
 static bool opj_t2_encode_packet_thresh(opj_tcd_tile_t * tile,
                                         opj_tcp_t * tcp,
-                                        opj_pi_iterator_t *pi,
+                                        uint32_t compno,
+                                        uint32_t resno,
+                                        uint32_t precno,
+                                        uint32_t layno,
+                                        opj_bio_t *bio,
                                         uint32_t * p_data_written,
                                         uint32_t length)
 {
     uint32_t bandno, cblkno;
     uint32_t l_nb_bytes;
-    uint32_t compno = pi->compno;     /* component value */
-    uint32_t resno = pi->resno;      /* resolution level value */
-    uint32_t precno = pi->precno;     /* precinct value */
-    uint32_t layno = pi->layno;      /* quality layer value */
     uint32_t l_nb_blocks;
     opj_tcd_band_t *band = 00;
     opj_tcd_cblk_enc_t* cblk = 00;
@@ -873,11 +1263,13 @@ static bool opj_t2_encode_packet_thresh(opj_tcd_tile_t * tile,
     opj_tcd_tilecomp_t *tilec = tile->comps + compno;
     opj_tcd_resolution_t *res = tilec->resolutions + resno;
 
-    opj_bio_t *bio = 00;    /* BIO component */
     uint32_t packet_bytes_written = 0;
 
     /* <SOP 0xff91> */
     if (tcp->csty & J2K_CP_CSTY_SOP) {
+        if (length < 6) {
+            return false;
+        }
         length -= 6;
         packet_bytes_written += 6;
     }
@@ -903,11 +1295,6 @@ static bool opj_t2_encode_packet_thresh(opj_tcd_tile_t * tile,
         }
     }
 
-    bio = opj_bio_create();
-    if (!bio) {
-        /* FIXME event manager error callback */
-        return false;
-    }
     opj_bio_init_enc(bio, 0, length);
     opj_bio_write(bio, 1, 1);           /* Empty header bit */
     bio->sim_out = true;
@@ -1002,18 +1389,21 @@ static bool opj_t2_encode_packet_thresh(opj_tcd_tile_t * tile,
     }
 
     if (!opj_bio_flush(bio)) {
-        opj_bio_destroy(bio);
         return false;
     }
 
     l_nb_bytes = (uint32_t)opj_bio_numbytes(bio);
+    if (l_nb_bytes > length) {
+        return false;
+    }
     packet_bytes_written += l_nb_bytes;
     length -= l_nb_bytes;
 
-    opj_bio_destroy(bio);
-
     /* <EPH 0xff92> */
     if (tcp->csty & J2K_CP_CSTY_EPH) {
+        if (length < 2) {
+            return false;
+        }
         length -= 2;
         packet_bytes_written += 2;
     }
@@ -1407,6 +1797,7 @@ static bool opj_t2_read_packet_data(   opj_t2_t* p_t2,
                 l_seg = l_cblk->segs;
                 ++l_cblk->numsegs;
                 l_cblk->data_current_size = 0;
+                l_cblk->numchunks = 0;
             } else {
                 l_seg = &l_cblk->segs[l_cblk->numsegs - 1];
 
@@ -1436,9 +1827,10 @@ static bool opj_t2_read_packet_data(   opj_t2_t* p_t2,
                     l_seg->dataindex = l_cblk->data_current_size;
                 }
 
-                opj_min_buf_vec_push_back(&l_cblk->seg_buffers, opj_seg_buf_get_global_ptr(src_buf), (uint16_t)l_seg->newlen);
-
-
+                if (l_seg->newlen && !opj_t2_add_chunk(l_cblk, opj_seg_buf_get_global_ptr(src_buf), l_seg->newlen)) {
+                    opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to read code-block data\n");
+                    return false;
+                }
 
                 *(p_data_read) += l_seg->newlen;
                 opj_seg_buf_incr_cur_seg_offset(src_buf, l_seg->newlen);
@@ -1586,3 +1978,28 @@ static bool opj_t2_init_seg(   opj_tcd_cblk_dec_t* cblk,
 
     return true;
 }
+
+static bool opj_t2_add_chunk(opj_tcd_cblk_dec_t* cblk,
+                             uint8_t *data,
+                             uint32_t len)
+{
+    if (cblk->numchunks) {
+        opj_tcd_seg_data_chunk_t* last = cblk->chunks + cblk->numchunks - 1;
+        if (last->data + last->len == data) {
+            last->len += len;
+            return true;
+        }
+    }
+    if (cblk->numchunks == cblk->numchunksalloc) {
+        uint32_t l_numchunksalloc = cblk->numchunksalloc ? cblk->numchunksalloc * 2 : OPJ_J2K_DEFAULT_NB_SEGS;
+        opj_tcd_seg_data_chunk_t* new_chunks = (opj_tcd_seg_data_chunk_t*) opj_realloc(cblk->chunks, l_numchunksalloc * sizeof(opj_tcd_seg_data_chunk_t));
+        if (!new_chunks)
+            return false;
+        cblk->chunks = new_chunks;
+        cblk->numchunksalloc = l_numchunksalloc;
+    }
+    cblk->chunks[cblk->numchunks].data = data;
+    cblk->chunks[cblk->numchunks].len = len;
+    ++cblk->numchunks;
+    return true;
+}
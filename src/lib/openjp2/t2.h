@@ -65,6 +65,8 @@
 /** @defgroup T2 T2 - Implementation of a tier-2 coding */
 /*@{*/
 
+struct opj_t2_thresh_cache;
+
 /**
 Tier-2 coding
 */
@@ -74,6 +76,8 @@ typedef struct opj_t2 {
     opj_image_t *image;
     /** pointer to the image coding parameters */
     opj_cp_t *cp;
+    /** Encoding: packet sizes of each precinct from the last opj_t2_encode_packets_thresh call */
+    opj_t2_thresh_cache *thresh_cache;
 } opj_t2_t;
 
 /** @name Exported functions */
@@ -107,7 +111,12 @@ bool opj_t2_encode_packets(	opj_t2_t* t2,
                             uint32_t pino);
 
 /**
-Encode the packets of a tile to a destination buffer
+Measure the packets of a tile, without writing them.
+
+Precincts are measured in parallel, and the size of each is kept in the T2 handle:
+it is measured again only once the passes of its code-blocks in layer maxlayers - 1
+change. Between calls on the same handle, lower layers must not change.
+
 @param t2               T2 handle
 @param tileno           number of the tile encoded
 @param tile             the tile for which to write the packets
@@ -115,6 +124,7 @@ Encode the packets of a tile to a destination buffer
 @param p_data_written   FIXME DOC
 @param len              the length of the destination buffer
 @param tppos            The position of the tile part flag in the progression order
+@param numThreads       number of tasks measuring precincts
 */
 bool opj_t2_encode_packets_thresh(opj_t2_t* t2,
                                   uint32_t tileno,
@@ -122,7 +132,8 @@ bool opj_t2_encode_packets_thresh(opj_t2_t* t2,
                                   uint32_t maxlayers,
                                   uint32_t * p_data_written,
                                   uint32_t len,
-                                  uint32_t tppos);
+                                  uint32_t tppos,
+                                  uint32_t numThreads);
 
 
 /**
@@ -134,6 +145,7 @@ Decode the packets of a tile from a source buffer
 @param p_data_read the source buffer
 @param len length of the source buffer
 @param cstr_info   FIXME DOC
+@param p_num_threads number of threads decoding precincts when PLT markers give the packet lengths
 
 @return FIXME DOC
  */
@@ -142,6 +154,7 @@ bool opj_t2_decode_packets(	opj_t2_t *t2,
                             opj_tcd_tile_t *tile,
                             opj_seg_buf_t* src_buf,
                             uint32_t * p_data_read,
+                            uint32_t p_num_threads,
                             opj_event_mgr_t *p_manager);
 
 /**
@@ -56,11 +56,16 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "cpu_features.h"
+#ifdef OPJ_HAVE_TARGET_KERNELS
+#include <immintrin.h>
+#endif
+
 #include "opj_includes.h"
 #include "T1Decoder.h"
-#ifdef _OPENMP
-#include <omp.h>
-#endif
+#include "Scheduler.h"
+#include <atomic>
+#include <algorithm>
 
 
 /* ----------------------------------------------------------------------- */
@@ -150,9 +155,9 @@ static bool opj_tcd_code_block_dec_allocate (opj_tcd_cblk_dec_t * p_code_block);
 static void opj_tcd_code_block_dec_deallocate (opj_tcd_precinct_t * p_precinct);
 
 /**
- * Allocates memory for an encoding code block (but not data).
+ * Allocates memory for an encoding code block (but not data), from the arena.
  */
-static bool opj_tcd_code_block_enc_allocate (opj_tcd_cblk_enc_t * p_code_block);
+static bool opj_tcd_code_block_enc_allocate (opj_tcd_cblk_enc_t * p_code_block, opj_arena_t * p_arena);
 
 /**
  * Allocates data for an encoding code block
@@ -184,13 +189,40 @@ static bool opj_tcd_dwt_decode (opj_tcd_t *p_tcd);
 
 static bool opj_tcd_mct_decode (opj_tcd_t *p_tcd, opj_event_mgr_t *p_manager);
 
-static bool opj_tcd_dc_level_shift_decode (opj_tcd_t *p_tcd);
+static bool opj_tcd_dc_level_shift_decode (opj_tcd_t *p_tcd, uint32_t p_first_comp);
 
+/**
+ * Applies the inverse MCT, DC level shift and clamp to the first three components in a single pass.
+ * Returns false, without touching the tile, if the tile cannot take the fused path.
+ */
+static bool opj_tcd_mct_dc_level_shift_decode (opj_tcd_t *p_tcd);
 
-static bool opj_tcd_dc_level_shift_encode ( opj_tcd_t *p_tcd );
+
+/**
+ * DC level shifts the tile region of p_src into the tile buffers, and applies the
+ * forward MCT row by row. p_src may be the tile buffers themselves.
+ *
+ * @param	p_src		first sample of the tile region of each component
+ * @param	p_src_stride	row stride of each component of p_src
+ * @param	p_truncate	wrap each source sample to the bytes its precision is stored in
+ */
+static bool opj_tcd_dc_level_shift_mct_encode ( opj_tcd_t *p_tcd,
+        int32_t* const* p_src,
+        const size_t* p_src_stride,
+        bool p_truncate);
 
 static bool opj_tcd_mct_encode ( opj_tcd_t *p_tcd );
 
+/**
+ * Applies a custom (matrix) MCT to p_samples samples of every component,
+ * in chunks across the scheduler.
+ */
+static bool opj_tcd_mct_custom(opj_tcd_t *p_tcd,
+                               bool (*p_transform)(uint8_t*, uint32_t, uint8_t**, uint32_t, uint32_t),
+                               uint8_t* p_matrix,
+                               uint32_t p_samples,
+                               uint8_t** p_data);
+
 static bool opj_tcd_dwt_encode ( opj_tcd_t *p_tcd );
 
 static bool opj_tcd_t1_encode ( opj_tcd_t *p_tcd );
@@ -205,8 +237,30 @@ static bool opj_tcd_rate_allocate_encode(   opj_tcd_t *p_tcd,
         uint32_t p_max_dest_size,
         opj_codestream_info_t *p_cstr_info );
 
+/**
+Runs p_fn(index) for every index in [0, p_count) on at most p_tcd->numThreads tasks,
+or inline when the tile coder is single threaded.
+*/
+static void opj_tcd_run(opj_tcd_t *p_tcd, uint32_t p_count, const std::function<void(uint32_t)>& p_fn);
+
 /* ----------------------------------------------------------------------- */
 
+static void opj_tcd_run(opj_tcd_t *p_tcd, uint32_t p_count, const std::function<void(uint32_t)>& p_fn)
+{
+	uint32_t l_num_tasks = opj_uint_min(p_tcd->numThreads, p_count);
+	if (l_num_tasks <= 1) {
+		for (uint32_t i = 0; i < p_count; ++i)
+			p_fn(i);
+		return;
+	}
+	std::atomic<uint32_t> l_next(0);
+	Scheduler::instance()->run(l_num_tasks, [&](size_t) {
+		uint32_t i;
+		while ((i = l_next++) < p_count)
+			p_fn(i);
+	});
+}
+
 /**
 Create a new TCD handle
 */
@@ -221,6 +275,7 @@ opj_tcd_t* opj_tcd_create(bool p_is_decoder)
     }
 
     l_tcd->m_is_decoder = p_is_decoder ? 1 : 0;
+    l_tcd->arena = new opj_arena_t();
 
     return l_tcd;
 }
@@ -238,88 +293,140 @@ void opj_tcd_rateallocate_fixed(opj_tcd_t *tcd)
 }
 
 
-void opj_tcd_makelayer( opj_tcd_t *tcd,
-                        uint32_t layno,
-                        double thresh,
-                        uint32_t final)
+/*
+A feasible truncation point of a code-block: a vertex of the convex hull of its
+rate-distortion curve, reached from the previous vertex at the given slope
+*/
+typedef struct opj_tcd_pcrd_point {
+    double slope;				/* distortion decrease per byte from the previous vertex */
+    double disto;				/* distortion decrease from the previous vertex */
+    opj_tcd_cblk_enc_t* cblk;
+    uint32_t cblkno;			/* index of the code-block in the tile */
+    uint32_t numpasses;			/* number of passes up to this truncation point */
+} opj_tcd_pcrd_point_t;
+
+static inline uint32_t opj_tcd_pass_rate(const opj_tcd_cblk_enc_t* cblk, uint32_t numpasses)
 {
-    uint32_t compno, resno, bandno, precno, cblkno;
-    uint32_t passno;
-
-    opj_tcd_tile_t *tcd_tile = tcd->tile;
-
-    tcd_tile->distolayer[layno] = 0;        /* fixed_quality */
-
-    for (compno = 0; compno < tcd_tile->numcomps; compno++) {
-        opj_tcd_tilecomp_t *tilec = tcd_tile->comps+compno;
-
-        for (resno = 0; resno < tilec->numresolutions; resno++) {
-            opj_tcd_resolution_t *res = tilec->resolutions+resno;
-
-            for (bandno = 0; bandno < res->numbands; bandno++) {
-                opj_tcd_band_t *band = res->bands+bandno;
-
-                for (precno = 0; precno < res->pw * res->ph; precno++) {
-                    opj_tcd_precinct_t *prc = band->precincts+precno;
-
-                    for (cblkno = 0; cblkno < prc->cw * prc->ch; cblkno++) {
-                        opj_tcd_cblk_enc_t *cblk = prc->cblks.enc+cblkno;
-                        opj_tcd_layer_t *layer = cblk->layers+layno;
-                        uint32_t n;
-
-                        if (layno == 0) {
-                            cblk->numpassesinlayers = 0;
-                        }
+    return numpasses ? cblk->passes[numpasses - 1].rate : 0;
+}
 
-                        n = cblk->numpassesinlayers;
+static inline double opj_tcd_pass_disto(const opj_tcd_cblk_enc_t* cblk, uint32_t numpasses)
+{
+    return numpasses ? cblk->passes[numpasses - 1].distortiondec : 0;
+}
 
-                        for (passno = cblk->numpassesinlayers; passno < cblk->totalpasses; passno++) {
-                            uint32_t dr;
-                            double dd;
-                            opj_tcd_pass_t *pass = &cblk->passes[passno];
+/*
+Append the convex hull of the rate-distortion curve of a code-block: slopes of
+successive vertices strictly decrease, so that truncating at any slope threshold
+keeps a prefix of the vertices
+*/
+static void opj_tcd_pcrd_hull(opj_tcd_cblk_enc_t* cblk,
+                              uint32_t cblkno,
+                              std::vector<opj_tcd_pcrd_point_t>& points)
+{
+    size_t first = points.size();
+    for (uint32_t numpasses = 1; numpasses <= cblk->totalpasses; ++numpasses) {
+        double slope;
+        for (;;) {
+            uint32_t prev = points.size() > first ? points.back().numpasses : 0;
+            double dd = opj_tcd_pass_disto(cblk, numpasses) - opj_tcd_pass_disto(cblk, prev);
+            if (dd <= 0) {
+                slope = -1;
+                break;
+            }
+            int64_t dr = (int64_t)opj_tcd_pass_rate(cblk, numpasses) - opj_tcd_pass_rate(cblk, prev);
+            slope = dr > 0 ? dd / (double)dr : DBL_MAX;
+            if (points.size() == first || slope < points.back().slope)
+                break;
+            points.pop_back();
+        }
+        if (slope < 0)
+            continue;
+        uint32_t prev = points.size() > first ? points.back().numpasses : 0;
+        points.push_back({ slope,
+                           opj_tcd_pass_disto(cblk, numpasses) - opj_tcd_pass_disto(cblk, prev),
+                           cblk,
+                           cblkno,
+                           numpasses });
+    }
+}
 
-                            if (n == 0) {
-                                dr = pass->rate;
-                                dd = pass->distortiondec;
-                            } else {
-                                dr = pass->rate - cblk->passes[n - 1].rate;
-                                dd = pass->distortiondec - cblk->passes[n - 1].distortiondec;
-                            }
+/*
+Estimate of the packet header bits that signal a code-block contribution
+*/
+static uint32_t opj_tcd_pcrd_header_bits(const opj_tcd_cblk_enc_t* cblk, uint32_t numpasses, uint32_t len)
+{
+    /* inclusion, plus tag tree and zero bit-plane bits the first time round */
+    uint32_t bits = cblk->numpassesinlayers ? 1 : 4;
+    if (numpasses == 1)
+        bits += 1;
+    else if (numpasses == 2)
+        bits += 2;
+    else if (numpasses <= 5)
+        bits += 4;
+    else if (numpasses <= 36)
+        bits += 9;
+    else
+        bits += 16;
+    /* segment length, and the length indicator increment */
+    return bits + (uint32_t)opj_int_floorlog2((int32_t)opj_uint_max(len, 1)) + 2;
+}
 
-                            if (!dr) {
-                                if (dd != 0)
-                                    n = passno + 1;
-                                continue;
-                            }
-                            if (thresh - (dd / dr) < DBL_EPSILON) /* do not rely on float equality, check with DBL_EPSILON margin */
-                                n = passno + 1;
-                        }
+/*
+Truncate each code-block at the last of its points in [first, last) for layer layno
+*/
+static void opj_tcd_pcrd_select(const std::vector<opj_tcd_cblk_enc_t*>& cblks,
+                                uint32_t layno,
+                                const opj_tcd_pcrd_point_t* first,
+                                const opj_tcd_pcrd_point_t* last)
+{
+    for (auto cblk : cblks)
+        cblk->layers[layno].numpasses = 0;
+    for (auto point = first; point != last; ++point) {
+        opj_tcd_cblk_enc_t* cblk = point->cblk;
+        if (point->numpasses > cblk->numpassesinlayers)
+            cblk->layers[layno].numpasses = point->numpasses - cblk->numpassesinlayers;
+    }
+}
 
-                        layer->numpasses = n - cblk->numpassesinlayers;
+/*
+Give layer layno every pass not yet included in a previous layer
+*/
+static void opj_tcd_pcrd_select_all(const std::vector<opj_tcd_cblk_enc_t*>& cblks,
+                                    uint32_t layno)
+{
+    for (auto cblk : cblks)
+        cblk->layers[layno].numpasses = cblk->totalpasses - cblk->numpassesinlayers;
+}
 
-                        if (!layer->numpasses) {
-                            layer->disto = 0;
-                            continue;
-                        }
+/*
+Fill in layer layno of every code-block from its selected number of passes
+*/
+static void opj_tcd_pcrd_makelayer(opj_tcd_tile_t* tcd_tile,
+                                   const std::vector<opj_tcd_cblk_enc_t*>& cblks,
+                                   uint32_t layno,
+                                   bool final)
+{
+    tcd_tile->distolayer[layno] = 0;        /* fixed_quality */
+    for (auto cblk : cblks) {
+        opj_tcd_layer_t *layer = cblk->layers + layno;
+        uint32_t n0 = cblk->numpassesinlayers;
+        uint32_t n = n0 + layer->numpasses;
+
+        if (!layer->numpasses) {
+            layer->len = 0;
+            layer->disto = 0;
+            continue;
+        }
 
-                        if (cblk->numpassesinlayers == 0) {
-                            layer->len = cblk->passes[n - 1].rate;
-                            layer->data = cblk->data;
-                            layer->disto = cblk->passes[n - 1].distortiondec;
-                        } else {
-                            layer->len = cblk->passes[n - 1].rate - cblk->passes[cblk->numpassesinlayers - 1].rate;
-                            layer->data = cblk->data + cblk->passes[cblk->numpassesinlayers - 1].rate;
-                            layer->disto = cblk->passes[n - 1].distortiondec - cblk->passes[cblk->numpassesinlayers - 1].distortiondec;
-                        }
+        layer->len = opj_tcd_pass_rate(cblk, n) - opj_tcd_pass_rate(cblk, n0);
+        layer->data = cblk->data + opj_tcd_pass_rate(cblk, n0);
+        layer->disto = opj_tcd_pass_disto(cblk, n) - opj_tcd_pass_disto(cblk, n0);
 
-                        tcd_tile->distolayer[layno] += layer->disto;    /* fixed_quality */
+        tcd_tile->distolayer[layno] += layer->disto;    /* fixed_quality */
 
-                        if (final)
-                            cblk->numpassesinlayers = n;
-                    }
-                }
-            }
-        }
+        if (final)
+            cblk->numpassesinlayers = n;
     }
 }
 
@@ -417,14 +524,21 @@ void opj_tcd_makelayer_fixed(opj_tcd_t *tcd, uint32_t layno, uint32_t final)
     }
 }
 
+/*
+Post-compression rate-distortion optimisation.
+
+The feasible truncation points of all code-blocks are sorted once, by decreasing
+rate-distortion slope. Every layer then takes the next run of points: as far as its
+distortion target, or as far as its byte budget allows. The budget is first met on an
+estimate of the packet header cost, accumulated point by point, and then settled with
+a few tier-2 encodes around the estimate.
+*/
 bool opj_tcd_rateallocate(  opj_tcd_t *tcd,
                             uint32_t * p_data_written,
                             uint32_t len,
                             opj_codestream_info_t *cstr_info)
 {
     uint32_t compno, resno, bandno, precno, cblkno, layno;
-    uint32_t passno;
-    double min, max;
     double cumdisto[100];      /* fixed_quality */
     const double K = 1;                /* 1.1; fixed_quality */
     double maxSE = 0;
@@ -433,8 +547,9 @@ bool opj_tcd_rateallocate(  opj_tcd_t *tcd,
     opj_tcd_tile_t *tcd_tile = tcd->tile;
     opj_tcp_t *tcd_tcp = tcd->tcp;
 
-    min = DBL_MAX;
-    max = 0;
+    std::vector<opj_tcd_cblk_enc_t*> cblks;
+    std::vector<opj_tcd_pcrd_point_t> points;
+    uint32_t numpackets = 0;
 
     tcd_tile->numpix = 0;           /* fixed_quality */
 	uint32_t state = opj_plugin_get_debug_state();
@@ -445,6 +560,7 @@ bool opj_tcd_rateallocate(  opj_tcd_t *tcd,
 
         for (resno = 0; resno < tilec->numresolutions; resno++) {
             opj_tcd_resolution_t *res = &tilec->resolutions[resno];
+            numpackets += res->pw * res->ph;
 
             for (bandno = 0; bandno < res->numbands; bandno++) {
                 opj_tcd_band_t *band = &res->bands[bandno];
@@ -468,32 +584,9 @@ bool opj_tcd_rateallocate(  opj_tcd_t *tcd,
 								&numPix);
 						}
 
-                        for (passno = 0; passno < cblk->totalpasses; passno++) {
-                            opj_tcd_pass_t *pass = &cblk->passes[passno];
-                            int32_t dr;
-                            double dd, rdslope;
-
-                            if (passno == 0) {
-                                dr = (int32_t)pass->rate;
-                                dd = pass->distortiondec;
-                            } else {
-                                dr = (int32_t)(pass->rate - cblk->passes[passno - 1].rate);
-                                dd = pass->distortiondec - cblk->passes[passno - 1].distortiondec;
-                            }
-
-                            if (dr == 0) {
-                                continue;
-                            }
-
-                            rdslope = dd / dr;
-                            if (rdslope < min) {
-                                min = rdslope;
-                            }
-
-                            if (rdslope > max) {
-                                max = rdslope;
-                            }
-                        } /* passno */
+                        cblk->numpassesinlayers = 0;
+                        opj_tcd_pcrd_hull(cblk, (uint32_t)cblks.size(), points);
+                        cblks.push_back(cblk);
 
                         /* fixed_quality */
 						tcd_tile->numpix += numPix;
@@ -508,6 +601,11 @@ bool opj_tcd_rateallocate(  opj_tcd_t *tcd,
                  * ((double)(tilec->numpix));
     } /* compno */
 
+    std::stable_sort(points.begin(), points.end(),
+    [](const opj_tcd_pcrd_point_t& a, const opj_tcd_pcrd_point_t& b) {
+        return a.slope > b.slope;
+    });
+
     /* index file */
     if(cstr_info) {
         opj_tile_info_t *tile_info = &cstr_info->tile[tcd->tcd_tileno];
@@ -520,15 +618,27 @@ bool opj_tcd_rateallocate(  opj_tcd_t *tcd,
         }
     }
 
+    /* empty packet header, plus markers */
+    uint32_t packet_bytes = 1;
+    if (tcd_tcp->csty & J2K_CP_CSTY_SOP)
+        packet_bytes += 6;
+    if (tcd_tcp->csty & J2K_CP_CSTY_EPH)
+        packet_bytes += 2;
+
+    /* contribution of each code-block to the current layer, for the header estimate */
+    std::vector<uint32_t> layer_len(cblks.size());
+    std::vector<uint32_t> layer_bits(cblks.size());
+
+    const opj_tcd_pcrd_point_t* all_points = points.data();
+    size_t numpoints = points.size();
+    size_t pos = 0;
+    uint64_t bytes_written = 0;
+
     for (layno = 0; layno < tcd_tcp->numlayers; layno++) {
-        double lo = min;
-        double hi = max;
         uint32_t maxlen = tcd_tcp->rates[layno] > 0.0f ? opj_uint_min(((uint32_t) ceil(tcd_tcp->rates[layno])), len) : len;
         double goodthresh = 0;
-        double stable_thresh = 0;
-        double old_thresh = -1;
-        uint32_t i;
         double distotarget;                /* fixed_quality */
+        uint32_t layer_written = 0;
 
         /* fixed_quality */
         distotarget = tcd_tile->distotile - ((K * maxSE) / pow(10.0f, tcd_tcp->distoratio[layno] / 10.0f));
@@ -538,76 +648,144 @@ bool opj_tcd_rateallocate(  opj_tcd_t *tcd,
           -q xx,yy,zz,0   (fixed_quality == 1 and distoratio == 0)
           ==> possible to have some lossy layers and the last layer for sure lossless */
         if ( ((cp->m_specific_param.m_enc.m_disto_alloc==1) && (tcd_tcp->rates[layno] > 0.0f)) || ((cp->m_specific_param.m_enc.m_fixed_quality==1) && (tcd_tcp->distoratio[layno] > 0.0f))) {
-            opj_t2_t*t2 = opj_t2_create(tcd->image, cp);
-            double thresh = 0;
-
-            if (t2 == 00) {
-                return false;
+            size_t end = numpoints;
+            bool check_rate = true;
+            /* the hull ends at the last pass with a distortion gain: once every point is in,
+               the trailing passes are taken too, as long as they fit */
+            bool take_all = false;
+
+            if (cp->m_specific_param.m_enc.m_fixed_quality) {       /* fixed_quality */
+                /* shortest run of points that reaches the distortion target */
+                double distoachieved = layno == 0 ? 0 : cumdisto[layno - 1];
+                for (end = pos; end < numpoints && distoachieved < distotarget; ++end)
+                    distoachieved += all_points[end].disto;
+                check_rate = OPJ_IS_CINEMA(cp->rsiz);
             }
 
-            for     (i = 0; i < 128; ++i) {
-                double distoachieved = 0;  /* fixed_quality */
-
-                thresh = (lo + hi) / 2;
-
-                opj_tcd_makelayer(tcd, layno, thresh, 0);
-                if ((fabs(old_thresh - thresh)) < 0.001)
-                    break;
-                old_thresh = thresh;
-
-                if (cp->m_specific_param.m_enc.m_fixed_quality) {       /* fixed_quality */
-                    if(OPJ_IS_CINEMA(cp->rsiz)) {
-                        if (! opj_t2_encode_packets_thresh(t2,tcd->tcd_tileno, tcd_tile, layno + 1, p_data_written, maxlen, tcd->tp_pos)) {
-
-                            lo = thresh;
-                            continue;
-                        } else {
-                            distoachieved = layno == 0 ?
-                                            tcd_tile->distolayer[0] : cumdisto[layno - 1] + tcd_tile->distolayer[layno];
-
-                            if (distoachieved < distotarget) {
-                                hi=thresh;
-                                stable_thresh = thresh;
-                                continue;
-                            } else {
-                                lo=thresh;
-                            }
-                        }
-                    } else {
-                        distoachieved = (layno == 0) ?
-                                        tcd_tile->distolayer[0] : (cumdisto[layno - 1] + tcd_tile->distolayer[layno]);
+            if (check_rate) {
+                opj_t2_t*t2 = opj_t2_create(tcd->image, cp);
+                if (t2 == 00) {
+                    return false;
+                }
+                auto fits = [&](size_t k) {
+                    opj_tcd_pcrd_select(cblks, layno, all_points + pos, all_points + k);
+                    opj_tcd_pcrd_makelayer(tcd_tile, cblks, layno, false);
+                    return opj_t2_encode_packets_thresh(t2, tcd->tcd_tileno, tcd_tile, layno + 1, p_data_written, maxlen, tcd->tp_pos, tcd->numThreads);
+                };
+
+                /* estimate: walk the points until the layer would overflow its budget */
+                int64_t body = 0;
+                int64_t header_bits = 0;
+                int64_t base = (int64_t)(bytes_written + (uint64_t)numpackets * packet_bytes);
+                size_t estimate = pos;
+                for (; estimate < end; ++estimate) {
+                    const opj_tcd_pcrd_point_t* point = all_points + estimate;
+                    opj_tcd_cblk_enc_t* cblk = point->cblk;
+                    if (point->numpasses <= cblk->numpassesinlayers)
+                        continue;
+                    uint32_t point_len = opj_tcd_pass_rate(cblk, point->numpasses) - opj_tcd_pass_rate(cblk, cblk->numpassesinlayers);
+                    uint32_t point_bits = opj_tcd_pcrd_header_bits(cblk, point->numpasses - cblk->numpassesinlayers, point_len);
+                    body += (int64_t)point_len - layer_len[point->cblkno];
+                    header_bits += (int64_t)point_bits - layer_bits[point->cblkno];
+                    if (base + body + ((header_bits + 7) >> 3) > (int64_t)maxlen)
+                        break;
+                    layer_len[point->cblkno] = point_len;
+                    layer_bits[point->cblkno] = point_bits;
+                }
+                for (size_t i = pos; i < end; ++i) {
+                    layer_len[all_points[i].cblkno] = 0;
+                    layer_bits[all_points[i].cblkno] = 0;
+                }
 
-                        if (distoachieved < distotarget) {
-                            hi = thresh;
-                            stable_thresh = thresh;
-                            continue;
+                /* settle the run length with tier-2 encodes, galloping away from the estimate */
+                size_t good = pos;
+                size_t bad = end + 1;
+                uint32_t good_written = 0;
+                size_t step = 1;
+                if (estimate == pos || fits(estimate)) {
+                    good = estimate;
+                    good_written = *p_data_written;
+                    while (good < end) {
+                        size_t k = std::min(good + step, end);
+                        if (!fits(k)) {
+                            bad = k;
+                            break;
                         }
-                        lo = thresh;
+                        good = k;
+                        good_written = *p_data_written;
+                        step <<= 1;
                     }
                 } else {
-                    if (! opj_t2_encode_packets_thresh(t2, tcd->tcd_tileno, tcd_tile, layno + 1, p_data_written, maxlen, tcd->tp_pos)) {
-                        /* TODO: what to do with l ??? seek / tell ??? */
-                        /* opj_event_msg(tcd->cinfo, EVT_INFO, "rate alloc: len=%d, max=%d\n", l, maxlen); */
-                        lo = thresh;
-                        continue;
+                    bad = estimate;
+                    while (bad > pos + 1) {
+                        size_t k = bad - std::min(step, bad - pos - 1);
+                        if (fits(k)) {
+                            good = k;
+                            good_written = *p_data_written;
+                            break;
+                        }
+                        bad = k;
+                        step <<= 1;
                     }
-
-                    hi = thresh;
-                    stable_thresh = thresh;
                 }
+                while (bad <= end && bad - good > 1) {
+                    size_t k = good + (bad - good) / 2;
+                    if (fits(k)) {
+                        good = k;
+                        good_written = *p_data_written;
+                    } else {
+                        bad = k;
+                    }
+                }
+                if (good == numpoints) {
+                    opj_tcd_pcrd_select_all(cblks, layno);
+                    opj_tcd_pcrd_makelayer(tcd_tile, cblks, layno, false);
+                    if (opj_t2_encode_packets_thresh(t2, tcd->tcd_tileno, tcd_tile, layno + 1, p_data_written, maxlen, tcd->tp_pos, tcd->numThreads)) {
+                        take_all = true;
+                        good_written = *p_data_written;
+                    }
+                }
+                opj_t2_destroy(t2);
+
+                end = good;
+                layer_written = good_written;
+            } else {
+                take_all = end == numpoints;
             }
-            goodthresh = stable_thresh == 0? thresh : stable_thresh;
 
-            opj_t2_destroy(t2);
+            if (take_all)
+                opj_tcd_pcrd_select_all(cblks, layno);
+            else
+                opj_tcd_pcrd_select(cblks, layno, all_points + pos, all_points + end);
+            if (end > pos)
+                goodthresh = all_points[end - 1].slope;
+            pos = end;
         } else {
-            goodthresh = min;
+            /* every remaining pass */
+            opj_tcd_pcrd_select_all(cblks, layno);
+            if (numpoints)
+                goodthresh = all_points[numpoints - 1].slope;
+            pos = numpoints;
         }
 
         if(cstr_info) { /* Threshold for Marcela Index */
             cstr_info->tile[tcd->tcd_tileno].thresh[layno] = goodthresh;
         }
 
-        opj_tcd_makelayer(tcd, layno, goodthresh, 1);
+        opj_tcd_pcrd_makelayer(tcd_tile, cblks, layno, true);
+
+        /* bytes taken by the layers so far: measured by tier-2 when it was run on the final
+           layer, estimated otherwise */
+        if (layer_written) {
+            bytes_written = layer_written;
+        } else {
+            for (auto cblk : cblks) {
+                opj_tcd_layer_t *layer = cblk->layers + layno;
+                if (layer->numpasses)
+                    bytes_written += layer->len + ((opj_tcd_pcrd_header_bits(cblk, layer->numpasses, layer->len) + 7) >> 3);
+            }
+            bytes_written += (uint64_t)numpackets * packet_bytes;
+        }
 
         /* fixed_quality */
         cumdisto[layno] = (layno == 0) ? tcd_tile->distolayer[0] : (cumdisto[layno - 1] + tcd_tile->distolayer[layno]);
@@ -636,7 +814,8 @@ bool opj_tcd_init( opj_tcd_t *p_tcd,
 
     p_tcd->tile->numcomps = p_image->numcomps;
     p_tcd->tp_pos = p_cp->m_specific_param.m_enc.m_tp_pos;
-	p_tcd->numThreads = numThreads;
+	/* 0 means one task per scheduler worker */
+	p_tcd->numThreads = numThreads ? numThreads : (uint32_t)Scheduler::instance()->num_workers();
 
     return true;
 }
@@ -648,6 +827,7 @@ void opj_tcd_destroy(opj_tcd_t *tcd)
 {
     if (tcd) {
         opj_tcd_free_tile(tcd);
+        delete tcd->arena;
         opj_free(tcd);
     }
 }
@@ -860,27 +1040,16 @@ static inline bool opj_tcd_init_tile(opj_tcd_t *p_tcd,
                 l_band->stepsize = (float)(((1.0 + l_step_size->mant / 2048.0) * pow(2.0, (int32_t) (numbps - l_step_size->expn)))) * fraction;
                 l_band->numbps = l_step_size->expn + l_tccp->numgbits - 1;      /* WHY -1 ? */
 
-                if (!l_band->precincts && (l_nb_precincts > 0U)) {
-                    l_band->precincts = (opj_tcd_precinct_t *) opj_malloc( /*3 * */ l_nb_precinct_size);
-                    if (! l_band->precincts) {
-                        return false;
-                    }
-                    /*fprintf(stderr, "\t\t\t\tAllocate precincts of a band (opj_tcd_precinct_t): %d\n",l_nb_precinct_size);     */
-                    memset(l_band->precincts,0,l_nb_precinct_size);
-                    l_band->precincts_data_size = l_nb_precinct_size;
-                } else if (l_band->precincts_data_size < l_nb_precinct_size) {
-
-                    opj_tcd_precinct_t * new_precincts = (opj_tcd_precinct_t *) opj_realloc(l_band->precincts,/*3 * */ l_nb_precinct_size);
+                if (l_band->precincts_data_size < l_nb_precinct_size) {
+                    opj_tcd_precinct_t * new_precincts = (opj_tcd_precinct_t *) opj_arena_alloc(p_tcd->arena, l_nb_precinct_size);
                     if (! new_precincts) {
                         opj_event_msg(manager, EVT_ERROR, "Not enough memory to handle band precints\n");
-                        opj_free(l_band->precincts);
-                        l_band->precincts = NULL;
-                        l_band->precincts_data_size = 0;
                         return false;
                     }
+                    /* the precincts keep their code-blocks and tag trees */
+                    if (l_band->precincts)
+                        memcpy(new_precincts, l_band->precincts, l_band->precincts_data_size);
                     l_band->precincts = new_precincts;
-                    /*fprintf(stderr, "\t\t\t\tReallocate precincts of a band (opj_tcd_precinct_t): from %d to %d\n",l_band->precincts_data_size, l_nb_precinct_size);*/
-                    memset(((uint8_t *) l_band->precincts) + l_band->precincts_data_size,0,l_nb_precinct_size - l_band->precincts_data_size);
                     l_band->precincts_data_size = l_nb_precinct_size;
                 }
 
@@ -918,37 +1087,20 @@ static inline bool opj_tcd_init_tile(opj_tcd_t *p_tcd,
                     /*fprintf(stderr, "\t\t\t\t precinct_cw = %d x recinct_ch = %d\n",l_current_precinct->cw, l_current_precinct->ch);      */
                     l_nb_code_blocks_size = l_nb_code_blocks * (uint32_t)sizeof_block;
 
-                    if (!l_current_precinct->cblks.blocks && (l_nb_code_blocks > 0U)) {
-                        l_current_precinct->cblks.blocks = opj_malloc(l_nb_code_blocks_size);
-                        if (! l_current_precinct->cblks.blocks ) {
-                            return false;
-                        }
-                        /*fprintf(stderr, "\t\t\t\tAllocate cblks of a precinct (opj_tcd_cblk_dec_t): %d\n",l_nb_code_blocks_size);*/
-
-                        memset(l_current_precinct->cblks.blocks,0,l_nb_code_blocks_size);
-
-                        l_current_precinct->block_size = l_nb_code_blocks_size;
-                    } else if (l_nb_code_blocks_size > l_current_precinct->block_size) {
-                        void *new_blocks = opj_realloc(l_current_precinct->cblks.blocks, l_nb_code_blocks_size);
+                    if (l_current_precinct->block_size < l_nb_code_blocks_size) {
+                        void *new_blocks = opj_arena_alloc(p_tcd->arena, l_nb_code_blocks_size);
                         if (! new_blocks) {
-                            opj_free(l_current_precinct->cblks.blocks);
-                            l_current_precinct->cblks.blocks = NULL;
-                            l_current_precinct->block_size = 0;
                             opj_event_msg(manager, EVT_ERROR, "Not enough memory for current precinct codeblock element\n");
                             return false;
                         }
+                        if (l_current_precinct->cblks.blocks)
+                            memcpy(new_blocks, l_current_precinct->cblks.blocks, l_current_precinct->block_size);
                         l_current_precinct->cblks.blocks = new_blocks;
-                        /*fprintf(stderr, "\t\t\t\tReallocate cblks of a precinct (opj_tcd_cblk_dec_t): from %d to %d\n",l_current_precinct->block_size, l_nb_code_blocks_size);     */
-
-                        memset(((uint8_t *) l_current_precinct->cblks.blocks) + l_current_precinct->block_size
-                               ,0
-                               ,l_nb_code_blocks_size - l_current_precinct->block_size);
-
                         l_current_precinct->block_size = l_nb_code_blocks_size;
                     }
 
                     if (! l_current_precinct->incltree) {
-                        l_current_precinct->incltree = opj_tgt_create(l_current_precinct->cw, l_current_precinct->ch, manager);
+                        l_current_precinct->incltree = opj_tgt_create(l_current_precinct->cw, l_current_precinct->ch, p_tcd->arena, manager);
                     } else {
                         l_current_precinct->incltree = opj_tgt_init(l_current_precinct->incltree, l_current_precinct->cw, l_current_precinct->ch, manager);
                     }
@@ -959,7 +1111,7 @@ static inline bool opj_tcd_init_tile(opj_tcd_t *p_tcd,
                     }
 
                     if (! l_current_precinct->imsbtree) {
-                        l_current_precinct->imsbtree = opj_tgt_create(l_current_precinct->cw, l_current_precinct->ch, manager);
+                        l_current_precinct->imsbtree = opj_tgt_create(l_current_precinct->cw, l_current_precinct->ch, p_tcd->arena, manager);
                     } else {
                         l_current_precinct->imsbtree = opj_tgt_init(l_current_precinct->imsbtree, l_current_precinct->cw, l_current_precinct->ch, manager);
                     }
@@ -978,7 +1130,7 @@ static inline bool opj_tcd_init_tile(opj_tcd_t *p_tcd,
                         if (isEncoder) {
                             opj_tcd_cblk_enc_t* l_code_block = l_current_precinct->cblks.enc + cblkno;
 
-                            if (! opj_tcd_code_block_enc_allocate(l_code_block)) {
+                            if (! opj_tcd_code_block_enc_allocate(l_code_block, p_tcd->arena)) {
                                 return false;
                             }
                             /* code-block size (global) */
@@ -1066,17 +1218,17 @@ bool opj_tcd_init_decode_tile (opj_tcd_t *p_tcd,
 /**
  * Allocates memory for an encoding code block (but not data memory).
  */
-static bool opj_tcd_code_block_enc_allocate (opj_tcd_cblk_enc_t * p_code_block)
+static bool opj_tcd_code_block_enc_allocate (opj_tcd_cblk_enc_t * p_code_block, opj_arena_t * p_arena)
 {
     if (! p_code_block->layers) {
         /* no memset since data */
-        p_code_block->layers = (opj_tcd_layer_t*) opj_calloc(100, sizeof(opj_tcd_layer_t));
+        p_code_block->layers = (opj_tcd_layer_t*) opj_arena_alloc(p_arena, 100 * sizeof(opj_tcd_layer_t));
         if (! p_code_block->layers) {
             return false;
         }
     }
     if (! p_code_block->passes) {
-        p_code_block->passes = (opj_tcd_pass_t*) opj_calloc(100, sizeof(opj_tcd_pass_t));
+        p_code_block->passes = (opj_tcd_pass_t*) opj_arena_alloc(p_arena, 100 * sizeof(opj_tcd_pass_t));
         if (! p_code_block->passes) {
             return false;
         }
@@ -1091,7 +1243,9 @@ static bool opj_tcd_code_block_enc_allocate_data (opj_tcd_cblk_enc_t * p_code_bl
 {
     uint32_t l_data_size;
 
-    l_data_size = (uint32_t)((p_code_block->x1 - p_code_block->x0) * (p_code_block->y1 - p_code_block->y0) * (int32_t)sizeof(uint32_t));
+    /* every code-block is MQ coded, even an empty one, and the final flush of a very
+       small code-block can write a few bytes past its sample count */
+    l_data_size = 32 + (uint32_t)((p_code_block->x1 - p_code_block->x0) * (p_code_block->y1 - p_code_block->y0) * (int32_t)sizeof(uint32_t));
 
     if (l_data_size > p_code_block->data_size) {
         if (p_code_block->data) {
@@ -1128,14 +1282,14 @@ static bool opj_tcd_code_block_dec_allocate (opj_tcd_cblk_dec_t * p_code_block)
         /* sanitize */
         opj_tcd_seg_t * l_segs = p_code_block->segs;
         uint32_t l_current_max_segs = p_code_block->m_current_max_segs;
-
-        /* Note: since seg_buffers simply holds references to another data buffer,
-        we do not need to copy it  to the sanitized block  */
-        opj_vec_cleanup(&p_code_block->seg_buffers);
+        opj_tcd_seg_data_chunk_t * l_chunks = p_code_block->chunks;
+        uint32_t l_numchunksalloc = p_code_block->numchunksalloc;
 
         memset(p_code_block, 0, sizeof(opj_tcd_cblk_dec_t));
         p_code_block->segs = l_segs;
         p_code_block->m_current_max_segs = l_current_max_segs;
+        p_code_block->chunks = l_chunks;
+        p_code_block->numchunksalloc = l_numchunksalloc;
     }
     return true;
 }
@@ -1171,93 +1325,117 @@ uint32_t opj_tcd_get_decoded_tile_size ( opj_tcd_t *p_tcd )
     return l_data_size;
 }
 
-bool opj_tcd_encode_tile(   opj_tcd_t *p_tcd,
+bool opj_tcd_precode_tile(  opj_tcd_t *p_tcd,
                             uint32_t p_tile_no,
-                            uint8_t *p_dest,
-                            uint32_t * p_data_written,
                             uint32_t p_max_length,
                             opj_codestream_info_t *p_cstr_info)
 {
 	uint32_t state = opj_plugin_get_debug_state();
-    if (p_tcd->cur_tp_num == 0) {
 
-        p_tcd->tcd_tileno = p_tile_no;
-        p_tcd->tcp = &p_tcd->cp->tcps[p_tile_no];
+    p_tcd->tcd_tileno = p_tile_no;
+    p_tcd->tcp = &p_tcd->cp->tcps[p_tile_no];
 
-        /* INDEX >> "Precinct_nb_X et Precinct_nb_Y" */
-        if(p_cstr_info)  {
-            uint32_t l_num_packs = 0;
-            uint32_t i;
-            opj_tcd_tilecomp_t *l_tilec_idx = &p_tcd->tile->comps[0];        /* based on component 0 */
-            opj_tccp_t *l_tccp = p_tcd->tcp->tccps; /* based on component 0 */
+    /* INDEX >> "Precinct_nb_X et Precinct_nb_Y" */
+    if(p_cstr_info)  {
+        uint32_t l_num_packs = 0;
+        uint32_t i;
+        opj_tcd_tilecomp_t *l_tilec_idx = &p_tcd->tile->comps[0];        /* based on component 0 */
+        opj_tccp_t *l_tccp = p_tcd->tcp->tccps; /* based on component 0 */
 
-            for (i = 0; i < l_tilec_idx->numresolutions; i++) {
-                opj_tcd_resolution_t *l_res_idx = &l_tilec_idx->resolutions[i];
+        for (i = 0; i < l_tilec_idx->numresolutions; i++) {
+            opj_tcd_resolution_t *l_res_idx = &l_tilec_idx->resolutions[i];
 
-                p_cstr_info->tile[p_tile_no].pw[i] = (int)l_res_idx->pw;
-                p_cstr_info->tile[p_tile_no].ph[i] = (int)l_res_idx->ph;
+            p_cstr_info->tile[p_tile_no].pw[i] = (int)l_res_idx->pw;
+            p_cstr_info->tile[p_tile_no].ph[i] = (int)l_res_idx->ph;
 
-                l_num_packs += l_res_idx->pw * l_res_idx->ph;
-                p_cstr_info->tile[p_tile_no].pdx[i] = (int)l_tccp->prcw[i];
-                p_cstr_info->tile[p_tile_no].pdy[i] = (int)l_tccp->prch[i];
-            }
-            p_cstr_info->tile[p_tile_no].packet = (opj_packet_info_t*) opj_calloc((size_t)p_cstr_info->numcomps * (size_t)p_cstr_info->numlayers * l_num_packs, sizeof(opj_packet_info_t));
-            if (!p_cstr_info->tile[p_tile_no].packet) {
-                /* FIXME event manager error callback */
-                return false;
-            }
+            l_num_packs += l_res_idx->pw * l_res_idx->ph;
+            p_cstr_info->tile[p_tile_no].pdx[i] = (int)l_tccp->prcw[i];
+            p_cstr_info->tile[p_tile_no].pdy[i] = (int)l_tccp->prch[i];
         }
-		/* << INDEX */
-		if ((state & OPJ_PLUGIN_STATE_DEBUG_ENCODE) &&
-			!(state & OPJ_PLUGIN_STATE_CPU_ONLY)) {
-			set_context_stream(p_tcd);
-		}
-
-		// When debugging the encoder, we do all of T1 up to and including DWT in the plugin, and pass this in as image data.
-		// This way, both OPJ and plugin start with same inputs for context formation and MQ coding.
-		bool debugEncode = state & OPJ_PLUGIN_STATE_DEBUG_ENCODE;
-		bool debugMCT = (state & OPJ_PLUGIN_STATE_MCT_ONLY) ? true : false ;
-
-		if (!p_tcd->current_plugin_tile || debugEncode) {
+        p_cstr_info->tile[p_tile_no].packet = (opj_packet_info_t*) opj_calloc((size_t)p_cstr_info->numcomps * (size_t)p_cstr_info->numlayers * l_num_packs, sizeof(opj_packet_info_t));
+        if (!p_cstr_info->tile[p_tile_no].packet) {
+            /* FIXME event manager error callback */
+            return false;
+        }
+    }
+	/* << INDEX */
+	if ((state & OPJ_PLUGIN_STATE_DEBUG_ENCODE) &&
+		!(state & OPJ_PLUGIN_STATE_CPU_ONLY)) {
+		set_context_stream(p_tcd);
+	}
 
-			if (!debugEncode) {
-				/* FIXME _ProfStart(PGROUP_DC_SHIFT); */
-				/*---------------TILE-------------------*/
-				if (!opj_tcd_dc_level_shift_encode(p_tcd)) {
-					return false;
+	// When debugging the encoder, we do all of T1 up to and including DWT in the plugin, and pass this in as image data.
+	// This way, both OPJ and plugin start with same inputs for context formation and MQ coding.
+	bool debugEncode = state & OPJ_PLUGIN_STATE_DEBUG_ENCODE;
+	bool debugMCT = (state & OPJ_PLUGIN_STATE_MCT_ONLY) ? true : false ;
+
+	if (!p_tcd->current_plugin_tile || debugEncode) {
+
+		if (!debugEncode) {
+			/* FIXME _ProfStart(PGROUP_DC_SHIFT); */
+			/*---------------TILE-------------------*/
+			if (!p_tcd->m_tile_data_transformed) {
+				std::vector<int32_t*> l_src(p_tcd->tile->numcomps);
+				std::vector<size_t> l_src_stride(p_tcd->tile->numcomps);
+				for (uint32_t compno = 0; compno < p_tcd->tile->numcomps; ++compno) {
+					opj_tcd_tilecomp_t* l_tilec = p_tcd->tile->comps + compno;
+					l_src[compno] = opj_tile_buf_get_ptr(l_tilec->buf, 0, 0, 0, 0);
+					l_src_stride[compno] = l_tilec->x1 - l_tilec->x0;
 				}
-				/* FIXME _ProfStop(PGROUP_DC_SHIFT); */
-
-				/* FIXME _ProfStart(PGROUP_MCT); */
-				if (!opj_tcd_mct_encode(p_tcd)) {
+				if (!opj_tcd_dc_level_shift_mct_encode(p_tcd, l_src.data(), l_src_stride.data(), false)) {
 					return false;
 				}
-				/* FIXME _ProfStop(PGROUP_MCT); */
 			}
+			p_tcd->m_tile_data_transformed = 0;
+			/* FIXME _ProfStop(PGROUP_DC_SHIFT); */
 
-			if (!debugEncode || debugMCT) {
-				/* FIXME _ProfStart(PGROUP_DWT); */
-				if (!opj_tcd_dwt_encode(p_tcd)) {
-					return false;
-				}
-				/* FIXME  _ProfStop(PGROUP_DWT); */
+			/* FIXME _ProfStart(PGROUP_MCT); */
+			if (!opj_tcd_mct_encode(p_tcd)) {
+				return false;
 			}
+			/* FIXME _ProfStop(PGROUP_MCT); */
+		}
 
-
-			/* FIXME  _ProfStart(PGROUP_T1); */
-			if (!opj_tcd_t1_encode(p_tcd)) {
+		if (!debugEncode || debugMCT) {
+			/* FIXME _ProfStart(PGROUP_DWT); */
+			if (!opj_tcd_dwt_encode(p_tcd)) {
 				return false;
 			}
-			/* FIXME _ProfStop(PGROUP_T1); */
-
+			/* FIXME  _ProfStop(PGROUP_DWT); */
 		}
 
-		/* FIXME _ProfStart(PGROUP_RATE); */
-		if (!opj_tcd_rate_allocate_encode(p_tcd, p_max_length, p_cstr_info)) {
+
+		/* FIXME  _ProfStart(PGROUP_T1); */
+		if (!opj_tcd_t1_encode(p_tcd)) {
 			return false;
 		}
-		/* FIXME _ProfStop(PGROUP_RATE); */
+		/* FIXME _ProfStop(PGROUP_T1); */
+
+	}
+
+	/* FIXME _ProfStart(PGROUP_RATE); */
+	if (!opj_tcd_rate_allocate_encode(p_tcd, p_max_length, p_cstr_info)) {
+		return false;
+	}
+	/* FIXME _ProfStop(PGROUP_RATE); */
 
+    p_tcd->m_tile_precoded = 1;
+    return true;
+}
+
+bool opj_tcd_encode_tile(   opj_tcd_t *p_tcd,
+                            uint32_t p_tile_no,
+                            uint8_t *p_dest,
+                            uint32_t * p_data_written,
+                            uint32_t p_max_length,
+                            opj_codestream_info_t *p_cstr_info)
+{
+    if (p_tcd->cur_tp_num == 0) {
+        if (!p_tcd->m_tile_precoded &&
+                !opj_tcd_precode_tile(p_tcd, p_tile_no, p_max_length, p_cstr_info)) {
+            return false;
+        }
+        p_tcd->m_tile_precoded = 0;
     }
     /*--------------TIER2------------------*/
 
@@ -1299,17 +1477,100 @@ bool opj_tcd_decode_tile(   opj_tcd_t *p_tcd,
         return false;
     }
 
+    /* the decode buffer writer applies the DC level shift itself */
+    if (! p_tcd->decode_buffer && opj_tcd_mct_dc_level_shift_decode(p_tcd)) {
+        return opj_tcd_dc_level_shift_decode(p_tcd, 3);
+    }
+
     if   (! opj_tcd_mct_decode(p_tcd, p_manager)) {
         return false;
     }
 
-    if  (! opj_tcd_dc_level_shift_decode(p_tcd)) {
+    if  (! p_tcd->decode_buffer && ! opj_tcd_dc_level_shift_decode(p_tcd, 0)) {
         return false;
     }
 
     return true;
 }
 
+/*
+DC shift, clamp and store one row of a tile component into every
+numcomps-th sample of an interleaved destination row
+*/
+template <typename T> static void opj_tcd_write_row(const int32_t* restrict src,
+													T* restrict dest,
+													uint32_t width,
+													uint32_t numcomps,
+													bool reversible,
+													int32_t shift,
+													int32_t min,
+													int32_t max) {
+	if (reversible) {
+		for (uint32_t i = 0; i < width; ++i) {
+			*dest = (T)opj_int_clamp(src[i] + shift, min, max);
+			dest += numcomps;
+		}
+	}
+	else {
+		auto src_float = (const float*)src;
+		for (uint32_t i = 0; i < width; ++i) {
+			*dest = (T)opj_int_clamp((int32_t)opj_lrintf(src_float[i]) + shift, min, max);
+			dest += numcomps;
+		}
+	}
+}
+
+void opj_tcd_write_decode_buffer(opj_tcd_t *p_tcd, opj_image_t* p_output_image)
+{
+	const opj_decode_buffer_t* l_buffer = p_tcd->decode_buffer;
+	opj_tcd_run(p_tcd, p_tcd->tile->numcomps, [p_tcd, p_output_image, l_buffer](uint32_t compno) {
+		opj_tcd_tilecomp_t *l_tile_comp = p_tcd->tile->comps + compno;
+		opj_tccp_t * l_tccp = p_tcd->tcp->tccps + compno;
+		opj_image_comp_t * l_img_comp = p_tcd->image->comps + compno;
+		opj_image_comp_t * l_img_comp_dest = p_output_image->comps + compno;
+		opj_tcd_resolution_t* l_res = l_tile_comp->resolutions + l_img_comp->resno_decoded;
+
+		/* intersect the decoded resolution with the output component, at the decoded resolution */
+		uint32_t l_x0_dest = opj_uint_ceildivpow2(l_img_comp_dest->x0, l_img_comp_dest->factor);
+		uint32_t l_y0_dest = opj_uint_ceildivpow2(l_img_comp_dest->y0, l_img_comp_dest->factor);
+		uint32_t l_x0 = opj_uint_max(l_res->x0, l_x0_dest);
+		uint32_t l_y0 = opj_uint_max(l_res->y0, l_y0_dest);
+		uint32_t l_x1 = opj_uint_min(l_res->x1, l_x0_dest + l_img_comp_dest->w);
+		uint32_t l_y1 = opj_uint_min(l_res->y1, l_y0_dest + l_img_comp_dest->h);
+		if (l_x0 >= l_x1 || l_y0 >= l_y1)
+			return;
+
+		int32_t l_min, l_max;
+		if (l_img_comp->sgnd) {
+			l_min = -(1 << (l_img_comp->prec - 1));
+			l_max = (1 << (l_img_comp->prec - 1)) - 1;
+		}
+		else {
+			l_min = 0;
+			l_max = (1 << l_img_comp->prec) - 1;
+		}
+
+		uint32_t l_src_stride = l_tile_comp->buf->data_width;
+		const int32_t* l_src = opj_tile_buf_get_ptr(l_tile_comp->buf, 0, 0, 0, 0) +
+							   (size_t)(l_y0 - l_res->y0) * l_src_stride + (l_x0 - l_res->x0);
+		size_t l_sample_size = l_buffer->prec >> 3;
+		uint8_t* l_dest = l_buffer->data + (size_t)(l_y0 - l_y0_dest) * l_buffer->stride +
+						  ((size_t)(l_x0 - l_x0_dest) * l_buffer->numcomps + compno) * l_sample_size;
+		bool l_reversible = l_tccp->qmfbid == 1;
+
+		for (uint32_t j = l_y0; j < l_y1; ++j) {
+			if (l_sample_size == 1)
+				opj_tcd_write_row<uint8_t>(l_src, l_dest, l_x1 - l_x0, l_buffer->numcomps,
+											l_reversible, l_tccp->m_dc_level_shift, l_min, l_max);
+			else
+				opj_tcd_write_row<uint16_t>(l_src, (uint16_t*)l_dest, l_x1 - l_x0, l_buffer->numcomps,
+											l_reversible, l_tccp->m_dc_level_shift, l_min, l_max);
+			l_src += l_src_stride;
+			l_dest += l_buffer->stride;
+		}
+	});
+}
+
 /*
 
 For each component, copy decoded resolutions from the tile data buffer
@@ -1349,7 +1610,7 @@ bool opj_tcd_update_tile_data ( opj_tcd_t *p_tcd,
         l_res = l_tilec->resolutions + l_img_comp->resno_decoded;
         l_width = (l_res->x1 - l_res->x0);
         l_height = (l_res->y1 - l_res->y0);
-        l_stride = (l_tilec->x1 - l_tilec->x0) - l_width;
+        l_stride = l_tilec->buf->data_width - l_width;
 
         if (l_size_comp == 3) {
             l_size_comp = 4;
@@ -1481,7 +1742,6 @@ static void opj_tcd_free_tile(opj_tcd_t *p_tcd)
                             ++l_precinct;
                         }
 
-                        opj_free(l_band->precincts);
                         l_band->precincts = 00;
                     }
                     ++l_band;
@@ -1502,6 +1762,7 @@ static void opj_tcd_free_tile(opj_tcd_t *p_tcd)
     l_tile->comps = 00;
     opj_free(p_tcd->tile);
     p_tcd->tile = 00;
+    opj_arena_rewind(p_tcd->arena);
 }
 
 
@@ -1525,6 +1786,7 @@ static bool opj_tcd_t2_decode (opj_tcd_t *p_tcd,
                 p_tcd->tile,
                 src_buf,
                 p_data_read,
+                p_tcd->numThreads,
                 p_manager)) {
         opj_t2_destroy(l_t2);
         return false;
@@ -1541,8 +1803,14 @@ static bool opj_tcd_t1_decode ( opj_tcd_t *p_tcd, opj_event_mgr_t * p_manager)
     opj_tcd_tile_t * l_tile = p_tcd->tile;
     opj_tcd_tilecomp_t* l_tile_comp = l_tile->comps;
     opj_tccp_t * l_tccp = p_tcd->tcp->tccps;
-	std::vector<decodeBlockInfo*> blocks;
-	T1Decoder decoder(l_tccp->cblkw, l_tccp->cblkh);
+	std::vector<decodeBlockInfo> blocks;
+	/* nominal code-block dimensions are the largest over all components */
+	uint32_t cblkw = 0, cblkh = 0;
+	for (compno = 0; compno < l_tile->numcomps; ++compno) {
+		cblkw = opj_uint_max(cblkw, 1U << l_tccp[compno].cblkw);
+		cblkh = opj_uint_max(cblkh, 1U << l_tccp[compno].cblkh);
+	}
+	T1Decoder decoder((uint16_t)cblkw, (uint16_t)cblkh);
     for (compno = 0; compno < l_tile->numcomps; ++compno) {
 
         /* The +3 is headroom required by the vectorized DWT */
@@ -1560,40 +1828,52 @@ static bool opj_tcd_t1_decode ( opj_tcd_t *p_tcd, opj_event_mgr_t * p_manager)
 static bool opj_tcd_dwt_decode ( opj_tcd_t *p_tcd )
 {
     opj_tcd_tile_t * l_tile = p_tcd->tile;
-    int64_t compno=0;
-    bool rc = true;
-#ifdef _OPENMP
-    #pragma omp parallel default(none) private(compno) shared(p_tcd, l_tile, rc)
-    {
-        #pragma omp for
-#endif
-        for (compno = 0; compno < (int64_t)l_tile->numcomps; compno++) {
-            opj_tcd_tilecomp_t * l_tile_comp = l_tile->comps + compno;
-            opj_tccp_t * l_tccp = p_tcd->tcp->tccps + compno;
-            opj_image_comp_t * l_img_comp = p_tcd->image->comps + compno;
-            if (l_tccp->qmfbid == 1) {
-                if (! opj_dwt_decode(l_tile_comp,
-									l_img_comp->resno_decoded+1,
-									p_tcd->numThreads)) {
-                    rc = false;
-                    continue;
-                }
-            } else {
-                if (! opj_dwt_decode_real(l_tile_comp, 
-											l_img_comp->resno_decoded+1,
-											p_tcd->numThreads)) {
-                    rc = false;
-                    continue;
-                }
-            }
-#ifdef _OPENMP
-        }
-#endif
-
-    }
+    std::atomic<bool> rc(true);
+	opj_tcd_run(p_tcd, l_tile->numcomps, [p_tcd, l_tile, &rc](uint32_t compno) {
+		opj_tcd_tilecomp_t * l_tile_comp = l_tile->comps + compno;
+		opj_tccp_t * l_tccp = p_tcd->tcp->tccps + compno;
+		opj_image_comp_t * l_img_comp = p_tcd->image->comps + compno;
+		if (l_tccp->qmfbid == 1) {
+			if (! opj_dwt_decode(l_tile_comp,
+								l_img_comp->resno_decoded+1,
+								p_tcd->numThreads)) {
+				rc = false;
+			}
+		} else {
+			if (! opj_dwt_decode_real(l_tile_comp, 
+										l_img_comp->resno_decoded+1,
+										p_tcd->numThreads)) {
+				rc = false;
+			}
+		}
+	});
 
     return rc;
 }
+static bool opj_tcd_mct_custom(opj_tcd_t *p_tcd,
+                               bool (*p_transform)(uint8_t*, uint32_t, uint8_t**, uint32_t, uint32_t),
+                               uint8_t* p_matrix,
+                               uint32_t p_samples,
+                               uint8_t** p_data)
+{
+	uint32_t l_numcomps = p_tcd->tile->numcomps;
+	/* chunks of at least a few thousand samples, so that the matrix set-up stays negligible */
+	uint32_t l_num_tasks = opj_uint_max(1, opj_uint_min(p_tcd->numThreads, p_samples >> 12));
+	std::atomic<bool> l_rc(true);
+
+	Scheduler::instance()->run(l_num_tasks, [=, &l_rc](size_t taskId) {
+		uint32_t l_start = (uint32_t)(((uint64_t)taskId * p_samples) / l_num_tasks);
+		uint32_t l_end = (uint32_t)(((uint64_t)(taskId + 1) * p_samples) / l_num_tasks);
+		std::vector<uint8_t*> l_data(l_numcomps);
+		for (uint32_t compno = 0; compno < l_numcomps; ++compno)
+			l_data[compno] = p_data[compno] + (size_t)l_start * sizeof(int32_t);
+		if (!p_transform(p_matrix, l_end - l_start, l_data.data(), l_numcomps, p_tcd->image->comps->sgnd))
+			l_rc = false;
+	});
+
+	return l_rc;
+}
+
 static bool opj_tcd_mct_decode ( opj_tcd_t *p_tcd, opj_event_mgr_t *p_manager)
 {
     opj_tcd_tile_t * l_tile = p_tcd->tile;
@@ -1605,13 +1885,14 @@ static bool opj_tcd_mct_decode ( opj_tcd_t *p_tcd, opj_event_mgr_t *p_manager)
         return true;
     }
 
-    l_samples = (uint32_t)((l_tile_comp->x1 - l_tile_comp->x0) * (l_tile_comp->y1 - l_tile_comp->y0));
+    /* only the decoded resolution is held in the tile buffers */
+    l_samples = l_tile_comp->buf->data_width * l_tile_comp->buf->data_height;
 
     if (l_tile->numcomps >= 3 ) {
         /* testcase 1336.pdf.asan.47.376 */
-        if ((l_tile->comps[0].x1 - l_tile->comps[0].x0) * (l_tile->comps[0].y1 - l_tile->comps[0].y0) < l_samples ||
-                (l_tile->comps[1].x1 - l_tile->comps[1].x0) * (l_tile->comps[1].y1 - l_tile->comps[1].y0) < l_samples ||
-                (l_tile->comps[2].x1 - l_tile->comps[2].x0) * (l_tile->comps[2].y1 - l_tile->comps[2].y0) < l_samples) {
+        if (l_tile->comps[0].buf->data_width * l_tile->comps[0].buf->data_height < l_samples ||
+                l_tile->comps[1].buf->data_width * l_tile->comps[1].buf->data_height < l_samples ||
+                l_tile->comps[2].buf->data_width * l_tile->comps[2].buf->data_height < l_samples) {
             opj_event_msg(p_manager, EVT_ERROR, "Tiles don't all have the same dimension. Skip the MCT step.\n");
             return false;
         } else if (l_tcp->mct == 2) {
@@ -1631,21 +1912,11 @@ static bool opj_tcd_mct_decode ( opj_tcd_t *p_tcd, opj_event_mgr_t *p_manager)
                 ++l_tile_comp;
             }
 
-            if (! opj_mct_decode_custom(/* MCT data */
-                        (uint8_t*) l_tcp->m_mct_decoding_matrix,
-                        /* size of components */
-                        l_samples,
-                        /* components */
-                        l_data,
-                        /* nb of components (i.e. size of pData) */
-                        l_tile->numcomps,
-                        /* tells if the data is signed */
-                        p_tcd->image->comps->sgnd)) {
-                opj_free(l_data);
+            bool l_rc = opj_tcd_mct_custom(p_tcd, opj_mct_decode_custom, (uint8_t*) l_tcp->m_mct_decoding_matrix, l_samples, l_data);
+            opj_free(l_data);
+            if (!l_rc) {
                 return false;
             }
-
-            opj_free(l_data);
         } else {
             if (l_tcp->tccps->qmfbid == 1) {
                 opj_mct_decode(opj_tile_buf_get_ptr(l_tile->comps[0].buf, 0, 0, 0, 0) ,
@@ -1667,65 +1938,117 @@ static bool opj_tcd_mct_decode ( opj_tcd_t *p_tcd, opj_event_mgr_t *p_manager)
 }
 
 
-static bool opj_tcd_dc_level_shift_decode ( opj_tcd_t *p_tcd )
+static bool opj_tcd_mct_dc_level_shift_decode ( opj_tcd_t *p_tcd )
 {
-    uint32_t compno=0;
-
-#ifdef _OPENMP
-#pragma omp parallel default(none) private(compno) shared(p_tcd)
-	{
-#pragma omp for
-#endif
-
-		for (compno = 0; compno < p_tcd->tile->numcomps; compno++) {
-			int32_t l_min = INT32_MAX, l_max = INT32_MIN;
+	opj_tcd_tile_t * l_tile = p_tcd->tile;
+	opj_tcp_t * l_tcp = p_tcd->tcp;
+	int32_t l_shift[3], l_min[3], l_max[3];
+	int32_t* l_data[3];
+
+	if (l_tcp->mct != 1 || l_tile->numcomps < 3)
+		return false;
+
+	opj_tcd_resolution_t* l_res = l_tile->comps[0].resolutions + p_tcd->image->comps[0].resno_decoded;
+	uint32_t l_width = l_res->x1 - l_res->x0;
+	uint32_t l_height = l_res->y1 - l_res->y0;
+	uint32_t l_stride = l_tile->comps[0].buf->data_width;
+
+	for (uint32_t compno = 0; compno < 3; ++compno) {
+		opj_tcd_tilecomp_t *l_tile_comp = l_tile->comps + compno;
+		opj_image_comp_t * l_img_comp = p_tcd->image->comps + compno;
+		opj_tcd_resolution_t* l_comp_res = l_tile_comp->resolutions + l_img_comp->resno_decoded;
+
+		/* the three planes must line up row for row, else the separate passes deal with them */
+		if (l_comp_res->x1 - l_comp_res->x0 != l_width ||
+				l_comp_res->y1 - l_comp_res->y0 != l_height ||
+				l_tile_comp->buf->data_width != l_stride ||
+				l_tile_comp->buf->data_height < l_height ||
+				l_tcp->tccps[compno].qmfbid != l_tcp->tccps->qmfbid)
+			return false;
 
-			opj_tcd_tilecomp_t *l_tile_comp = p_tcd->tile->comps + compno;
-			opj_tccp_t * l_tccp = p_tcd->tcp->tccps + compno;
-			opj_image_comp_t * l_img_comp = p_tcd->image->comps + compno;
+		l_shift[compno] = l_tcp->tccps[compno].m_dc_level_shift;
+		if (l_img_comp->sgnd) {
+			l_min[compno] = -(1 << (l_img_comp->prec - 1));
+			l_max[compno] = (1 << (l_img_comp->prec - 1)) - 1;
+		}
+		else {
+			l_min[compno] = 0;
+			l_max[compno] = (1 << l_img_comp->prec) - 1;
+		}
+		l_data[compno] = opj_tile_buf_get_ptr(l_tile_comp->buf, 0, 0, 0, 0);
+	}
 
-			opj_tcd_resolution_t* l_res = l_tile_comp->resolutions + l_img_comp->resno_decoded;
-			uint32_t l_width = (l_res->x1 - l_res->x0);
-			uint32_t l_height = (l_res->y1 - l_res->y0);
-			uint32_t l_stride = (l_tile_comp->x1 - l_tile_comp->x0) - l_width;
+	/* contiguous bands of rows, so each task streams through its part of the three planes once */
+	uint32_t l_num_tasks = opj_uint_max(1, opj_uint_min(p_tcd->numThreads, l_height));
+	uint32_t l_rows_per_task = (l_height + l_num_tasks - 1) / l_num_tasks;
+	bool l_reversible = l_tcp->tccps->qmfbid == 1;
+	Scheduler::instance()->run(l_num_tasks, [&](size_t taskId) {
+		uint32_t l_y0 = (uint32_t)taskId * l_rows_per_task;
+		uint32_t l_y1 = opj_uint_min(l_y0 + l_rows_per_task, l_height);
+		for (uint32_t j = l_y0; j < l_y1; ++j) {
+			size_t l_offset = (size_t)j * l_stride;
+			if (l_reversible)
+				opj_mct_decode_shift(l_data[0] + l_offset, l_data[1] + l_offset, l_data[2] + l_offset,
+									l_width, l_shift, l_min, l_max);
+			else
+				opj_mct_decode_real_shift((float*)(l_data[0] + l_offset), (float*)(l_data[1] + l_offset),
+										(float*)(l_data[2] + l_offset), l_width, l_shift, l_min, l_max);
+		}
+	});
 
-		//	assert(l_height == 0 || l_width + l_stride <= l_tile_comp->buf->data_size / l_height); 
+	return true;
+}
 
-			if (l_img_comp->sgnd) {
-				l_min = -(1 << (l_img_comp->prec - 1));
-				l_max = (1 << (l_img_comp->prec - 1)) - 1;
-			}
-			else {
-				l_min = 0;
-				l_max = (1 << l_img_comp->prec) - 1;
-			}
+static bool opj_tcd_dc_level_shift_decode ( opj_tcd_t *p_tcd, uint32_t p_first_comp )
+{
+	if (p_first_comp >= p_tcd->tile->numcomps)
+		return true;
+	opj_tcd_run(p_tcd, p_tcd->tile->numcomps - p_first_comp, [p_tcd, p_first_comp](uint32_t taskId) {
+		uint32_t compno = p_first_comp + taskId;
+		int32_t l_min = INT32_MAX, l_max = INT32_MIN;
+
+		opj_tcd_tilecomp_t *l_tile_comp = p_tcd->tile->comps + compno;
+		opj_tccp_t * l_tccp = p_tcd->tcp->tccps + compno;
+		opj_image_comp_t * l_img_comp = p_tcd->image->comps + compno;
+
+		opj_tcd_resolution_t* l_res = l_tile_comp->resolutions + l_img_comp->resno_decoded;
+		uint32_t l_width = (l_res->x1 - l_res->x0);
+		uint32_t l_height = (l_res->y1 - l_res->y0);
+		uint32_t l_stride = l_tile_comp->buf->data_width - l_width;
+
+	//	assert(l_height == 0 || l_width + l_stride <= l_tile_comp->buf->data_size / l_height); 
+
+		if (l_img_comp->sgnd) {
+			l_min = -(1 << (l_img_comp->prec - 1));
+			l_max = (1 << (l_img_comp->prec - 1)) - 1;
+		}
+		else {
+			l_min = 0;
+			l_max = (1 << l_img_comp->prec) - 1;
+		}
 
-			int32_t* l_current_ptr = opj_tile_buf_get_ptr(l_tile_comp->buf, 0, 0, 0, 0);
+		int32_t* l_current_ptr = opj_tile_buf_get_ptr(l_tile_comp->buf, 0, 0, 0, 0);
 
-			if (l_tccp->qmfbid == 1) {
-				for (uint32_t j = 0; j < l_height; ++j) {
-					for (uint32_t i = 0; i < l_width; ++i) {
-						*l_current_ptr = opj_int_clamp(*l_current_ptr + l_tccp->m_dc_level_shift, l_min, l_max);
-						++l_current_ptr;
-					}
-					l_current_ptr += l_stride;
+		if (l_tccp->qmfbid == 1) {
+			for (uint32_t j = 0; j < l_height; ++j) {
+				for (uint32_t i = 0; i < l_width; ++i) {
+					*l_current_ptr = opj_int_clamp(*l_current_ptr + l_tccp->m_dc_level_shift, l_min, l_max);
+					++l_current_ptr;
 				}
+				l_current_ptr += l_stride;
 			}
-			else {
-				for (uint32_t j = 0; j < l_height; ++j) {
-					for (uint32_t i = 0; i < l_width; ++i) {
-						float l_value = *((float *)l_current_ptr);
-						*l_current_ptr = opj_int_clamp((int32_t)opj_lrintf(l_value) + l_tccp->m_dc_level_shift, l_min, l_max); ;
-						++l_current_ptr;
-					}
-					l_current_ptr += l_stride;
+		}
+		else {
+			for (uint32_t j = 0; j < l_height; ++j) {
+				for (uint32_t i = 0; i < l_width; ++i) {
+					float l_value = *((float *)l_current_ptr);
+					*l_current_ptr = opj_int_clamp((int32_t)opj_lrintf(l_value) + l_tccp->m_dc_level_shift, l_min, l_max); ;
+					++l_current_ptr;
 				}
+				l_current_ptr += l_stride;
 			}
 		}
-
-#ifdef _OPENMP
-	}
-#endif
+	});
 
     return true;
 }
@@ -1751,7 +2074,10 @@ static void opj_tcd_code_block_dec_deallocate (opj_tcd_precinct_t * p_precinct)
         /*fprintf(stderr,"nb_code_blocks =%d\t}\n", l_nb_code_blocks);*/
 
         for (cblkno = 0; cblkno < l_nb_code_blocks; ++cblkno) {
-            opj_vec_cleanup(&l_code_block->seg_buffers);
+            if (l_code_block->chunks) {
+                opj_free(l_code_block->chunks);
+                l_code_block->chunks = 00;
+            }
             if (l_code_block->segs) {
                 opj_free(l_code_block->segs );
                 l_code_block->segs = 00;
@@ -1760,7 +2086,6 @@ static void opj_tcd_code_block_dec_deallocate (opj_tcd_precinct_t * p_precinct)
             ++l_code_block;
         }
 
-        opj_free(p_precinct->cblks.dec);
         p_precinct->cblks.dec = 00;
     }
 }
@@ -1783,20 +2108,12 @@ static void opj_tcd_code_block_enc_deallocate (opj_tcd_precinct_t * p_precinct)
 				l_code_block->owns_data = false;
             }
 
-            if (l_code_block->layers) {
-                opj_free(l_code_block->layers );
-                l_code_block->layers = 00;
-            }
-
-            if (l_code_block->passes) {
-                opj_free(l_code_block->passes );
-                l_code_block->passes = 00;
-            }
+            /* layers and passes belong to the arena */
+            l_code_block->layers = 00;
+            l_code_block->passes = 00;
             ++l_code_block;
         }
 
-        opj_free(p_precinct->cblks.enc);
-
         p_precinct->cblks.enc = 00;
     }
 }
@@ -1830,43 +2147,222 @@ uint32_t opj_tcd_get_encoded_tile_size ( opj_tcd_t *p_tcd )
     return l_data_size;
 }
 
-static bool opj_tcd_dc_level_shift_encode ( opj_tcd_t *p_tcd )
+/*
+Truncate one row of image samples to their storage precision, DC level shift them
+and scale them to the fixed point format of the irreversible path
+*/
+static void opj_tcd_convert_row_base(const int32_t* restrict p_src,
+		int32_t* restrict p_dest,
+		uint32_t p_width,
+		uint32_t p_sign_shift,
+		uint32_t p_mask,
+		int32_t p_dc_shift,
+		uint32_t p_scale_shift)
 {
-    uint32_t compno;
-    opj_tcd_tilecomp_t * l_tile_comp = 00;
-    opj_tccp_t * l_tccp = 00;
-    opj_image_comp_t * l_img_comp = 00;
-    opj_tcd_tile_t * l_tile;
-    uint32_t l_nb_elem,i;
-    int32_t * l_current_ptr;
+	for (uint32_t i = 0; i < p_width; ++i) {
+		int32_t l_value = (int32_t)(((uint32_t)p_src[i] << p_sign_shift) & p_mask) >> p_sign_shift;
+		p_dest[i] = (int32_t)((uint32_t)(l_value - p_dc_shift) << p_scale_shift);
+	}
+}
 
-    l_tile = p_tcd->tile;
-    l_tile_comp = l_tile->comps;
-    l_tccp = p_tcd->tcp->tccps;
-    l_img_comp = p_tcd->image->comps;
+#ifdef OPJ_HAVE_TARGET_KERNELS
+OPJ_TARGET_AVX2 static void opj_tcd_convert_row_avx2(const int32_t* restrict p_src,
+		int32_t* restrict p_dest,
+		uint32_t p_width,
+		uint32_t p_sign_shift,
+		uint32_t p_mask,
+		int32_t p_dc_shift,
+		uint32_t p_scale_shift)
+{
+	const __m128i l_sign_shift = _mm_cvtsi32_si128((int)p_sign_shift);
+	const __m128i l_scale_shift = _mm_cvtsi32_si128((int)p_scale_shift);
+	const __m256i l_mask = _mm256_set1_epi32((int)p_mask);
+	const __m256i l_dc_shift = _mm256_set1_epi32(p_dc_shift);
+	uint32_t i = 0;
+	for (; i + 8 <= p_width; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(p_src + i));
+		v = _mm256_sra_epi32(_mm256_and_si256(_mm256_sll_epi32(v, l_sign_shift), l_mask), l_sign_shift);
+		v = _mm256_sll_epi32(_mm256_sub_epi32(v, l_dc_shift), l_scale_shift);
+		_mm256_storeu_si256((__m256i*)(p_dest + i), v);
+	}
+	opj_tcd_convert_row_base(p_src + i, p_dest + i, p_width - i, p_sign_shift, p_mask, p_dc_shift, p_scale_shift);
+}
 
-    for (compno = 0; compno < l_tile->numcomps; compno++) {
-        l_current_ptr = opj_tile_buf_get_ptr(l_tile_comp->buf, 0, 0, 0, 0);
-        l_nb_elem = (l_tile_comp->x1 - l_tile_comp->x0) * (l_tile_comp->y1 - l_tile_comp->y0);
+OPJ_TARGET_AVX512 static void opj_tcd_convert_row_avx512(const int32_t* restrict p_src,
+		int32_t* restrict p_dest,
+		uint32_t p_width,
+		uint32_t p_sign_shift,
+		uint32_t p_mask,
+		int32_t p_dc_shift,
+		uint32_t p_scale_shift)
+{
+	const __m128i l_sign_shift = _mm_cvtsi32_si128((int)p_sign_shift);
+	const __m128i l_scale_shift = _mm_cvtsi32_si128((int)p_scale_shift);
+	const __m512i l_mask = _mm512_set1_epi32((int)p_mask);
+	const __m512i l_dc_shift = _mm512_set1_epi32(p_dc_shift);
+	/* zero-masking shifts over every lane, so that no operand is left undefined */
+	const __mmask16 l_all = 0xFFFF;
+	uint32_t i = 0;
+	for (; i + 16 <= p_width; i += 16) {
+		__m512i v = _mm512_loadu_si512((const void*)(p_src + i));
+		v = _mm512_maskz_sra_epi32(l_all, _mm512_and_si512(_mm512_maskz_sll_epi32(l_all, v, l_sign_shift), l_mask), l_sign_shift);
+		v = _mm512_maskz_sll_epi32(l_all, _mm512_sub_epi32(v, l_dc_shift), l_scale_shift);
+		_mm512_storeu_si512((void*)(p_dest + i), v);
+	}
+	opj_tcd_convert_row_base(p_src + i, p_dest + i, p_width - i, p_sign_shift, p_mask, p_dc_shift, p_scale_shift);
+}
+#endif
 
-        if (l_tccp->qmfbid == 1) {
-            for     (i = 0; i < l_nb_elem; ++i) {
-                *l_current_ptr -= l_tccp->m_dc_level_shift ;
-                ++l_current_ptr;
-            }
-        } else {
-            for (i = 0; i < l_nb_elem; ++i) {
-                *l_current_ptr = (*l_current_ptr - l_tccp->m_dc_level_shift) * (1 << 11) ;
-                ++l_current_ptr;
-            }
-        }
+typedef void (*opj_tcd_convert_row_fn)(const int32_t* restrict, int32_t* restrict, uint32_t, uint32_t,
+		uint32_t, int32_t, uint32_t);
 
-        ++l_img_comp;
-        ++l_tccp;
-        ++l_tile_comp;
-    }
+static opj_tcd_convert_row_fn opj_tcd_select_convert_row(void)
+{
+#ifdef OPJ_HAVE_TARGET_KERNELS
+	uint32_t l_features = opj_cpu_detect_features();
+	if (l_features & OPJ_CPU_AVX512)
+		return opj_tcd_convert_row_avx512;
+	if (l_features & OPJ_CPU_AVX2)
+		return opj_tcd_convert_row_avx2;
+#endif
+	return opj_tcd_convert_row_base;
+}
 
-    return true;
+/* bound once, on first use */
+static opj_tcd_convert_row_fn opj_tcd_get_convert_row(void)
+{
+	static const opj_tcd_convert_row_fn l_convert_row = opj_tcd_select_convert_row();
+	return l_convert_row;
+}
+
+void opj_tcd_init_kernels(void)
+{
+	opj_tcd_get_convert_row();
+}
+
+static bool opj_tcd_dc_level_shift_mct_encode ( opj_tcd_t *p_tcd,
+        int32_t* const* p_src,
+        const size_t* p_src_stride,
+        bool p_truncate)
+{
+	opj_tcd_tile_t * l_tile = p_tcd->tile;
+	opj_tcp_t * l_tcp = p_tcd->tcp;
+	uint32_t l_mct_comps = 0;
+
+	/* the custom MCT (mct == 2) runs on the shifted tile afterwards, in opj_tcd_mct_encode */
+	if (l_tcp->mct == 1 && l_tile->numcomps >= 3) {
+		l_mct_comps = 3;
+		for (uint32_t compno = 1; compno < 3; ++compno) {
+			if (l_tile->comps[compno].x1 - l_tile->comps[compno].x0 != l_tile->comps[0].x1 - l_tile->comps[0].x0 ||
+					l_tile->comps[compno].y1 - l_tile->comps[compno].y0 != l_tile->comps[0].y1 - l_tile->comps[0].y0) {
+				return false;
+			}
+		}
+	}
+
+	/* bands of rows: each task shifts its rows of every component, and colour transforms
+	   the rows of the first three components while they are still in cache */
+	uint32_t l_max_height = 0;
+	for (uint32_t compno = 0; compno < l_tile->numcomps; ++compno)
+		l_max_height = opj_uint_max(l_max_height, l_tile->comps[compno].y1 - l_tile->comps[compno].y0);
+	uint32_t l_num_tasks = opj_uint_max(1, opj_uint_min(p_tcd->numThreads, l_max_height));
+	opj_tcd_convert_row_fn l_convert_row = opj_tcd_get_convert_row();
+
+	Scheduler::instance()->run(l_num_tasks, [=](size_t taskId) {
+		auto shift_row = [=](uint32_t compno, uint32_t j) {
+			opj_tcd_tilecomp_t* l_tilec = l_tile->comps + compno;
+			opj_tccp_t* l_tccp = l_tcp->tccps + compno;
+			opj_image_comp_t* l_img_comp = p_tcd->image->comps + compno;
+			uint32_t l_width = l_tilec->x1 - l_tilec->x0;
+			const int32_t* l_src = p_src[compno] + (size_t)j * p_src_stride[compno];
+			int32_t* l_dest = opj_tile_buf_get_ptr(l_tilec->buf, 0, 0, 0, 0) + (size_t)j * l_width;
+
+			/* samples are stored in 1, 2 or 4 bytes, depending on their precision */
+			uint32_t l_bits = 32;
+			if (p_truncate && l_img_comp->prec <= 16)
+				l_bits = l_img_comp->prec <= 8 ? 8 : 16;
+			uint32_t l_sign_shift = l_img_comp->sgnd ? 32 - l_bits : 0;
+			uint32_t l_mask = (l_img_comp->sgnd || l_bits == 32) ? 0xFFFFFFFF : (1U << l_bits) - 1;
+			uint32_t l_scale_shift = (l_tccp->qmfbid == 1) ? 0 : 11;
+
+			l_convert_row(l_src, l_dest, l_width, l_sign_shift, l_mask, l_tccp->m_dc_level_shift, l_scale_shift);
+		};
+
+		if (l_mct_comps) {
+			opj_tcd_tilecomp_t* l_tilec = l_tile->comps;
+			uint32_t l_width = l_tilec->x1 - l_tilec->x0;
+			uint32_t l_height = l_tilec->y1 - l_tilec->y0;
+			uint32_t l_y0 = (uint32_t)(((uint64_t)taskId * l_height) / l_num_tasks);
+			uint32_t l_y1 = (uint32_t)(((uint64_t)(taskId + 1) * l_height) / l_num_tasks);
+			int32_t* l_c0 = opj_tile_buf_get_ptr(l_tile->comps[0].buf, 0, 0, 0, 0);
+			int32_t* l_c1 = opj_tile_buf_get_ptr(l_tile->comps[1].buf, 0, 0, 0, 0);
+			int32_t* l_c2 = opj_tile_buf_get_ptr(l_tile->comps[2].buf, 0, 0, 0, 0);
+			for (uint32_t j = l_y0; j < l_y1; ++j) {
+				size_t l_offset = (size_t)j * l_width;
+				shift_row(0, j);
+				shift_row(1, j);
+				shift_row(2, j);
+				if (l_tcp->tccps->qmfbid == 0)
+					opj_mct_encode_real(l_c0 + l_offset, l_c1 + l_offset, l_c2 + l_offset, l_width);
+				else
+					opj_mct_encode(l_c0 + l_offset, l_c1 + l_offset, l_c2 + l_offset, l_width);
+			}
+		}
+		for (uint32_t compno = l_mct_comps; compno < l_tile->numcomps; ++compno) {
+			uint32_t l_height = l_tile->comps[compno].y1 - l_tile->comps[compno].y0;
+			uint32_t l_y0 = (uint32_t)(((uint64_t)taskId * l_height) / l_num_tasks);
+			uint32_t l_y1 = (uint32_t)(((uint64_t)(taskId + 1) * l_height) / l_num_tasks);
+			for (uint32_t j = l_y0; j < l_y1; ++j)
+				shift_row(compno, j);
+		}
+	});
+
+	return true;
+}
+
+void opj_tcd_copy_image_data (opj_tcd_t *p_tcd, uint32_t p_tile_no)
+{
+	opj_image_t * l_image = p_tcd->image;
+	uint32_t state = opj_plugin_get_debug_state();
+	std::vector<int32_t*> l_src(l_image->numcomps);
+	std::vector<size_t> l_src_stride(l_image->numcomps);
+
+	p_tcd->tcp = &p_tcd->cp->tcps[p_tile_no];
+
+	for (uint32_t compno = 0; compno < l_image->numcomps; ++compno) {
+		opj_tcd_tilecomp_t * l_tilec = p_tcd->tile->comps + compno;
+		opj_image_comp_t * l_img_comp = l_image->comps + compno;
+		uint32_t l_offset_x = opj_uint_ceildiv(l_image->x0, l_img_comp->dx);
+		uint32_t l_offset_y = opj_uint_ceildiv(l_image->y0, l_img_comp->dy);
+		uint32_t l_image_width = opj_uint_ceildiv(l_image->x1 - l_image->x0, l_img_comp->dx);
+
+		l_src[compno] = l_img_comp->data + (l_tilec->x0 - l_offset_x) + (size_t)(l_tilec->y0 - l_offset_y) * l_image_width;
+		l_src_stride[compno] = l_image_width;
+	}
+
+	/* the plugin (or the plugin debugger) transforms the tile itself */
+	p_tcd->m_tile_data_transformed = 0;
+	if (!p_tcd->current_plugin_tile && !(state & OPJ_PLUGIN_STATE_DEBUG_ENCODE))
+		p_tcd->m_tile_data_transformed = opj_tcd_dc_level_shift_mct_encode(p_tcd, l_src.data(), l_src_stride.data(), true) ? 1 : 0;
+	if (p_tcd->m_tile_data_transformed)
+		return;
+
+	for (uint32_t compno = 0; compno < l_image->numcomps; ++compno) {
+		opj_tcd_tilecomp_t * l_tilec = p_tcd->tile->comps + compno;
+		opj_image_comp_t * l_img_comp = l_image->comps + compno;
+		uint32_t l_width = l_tilec->x1 - l_tilec->x0;
+		uint32_t l_height = l_tilec->y1 - l_tilec->y0;
+		uint32_t l_bits = l_img_comp->prec <= 8 ? 8 : (l_img_comp->prec <= 16 ? 16 : 32);
+		uint32_t l_sign_shift = l_img_comp->sgnd ? 32 - l_bits : 0;
+		uint32_t l_mask = (l_img_comp->sgnd || l_bits == 32) ? 0xFFFFFFFF : (1U << l_bits) - 1;
+		int32_t* l_dest = opj_tile_buf_get_ptr(l_tilec->buf, 0, 0, 0, 0);
+
+		for (uint32_t j = 0; j < l_height; ++j) {
+			const int32_t* l_src_row = l_src[compno] + (size_t)j * l_src_stride[compno];
+			for (uint32_t i = 0; i < l_width; ++i)
+				*(l_dest++) = (int32_t)(((uint32_t)l_src_row[i] << l_sign_shift) & l_mask) >> l_sign_shift;
+		}
+	}
 }
 
 static bool opj_tcd_mct_encode ( opj_tcd_t *p_tcd )
@@ -1876,12 +2372,8 @@ static bool opj_tcd_mct_encode ( opj_tcd_t *p_tcd )
     uint32_t samples = (uint32_t)((l_tile_comp->x1 - l_tile_comp->x0) * (l_tile_comp->y1 - l_tile_comp->y0));
     uint32_t i;
     uint8_t ** l_data = 00;
-    opj_tcp_t * l_tcp = p_tcd->tcp;
-
-    if(!p_tcd->tcp->mct) {
-        return true;
-    }
 
+    /* the RCT and ICT are applied along with the DC level shift */
     if (p_tcd->tcp->mct == 2) {
         if (! p_tcd->tcp->m_mct_coding_matrix) {
             return true;
@@ -1897,31 +2389,11 @@ static bool opj_tcd_mct_encode ( opj_tcd_t *p_tcd )
             ++l_tile_comp;
         }
 
-        if (! opj_mct_encode_custom(/* MCT data */
-                    (uint8_t*) p_tcd->tcp->m_mct_coding_matrix,
-                    /* size of components */
-                    samples,
-                    /* components */
-                    l_data,
-                    /* nb of components (i.e. size of pData) */
-                    l_tile->numcomps,
-                    /* tells if the data is signed */
-                    p_tcd->image->comps->sgnd) ) {
-            opj_free(l_data);
+        bool l_rc = opj_tcd_mct_custom(p_tcd, opj_mct_encode_custom, (uint8_t*) p_tcd->tcp->m_mct_coding_matrix, samples, l_data);
+        opj_free(l_data);
+        if (!l_rc) {
             return false;
         }
-
-        opj_free(l_data);
-    } else if (l_tcp->tccps->qmfbid == 0) {
-        opj_mct_encode_real(opj_tile_buf_get_ptr(l_tile->comps[0].buf, 0, 0, 0, 0),
-                            opj_tile_buf_get_ptr(l_tile->comps[1].buf, 0, 0, 0, 0),
-                            opj_tile_buf_get_ptr(l_tile->comps[2].buf, 0, 0, 0, 0),
-                            samples);
-    } else {
-        opj_mct_encode(opj_tile_buf_get_ptr(l_tile->comps[0].buf, 0, 0, 0, 0),
-                       opj_tile_buf_get_ptr(l_tile->comps[1].buf, 0, 0, 0, 0),
-                       opj_tile_buf_get_ptr(l_tile->comps[2].buf, 0, 0, 0, 0),
-                       samples);
     }
 
     return true;
@@ -1931,31 +2403,20 @@ static bool opj_tcd_mct_encode ( opj_tcd_t *p_tcd )
 bool opj_tcd_dwt_encode ( opj_tcd_t *p_tcd )
 {
     opj_tcd_tile_t * l_tile = p_tcd->tile;
-    int64_t compno=0;
-    bool rc = true;
-#ifdef _OPENMP
-    #pragma omp parallel default(none) private(compno) shared(p_tcd, l_tile, rc)
-    {
-        #pragma omp for
-#endif
-        for (compno = 0; compno < (int64_t)l_tile->numcomps; ++compno) {
-            opj_tcd_tilecomp_t * tile_comp = p_tcd->tile->comps + compno;
-            opj_tccp_t * l_tccp = p_tcd->tcp->tccps + compno;
-            if (l_tccp->qmfbid == 1) {
-                if (! opj_dwt_encode(tile_comp)) {
-                    rc = false;
-                    continue;
-                }
-            } else if (l_tccp->qmfbid == 0) {
-                if (! opj_dwt_encode_real(tile_comp)) {
-                    rc = false;
-                    continue;
-                }
-            }
-        }
-#ifdef _OPENMP
-    }
-#endif
+    std::atomic<bool> rc(true);
+	opj_tcd_run(p_tcd, l_tile->numcomps, [p_tcd, &rc](uint32_t compno) {
+		opj_tcd_tilecomp_t * tile_comp = p_tcd->tile->comps + compno;
+		opj_tccp_t * l_tccp = p_tcd->tcp->tccps + compno;
+		if (l_tccp->qmfbid == 1) {
+			if (! opj_dwt_encode(tile_comp, p_tcd->numThreads)) {
+				rc = false;
+			}
+		} else if (l_tccp->qmfbid == 0) {
+			if (! opj_dwt_encode_real(tile_comp, p_tcd->numThreads)) {
+				rc = false;
+			}
+		}
+	});
 
     return rc;
 }
@@ -119,8 +119,18 @@ typedef struct opj_tcd_cblk_enc {
 } opj_tcd_cblk_enc_t;
 
 
+/**
+Run of code-block data, referencing the source buffer
+*/
+typedef struct opj_tcd_seg_data_chunk {
+    uint8_t *data;
+    uint32_t len;
+} opj_tcd_seg_data_chunk_t;
+
 typedef struct opj_tcd_cblk_dec {
-    opj_vec_t seg_buffers;
+    opj_tcd_seg_data_chunk_t* chunks;	/* code-block data, in codestream order; adjacent runs are merged */
+    uint32_t numchunks;
+    uint32_t numchunksalloc;		/* kept, with the array, when the code-block is reused */
     opj_tcd_seg_t* segs;			/* segments information */
     uint32_t x0, y0, x1, y1;		/* position of the code-blocks : left upper corner (x0, y0) right low corner (x1,y1) */
     uint32_t numbps;
@@ -214,6 +224,9 @@ typedef struct opj_tcd {
     uint32_t cur_pino;
     /** info on image tile */
     opj_tcd_tile_t* tile;
+    /** holds the precincts, code-blocks and tag trees of the tile, which are
+    reused from one tile to the next */
+    opj_arena_t* arena;
     /** image header */
     opj_image_t *image;
     /** coding parameters */
@@ -224,8 +237,15 @@ typedef struct opj_tcd {
     uint32_t tcd_tileno;
     /** indicate if the tcd is a decoder. */
     uint32_t m_is_decoder : 1;
+    /** tile has already been transformed, T1 coded and rate allocated */
+    uint32_t m_tile_precoded : 1;
+    /** tile buffers already hold DC shifted, colour transformed samples */
+    uint32_t m_tile_data_transformed : 1;
     opj_plugin_tile_t* current_plugin_tile;
 	uint32_t numThreads;
+    /** caller-owned interleaved output of the decoder, or NULL.
+    When set, the DC level shift is applied while writing into it */
+    const opj_decode_buffer_t* decode_buffer;
 } opj_tcd_t;
 
 /** @name Exported functions */
@@ -283,11 +303,6 @@ void opj_tcd_makelayer_fixed(opj_tcd_t *tcd, uint32_t layno, uint32_t final);
 
 void opj_tcd_rateallocate_fixed(opj_tcd_t *tcd);
 
-void opj_tcd_makelayer(	opj_tcd_t *tcd,
-                        uint32_t layno,
-                        double thresh,
-                        uint32_t final);
-
 bool opj_tcd_rateallocate(	opj_tcd_t *tcd,
                             uint32_t * p_data_written,
                             uint32_t len,
@@ -315,6 +330,21 @@ bool opj_tcd_encode_tile(   opj_tcd_t *p_tcd,
                             uint32_t p_len,
                             struct opj_codestream_info *p_cstr_info);
 
+/**
+ * Runs DC shift, MCT, DWT, T1 and rate allocation on a tile, leaving only T2
+ * to the following opj_tcd_encode_tile calls. Tiles held by different tile coders
+ * can be pre-coded concurrently.
+ * @param	p_tcd			Tile Coder handle
+ * @param	p_tile_no		Index of the tile to encode.
+ * @param	p_len			Maximum length of the first tile part
+ * @param	p_cstr_info		Codestream information structure
+ * @return  true if the coding is successful.
+*/
+bool opj_tcd_precode_tile(  opj_tcd_t *p_tcd,
+                            uint32_t p_tile_no,
+                            uint32_t p_len,
+                            struct opj_codestream_info *p_cstr_info);
+
 
 /**
 Decode a tile from a buffer into a raw image
@@ -331,6 +361,14 @@ bool opj_tcd_decode_tile(   opj_tcd_t *tcd,
                             opj_event_mgr_t *manager);
 
 
+/**
+ * DC shifts and clamps the decoded tile, and packs it into the decode buffer of the tile coder.
+ *
+ * @param	p_tcd			TCD handle, with a decode buffer set.
+ * @param	p_output_image	output image, whose components locate the buffer in the image.
+ */
+void opj_tcd_write_decode_buffer(opj_tcd_t *p_tcd, opj_image_t* p_output_image);
+
 /**
  * Copies tile data from the system onto the given memory block.
  */
@@ -355,6 +393,21 @@ uint32_t opj_tcd_get_encoded_tile_size ( opj_tcd_t *p_tcd );
 bool opj_tcd_init_encode_tile (	opj_tcd_t *p_tcd,
                                 uint32_t p_tile_no, opj_event_mgr_t* p_manager );
 
+/**
+ * Copies the tile region of the image components into the tile buffers.
+ * Unless a plugin codes the tile, the DC level shift and forward MCT are applied
+ * in the same pass, and opj_tcd_precode_tile does not repeat them.
+ *
+ * @param	p_tcd		TCD handle, with the tile buffers allocated.
+ * @param	p_tile_no	index of the tile.
+ */
+void opj_tcd_copy_image_data (opj_tcd_t *p_tcd, uint32_t p_tile_no);
+
+/**
+ * Binds the widest tile conversion kernels the CPU supports (see cpu_features.h).
+ */
+void opj_tcd_init_kernels(void);
+
 /**
  * Copies tile data from the given memory block onto the system.
  */
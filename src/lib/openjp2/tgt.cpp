@@ -63,7 +63,7 @@
 ==========================================================
 */
 
-opj_tgt_tree_t *opj_tgt_create(uint32_t numleafsh, uint32_t numleafsv, opj_event_mgr_t *manager)
+opj_tgt_tree_t *opj_tgt_create(uint32_t numleafsh, uint32_t numleafsv, opj_arena_t *arena, opj_event_mgr_t *manager)
 {
     int32_t nplh[32];
     int32_t nplv[32];
@@ -76,7 +76,10 @@ opj_tgt_tree_t *opj_tgt_create(uint32_t numleafsh, uint32_t numleafsv, opj_event
     uint32_t numlvls;
     uint32_t n;
 
-    tree = (opj_tgt_tree_t *) opj_calloc(1,sizeof(opj_tgt_tree_t));
+    if (arena)
+        tree = (opj_tgt_tree_t *) opj_arena_alloc(arena, sizeof(opj_tgt_tree_t));
+    else
+        tree = (opj_tgt_tree_t *) opj_calloc(1,sizeof(opj_tgt_tree_t));
     if(!tree) {
         opj_event_msg(manager, EVT_ERROR, "Not enough memory to create Tag-tree\n");
         return 00;
@@ -97,17 +100,22 @@ opj_tgt_tree_t *opj_tgt_create(uint32_t numleafsh, uint32_t numleafsv, opj_event
         ++numlvls;
     } while (n > 1);
 
+    tree->arena = arena;
+
     /* ADD */
     if (tree->numnodes == 0) {
-        opj_free(tree);
+        opj_tgt_destroy(tree);
         opj_event_msg(manager, EVT_WARNING, "tgt_create tree->numnodes == 0, no tree created.\n");
         return 00;
     }
 
-    tree->nodes = (opj_tgt_node_t*) opj_calloc(tree->numnodes, sizeof(opj_tgt_node_t));
+    if (arena)
+        tree->nodes = (opj_tgt_node_t*) opj_arena_alloc(arena, tree->numnodes * sizeof(opj_tgt_node_t));
+    else
+        tree->nodes = (opj_tgt_node_t*) opj_calloc(tree->numnodes, sizeof(opj_tgt_node_t));
     if(!tree->nodes) {
         opj_event_msg(manager, EVT_ERROR, "Not enough memory to create Tag-tree nodes\n");
-        opj_free(tree);
+        opj_tgt_destroy(tree);
         return 00;
     }
     tree->nodes_size = tree->numnodes * (uint32_t)sizeof(opj_tgt_node_t);
@@ -190,14 +198,20 @@ opj_tgt_tree_t *opj_tgt_init(opj_tgt_tree_t * p_tree,uint32_t p_num_leafs_h, uin
         l_node_size = p_tree->numnodes * (uint32_t)sizeof(opj_tgt_node_t);
 
         if (l_node_size > p_tree->nodes_size) {
-            opj_tgt_node_t* new_nodes = (opj_tgt_node_t*) opj_realloc(p_tree->nodes, l_node_size);
+            opj_tgt_node_t* new_nodes = NULL;
+            /* every node is relinked below, so the old ones need not be kept */
+            if (p_tree->arena)
+                new_nodes = (opj_tgt_node_t*) opj_arena_alloc(p_tree->arena, l_node_size);
+            else
+                new_nodes = (opj_tgt_node_t*) opj_realloc(p_tree->nodes, l_node_size);
             if (! new_nodes) {
                 opj_event_msg(p_manager, EVT_ERROR, "Not enough memory to reinitialize the tag tree\n");
                 opj_tgt_destroy(p_tree);
                 return 00;
             }
             p_tree->nodes = new_nodes;
-            memset(((char *) p_tree->nodes) + p_tree->nodes_size, 0 , l_node_size - p_tree->nodes_size);
+            if (!p_tree->arena)
+                memset(((char *) p_tree->nodes) + p_tree->nodes_size, 0 , l_node_size - p_tree->nodes_size);
             p_tree->nodes_size = l_node_size;
         }
         l_node = p_tree->nodes;
@@ -233,7 +247,7 @@ opj_tgt_tree_t *opj_tgt_init(opj_tgt_tree_t * p_tree,uint32_t p_num_leafs_h, uin
 
 void opj_tgt_destroy(opj_tgt_tree_t *p_tree)
 {
-    if (! p_tree) {
+    if (! p_tree || p_tree->arena) {
         return;
     }
 
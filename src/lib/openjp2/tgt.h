@@ -88,6 +88,7 @@ typedef struct opj_tgt_tree {
     uint32_t numnodes;
     opj_tgt_node_t *nodes;
     uint32_t  nodes_size;		/* maximum size taken by nodes */
+    opj_arena_t *arena;		/* arena holding the tree and its nodes, if any */
 } opj_tgt_tree_t;
 
 
@@ -98,12 +99,14 @@ typedef struct opj_tgt_tree {
 Create a tag-tree
 @param numleafsh Width of the array of leafs of the tree
 @param numleafsv Height of the array of leafs of the tree
+@param arena Arena to allocate the tree from, or NULL to allocate it on the heap
 @return Returns a new tag-tree if successful, returns NULL otherwise
 */
-opj_tgt_tree_t *opj_tgt_create(uint32_t numleafsh, uint32_t numleafsv, opj_event_mgr_t *manager);
+opj_tgt_tree_t *opj_tgt_create(uint32_t numleafsh, uint32_t numleafsv, opj_arena_t *arena, opj_event_mgr_t *manager);
 
 /**
- * Reinitialises a tag-tree from an exixting one.
+ * Reinitialises a tag-tree from an exixting one. Nodes of a tree allocated
+ * from an arena are taken from the same arena when the tree grows.
  *
  * @param	p_tree				the tree to reinitialize.
  * @param	p_num_leafs_h		the width of the array of leafs of the tree
@@ -115,7 +118,7 @@ opj_tgt_tree_t *opj_tgt_init(opj_tgt_tree_t * p_tree,
                              uint32_t  p_num_leafs_h,
                              uint32_t  p_num_leafs_v, opj_event_mgr_t *p_manager);
 /**
-Destroy a tag-tree, liberating memory
+Destroy a tag-tree, liberating memory unless it belongs to an arena
 @param tree Tag-tree to destroy
 */
 void opj_tgt_destroy(opj_tgt_tree_t *tree);
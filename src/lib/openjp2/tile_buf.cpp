@@ -69,6 +69,17 @@ bool opj_tile_buf_create_component(opj_tcd_tilecomp_t* tilec,
     }
 
 
+    /* for decode, only resolutions up to the reduction factor are ever written,
+       and they all fit in the top left hand corner of the highest one */
+    if (output_image) {
+        opj_tcd_resolution_t* max_res = tilec->resolutions + tilec->minimum_num_resolutions - 1;
+        comp->data_width = max_res->x1 - max_res->x0;
+        comp->data_height = max_res->y1 - max_res->y0;
+    } else {
+        comp->data_width = tilec->x1 - tilec->x0;
+        comp->data_height = tilec->y1 - tilec->y0;
+    }
+
     /* for encode, we don't need to allocate resolutions */
     if (!output_image) {
         opj_tile_buf_destroy_component(tilec->buf);
@@ -77,8 +88,10 @@ bool opj_tile_buf_create_component(opj_tcd_tilecomp_t* tilec,
     }
 
 
+    /* region of the highest decoded resolution */
     component_output_rect = comp->dim;
-
+    opj_rect_ceildivpow2(&component_output_rect,
+                         (int32_t)(tilec->numresolutions - tilec->minimum_num_resolutions));
 
     /* fill resolutions vector */
     for (resno = (int32_t)(tilec->numresolutions-1); resno >= 0; --resno) {
@@ -95,38 +108,60 @@ bool opj_tile_buf_create_component(opj_tcd_tilecomp_t* tilec,
         res->origin.x = tcd_res->x0;
         res->origin.y = tcd_res->y0;
 
-        for (bandno = 0; bandno < tcd_res->numbands; ++bandno) {
-            opj_tcd_band_t* band = tcd_res->bands + bandno;
-            opj_rect_t  band_rect;
-            opj_rect_init(&band_rect,
-                          band->x0,
-                          band->y0,
-                          band->x1,
-                          band->y1
-                         );
-
-            res->band_region[bandno].dim = component_output_rect;
-            if (resno > 0) {
-
-                /*For next level down, E' = ceil((E-b)/2) where b in {0,1} identifies band  */
-                opj_pt_t shift;
-                shift.x = band->bandno & 1;
-                shift.y = band->bandno & 2;
-
-                opj_rect_pan(&res->band_region[bandno].dim, &shift);
-                opj_rect_ceildivpow2(&res->band_region[bandno].dim, 1);
-
-                /* boundary padding */
-                opj_rect_grow(&res->band_region[bandno].dim, irreversible ? 3 : 2);
+        /* resolutions above the reduction factor are never synthesized */
+        if (resno >= (int32_t)tilec->minimum_num_resolutions) {
+            opj_rect_init(&res->dim, 0, 0, 0, 0);
+            res->num_bands = 0;
+            comp->resolutions.push_back(res);
+            continue;
+        }
+        res->dim = component_output_rect;
 
+        if (resno == 0) {
+            res->band_region[0].dim = component_output_rect;
+        } else {
+            /* Sub-band samples needed to synthesize the region:
+               low pass sample i sits at 2i, and high pass sample i at 2i+1,
+               so E' = [floor(E0/2), ceil(E1/2)) in every band, grown by the
+               support of the synthesis filter and clipped to the band */
+            opj_tcd_resolution_t* prev_tcd_res = tcd_res - 1;
+            opj_rect_t prev_res_rect;
+            int32_t margin = irreversible ? 3 : 2;
+            opj_rect_t band_rect;
+            opj_rect_init(&band_rect,
+                          (component_output_rect.x0 >> 1) - margin,
+                          (component_output_rect.y0 >> 1) - margin,
+                          ((component_output_rect.x1 + 1) >> 1) + margin,
+                          ((component_output_rect.y1 + 1) >> 1) + margin);
+
+            for (bandno = 0; bandno < tcd_res->numbands; ++bandno) {
+                opj_tcd_band_t* band = tcd_res->bands + bandno;
+                opj_rect_t full_band_rect;
+                opj_rect_init(&full_band_rect,
+                              band->x0,
+                              band->y0,
+                              band->x1,
+                              band->y1);
+                if (!opj_rect_clip(&band_rect, &full_band_rect, &res->band_region[bandno].dim))
+                    opj_rect_init(&res->band_region[bandno].dim, 0, 0, 0, 0);
             }
 
+            /* the low pass samples in both directions make up
+               the region of the next resolution down */
+            opj_rect_init(&prev_res_rect,
+                          prev_tcd_res->x0,
+                          prev_tcd_res->y0,
+                          prev_tcd_res->x1,
+                          prev_tcd_res->y1);
+            if (!opj_rect_clip(&band_rect, &prev_res_rect, &component_output_rect))
+                opj_rect_init(&component_output_rect, 0, 0, 0, 0);
+        }
+
+        for (bandno = 0; bandno < tcd_res->numbands; ++bandno) {
             /* add code block padding around region */
             (res->band_region + bandno)->data_dim = (res->band_region + bandno)->dim;
             opj_rect_grow2(&(res->band_region + bandno)->data_dim, cblkw, cblkh);
-
         }
-        component_output_rect = res->band_region[0].dim;
         res->num_bands = tcd_res->numbands;
         comp->resolutions.push_back(res);
     }
@@ -152,7 +187,7 @@ int32_t* opj_tile_buf_get_ptr(opj_tile_buf_component_t* buf,
 {
 	(void)resno;
 	(void)bandno;
-    return buf->data + (uint64_t)offsetx + (uint64_t)offsety* (buf->tile_dim.x1 - buf->tile_dim.x0);
+    return buf->data + (uint64_t)offsetx + (uint64_t)offsety * buf->data_width;
 
 }
 
@@ -198,7 +233,7 @@ bool opj_tile_buf_alloc_component_data_decode(opj_tile_buf_component_t* buf)
         return false;
 
     if (!buf->data ) {
-        int64_t area = opj_rect_get_area(&buf->tile_dim);
+        uint64_t area = (uint64_t)buf->data_width * buf->data_height;
 		if (area) {
 			buf->data = (int32_t *)opj_aligned_malloc(area * sizeof(int32_t));
 			if (!buf->data) {
@@ -238,13 +273,32 @@ bool opj_tile_buf_hit_test(opj_tile_buf_component_t* comp, opj_rect_t* rect)
         opj_rect_t dummy;
         uint32_t j;
         for (j = 0; j < res->num_bands; ++j) {
-            if (opj_rect_clip(&(res->band_region + j)->dim, rect, &dummy))
+            if (opj_rect_clip(&(res->band_region + j)->dim, rect, &dummy) &&
+                    opj_rect_is_non_degenerate(&dummy))
                 return true;
         }
     }
     return false;
 }
 
+bool opj_tile_buf_hit_test_band(opj_tile_buf_component_t* comp,
+                                uint32_t resno,
+                                uint32_t bandno,
+                                opj_rect_t* rect)
+{
+    opj_tile_buf_resolution_t* res = NULL;
+    opj_rect_t dummy;
+    if (!comp || !rect || resno >= comp->resolutions.size())
+        return false;
+
+    res = comp->resolutions[comp->resolutions.size() - 1 - resno];
+    if (!res || bandno >= res->num_bands)
+        return false;
+
+    return opj_rect_clip(&(res->band_region + bandno)->dim, rect, &dummy) &&
+           opj_rect_is_non_degenerate(&dummy);
+}
+
 opj_pt_t opj_tile_buf_get_uninterleaved_range(opj_tile_buf_component_t* comp,
         uint32_t resno,
         bool is_even,
@@ -254,48 +308,40 @@ opj_pt_t opj_tile_buf_get_uninterleaved_range(opj_tile_buf_component_t* comp,
     opj_tile_buf_resolution_t* res= NULL;
     opj_tile_buf_resolution_t* prev_res = NULL;
     opj_tile_buf_band_t *band= NULL;
+    int32_t origin, size;
     memset(&rc, 0, sizeof(opj_pt_t));
-    if (!comp)
+    if (!comp || resno == 0 || resno >= comp->resolutions.size())
         return rc;
 
     res = comp->resolutions[comp->resolutions.size() - 1 - resno];
-    if (!res)
-        return rc;
-
     prev_res = comp->resolutions[comp->resolutions.size() - 1 - resno+1];
+    if (!res || !prev_res || !res->num_bands)
+        return rc;
 
-    if (resno == 0) {
-        band = res->band_region;
+    /* band_region[0] is high pass horizontally and low pass vertically,
+       band_region[1] is the reverse, and band_region[2] is high pass in both directions */
+    if (!is_even) {
+        band = res->band_region + 2;
     } else {
-        if (!is_even) {
-            band = res->band_region + 2;
-        } else {
-            band = is_horizontal ? res->band_region + 1 : res->band_region;
-        }
+        band = is_horizontal ? res->band_region + 1 : res->band_region;
     }
 
+    /* low pass bands start at ceil(origin/2), and high pass bands at floor(origin/2) */
     if (is_horizontal) {
-        rc.x = band->dim.x0 - prev_res->origin.x;
-        rc.y = band->dim.x1 - prev_res->origin.x;
+        origin = is_even ? prev_res->origin.x : (res->origin.x >> 1);
+        size = is_even ? prev_res->bounds.x : res->bounds.x - prev_res->bounds.x;
+        rc.x = band->dim.x0 - origin;
+        rc.y = band->dim.x1 - origin;
     } else {
-        rc.x = band->dim.y0 - prev_res->origin.y;
-        rc.y = band->dim.y1 - prev_res->origin.y;
+        origin = is_even ? prev_res->origin.y : (res->origin.y >> 1);
+        size = is_even ? prev_res->bounds.y : res->bounds.y - prev_res->bounds.y;
+        rc.x = band->dim.y0 - origin;
+        rc.y = band->dim.y1 - origin;
     }
 
     /* clip */
     rc.x = opj_int_max(0, rc.x);
-
-    /* if resno == 0, then prev_res is null */
-    if (resno == 0) {
-        rc.y = opj_int_min(rc.y, is_horizontal ? res->bounds.x : res->bounds.y);
-    } else {
-        if (is_even)
-            rc.y = opj_int_min(rc.y, is_horizontal ? prev_res->bounds.x : prev_res->bounds.y);
-        else
-            rc.y = opj_int_min(rc.y,
-                               is_horizontal ? res->bounds.x - prev_res->bounds.x : res->bounds.y - prev_res->bounds.y);
-
-    }
+    rc.y = opj_int_max(rc.x, opj_int_min(rc.y, size));
 
     return rc;
 
@@ -306,37 +352,51 @@ opj_pt_t opj_tile_buf_get_interleaved_range(opj_tile_buf_component_t* comp,
         bool is_horizontal)
 {
     opj_pt_t rc;
-    opj_pt_t even;
-    opj_pt_t odd;
     opj_tile_buf_resolution_t* res = NULL;
     memset(&rc, 0, sizeof(opj_pt_t));
-    if (!comp)
+    if (!comp || resno >= comp->resolutions.size())
         return rc;
 
     res = comp->resolutions[comp->resolutions.size()- 1 - resno];
     if (!res)
         return rc;
 
-    even = opj_tile_buf_get_uninterleaved_range(comp, resno, true, is_horizontal);
-    odd = opj_tile_buf_get_uninterleaved_range(comp, resno, false, is_horizontal);
-
-    rc.x = opj_int_min( (even.x <<1), (odd.x << 1) + 1 );
-    rc.y = opj_int_max( (even.y<< 1),  (odd.y << 1) + 1);
+    if (is_horizontal) {
+        rc.x = res->dim.x0 - res->origin.x;
+        rc.y = res->dim.x1 - res->origin.x;
+    } else {
+        rc.x = res->dim.y0 - res->origin.y;
+        rc.y = res->dim.y1 - res->origin.y;
+    }
 
     /* clip to resolution bounds */
     rc.x = opj_int_max(0, rc.x);
-    rc.y = opj_int_min(rc.y, is_horizontal ? res->bounds.x : res->bounds.y);
+    rc.y = opj_int_max(rc.x, opj_int_min(rc.y, is_horizontal ? res->bounds.x : res->bounds.y));
     return rc;
 }
 
 int32_t opj_tile_buf_get_max_interleaved_range(opj_tile_buf_component_t* comp)
 {
-    opj_pt_t even, odd;
-    if (!comp || comp->resolutions.empty())
+    int32_t rc = 0;
+    uint32_t resno;
+    if (!comp)
         return 0;
-    even = opj_tile_buf_get_interleaved_range(comp, (uint32_t)comp->resolutions.size() - 1, true);
-    odd = opj_tile_buf_get_interleaved_range(comp, (uint32_t)comp->resolutions.size() - 1, false);
-
-    return opj_int_max(even.y - even.x, odd.y - odd.x);
+    for (resno = 1; resno < comp->resolutions.size(); ++resno) {
+        opj_tile_buf_resolution_t* res = comp->resolutions[comp->resolutions.size() - 1 - resno];
+        uint32_t k;
+        if (!res->num_bands)
+            break;
+        for (k = 0; k < 2; ++k) {
+            bool is_horizontal = (k == 0);
+            int32_t odd_top_left_bit = (is_horizontal ? res->origin.x : res->origin.y) & 1;
+            opj_pt_t even = opj_tile_buf_get_uninterleaved_range(comp, resno, true, is_horizontal);
+            opj_pt_t odd = opj_tile_buf_get_uninterleaved_range(comp, resno, false, is_horizontal);
+
+            /* span of interleaved locations touched by the sub-band samples */
+            int32_t start = opj_int_min((even.x << 1) + odd_top_left_bit, (odd.x << 1) + (odd_top_left_bit ^ 1));
+            int32_t end = opj_int_max((even.y << 1) + odd_top_left_bit, (odd.y << 1) + (odd_top_left_bit ^ 1));
+            rc = opj_int_max(rc, end - start);
+        }
+    }
+    return rc;
 }
-
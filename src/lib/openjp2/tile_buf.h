@@ -36,6 +36,7 @@ typedef struct opj_tile_buf_band {
 } opj_tile_buf_band_t;
 
 typedef struct opj_tile_buf_resolution {
+    opj_rect_t dim;			/* region of resolution to be synthesized (canvas coordinates) */
     opj_tile_buf_band_t band_region[3];
     uint32_t num_bands;
     opj_pt_t origin;		/* resolution origin, in canvas coordinates */
@@ -53,6 +54,9 @@ typedef struct opj_tile_buf_component {
     opj_rect_t dim;		  /* canvas coordinates of region */
     opj_rect_t tile_dim;  /* canvas coordinates of tile */
 
+    uint32_t data_width;	/* dimensions of the data array: the full tile for encode, and */
+    uint32_t data_height;	/* the highest decoded resolution for decode */
+
 } opj_tile_buf_component_t;
 
 /* offsets are in canvas coordinate system*/
@@ -77,17 +81,28 @@ void opj_tile_buf_destroy_component(opj_tile_buf_component_t* comp);
 */
 bool opj_tile_buf_hit_test(opj_tile_buf_component_t* comp, opj_rect_t* rect);
 
-/* sub-band coordinates */
+/* Check if rect overlaps with the samples of sub-band bandno of resolution resno
+   that are needed to synthesize the region, filter support included.
+   rect coordinates must be stored in sub-band canvas coordinates
+*/
+bool opj_tile_buf_hit_test_band(opj_tile_buf_component_t* comp,
+                                uint32_t resno,
+                                uint32_t bandno,
+                                opj_rect_t* rect);
+
+/* range of sub-band samples needed to synthesize the region of resolution resno,
+   in sub-band coordinates */
 opj_pt_t opj_tile_buf_get_uninterleaved_range(opj_tile_buf_component_t* comp,
         uint32_t resno,
         bool is_even,
         bool is_horizontal);
 
 
-/* resolution coordinates */
+/* range of resolution resno that must be synthesized, in resolution coordinates */
 opj_pt_t opj_tile_buf_get_interleaved_range(opj_tile_buf_component_t* comp,
         uint32_t resno,
         bool is_horizontal);
 
+/* largest span of interleaved locations touched by any synthesized resolution */
 int32_t opj_tile_buf_get_max_interleaved_range(opj_tile_buf_component_t* comp);
 
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2012, Mathieu Malaterre
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Decoding into a caller buffer (opj_set_decode_buffer) must give the samples of a
+ * normal decode, for the whole image and for a decode area, at 8 and 16 bits.
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "unit_test_common.h"
+
+#define J2K_CFMT 0
+
+static const char outputfile[] = "testdecodebuffer.j2k";
+
+static int32_t sample(uint32_t compno, uint32_t x, uint32_t y, void* data)
+{
+    (void)data;
+    return ((x * (compno + 1) + y * 3) & 0x80) ? 255 : 0;
+}
+
+/* irreversible, several tiles, and a rate low enough for decoded samples to need clamping */
+static bool encode(uint32_t width, uint32_t height)
+{
+    opj_cparameters_t parameters;
+    opj_image_t *image;
+    bool bSuccess;
+
+    image = test_image_create(3, width, height, sample, 00);
+    if (!image)
+        return false;
+    opj_set_default_encoder_parameters(&parameters);
+    parameters.cod_format = J2K_CFMT;
+    parameters.irreversible = 1;
+    parameters.tcp_numlayers = 1;
+    parameters.tcp_rates[0] = 20;
+    parameters.cp_disto_alloc = 1;
+    parameters.tcp_mct = 1;
+    parameters.tile_size_on = true;
+    parameters.cp_tdx = 64;
+    parameters.cp_tdy = 64;
+    bSuccess = test_encode(image, &parameters, outputfile);
+    opj_image_destroy(image);
+    return bSuccess;
+}
+
+/* compare a buffer decode with a normal decode of the same area */
+static bool check(uint32_t prec, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+    size_t sample_size = prec == 8 ? 1 : 2;
+    test_decode_options_t options;
+    opj_decode_buffer_t buffer;
+    opj_image_t *ref, *image;
+    uint32_t compno, x, y;
+    bool bSuccess = true;
+
+    test_decode_options_init(&options);
+    options.numThreads = 1;
+    options.x0 = x0;
+    options.y0 = y0;
+    options.x1 = x1;
+    options.y1 = y1;
+    ref = test_decode(outputfile, &options);
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.prec = prec;
+    options.numThreads = 4;
+    options.buffer = &buffer;
+    image = test_decode(outputfile, &options);
+    if (!ref || !image) {
+        bSuccess = false;
+    } else if (image->comps[0].w != ref->comps[0].w || image->comps[0].h != ref->comps[0].h) {
+        fprintf( stderr, "Decode buffer covers %ux%u pixels instead of %ux%u\n",
+                 image->comps[0].w, image->comps[0].h, ref->comps[0].w, ref->comps[0].h );
+        bSuccess = false;
+    } else {
+        for (y = 0; bSuccess && y < ref->comps[0].h; y++) {
+            for (x = 0; bSuccess && x < ref->comps[0].w; x++) {
+                for (compno = 0; compno < 3; compno++) {
+                    const uint8_t* sample = buffer.data + y * buffer.stride + (x * 3 + compno) * sample_size;
+                    int32_t expected = ref->comps[compno].data[y * ref->comps[0].w + x];
+                    int32_t value = prec == 8 ? *sample : *(const uint16_t*)sample;
+                    if (value != expected) {
+                        fprintf( stderr, "%u bit buffer: component %u at (%u,%u) is %d instead of %d\n",
+                                 prec, compno, x, y, value, expected );
+                        bSuccess = false;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    free(buffer.data);
+    opj_image_destroy(image);
+    opj_image_destroy(ref);
+    return bSuccess;
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if( !encode(200, 150) )
+        return 1;
+    if( !check(8, 0, 0, 0, 0) || !check(16, 0, 0, 0, 0) ||
+            !check(8, 30, 20, 170, 141) || !check(16, 30, 20, 170, 141) )
+        return 1;
+
+    puts( "end" );
+    return 0;
+}
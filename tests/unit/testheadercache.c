@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2012, Mathieu Malaterre
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * With the header cache on (opj_set_header_cache_size), files opened again must decode
+ * as they do without it: once the headers come from the cache, and once more with the
+ * cached tile-part index, for the whole image and for a single tile. A stream with a
+ * TLM marker must keep the tile-part index it gives, without a warning, when its header
+ * comes from the cache.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unit_test_common.h"
+
+#define J2K_CFMT 0
+
+static const char outputfile[] = "testheadercache.j2k";
+static const char tiledfile[] = "testheadercache_tiled.j2k";
+static const char tlmfile[] = "testheadercache_tlm.j2k";
+
+static int32_t sample(uint32_t compno, uint32_t x, uint32_t y, void* data)
+{
+    (void)data;
+    return (int32_t)((x * (compno + 1) + y * (3 - compno)) & 0xFF);
+}
+
+/* a tiled RGB image, with two layers so that tiles have more than one packet */
+static bool encode(const char* file, uint32_t width, uint32_t height, uint32_t tile_size)
+{
+    opj_cparameters_t parameters;
+    opj_image_t *image;
+    bool bSuccess;
+
+    image = test_image_create(3, width, height, sample, 00);
+    if (!image)
+        return false;
+    opj_set_default_encoder_parameters(&parameters);
+    parameters.cod_format = J2K_CFMT;
+    parameters.tcp_numlayers = 2;
+    parameters.tcp_rates[0] = 10;
+    parameters.tcp_rates[1] = 0;
+    parameters.cp_disto_alloc = 1;
+    parameters.tcp_mct = 1;
+    parameters.tile_size_on = true;
+    parameters.cp_tdx = tile_size;
+    parameters.cp_tdy = tile_size;
+    bSuccess = test_encode(image, &parameters, file);
+    opj_image_destroy(image);
+    return bSuccess;
+}
+
+/* decode the whole image, or only tile tile_index when it is not -1 */
+static opj_image_t* decode(const char* file, int tile_index)
+{
+    test_decode_options_t options;
+
+    test_decode_options_init(&options);
+    options.tile_index = tile_index;
+    return test_decode(file, &options);
+}
+
+/*
+Write to dest the codestream src with a TLM marker in its main header, listing every
+tile-part with its tile number on 16 bits and its length on 32 bits.
+*/
+static bool write_tlm_file(const char* src, const char* dest)
+{
+    uint8_t *data, *out = 00;
+    size_t len = 0, first_sot = 2, pos, nb_tps = 0, out_len = 0;
+    bool bSuccess = false;
+
+    data = test_read_file(src, &len);
+    if (!data)
+        return false;
+    while (first_sot + 4 <= len && test_read_u16(data + first_sot) != 0xFF90)
+        first_sot += 2 + test_read_u16(data + first_sot + 2);
+    for (pos = first_sot; pos + 10 <= len && test_read_u16(data + pos) == 0xFF90 &&
+            test_read_u32(data + pos + 6); pos += test_read_u32(data + pos + 6))
+        nb_tps++;
+    if (nb_tps && 4 + 6 * nb_tps <= 0xFFFF)
+        out = (uint8_t*)malloc(len + 6 + 6 * nb_tps);
+    if (out) {
+        uint8_t* tlm = out + first_sot;
+        memcpy(out, data, first_sot);
+        test_write_u16(tlm, 0xFF55);
+        test_write_u16(tlm + 2, (uint32_t)(4 + 6 * nb_tps));
+        tlm[4] = 0;     /* Ztlm */
+        tlm[5] = 0x60;  /* Stlm: 16 bit Ttlm, 32 bit Ptlm */
+        tlm += 6;
+        for (pos = first_sot; nb_tps--; pos += test_read_u32(data + pos + 6)) {
+            test_write_u16(tlm, test_read_u16(data + pos + 4));
+            test_write_u32(tlm + 2, test_read_u32(data + pos + 6));
+            tlm += 6;
+        }
+        memcpy(tlm, data + first_sot, len - first_sot);
+        out_len = (size_t)(tlm - out) + len - first_sot;
+        bSuccess = test_write_file(dest, out, out_len);
+    }
+    free(out);
+    free(data);
+    return bSuccess;
+}
+
+static bool same_image(const opj_image_t* a, const opj_image_t* b, const char* what)
+{
+    if (!test_same_image(a, b)) {
+        fprintf( stderr, "%s: decoded image differs\n", what );
+        return false;
+    }
+    return true;
+}
+
+/* with a TLM marker, a cached header must give the tiles as they are without the cache */
+static bool check_tlm(void)
+{
+    const int tile_indices[3] = { 7, 7, 11 };
+    opj_image_t *refs[3], *images[3];
+    uint32_t nb_warnings;
+    bool bSuccess = true;
+    int i;
+
+    if( !encode(tiledfile, 520, 390, 130) || !write_tlm_file(tiledfile, tlmfile) ) {
+        fprintf( stderr, "Failed to write %s\n", tlmfile );
+        return false;
+    }
+    nb_warnings = test_warning_count();
+    for (i = 0; i < 3; i++)
+        refs[i] = decode(tlmfile, tile_indices[i]);
+
+    opj_set_header_cache_size(4);
+    for (i = 0; i < 3; i++)
+        images[i] = decode(tlmfile, tile_indices[i]);
+    opj_set_header_cache_size(0);
+    if (test_warning_count() != nb_warnings) {
+        fprintf( stderr, "TLM marker: unexpected warnings\n" );
+        bSuccess = false;
+    }
+
+    bSuccess = same_image(refs[0], images[0], "TLM marker, first open") &&
+               same_image(refs[1], images[1], "TLM marker, cached header") &&
+               same_image(refs[2], images[2], "TLM marker, cached header, other tile") &&
+               bSuccess;
+
+    for (i = 0; i < 3; i++) {
+        opj_image_destroy(images[i]);
+        opj_image_destroy(refs[i]);
+    }
+    return bSuccess;
+}
+
+int main(int argc, char *argv[])
+{
+    const int tile_index = 7;
+    opj_image_t *ref, *ref_tile;
+    opj_image_t *images[4];
+    bool bSuccess;
+    int i;
+    (void)argc;
+    (void)argv;
+
+    if( !encode(outputfile, 256, 192, 64) )
+        return 1;
+
+    /* without the cache */
+    ref = decode(outputfile, -1);
+    ref_tile = decode(outputfile, tile_index);
+
+    /* the first open fills the cache, the next ones read from it */
+    opj_set_header_cache_size(4);
+    images[0] = decode(outputfile, -1);
+    images[1] = decode(outputfile, -1);
+    images[2] = decode(outputfile, tile_index);
+    images[3] = decode(outputfile, tile_index);
+    opj_set_header_cache_size(0);
+
+    bSuccess = same_image(ref, images[0], "first open") &&
+               same_image(ref, images[1], "cached header") &&
+               same_image(ref_tile, images[2], "cached tile-part index") &&
+               same_image(ref_tile, images[3], "cached tile-part index, again");
+
+    for (i = 0; i < 4; i++)
+        opj_image_destroy(images[i]);
+    opj_image_destroy(ref_tile);
+    opj_image_destroy(ref);
+    if (!bSuccess || !check_tlm())
+        return 1;
+
+    puts( "end" );
+    return 0;
+}
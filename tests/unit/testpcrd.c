@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2012, Mathieu Malaterre
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Rate allocation with a byte target that every pass fits in (-r 1): the passes
+ * that follow the last distortion gain of a code-block must still be coded, so
+ * the decoded image has to come back (nearly) lossless.
+ */
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "unit_test_common.h"
+
+#define J2K_CFMT 0
+
+/* smooth gradients plus a little noise, so that the last bit-planes carry real detail */
+static int32_t sample(uint32_t compno, uint32_t x, uint32_t y, void* data)
+{
+    uint32_t* seed = (uint32_t*)data;
+    double v = 128 + 60 * sin(x / 17.0 + compno) + 50 * cos(y / 23.0 * (compno + 1));
+
+    *seed = *seed * 1103515245 + 12345;
+    v += (double)((*seed >> 16) % 17) - 8;
+    if (v < 0)
+        v = 0;
+    if (v > 255)
+        v = 255;
+    return (int32_t)v;
+}
+
+static opj_image_t* create_image(uint32_t width, uint32_t height)
+{
+    uint32_t seed = 1;
+
+    return test_image_create(3, width, height, sample, &seed);
+}
+
+int main(int argc, char *argv[])
+{
+    const unsigned int image_width = 517;
+    const unsigned int image_height = 389;
+    const char outputfile[] = "testpcrd.j2k";
+    const double min_psnr = 75.0;
+
+    opj_cparameters_t parameters;
+    test_decode_options_t options;
+    opj_image_t *image;
+    opj_image_t *decoded;
+    bool bSuccess;
+    double se = 0;
+    double psnr;
+    unsigned int compno, i;
+    (void)argc;
+    (void)argv;
+
+    image = create_image(image_width, image_height);
+    assert( image );
+
+    /* opj_compress -M 32 -b 32,16 -r 1 */
+    opj_set_default_encoder_parameters(&parameters);
+    parameters.cod_format = J2K_CFMT;
+    parameters.tcp_numlayers = 1;
+    parameters.tcp_rates[0] = 1;
+    parameters.cp_disto_alloc = 1;
+    parameters.cblockw_init = 32;
+    parameters.cblockh_init = 16;
+    parameters.mode = 32;
+    parameters.tcp_mct = 1;
+    bSuccess = test_encode(image, &parameters, outputfile);
+    opj_image_destroy(image);
+    if( !bSuccess )
+        return 1;
+
+    /* read back the generated file */
+    test_decode_options_init(&options);
+    decoded = test_decode(outputfile, &options);
+    if( !decoded || decoded->numcomps != 3 ||
+            decoded->comps[0].w != image_width || decoded->comps[0].h != image_height ) {
+        fprintf( stderr, "Failed to decode %s\n", outputfile );
+        opj_image_destroy(decoded);
+        return 1;
+    }
+
+    /* the encoder takes over the samples of the image, so compare with a fresh copy */
+    image = create_image(image_width, image_height);
+    assert( image );
+
+    for (compno = 0; compno < 3; compno++) {
+        for (i = 0; i < image_width * image_height; i++) {
+            double d = (double)(decoded->comps[compno].data[i] - image->comps[compno].data[i]);
+            se += d * d;
+        }
+    }
+    opj_image_destroy(decoded);
+    opj_image_destroy(image);
+
+    psnr = se > 0 ? 10 * log10(255.0 * 255.0 * 3 * image_width * image_height / se) : 999;
+    printf("PSNR %.2f dB\n", psnr);
+    if (psnr < min_psnr) {
+        fprintf( stderr, "PSNR %.2f dB is below %.2f dB\n", psnr, min_psnr );
+        return 1;
+    }
+
+    puts( "end" );
+    return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2012, Mathieu Malaterre
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Packet lengths from PLT markers let the packets of a tile be decoded in parallel.
+ * A stream encoded with SOP markers is given PLT markers here, and must then decode
+ * on several threads exactly as it does sequentially, and as the stream without
+ * PLT markers does: whole, at a lower resolution, and through a decode area.
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "unit_test_common.h"
+
+#define J2K_CFMT 0
+
+static const char outputfile[] = "testplt.j2k";
+static const char pltfile[] = "testplt_plt.j2k";
+
+static int32_t sample(uint32_t compno, uint32_t x, uint32_t y, void* data)
+{
+    (void)data;
+    return (int32_t)((x * (compno + 1) ^ y * (3 - compno)) & 0xFF);
+}
+
+/* a tiled RGB image with three layers, and an SOP marker in front of every packet */
+static bool encode(uint32_t width, uint32_t height)
+{
+    opj_cparameters_t parameters;
+    opj_image_t *image;
+    bool bSuccess;
+
+    image = test_image_create(3, width, height, sample, 00);
+    if (!image)
+        return false;
+    opj_set_default_encoder_parameters(&parameters);
+    parameters.cod_format = J2K_CFMT;
+    parameters.csty |= 0x02;    /* SOP */
+    parameters.tcp_numlayers = 3;
+    parameters.tcp_rates[0] = 20;
+    parameters.tcp_rates[1] = 5;
+    parameters.tcp_rates[2] = 0;
+    parameters.cp_disto_alloc = 1;
+    parameters.tcp_mct = 1;
+    parameters.tile_size_on = true;
+    parameters.cp_tdx = 128;
+    parameters.cp_tdy = 128;
+    bSuccess = test_encode(image, &parameters, outputfile);
+    opj_image_destroy(image);
+    return bSuccess;
+}
+
+/*
+Copy the codestream src into dest, adding to every tile-part header a PLT marker with
+the lengths of its packets, found from their SOP markers. dest must have room for
+twice the size of src. Returns the size of dest, or 0 if src cannot be parsed.
+*/
+static size_t add_plt(const uint8_t* src, size_t src_len, uint8_t* dest)
+{
+    size_t pos = 2, out;
+    uint32_t nsop = 0;
+
+    /* main header */
+    while (pos + 4 <= src_len && test_read_u16(src + pos) != 0xFF90)
+        pos += 2 + test_read_u16(src + pos + 2);
+    memcpy(dest, src, pos);
+    out = pos;
+
+    while (pos + 12 <= src_len && test_read_u16(src + pos) == 0xFF90) {
+        size_t psot = test_read_u32(src + pos + 6);
+        size_t end = pos + psot;
+        size_t sod = pos + 12, i, plt_len = 0, packet_start;
+        uint8_t* plt;
+
+        if (src[pos + 10] == 0)
+            nsop = 0;
+        if (!psot || end > src_len)
+            return 0;
+        while (sod + 4 <= end && test_read_u16(src + sod) != 0xFF93)
+            sod += 2 + test_read_u16(src + sod + 2);
+        if (sod + 2 > end || test_read_u16(src + sod) != 0xFF93)
+            return 0;
+
+        /* tile-part header up to SOD, then PLT */
+        memcpy(dest + out, src + pos, sod - pos);
+        plt = dest + out + (sod - pos);
+        plt[0] = 0xFF;
+        plt[1] = 0x58;
+        plt[4] = 0;     /* Zplt */
+
+        /* packets start at their SOP marker: 0xFF91, Lsop = 4, and the packet count */
+        packet_start = sod + 2;
+        for (i = sod + 2; i <= end; i++) {
+            if (i == end || (i + 6 <= end && src[i] == 0xFF && src[i + 1] == 0x91 &&
+                             test_read_u16(src + i + 2) == 4 && test_read_u16(src + i + 4) == (nsop & 0xFFFF))) {
+                if (i > sod + 2) {
+                    size_t len = i - packet_start, n = 0, k;
+                    uint8_t bytes[5];
+                    do {
+                        bytes[n++] = (uint8_t)(len & 0x7F);
+                        len >>= 7;
+                    } while (len);
+                    for (k = n; k > 0; k--)
+                        plt[5 + plt_len++] = (uint8_t)(bytes[k - 1] | (k > 1 ? 0x80 : 0));
+                } else if (i == end) {
+                    return 0;
+                }
+                packet_start = i;
+                if (i < end)
+                    nsop++;
+            }
+        }
+        if (3 + plt_len > 0xFFFF)
+            return 0;
+        test_write_u16(plt + 2, (uint32_t)(3 + plt_len));
+
+        /* Psot, then SOD and the packets */
+        psot += 5 + plt_len;
+        test_write_u32(dest + out + 6, (uint32_t)psot);
+        out += (sod - pos) + 5 + plt_len;
+        memcpy(dest + out, src + sod, end - sod);
+        out += end - sod;
+        pos = end;
+    }
+
+    /* EOC */
+    memcpy(dest + out, src + pos, src_len - pos);
+    return out + src_len - pos;
+}
+
+static bool write_plt_file(void)
+{
+    uint8_t *src, *dest = 00;
+    size_t src_len = 0, dest_len = 0;
+    bool bSuccess;
+
+    src = test_read_file(outputfile, &src_len);
+    if (src)
+        dest = (uint8_t*)malloc(2 * src_len);
+    if (dest)
+        dest_len = add_plt(src, src_len, dest);
+    bSuccess = dest_len && test_write_file(pltfile, dest, dest_len);
+    free(src);
+    free(dest);
+    return bSuccess;
+}
+
+/* decode the area [x0,x1)x[y0,y1), or the whole image when x1 is 0, at resolution reduce */
+static opj_image_t* decode(const char* file, uint32_t numThreads, uint32_t reduce,
+                           uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+    test_decode_options_t options;
+
+    test_decode_options_init(&options);
+    options.numThreads = numThreads;
+    options.reduce = reduce;
+    options.x0 = x0;
+    options.y0 = y0;
+    options.x1 = x1;
+    options.y1 = y1;
+    return test_decode(file, &options);
+}
+
+/* the PLT stream on one thread and on four must both decode as the stream without PLT */
+static bool check(uint32_t reduce, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+    opj_image_t *ref = decode(outputfile, 1, reduce, x0, y0, x1, y1);
+    opj_image_t *sequential = decode(pltfile, 1, reduce, x0, y0, x1, y1);
+    opj_image_t *parallel = decode(pltfile, 4, reduce, x0, y0, x1, y1);
+    bool bSuccess = ref && test_same_image(ref, sequential) && test_same_image(ref, parallel);
+
+    if (!bSuccess)
+        fprintf( stderr, "PLT decode differs at reduce %u, area (%u,%u)-(%u,%u)\n", reduce, x0, y0, x1, y1 );
+    opj_image_destroy(parallel);
+    opj_image_destroy(sequential);
+    opj_image_destroy(ref);
+    return bSuccess;
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    if( !encode(256, 192) )
+        return 1;
+    if( !write_plt_file() ) {
+        fprintf( stderr, "Failed to add PLT markers to %s\n", outputfile );
+        return 1;
+    }
+    if( !check(0, 0, 0, 0, 0) || !check(2, 0, 0, 0, 0) || !check(0, 40, 30, 200, 150) )
+        return 1;
+
+    puts( "end" );
+    return 0;
+}
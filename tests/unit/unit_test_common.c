@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2012, Mathieu Malaterre
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "unit_test_common.h"
+
+static uint32_t warning_count;
+
+static void error_callback(const char *msg, void *v)
+{
+    (void)v;
+    puts(msg);
+}
+static void warning_callback(const char *msg, void *v)
+{
+    (void)v;
+    warning_count++;
+    puts(msg);
+}
+static void info_callback(const char *msg, void *v)
+{
+    (void)msg;
+    (void)v;
+}
+
+static void set_handlers(opj_codec_t* l_codec)
+{
+    opj_set_info_handler(l_codec, info_callback,00);
+    opj_set_warning_handler(l_codec, warning_callback,00);
+    opj_set_error_handler(l_codec, error_callback,00);
+}
+
+uint32_t test_warning_count(void)
+{
+    return warning_count;
+}
+
+opj_image_t* test_image_create(uint32_t numcomps, uint32_t width, uint32_t height,
+                               test_sample_fn sample, void* data)
+{
+    opj_image_cmptparm_t cmptparm[4];
+    opj_image_t *image;
+    uint32_t compno, x, y;
+
+    if (numcomps > 4)
+        return 00;
+    memset(cmptparm, 0, sizeof(cmptparm));
+    for (compno = 0; compno < numcomps; compno++) {
+        cmptparm[compno].prec = 8;
+        cmptparm[compno].dx = 1;
+        cmptparm[compno].dy = 1;
+        cmptparm[compno].w = width;
+        cmptparm[compno].h = height;
+    }
+    image = opj_image_create(numcomps, cmptparm, numcomps == 3 ? OPJ_CLRSPC_SRGB : OPJ_CLRSPC_GRAY);
+    if (!image)
+        return 00;
+    image->x1 = width;
+    image->y1 = height;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            for (compno = 0; compno < numcomps; compno++)
+                image->comps[compno].data[y * width + x] = sample(compno, x, y, data);
+        }
+    }
+    return image;
+}
+
+bool test_encode(opj_image_t* image, opj_cparameters_t* parameters, const char* outfile)
+{
+    opj_codec_t* l_codec;
+    opj_stream_t *l_stream;
+    bool bSuccess;
+
+    l_codec = opj_create_compress(OPJ_CODEC_J2K);
+    if (!l_codec)
+        return false;
+    set_handlers(l_codec);
+    bSuccess = opj_setup_encoder(l_codec, parameters, image);
+    l_stream = bSuccess ? opj_stream_create_default_file_stream(outfile,false) : 00;
+    bSuccess = l_stream &&
+               opj_start_compress(l_codec,image,l_stream) &&
+               opj_encode(l_codec, l_stream) &&
+               opj_end_compress(l_codec, l_stream);
+    opj_stream_destroy(l_stream);
+    opj_destroy_codec(l_codec);
+    if (!bSuccess)
+        fprintf( stderr, "Failed to encode %s\n", outfile );
+    return bSuccess;
+}
+
+void test_decode_options_init(test_decode_options_t* options)
+{
+    memset(options, 0, sizeof(*options));
+    options->tile_index = -1;
+}
+
+opj_image_t* test_decode(const char* infile, const test_decode_options_t* options)
+{
+    opj_dparameters_t dparameters;
+    opj_image_t *image = 00;
+    opj_codec_t* l_codec;
+    opj_stream_t *l_stream;
+    opj_decode_buffer_t* buffer = options->buffer;
+    bool bSuccess;
+
+    l_codec = opj_create_decompress(OPJ_CODEC_J2K);
+    if (!l_codec)
+        return 00;
+    set_handlers(l_codec);
+    opj_set_default_decoder_parameters(&dparameters);
+    dparameters.numThreads = options->numThreads;
+    dparameters.cp_reduce = options->reduce;
+    bSuccess = opj_setup_decoder(l_codec, &dparameters);
+    l_stream = bSuccess ? opj_stream_create_default_file_stream(infile,true) : 00;
+    bSuccess = l_stream && opj_read_header(l_stream, l_codec, &image);
+    if (bSuccess && options->x1)
+        bSuccess = opj_set_decode_area(l_codec, image, options->x0, options->y0, options->x1, options->y1);
+    if (bSuccess && buffer) {
+        /* a few pixels of padding at the end of each row */
+        buffer->numcomps = image->numcomps;
+        buffer->stride = (image->comps[0].w + 3) * image->numcomps * (buffer->prec / 8);
+        buffer->data = (uint8_t*)malloc(buffer->stride * image->comps[0].h);
+        bSuccess = buffer->data && opj_set_decode_buffer(l_codec, image, buffer);
+    }
+    if (options->tile_index < 0)
+        bSuccess = bSuccess &&
+                   opj_decode(l_codec, l_stream, image) &&
+                   opj_end_decompress(l_codec, l_stream);
+    else
+        bSuccess = bSuccess && opj_get_decoded_tile(l_codec, l_stream, image, (uint32_t)options->tile_index);
+    opj_stream_destroy(l_stream);
+    opj_destroy_codec(l_codec);
+    if (!bSuccess) {
+        fprintf( stderr, "Failed to decode %s\n", infile );
+        opj_image_destroy(image);
+        return 00;
+    }
+    return image;
+}
+
+bool test_same_image(const opj_image_t* a, const opj_image_t* b)
+{
+    uint32_t compno;
+
+    if (!a || !b || a->numcomps != b->numcomps ||
+            a->x0 != b->x0 || a->y0 != b->y0 || a->x1 != b->x1 || a->y1 != b->y1)
+        return false;
+    for (compno = 0; compno < a->numcomps; compno++) {
+        const opj_image_comp_t* ca = a->comps + compno;
+        const opj_image_comp_t* cb = b->comps + compno;
+        if (ca->w != cb->w || ca->h != cb->h || ca->x0 != cb->x0 || ca->y0 != cb->y0 || ca->prec != cb->prec)
+            return false;
+        if (ca->data != cb->data &&
+                (!ca->data || !cb->data || memcmp(ca->data, cb->data, (size_t)ca->w * ca->h * sizeof(int32_t)) != 0))
+            return false;
+    }
+    return true;
+}
+
+uint8_t* test_read_file(const char* fname, size_t* len)
+{
+    FILE* f = fopen(fname, "rb");
+    uint8_t* data = 00;
+    long l_len;
+
+    if (!f)
+        return 00;
+    if (fseek(f, 0, SEEK_END) == 0 && (l_len = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0) {
+        data = (uint8_t*)malloc((size_t)l_len);
+        if (data && fread(data, 1, (size_t)l_len, f) == (size_t)l_len) {
+            *len = (size_t)l_len;
+        } else {
+            free(data);
+            data = 00;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+bool test_write_file(const char* fname, const uint8_t* data, size_t len)
+{
+    FILE* f = fopen(fname, "wb");
+    bool bSuccess;
+
+    if (!f)
+        return false;
+    bSuccess = fwrite(data, 1, len, f) == len;
+    return fclose(f) == 0 && bSuccess;
+}
+
+uint32_t test_read_u16(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+uint32_t test_read_u32(const uint8_t* p)
+{
+    return (test_read_u16(p) << 16) | test_read_u16(p + 2);
+}
+
+void test_write_u16(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+void test_write_u32(uint8_t* p, uint32_t v)
+{
+    test_write_u16(p, v >> 16);
+    test_write_u16(p + 2, v);
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2012, Mathieu Malaterre
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Fixtures shared by the unit tests: synthetic images, encoding and decoding
+ * of codestream files, and image comparison.
+ */
+#ifndef UNIT_TEST_COMMON_H
+#define UNIT_TEST_COMMON_H
+
+#include <stddef.h>
+
+#include "opj_config.h"
+#include "openjpeg.h"
+
+/**
+ * Sample of component compno at (x, y). Called row by row, pixel by pixel and
+ * component by component, so that it may keep a state in data.
+ */
+typedef int32_t (*test_sample_fn)(uint32_t compno, uint32_t x, uint32_t y, void* data);
+
+/**
+ * @return the number of warnings the codecs of these fixtures have emitted so far
+ */
+uint32_t test_warning_count(void);
+
+/**
+ * Creates an unsigned 8 bit image of numcomps components, sRGB when there are three
+ * of them and grayscale otherwise, filled from sample.
+ */
+opj_image_t* test_image_create(uint32_t numcomps, uint32_t width, uint32_t height,
+                               test_sample_fn sample, void* data);
+
+/**
+ * Encodes image into the J2K file outfile. The encoder takes over the samples of
+ * image, which the caller still destroys.
+ */
+bool test_encode(opj_image_t* image, opj_cparameters_t* parameters, const char* outfile);
+
+typedef struct test_decode_options {
+    /** decoder threads; 0 uses every worker */
+    uint32_t numThreads;
+    /** number of highest resolution levels to discard */
+    uint32_t reduce;
+    /** decode area, the whole image when x1 is 0 */
+    uint32_t x0, y0, x1, y1;
+    /** single tile to decode with opj_get_decoded_tile, or -1 */
+    int tile_index;
+    /** when not NULL, decode into this buffer with opj_set_decode_buffer: its prec
+        is set by the caller, and its data is allocated here and freed by the caller */
+    opj_decode_buffer_t* buffer;
+} test_decode_options_t;
+
+/**
+ * Sets options to decode a whole image on every worker thread.
+ */
+void test_decode_options_init(test_decode_options_t* options);
+
+/**
+ * Decodes the J2K file infile.
+ * @return the decoded image, or NULL on failure
+ */
+opj_image_t* test_decode(const char* infile, const test_decode_options_t* options);
+
+/**
+ * @return true if a and b have the same header and samples
+ */
+bool test_same_image(const opj_image_t* a, const opj_image_t* b);
+
+/**
+ * Reads the whole file fname.
+ * @return its bytes, to free, or NULL on failure
+ */
+uint8_t* test_read_file(const char* fname, size_t* len);
+
+/**
+ * Writes len bytes of data to the file fname.
+ */
+bool test_write_file(const char* fname, const uint8_t* data, size_t len);
+
+/**
+ * Big endian fields of codestream markers.
+ */
+uint32_t test_read_u16(const uint8_t* p);
+uint32_t test_read_u32(const uint8_t* p);
+void test_write_u16(uint8_t* p, uint32_t v);
+void test_write_u32(uint8_t* p, uint32_t v);
+
+#endif /* UNIT_TEST_COMMON_H */